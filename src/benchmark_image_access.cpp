@@ -0,0 +1,171 @@
+// This binary times reading every pixel value of a large synthetic image with
+// the per-pixel GetPixelValue() accessor against the row and spectral vector
+// accessors of ImageData. The default size is a 1024 x 1024 image with 200
+// bands (about 1.6 GB in double precision).
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "image/image_data.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(image_width, 1024, "Width of the synthetic image.");
+DEFINE_int32(image_height, 1024, "Height of the synthetic image.");
+DEFINE_int32(num_bands, 200, "Number of bands of the synthetic image.");
+DEFINE_int32(num_repetitions, 3,
+    "Number of times each access pattern is timed (the fastest is reported).");
+DEFINE_int32(spectral_block_size, 1024,
+    "Number of pixels gathered per GatherSpectralVectors() call.");
+
+using super_resolution::ImageData;
+
+// Returns the fastest wall-clock time in seconds of the given number of runs
+// of the function. The checksum returned by the function is stored in
+// checksum so that the reads cannot be optimized away.
+template <typename Function>
+double TimeFastestRun(
+    const int num_repetitions, const Function& function, double* checksum) {
+
+  double fastest_time_seconds = 0.0;
+  for (int i = 0; i < num_repetitions; ++i) {
+    const auto start_time = std::chrono::steady_clock::now();
+    *checksum = function();
+    const auto end_time = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed_time_seconds =
+        end_time - start_time;
+    if (i == 0 || elapsed_time_seconds.count() < fastest_time_seconds) {
+      fastest_time_seconds = elapsed_time_seconds.count();
+    }
+  }
+  return fastest_time_seconds;
+}
+
+// Logs the times of the old and new access patterns and checks that they read
+// the same values.
+void ReportTimes(
+    const std::string& name,
+    const double old_time_seconds,
+    const double old_checksum,
+    const double new_time_seconds,
+    const double new_checksum) {
+
+  CHECK_EQ(old_checksum, new_checksum) << name << " read different values.";
+  LOG(INFO) << name << ": GetPixelValue " << old_time_seconds << " s, new "
+            << new_time_seconds << " s (" << old_time_seconds / new_time_seconds
+            << "x speed-up).";
+}
+
+int main(int argc, char** argv) {
+  super_resolution::util::InitApp(argc, argv,
+      "Time the ImageData pixel accessors on a large synthetic image.");
+
+  CHECK_GT(FLAGS_image_width, 0);
+  CHECK_GT(FLAGS_image_height, 0);
+  CHECK_GT(FLAGS_num_bands, 0);
+  CHECK_GT(FLAGS_num_repetitions, 0);
+  CHECK_GT(FLAGS_spectral_block_size, 0);
+
+  const cv::Size image_size(FLAGS_image_width, FLAGS_image_height);
+  ImageData image;
+  for (int band = 0; band < FLAGS_num_bands; ++band) {
+    cv::Mat channel_image(image_size, CV_64FC1);
+    cv::randu(channel_image, 0.0, 1.0);
+    image.AddChannel(channel_image, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+  const int num_channels = image.GetNumChannels();
+  const int num_pixels = image.GetNumPixels();
+  LOG(INFO) << "Timing a " << image_size.width << " x " << image_size.height
+            << " image with " << num_channels << " bands.";
+
+  // Row traversal, as in the SSIM statistics.
+  double old_row_checksum = 0.0;
+  const double old_row_time_seconds = TimeFastestRun(
+      FLAGS_num_repetitions, [&]() {
+        double sum = 0.0;
+        for (int channel = 0; channel < num_channels; ++channel) {
+          for (int row = 0; row < image_size.height; ++row) {
+            for (int col = 0; col < image_size.width; ++col) {
+              sum += image.GetPixelValue(channel, row, col);
+            }
+          }
+        }
+        return sum;
+      }, &old_row_checksum);
+  double new_row_checksum = 0.0;
+  const double new_row_time_seconds = TimeFastestRun(
+      FLAGS_num_repetitions, [&]() {
+        double sum = 0.0;
+        for (int channel = 0; channel < num_channels; ++channel) {
+          for (int row = 0; row < image_size.height; ++row) {
+            const double* row_data = image.GetRowData(channel, row);
+            for (int col = 0; col < image_size.width; ++col) {
+              sum += row_data[col];
+            }
+          }
+        }
+        return sum;
+      }, &new_row_checksum);
+  ReportTimes(
+      "Row traversal",
+      old_row_time_seconds,
+      old_row_checksum,
+      new_row_time_seconds,
+      new_row_checksum);
+
+  // Pixel-major spectral vectors, as in the SpectralPCA sample gathering and
+  // projection. Each spectral vector is weighted by its band index so that the
+  // band order matters to the checksum.
+  double old_spectral_checksum = 0.0;
+  const double old_spectral_time_seconds = TimeFastestRun(
+      FLAGS_num_repetitions, [&]() {
+        std::vector<double> spectral_vector(num_channels);
+        double sum = 0.0;
+        for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+          for (int channel = 0; channel < num_channels; ++channel) {
+            spectral_vector[channel] =
+                image.GetPixelValue(channel, pixel_index);
+          }
+          for (int channel = 0; channel < num_channels; ++channel) {
+            sum += channel * spectral_vector[channel];
+          }
+        }
+        return sum;
+      }, &old_spectral_checksum);
+  double new_spectral_checksum = 0.0;
+  const double new_spectral_time_seconds = TimeFastestRun(
+      FLAGS_num_repetitions, [&]() {
+        std::vector<double> spectral_vectors(
+            static_cast<size_t>(FLAGS_spectral_block_size) * num_channels);
+        double sum = 0.0;
+        for (int pixel_start = 0; pixel_start < num_pixels;
+             pixel_start += FLAGS_spectral_block_size) {
+          const int num_block_pixels =
+              std::min(FLAGS_spectral_block_size, num_pixels - pixel_start);
+          image.GatherSpectralVectors(
+              pixel_start, num_block_pixels, spectral_vectors.data());
+          for (int i = 0; i < num_block_pixels; ++i) {
+            const double* spectral_vector =
+                spectral_vectors.data() + static_cast<size_t>(i) * num_channels;
+            for (int channel = 0; channel < num_channels; ++channel) {
+              sum += channel * spectral_vector[channel];
+            }
+          }
+        }
+        return sum;
+      }, &new_spectral_checksum);
+  ReportTimes(
+      "Spectral vectors",
+      old_spectral_time_seconds,
+      old_spectral_checksum,
+      new_spectral_time_seconds,
+      new_spectral_checksum);
+
+  return EXIT_SUCCESS;
+}
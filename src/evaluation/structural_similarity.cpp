@@ -11,8 +11,9 @@ double ComputeAveragePixelIntensity(const ImageData& image) {
   const int num_pixels = image.GetNumPixels();
   double intensity_sum = 0.0;
   for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_data = image.GetChannelData(channel);
     for (int pixel = 0; pixel < num_pixels; ++pixel) {
-      intensity_sum += image.GetPixelValue(channel, pixel);
+      intensity_sum += channel_data[pixel];
     }
   }
   return intensity_sum / static_cast<double>(num_channels * num_pixels);
@@ -30,9 +31,11 @@ double ComputePixelIntensityCovariance(
   const int num_pixels = image1.GetNumPixels();
   double covariance = 0.0;
   for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_data_1 = image1.GetChannelData(channel);
+    const double* channel_data_2 = image2.GetChannelData(channel);
     for (int pixel = 0; pixel < num_pixels; ++pixel) {
-      const double diff1 = image1.GetPixelValue(channel, pixel) - mean1;
-      const double diff2 = image2.GetPixelValue(channel, pixel) - mean2;
+      const double diff1 = channel_data_1[pixel] - mean1;
+      const double diff2 = channel_data_2[pixel] - mean2;
       covariance += diff1 * diff2;
     }
   }
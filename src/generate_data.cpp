@@ -8,12 +8,15 @@
 #include <string>
 #include <vector>
 
+#include "hyperspectral/chunked_cube_file.h"
+#include "hyperspectral/hyperspectral_data_loader.h"
 #include "image/image_data.h"
 #include "image_model/additive_noise_module.h"
 #include "image_model/blur_module.h"
 #include "image_model/downsampling_module.h"
 #include "image_model/image_model.h"
 #include "image_model/motion_module.h"
+#include "image_model/warp_motion_module.h"
 #include "motion/motion_shift.h"
 #include "util/data_loader.h"
 #include "util/macros.h"
@@ -36,6 +39,13 @@ DEFINE_string(output_image_dir, "",
 DEFINE_string(output_image_extension, "",
     "The file extension of the generated images. Same as input by default.");
 
+// Optionally, only a part of the input image is loaded. Chunked cube and ENVI
+// files only read the values inside of the range.
+DEFINE_string(input_region, "",
+    "Region of the input image to load, as x,y,width,height. All if empty.");
+DEFINE_string(input_bands, "",
+    "Input bands to load, as start,end (end is exclusive). All if empty.");
+
 // Instead of generating data, just loads a the image file (for hyperspectral
 // data, the range can be defined in the config file) and saves it as a new
 // file. For non-hyperspectral images, this can be used to save the file in a
@@ -44,9 +54,29 @@ DEFINE_string(output_image_extension, "",
 DEFINE_string(save_as, "",
     "Load and save a file as is. For HSI files this can be a cropped chunk.");
 
+// The data type of the saved images that are written as ENVI hyperspectral
+// files (2 or 4+ channels, unless saved as a chunked cube). Integer types
+// round and clamp the values.
+DEFINE_string(save_data_type, "float",
+    "ENVI data type: uint8, int16, uint16, int32, float, double, or complex.");
+
+// Options for saving images as chunked cube files (if the save_as path has the
+// ".cube" extension), which allow fast reads of regions and band subsets.
+DEFINE_int32(cube_chunk_size, 64,
+    "The width and height of each chunk of a saved chunked cube file.");
+DEFINE_int32(cube_chunk_bands, 16,
+    "The number of bands in each chunk of a saved chunked cube file.");
+DEFINE_bool(compress_cube, false,
+    "Compress the chunks of a saved chunked cube file (run-length encoding).");
+
 // Motion estimate file I/O parameters.
 DEFINE_string(motion_sequence_path, "",
     "Path to a text file containing a simulated motion sequence.");
+DEFINE_string(warp_motion_path, "",
+    "Path to a YAML/XML file of per-frame affine transforms or flow fields "
+    "to warp the frames with instead of a motion sequence.");
+DEFINE_string(warp_motion_type, "affine",
+    "The type of the warp motions: 'affine' or 'flow'.");
 
 // Parameters for the low-resolution image generation.
 DEFINE_int32(blur_radius, 0,
@@ -86,14 +116,37 @@ int main(int argc, char** argv) {
 
   REQUIRE_ARG(FLAGS_input_image);
 
-  const ImageData image_data =
-      super_resolution::util::LoadImage(FLAGS_input_image);
+  const ImageData image_data = super_resolution::util::LoadImage(
+      FLAGS_input_image,
+      super_resolution::util::GetImageLoadRange(
+          FLAGS_input_region, FLAGS_input_bands));
+
+  // The binary format of saved ENVI hyperspectral files.
+  super_resolution::HSIBinaryDataFormat hsi_data_format;
+  hsi_data_format.data_type =
+      super_resolution::GetHSIDataType(FLAGS_save_data_type);
 
   // If just saving the file as a copy just save it as is and exit. This is
   // intended for saving cropped versions of hyperspectral images or saving
   // images in a different format.
   if (!FLAGS_save_as.empty()) {
-    super_resolution::util::SaveImage(image_data, FLAGS_save_as);
+    const std::string extension =
+        super_resolution::util::GetFileExtension(FLAGS_save_as);
+    if (extension == super_resolution::kChunkedCubeFileExtension) {
+      super_resolution::ChunkedCubeOptions cube_options;
+      cube_options.chunk_rows = FLAGS_cube_chunk_size;
+      cube_options.chunk_cols = FLAGS_cube_chunk_size;
+      cube_options.chunk_bands = FLAGS_cube_chunk_bands;
+      if (FLAGS_compress_cube) {
+        cube_options.compression =
+            super_resolution::CUBE_COMPRESSION_RUN_LENGTH;
+      }
+      super_resolution::SaveChunkedCube(
+          image_data, FLAGS_save_as, cube_options);
+    } else {
+      super_resolution::util::SaveImage(
+          image_data, FLAGS_save_as, hsi_data_format);
+    }
     return EXIT_SUCCESS;
   }
 
@@ -107,6 +160,12 @@ int main(int argc, char** argv) {
   model_parameters.blur_radius = FLAGS_blur_radius;
   model_parameters.blur_sigma = FLAGS_blur_sigma;
   model_parameters.motion_sequence_path = FLAGS_motion_sequence_path;
+  if (!FLAGS_warp_motion_path.empty()) {
+    model_parameters.warp_motion_path = FLAGS_warp_motion_path;
+    model_parameters.warp_motion_type =
+        super_resolution::GetWarpMotionType(FLAGS_warp_motion_type);
+    model_parameters.image_size = image_data.GetImageSize();
+  }
   model_parameters.noise_sigma = FLAGS_noise_sigma;
 
   super_resolution::ImageModel image_model =
@@ -119,7 +178,8 @@ int main(int argc, char** argv) {
     // Write the file.
     std::string image_path =
         FLAGS_output_image_dir + "/low_res_" + std::to_string(i) + extension;
-    super_resolution::util::SaveImage(low_res_frame, image_path);
+    super_resolution::util::SaveImage(
+        low_res_frame, image_path, hsi_data_format);
     LOG(INFO) << "Generated output image " << image_path;
   }
 
@@ -0,0 +1,487 @@
+#include "hyperspectral/chunked_cube_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "image/image_data.h"
+#include "util/matrix_util.h"
+#include "util/memory_mapped_file.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Identifies chunked cube files (and the version of the format).
+constexpr char kChunkedCubeMagic[8] = {'S', 'R', 'C', 'U', 'B', 'E', '0', '1'};
+
+// Written in native byte order, so a reader on a machine with a different
+// byte order can detect the mismatch.
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// The header at the start of every chunked cube file.
+struct ChunkedCubeHeader {
+  char magic[8];
+  uint32_t byte_order_mark;
+  int32_t num_rows;
+  int32_t num_cols;
+  int32_t num_bands;
+  int32_t chunk_rows;
+  int32_t chunk_cols;
+  int32_t chunk_bands;
+  int32_t reserved;  // Pads the header to a multiple of 8 bytes.
+};
+
+// The entry of a single chunk in the chunk index, which immediately follows
+// the header. The offset is in bytes from the start of the file.
+struct ChunkedCubeIndexEntry {
+  uint64_t offset;
+  uint64_t num_bytes;
+  int32_t compression;
+  int32_t reserved;  // Pads the entry to a multiple of 8 bytes.
+};
+
+// The longest run or literal sequence that one run-length control byte can
+// describe.
+constexpr int kMaxRunLength = 128;
+
+// Returns the number of chunks of the given size needed to cover the given
+// length.
+int GetNumChunks(const int length, const int chunk_length) {
+  return (length + chunk_length - 1) / chunk_length;
+}
+
+// Rearranges the bytes of the given values so that byte k of every value is
+// stored contiguously in plane k. Similar values share their high bytes, so
+// this produces long runs of equal bytes.
+void ShuffleBytes(
+    const float* values, const int num_values, unsigned char* shuffled) {
+
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+  for (int i = 0; i < num_values; ++i) {
+    for (int k = 0; k < static_cast<int>(sizeof(float)); ++k) {
+      shuffled[k * num_values + i] = bytes[i * sizeof(float) + k];
+    }
+  }
+}
+
+// Reverses ShuffleBytes().
+void UnshuffleBytes(
+    const unsigned char* shuffled, const int num_values, float* values) {
+
+  unsigned char* bytes = reinterpret_cast<unsigned char*>(values);
+  for (int i = 0; i < num_values; ++i) {
+    for (int k = 0; k < static_cast<int>(sizeof(float)); ++k) {
+      bytes[i * sizeof(float) + k] = shuffled[k * num_values + i];
+    }
+  }
+}
+
+// Run-length encodes the given bytes (PackBits). Each control byte c is
+// followed either by c + 1 literal bytes (0 <= c <= 127) or by a single byte
+// that is repeated 1 - c times (-127 <= c <= -1).
+std::vector<unsigned char> RunLengthEncode(
+    const unsigned char* data, const size_t num_bytes) {
+
+  std::vector<unsigned char> encoded;
+  encoded.reserve(num_bytes);
+  // Returns true if a run of at least 3 equal bytes starts at index i.
+  const auto is_run_start = [&](const size_t i) {
+    return i + 2 < num_bytes &&
+        data[i] == data[i + 1] && data[i] == data[i + 2];
+  };
+  size_t i = 0;
+  while (i < num_bytes) {
+    if (is_run_start(i)) {
+      int run_length = 3;
+      while (i + run_length < num_bytes &&
+             run_length < kMaxRunLength &&
+             data[i + run_length] == data[i]) {
+        ++run_length;
+      }
+      encoded.push_back(static_cast<unsigned char>(
+          static_cast<int8_t>(1 - run_length)));
+      encoded.push_back(data[i]);
+      i += run_length;
+    } else {
+      const size_t literal_start = i;
+      while (i < num_bytes &&
+             i - literal_start < kMaxRunLength &&
+             (i == literal_start || !is_run_start(i))) {
+        ++i;
+      }
+      encoded.push_back(static_cast<unsigned char>(i - literal_start - 1));
+      encoded.insert(encoded.end(), data + literal_start, data + i);
+    }
+  }
+  return encoded;
+}
+
+// Decodes run-length encoded data (see RunLengthEncode()) into exactly
+// num_output_bytes bytes. An error will occur if the data is corrupt.
+void RunLengthDecode(
+    const unsigned char* encoded,
+    const size_t num_encoded_bytes,
+    const size_t num_output_bytes,
+    unsigned char* output) {
+
+  size_t input_index = 0;
+  size_t output_index = 0;
+  while (input_index < num_encoded_bytes) {
+    const int control = static_cast<int8_t>(encoded[input_index++]);
+    if (control >= 0) {
+      const size_t num_literals = control + 1;
+      CHECK_LE(input_index + num_literals, num_encoded_bytes)
+          << "Corrupt chunk in chunked cube file.";
+      CHECK_LE(output_index + num_literals, num_output_bytes)
+          << "Corrupt chunk in chunked cube file.";
+      std::memcpy(output + output_index, encoded + input_index, num_literals);
+      input_index += num_literals;
+      output_index += num_literals;
+    } else {
+      const size_t run_length = 1 - control;
+      CHECK_LT(input_index, num_encoded_bytes)
+          << "Corrupt chunk in chunked cube file.";
+      CHECK_LE(output_index + run_length, num_output_bytes)
+          << "Corrupt chunk in chunked cube file.";
+      std::memset(output + output_index, encoded[input_index++], run_length);
+      output_index += run_length;
+    }
+  }
+  CHECK_EQ(output_index, num_output_bytes)
+      << "Corrupt chunk in chunked cube file.";
+}
+
+// The region of the cube covered by a single chunk.
+struct ChunkBounds {
+  int start_row;
+  int end_row;
+  int start_col;
+  int end_col;
+  int start_band;
+  int end_band;
+
+  int GetNumValues() const {
+    return (end_row - start_row) * (end_col - start_col) *
+        (end_band - start_band);
+  }
+};
+
+// Returns the region of the cube covered by the given chunk.
+ChunkBounds GetChunkBounds(
+    const int band_chunk,
+    const int row_chunk,
+    const int col_chunk,
+    const ChunkedCubeHeader& header) {
+
+  ChunkBounds bounds;
+  bounds.start_row = row_chunk * header.chunk_rows;
+  bounds.end_row =
+      std::min(bounds.start_row + header.chunk_rows, header.num_rows);
+  bounds.start_col = col_chunk * header.chunk_cols;
+  bounds.end_col =
+      std::min(bounds.start_col + header.chunk_cols, header.num_cols);
+  bounds.start_band = band_chunk * header.chunk_bands;
+  bounds.end_band =
+      std::min(bounds.start_band + header.chunk_bands, header.num_bands);
+  return bounds;
+}
+
+// Copies the values of the given chunk of the image into the chunk value
+// array as floats. The pixel type T must match the precision of the image.
+template <typename T>
+void CopyChunkValues(
+    const ImageData& image, const ChunkBounds& bounds, float* values) {
+
+  const int chunk_width = bounds.end_col - bounds.start_col;
+  float* chunk_row = values;
+  for (int band = bounds.start_band; band < bounds.end_band; ++band) {
+    const cv::Mat channel_image = image.GetChannelImage(band);
+    for (int row = bounds.start_row; row < bounds.end_row; ++row) {
+      const T* image_row = channel_image.ptr<T>(row) + bounds.start_col;
+      for (int col = 0; col < chunk_width; ++col) {
+        chunk_row[col] = static_cast<float>(image_row[col]);
+      }
+      chunk_row += chunk_width;
+    }
+  }
+}
+
+// Encodes the values of the given chunk of the image. Returns the compression
+// that was actually used.
+ChunkedCubeCompression EncodeChunk(
+    const ImageData& image,
+    const ChunkBounds& bounds,
+    const ChunkedCubeCompression compression,
+    std::vector<unsigned char>* encoded_chunk) {
+
+  std::vector<float> values(bounds.GetNumValues());
+  if (image.GetPrecision() == IMAGE_PRECISION_FLOAT) {
+    CopyChunkValues<float>(image, bounds, values.data());
+  } else {
+    CopyChunkValues<double>(image, bounds, values.data());
+  }
+
+  const size_t num_bytes = values.size() * sizeof(float);
+  if (compression == CUBE_COMPRESSION_RUN_LENGTH) {
+    std::vector<unsigned char> shuffled(num_bytes);
+    ShuffleBytes(values.data(), values.size(), shuffled.data());
+    *encoded_chunk = RunLengthEncode(shuffled.data(), num_bytes);
+    if (encoded_chunk->size() < num_bytes) {
+      return CUBE_COMPRESSION_RUN_LENGTH;
+    }
+  }
+  const unsigned char* bytes =
+      reinterpret_cast<const unsigned char*>(values.data());
+  encoded_chunk->assign(bytes, bytes + num_bytes);
+  return CUBE_COMPRESSION_NONE;
+}
+
+}  // namespace
+
+void SaveChunkedCube(
+    const ImageData& image,
+    const std::string& file_path,
+    const ChunkedCubeOptions& options) {
+
+  CHECK_GT(image.GetNumChannels(), 0) << "Cannot save an empty image.";
+  CHECK_GT(options.chunk_rows, 0) << "Chunk size must be positive.";
+  CHECK_GT(options.chunk_cols, 0) << "Chunk size must be positive.";
+  CHECK_GT(options.chunk_bands, 0) << "Chunk size must be positive.";
+
+  ChunkedCubeHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kChunkedCubeMagic, sizeof(header.magic));
+  header.byte_order_mark = kByteOrderMark;
+  header.num_rows = image.GetImageSize().height;
+  header.num_cols = image.GetImageSize().width;
+  header.num_bands = image.GetNumChannels();
+  header.chunk_rows = std::min(options.chunk_rows, header.num_rows);
+  header.chunk_cols = std::min(options.chunk_cols, header.num_cols);
+  header.chunk_bands = std::min(options.chunk_bands, header.num_bands);
+
+  const int num_row_chunks = GetNumChunks(header.num_rows, header.chunk_rows);
+  const int num_col_chunks = GetNumChunks(header.num_cols, header.chunk_cols);
+  const int num_band_chunks =
+      GetNumChunks(header.num_bands, header.chunk_bands);
+  const int num_chunks = num_band_chunks * num_row_chunks * num_col_chunks;
+
+  // Encode all chunks in parallel.
+  std::vector<std::vector<unsigned char>> encoded_chunks(num_chunks);
+  std::vector<ChunkedCubeIndexEntry> index(num_chunks);
+  util::ParallelFor(num_chunks, [&](const int chunk) {
+    const int col_chunk = chunk % num_col_chunks;
+    const int row_chunk = (chunk / num_col_chunks) % num_row_chunks;
+    const int band_chunk = chunk / (num_col_chunks * num_row_chunks);
+    const ChunkBounds bounds =
+        GetChunkBounds(band_chunk, row_chunk, col_chunk, header);
+    std::memset(&index[chunk], 0, sizeof(ChunkedCubeIndexEntry));
+    index[chunk].compression = EncodeChunk(
+        image, bounds, options.compression, &encoded_chunks[chunk]);
+    index[chunk].num_bytes = encoded_chunks[chunk].size();
+  });
+
+  uint64_t offset =
+      sizeof(ChunkedCubeHeader) + num_chunks * sizeof(ChunkedCubeIndexEntry);
+  for (ChunkedCubeIndexEntry& entry : index) {
+    entry.offset = offset;
+    offset += entry.num_bytes;
+  }
+
+  std::ofstream cube_file(file_path, std::ios::binary);
+  CHECK(cube_file.is_open())
+      << "Cube file '" << file_path << "' could not be opened for writing.";
+  cube_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  cube_file.write(
+      reinterpret_cast<const char*>(index.data()),
+      index.size() * sizeof(ChunkedCubeIndexEntry));
+  for (const std::vector<unsigned char>& encoded_chunk : encoded_chunks) {
+    cube_file.write(
+        reinterpret_cast<const char*>(encoded_chunk.data()),
+        encoded_chunk.size());
+  }
+  CHECK(cube_file.good())
+      << "Failed to write cube file '" << file_path << "'.";
+  cube_file.close();
+}
+
+ChunkedCubeFile::ChunkedCubeFile(const std::string& file_path) {
+  cube_file_.reset(new util::MemoryMappedFile(file_path));
+  const unsigned char* data = cube_file_->GetData();
+  const size_t file_size = cube_file_->GetSize();
+
+  ChunkedCubeHeader header;
+  CHECK_GE(file_size, sizeof(header))
+      << "File '" << file_path << "' is not a chunked cube file.";
+  std::memcpy(&header, data, sizeof(header));
+  CHECK_EQ(std::memcmp(header.magic, kChunkedCubeMagic, sizeof(header.magic)),
+           0)
+      << "File '" << file_path << "' is not a chunked cube file.";
+  CHECK_EQ(header.byte_order_mark, kByteOrderMark)
+      << "Cube file '" << file_path
+      << "' was written on a machine with a different byte order.";
+  CHECK_GT(header.num_rows, 0) << "Invalid cube size.";
+  CHECK_GT(header.num_cols, 0) << "Invalid cube size.";
+  CHECK_GT(header.num_bands, 0) << "Invalid cube size.";
+  CHECK_GT(header.chunk_rows, 0) << "Invalid chunk size.";
+  CHECK_GT(header.chunk_cols, 0) << "Invalid chunk size.";
+  CHECK_GT(header.chunk_bands, 0) << "Invalid chunk size.";
+
+  num_rows_ = header.num_rows;
+  num_cols_ = header.num_cols;
+  num_bands_ = header.num_bands;
+  chunk_rows_ = header.chunk_rows;
+  chunk_cols_ = header.chunk_cols;
+  chunk_bands_ = header.chunk_bands;
+  num_row_chunks_ = GetNumChunks(num_rows_, chunk_rows_);
+  num_col_chunks_ = GetNumChunks(num_cols_, chunk_cols_);
+  num_band_chunks_ = GetNumChunks(num_bands_, chunk_bands_);
+
+  const size_t num_chunks =
+      static_cast<size_t>(num_band_chunks_) * num_row_chunks_ * num_col_chunks_;
+  CHECK_GE(file_size,
+           sizeof(header) + num_chunks * sizeof(ChunkedCubeIndexEntry))
+      << "Cube file '" << file_path << "' is truncated.";
+  chunk_locations_.resize(num_chunks);
+  for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    ChunkedCubeIndexEntry entry;
+    std::memcpy(
+        &entry,
+        data + sizeof(header) + chunk * sizeof(ChunkedCubeIndexEntry),
+        sizeof(entry));
+    CHECK_LE(entry.offset + entry.num_bytes, file_size)
+        << "Cube file '" << file_path << "' is truncated.";
+    CHECK(entry.compression == CUBE_COMPRESSION_NONE ||
+          entry.compression == CUBE_COMPRESSION_RUN_LENGTH)
+        << "Unknown chunk compression in cube file '" << file_path << "'.";
+    chunk_locations_[chunk].offset = entry.offset;
+    chunk_locations_[chunk].num_bytes = entry.num_bytes;
+    chunk_locations_[chunk].compression =
+        static_cast<ChunkedCubeCompression>(entry.compression);
+  }
+}
+
+ImageData ChunkedCubeFile::ReadImage() const {
+  return ReadImage(cv::Rect(0, 0, num_cols_, num_rows_), 0, num_bands_);
+}
+
+ImageData ChunkedCubeFile::ReadImage(
+    const cv::Rect& region, const int start_band, const int end_band) const {
+
+  const std::vector<int> chunks =
+      GetChunksInRange(region, start_band, end_band);
+  std::vector<cv::Mat> channel_images(end_band - start_band);
+  for (cv::Mat& channel_image : channel_images) {
+    channel_image.create(region.size(), util::kOpenCvMatrixType);
+  }
+
+  // Each chunk covers a different part of the output channels, so they can be
+  // decoded and copied in parallel.
+  ChunkedCubeHeader header;
+  header.num_rows = num_rows_;
+  header.num_cols = num_cols_;
+  header.num_bands = num_bands_;
+  header.chunk_rows = chunk_rows_;
+  header.chunk_cols = chunk_cols_;
+  header.chunk_bands = chunk_bands_;
+  util::ParallelFor(chunks.size(), [&](const int i) {
+    const int chunk = chunks[i];
+    const int col_chunk = chunk % num_col_chunks_;
+    const int row_chunk = (chunk / num_col_chunks_) % num_row_chunks_;
+    const int band_chunk = chunk / (num_col_chunks_ * num_row_chunks_);
+    const ChunkBounds bounds =
+        GetChunkBounds(band_chunk, row_chunk, col_chunk, header);
+
+    const ChunkLocation& location = chunk_locations_[chunk];
+    const unsigned char* encoded_chunk =
+        cube_file_->GetData() + location.offset;
+    const int num_values = bounds.GetNumValues();
+    std::vector<float> values(num_values);
+    if (location.compression == CUBE_COMPRESSION_RUN_LENGTH) {
+      std::vector<unsigned char> shuffled(num_values * sizeof(float));
+      RunLengthDecode(
+          encoded_chunk, location.num_bytes, shuffled.size(), shuffled.data());
+      UnshuffleBytes(shuffled.data(), num_values, values.data());
+    } else {
+      CHECK_EQ(location.num_bytes, num_values * sizeof(float))
+          << "Corrupt chunk in chunked cube file.";
+      std::memcpy(values.data(), encoded_chunk, location.num_bytes);
+    }
+
+    // Copy the part of the chunk that overlaps the region.
+    const int chunk_width = bounds.end_col - bounds.start_col;
+    const int chunk_height = bounds.end_row - bounds.start_row;
+    const int first_band = std::max(bounds.start_band, start_band);
+    const int last_band = std::min(bounds.end_band, end_band);
+    const int first_row = std::max(bounds.start_row, region.y);
+    const int last_row = std::min(bounds.end_row, region.y + region.height);
+    const int first_col = std::max(bounds.start_col, region.x);
+    const int last_col = std::min(bounds.end_col, region.x + region.width);
+    for (int band = first_band; band < last_band; ++band) {
+      for (int row = first_row; row < last_row; ++row) {
+        const float* chunk_row = values.data() +
+            ((band - bounds.start_band) * chunk_height +
+             (row - bounds.start_row)) * chunk_width;
+        double* channel_row =
+            channel_images[band - start_band].ptr<double>(row - region.y);
+        for (int col = first_col; col < last_col; ++col) {
+          channel_row[col - region.x] = chunk_row[col - bounds.start_col];
+        }
+      }
+    }
+  });
+
+  ImageData image;
+  for (cv::Mat& channel_image : channel_images) {
+    image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
+    channel_image.release();
+  }
+  return image;
+}
+
+int ChunkedCubeFile::GetNumChunksInRange(
+    const cv::Rect& region, const int start_band, const int end_band) const {
+
+  return GetChunksInRange(region, start_band, end_band).size();
+}
+
+std::vector<int> ChunkedCubeFile::GetChunksInRange(
+    const cv::Rect& region, const int start_band, const int end_band) const {
+
+  CHECK_GT(region.area(), 0) << "The region must not be empty.";
+  CHECK((region & cv::Rect(0, 0, num_cols_, num_rows_)) == region)
+      << "The region " << region << " is outside of the cube.";
+  CHECK_GE(start_band, 0) << "Start band index cannot be negative.";
+  CHECK_LE(end_band, num_bands_) << "End band index is out of bounds.";
+  CHECK_GT(end_band - start_band, 0) << "Band range must be positive.";
+
+  std::vector<int> chunks;
+  const int last_band_chunk = (end_band - 1) / chunk_bands_;
+  const int last_row_chunk = (region.y + region.height - 1) / chunk_rows_;
+  const int last_col_chunk = (region.x + region.width - 1) / chunk_cols_;
+  for (int band_chunk = start_band / chunk_bands_;
+       band_chunk <= last_band_chunk;
+       ++band_chunk) {
+    for (int row_chunk = region.y / chunk_rows_;
+         row_chunk <= last_row_chunk;
+         ++row_chunk) {
+      for (int col_chunk = region.x / chunk_cols_;
+           col_chunk <= last_col_chunk;
+           ++col_chunk) {
+        chunks.push_back(
+            (band_chunk * num_row_chunks_ + row_chunk) * num_col_chunks_ +
+            col_chunk);
+      }
+    }
+  }
+  return chunks;
+}
+
+}  // namespace super_resolution
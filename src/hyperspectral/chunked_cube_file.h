@@ -0,0 +1,131 @@
+// Provides a native binary file format for hyperspectral image cubes that
+// supports fast reads of spatial regions and band subsets.
+//
+// The cube is split into fixed-size chunks of rows x cols x bands, and each
+// chunk is stored (and optionally compressed) independently. The file starts
+// with a small binary header followed by an index of the position and size of
+// every chunk, so reading any region of the cube only has to decode the chunks
+// that overlap it. Unlike ENVI files, no text header or configuration file has
+// to be parsed.
+//
+// File layout (native byte order, which is verified when reading):
+//   ChunkedCubeHeader
+//   ChunkedCubeIndexEntry x number of chunks
+//   chunk data
+// Chunks are ordered by band chunk, then row chunk, then column chunk. The
+// values in each chunk are 32-bit floats ordered by band, row, and column.
+
+#ifndef SRC_HYPERSPECTRAL_CHUNKED_CUBE_FILE_H_
+#define SRC_HYPERSPECTRAL_CHUNKED_CUBE_FILE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image/image_data.h"
+#include "util/memory_mapped_file.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+// The file extension used for chunked cube files (without the dot).
+constexpr char kChunkedCubeFileExtension[] = "cube";
+
+// How each chunk is compressed.
+enum ChunkedCubeCompression {
+  CUBE_COMPRESSION_NONE = 0,
+
+  // The bytes of the values are shuffled so that equal bytes (e.g. the
+  // exponents of similar values) are adjacent, and then run-length encoded.
+  // This is cheap to decode and works well on smooth or sparse data. Chunks
+  // that would not get smaller are stored uncompressed.
+  CUBE_COMPRESSION_RUN_LENGTH = 1
+};
+
+// Options for writing chunked cube files.
+struct ChunkedCubeOptions {
+  // The size of each chunk. Chunks at the edges of the cube may be smaller.
+  int chunk_rows = 64;
+  int chunk_cols = 64;
+  int chunk_bands = 16;
+
+  ChunkedCubeCompression compression = CUBE_COMPRESSION_NONE;
+};
+
+// Saves the given image as a chunked cube file at the given path. Values are
+// stored as 32-bit floats. Chunks are encoded in parallel.
+void SaveChunkedCube(
+    const ImageData& image,
+    const std::string& file_path,
+    const ChunkedCubeOptions& options = ChunkedCubeOptions());
+
+class ChunkedCubeFile {
+ public:
+  // Maps the given file and reads its header and chunk index. No chunk data is
+  // read until one of the ReadImage methods is called. An error will occur if
+  // the file is not a valid chunked cube file.
+  explicit ChunkedCubeFile(const std::string& file_path);
+
+  // The file mapping is owned by this object, so it cannot be copied.
+  ChunkedCubeFile(const ChunkedCubeFile&) = delete;
+  ChunkedCubeFile& operator=(const ChunkedCubeFile&) = delete;
+
+  // Returns the size of the entire cube.
+  cv::Size GetImageSize() const {
+    return cv::Size(num_cols_, num_rows_);
+  }
+  int GetNumChannels() const {
+    return num_bands_;
+  }
+
+  // Reads the entire cube.
+  ImageData ReadImage() const;
+
+  // Reads the given spatial region of the bands in [start_band, end_band).
+  // Only the chunks that overlap the region are decoded, and they are decoded
+  // in parallel.
+  ImageData ReadImage(
+      const cv::Rect& region, const int start_band, const int end_band) const;
+
+  // Returns the number of chunks that ReadImage() decodes for the given
+  // region and band range.
+  int GetNumChunksInRange(
+      const cv::Rect& region, const int start_band, const int end_band) const;
+
+ private:
+  // The position and encoding of a chunk in the file.
+  struct ChunkLocation {
+    uint64_t offset;
+    uint64_t num_bytes;
+    ChunkedCubeCompression compression;
+  };
+
+  // Returns the indices of the chunks that overlap the given region and band
+  // range.
+  std::vector<int> GetChunksInRange(
+      const cv::Rect& region, const int start_band, const int end_band) const;
+
+  std::unique_ptr<util::MemoryMappedFile> cube_file_;
+
+  // The size of the cube and of its chunks.
+  int num_rows_ = 0;
+  int num_cols_ = 0;
+  int num_bands_ = 0;
+  int chunk_rows_ = 0;
+  int chunk_cols_ = 0;
+  int chunk_bands_ = 0;
+
+  // The number of chunks along each dimension.
+  int num_row_chunks_ = 0;
+  int num_col_chunks_ = 0;
+  int num_band_chunks_ = 0;
+
+  // The location of every chunk in the file.
+  std::vector<ChunkLocation> chunk_locations_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_HYPERSPECTRAL_CHUNKED_CUBE_FILE_H_
@@ -1,5 +1,13 @@
 #include "hyperspectral/hyperspectral_data_loader.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <limits>
 #include <sstream>
@@ -11,6 +19,8 @@
 #include "util/config_reader.h"
 #include "util/data_loader.h"
 #include "util/matrix_util.h"
+#include "util/memory_mapped_file.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
 
@@ -21,30 +31,6 @@ namespace {
 
 constexpr char kMatlabTextDataDelimiter = ',';
 
-struct HSIDataRange {
-  int start_row = 0;
-  int start_col = 0;
-  int end_row = 0;
-  int end_col = 0;
-  int start_band = 0;
-  int end_band = 0;
-};
-
-
-// Reverses the bytes of the given value (e.g. float). This is used to convert
-// from the data's endian form into the machine's endian form when they are not
-// matched up.
-template <typename T>
-T ReverseBytes(const T value) {
-  T reversed_value;
-  const unsigned char* original_bytes = (const unsigned char*)(&value);
-  unsigned char* reversed_bytes  = (unsigned char*)(&reversed_value);
-  const int num_bytes = sizeof(T);
-  for (int i = 0; i < num_bytes; ++i) {
-    reversed_bytes[i] = original_bytes[num_bytes - 1 - i];
-  }
-  return reversed_value;
-}
 
 // Returns true if this machine uses big-endian or false if it uses
 // little-endian. If the byte order is mismatched with the data's byte order,
@@ -65,87 +51,536 @@ bool IsMachineBigEndian() {
   return machine_big_endian;
 }
 
+// A complex value as stored in ENVI files (data type 6): the real part
+// followed by the imaginary part, each a 32-bit float.
+struct ComplexFloat {
+  float real;
+  float imaginary;
+};
+
+// Describes how each HSIBinaryDataType is named in ENVI header files (by its
+// numeric code) and in configuration files, and how many bytes each value
+// takes up in the binary file.
+struct HSIDataTypeInfo {
+  HSIBinaryDataType data_type;
+  int envi_code;
+  const char* name;
+  size_t size;
+};
+
+static const HSIDataTypeInfo kDataTypeInfo[] = {
+  {HSI_DATA_TYPE_UINT8, 1, "uint8", sizeof(uint8_t)},
+  {HSI_DATA_TYPE_INT16, 2, "int16", sizeof(int16_t)},
+  {HSI_DATA_TYPE_INT32, 3, "int32", sizeof(int32_t)},
+  {HSI_DATA_TYPE_FLOAT, 4, "float", sizeof(float)},
+  {HSI_DATA_TYPE_DOUBLE, 5, "double", sizeof(double)},
+  {HSI_DATA_TYPE_COMPLEX_FLOAT, 6, "complex", sizeof(ComplexFloat)},
+  {HSI_DATA_TYPE_UINT16, 12, "uint16", sizeof(uint16_t)}
+};
+
+// Returns the description of the given data type.
+const HSIDataTypeInfo& GetDataTypeInfo(const HSIBinaryDataType data_type) {
+  for (const HSIDataTypeInfo& info : kDataTypeInfo) {
+    if (info.data_type == data_type) {
+      return info;
+    }
+  }
+  LOG(FATAL) << "Unsupported data type: " << data_type << ".";
+  return kDataTypeInfo[0];  // Never reached.
+}
+
+// Sets the data type from its ENVI header code (e.g. 4 for float). Returns
+// false if the code is not a supported data type.
+bool ParseENVIDataTypeCode(const int code, HSIBinaryDataType* data_type) {
+  for (const HSIDataTypeInfo& info : kDataTypeInfo) {
+    if (info.envi_code == code) {
+      *data_type = info.data_type;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sets the data type from its configuration file name (e.g. "float"). Returns
+// false if the name is not a supported data type.
+bool ParseDataTypeName(
+    const std::string& name, HSIBinaryDataType* data_type) {
+
+  for (const HSIDataTypeInfo& info : kDataTypeInfo) {
+    if (name == info.name) {
+      *data_type = info.data_type;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Unsigned integer types of each value size, used to reverse the byte order
+// of values without going through individual bytes.
+template <int kNumBytes> struct UnsignedInteger;
+template <> struct UnsignedInteger<1> { typedef uint8_t Type; };
+template <> struct UnsignedInteger<2> { typedef uint16_t Type; };
+template <> struct UnsignedInteger<4> { typedef uint32_t Type; };
+template <> struct UnsignedInteger<8> { typedef uint64_t Type; };
+
+// Reverses the byte order of an unsigned integer. These compile down to single
+// byte swap instructions, which the conversion loops below can vectorize.
+inline uint8_t SwapBytes(const uint8_t value) {
+  return value;
+}
+inline uint16_t SwapBytes(const uint16_t value) {
+  return __builtin_bswap16(value);
+}
+inline uint32_t SwapBytes(const uint32_t value) {
+  return __builtin_bswap32(value);
+}
+inline uint64_t SwapBytes(const uint64_t value) {
+  return __builtin_bswap64(value);
+}
+
+// Converts a contiguous span of num_values binary values of type T into
+// doubles. The span does not need to be aligned. If reverse_bytes is true, the
+// byte order of each value is reversed before the conversion.
 template <typename T>
-ImageData ReadBinaryFileBSQ(
-    const std::string& hsi_file_path,
-    const int num_data_rows,
-    const int num_data_cols,
-    const int num_data_bands,
-    const long start_index,
+void ConvertBinarySpan(
+    const unsigned char* span,
+    const int num_values,
     const bool reverse_bytes,
-    const HSIDataRange& data_range) {
+    double* output) {
+
+  typedef typename UnsignedInteger<sizeof(T)>::Type Bits;
+  if (!reverse_bytes) {
+    for (int i = 0; i < num_values; ++i) {
+      T value;
+      std::memcpy(&value, span + i * sizeof(T), sizeof(T));
+      output[i] = static_cast<double>(value);
+    }
+    return;
+  }
+  for (int i = 0; i < num_values; ++i) {
+    Bits bits;
+    std::memcpy(&bits, span + i * sizeof(T), sizeof(T));
+    bits = SwapBytes(bits);
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    output[i] = static_cast<double>(value);
+  }
+}
+
+// Complex values with a zero imaginary part (as written by this loader) are
+// converted to their real part, so that negative values keep their sign.
+// Other complex values are converted to their magnitude. The real and
+// imaginary parts are byte swapped independently of each other.
+template <>
+void ConvertBinarySpan<ComplexFloat>(
+    const unsigned char* span,
+    const int num_values,
+    const bool reverse_bytes,
+    double* output) {
+
+  for (int i = 0; i < num_values; ++i) {
+    uint32_t bits[2];
+    std::memcpy(bits, span + i * sizeof(ComplexFloat), sizeof(ComplexFloat));
+    if (reverse_bytes) {
+      bits[0] = SwapBytes(bits[0]);
+      bits[1] = SwapBytes(bits[1]);
+    }
+    ComplexFloat value;
+    std::memcpy(&value.real, &bits[0], sizeof(float));
+    std::memcpy(&value.imaginary, &bits[1], sizeof(float));
+    if (value.imaginary == 0.0f) {
+      output[i] = static_cast<double>(value.real);
+    } else {
+      output[i] = std::hypot(
+          static_cast<double>(value.real),
+          static_cast<double>(value.imaginary));
+    }
+  }
+}
+
+// Converts num_values binary values of type T that are value_stride bytes
+// apart into doubles. Contiguous values are converted as a single span.
+template <typename T>
+void ConvertStridedBinaryValues(
+    const unsigned char* data,
+    const int num_values,
+    const size_t value_stride,
+    const bool reverse_bytes,
+    double* output) {
+
+  if (value_stride == sizeof(T)) {
+    ConvertBinarySpan<T>(data, num_values, reverse_bytes, output);
+    return;
+  }
+  for (int i = 0; i < num_values; ++i) {
+    ConvertBinarySpan<T>(data + i * value_stride, 1, reverse_bytes, output + i);
+  }
+}
+
+// Converts a double to type T. Integer types are rounded to the nearest
+// integer and clamped to the range of the type (NaN becomes 0), so values that
+// do not fit are saturated instead of wrapping around.
+template <typename T>
+T ConvertFromDouble(const double value) {
+  if (!std::numeric_limits<T>::is_integer) {
+    return static_cast<T>(value);
+  }
+  if (std::isnan(value)) {
+    return 0;
+  }
+  const double min_value = static_cast<double>(std::numeric_limits<T>::min());
+  const double max_value = static_cast<double>(std::numeric_limits<T>::max());
+  return static_cast<T>(
+      std::min(std::max(std::round(value), min_value), max_value));
+}
+
+// Number of pixels that are transposed at a time between the pixel-interleaved
+// (BIP) file layout and the planar ImageData layout. A block of this many
+// spectral vectors stays in cache even for several hundred bands.
+constexpr int kTransposeBlockSize = 64;
+
+// Returns the name of the interleave format as used in ENVI header and
+// configuration files (e.g. "bsq").
+std::string GetInterleaveFormatName(const HSIDataInterleaveFormat interleave) {
+  switch (interleave) {
+    case HSI_BINARY_INTERLEAVE_BIL:
+      return "bil";
+    case HSI_BINARY_INTERLEAVE_BIP:
+      return "bip";
+    case HSI_BINARY_INTERLEAVE_BSQ:
+    default:
+      return "bsq";
+  }
+}
+
+// Sets the interleave format from its ENVI name (e.g. "bsq"). Returns false if
+// the name is not a supported interleave format.
+bool ParseInterleaveFormat(
+    const std::string& name, HSIDataInterleaveFormat* interleave) {
+
+  if (name == "bsq") {
+    *interleave = HSI_BINARY_INTERLEAVE_BSQ;
+  } else if (name == "bil") {
+    *interleave = HSI_BINARY_INTERLEAVE_BIL;
+  } else if (name == "bip") {
+    *interleave = HSI_BINARY_INTERLEAVE_BIP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Returns the position (in values, not bytes) of the value at the given row,
+// column, and band in a binary file with the given size and interleave format.
+size_t GetValueIndex(
+    const HSIDataInterleaveFormat interleave,
+    const size_t num_rows,
+    const size_t num_cols,
+    const size_t num_bands,
+    const size_t row,
+    const size_t col,
+    const size_t band) {
 
-  std::ifstream input_file(hsi_file_path);
-  CHECK(input_file.is_open())
-      << "File '" << hsi_file_path << "' could not be opened for reading.";
+  switch (interleave) {
+    case HSI_BINARY_INTERLEAVE_BIL:
+      return (row * num_bands + band) * num_cols + col;
+    case HSI_BINARY_INTERLEAVE_BIP:
+      return (row * num_cols + col) * num_bands + band;
+    case HSI_BINARY_INTERLEAVE_BSQ:
+    default:
+      return (band * num_rows + row) * num_cols + col;
+  }
+}
+
+// Converts num_values doubles into binary values of type T, written into the
+// given byte span. If reverse_bytes is true, the byte order of each value is
+// reversed after the conversion.
+template <typename T>
+void ConvertToBinarySpan(
+    const double* values,
+    const int num_values,
+    const bool reverse_bytes,
+    unsigned char* span) {
+
+  typedef typename UnsignedInteger<sizeof(T)>::Type Bits;
+  for (int i = 0; i < num_values; ++i) {
+    const T value = ConvertFromDouble<T>(values[i]);
+    Bits bits;
+    std::memcpy(&bits, &value, sizeof(T));
+    if (reverse_bytes) {
+      bits = SwapBytes(bits);
+    }
+    std::memcpy(span + i * sizeof(T), &bits, sizeof(T));
+  }
+}
 
-  const int data_point_size = sizeof(T);
-  long current_index = start_index;
-  input_file.seekg(current_index * data_point_size);
+// Complex values are written as the real part with a zero imaginary part.
+template <>
+void ConvertToBinarySpan<ComplexFloat>(
+    const double* values,
+    const int num_values,
+    const bool reverse_bytes,
+    unsigned char* span) {
 
-  ImageData hsi_image;
+  std::vector<double> parts(2 * num_values, 0.0);
+  for (int i = 0; i < num_values; ++i) {
+    parts[2 * i] = values[i];
+  }
+  ConvertToBinarySpan<float>(parts.data(), 2 * num_values, reverse_bytes, span);
+}
+
+// Builds an ImageData out of the given channels. Each channel is released as
+// soon as it has been copied into the image to limit the peak memory usage.
+ImageData BuildImageFromChannels(std::vector<cv::Mat>* channel_images) {
+  ImageData image;
+  for (cv::Mat& channel_image : *channel_images) {
+    image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
+    channel_image.release();
+  }
+  return image;
+}
+
+// Reads the given data range of a BSQ or BIL file. In both formats the columns
+// of each (band, row) pair are stored contiguously, so every row of the range
+// is a single span in the file that is converted directly from the mapped
+// file. Only the spans inside the range are touched. Bands are read in
+// parallel.
+template <typename T>
+ImageData ReadBinaryFileRowSpans(
+    const util::MemoryMappedFile& hsi_file,
+    const HSIBinaryDataParameters& parameters,
+    const bool reverse_bytes,
+    const HSIDataRange& data_range) {
+
+  const unsigned char* data = hsi_file.GetData() + parameters.header_offset;
+  const HSIDataInterleaveFormat interleave = parameters.data_format.interleave;
   const cv::Size image_size(
       data_range.end_col - data_range.start_col,
       data_range.end_row - data_range.start_row);
-  const long num_pixels = num_data_rows * num_data_cols;
-  for (int band = data_range.start_band; band < data_range.end_band; ++band) {
-    const long band_index = band * num_pixels;
+  const int num_bands = data_range.end_band - data_range.start_band;
+  std::vector<cv::Mat> channel_images(num_bands);
+  util::ParallelFor(num_bands, [&](const int channel_index) {
+    const int band = data_range.start_band + channel_index;
+    if (interleave == HSI_BINARY_INTERLEAVE_BSQ) {
+      const size_t band_start = GetValueIndex(
+          interleave,
+          parameters.num_data_rows,
+          parameters.num_data_cols,
+          parameters.num_data_bands,
+          data_range.start_row, 0, band);
+      hsi_file.AdviseSequentialRead(
+          parameters.header_offset + band_start * sizeof(T),
+          static_cast<size_t>(image_size.height) *
+              parameters.num_data_cols * sizeof(T));
+    }
     cv::Mat channel_image(image_size, util::kOpenCvMatrixType);
     for (int row = data_range.start_row; row < data_range.end_row; ++row) {
-      const int channel_row = row - data_range.start_row;
-      for (int col = data_range.start_col; col < data_range.end_col; ++col) {
-        const int channel_col = col - data_range.start_col;
-        const long pixel_index = row * num_data_cols + col;
-        const long next_index = band_index + pixel_index;
-        // Skip to next position if necessary.
-        if (next_index > (current_index + 1)) {
-          input_file.seekg(next_index * data_point_size);
-        }
-        T value;
-        input_file.read(reinterpret_cast<char*>(&value), data_point_size);
-        if (reverse_bytes) {
-          value = ReverseBytes<T>(value);
+      const size_t span_start = GetValueIndex(
+          interleave,
+          parameters.num_data_rows,
+          parameters.num_data_cols,
+          parameters.num_data_bands,
+          row, data_range.start_col, band);
+      ConvertBinarySpan<T>(
+          data + span_start * sizeof(T),
+          image_size.width,
+          reverse_bytes,
+          channel_image.ptr<double>(row - data_range.start_row));
+    }
+    channel_images[channel_index] = channel_image;
+  });
+  return BuildImageFromChannels(&channel_images);
+}
+
+// Reads the given data range of a BIP file. The bands of each pixel are stored
+// contiguously, so the spectral vectors of a block of pixels are converted
+// into a small buffer first, and the buffer is then transposed into the rows
+// of the individual channels. Only the bands inside the range are read for
+// each pixel. Rows are read in parallel.
+template <typename T>
+ImageData ReadBinaryFileBIP(
+    const util::MemoryMappedFile& hsi_file,
+    const HSIBinaryDataParameters& parameters,
+    const bool reverse_bytes,
+    const HSIDataRange& data_range) {
+
+  const unsigned char* data = hsi_file.GetData() + parameters.header_offset;
+  const cv::Size image_size(
+      data_range.end_col - data_range.start_col,
+      data_range.end_row - data_range.start_row);
+  const int num_bands = data_range.end_band - data_range.start_band;
+  std::vector<cv::Mat> channel_images(num_bands);
+  for (int channel_index = 0; channel_index < num_bands; ++channel_index) {
+    channel_images[channel_index].create(image_size, util::kOpenCvMatrixType);
+  }
+
+  util::ParallelFor(image_size.height, [&](const int channel_row) {
+    const int row = data_range.start_row + channel_row;
+    std::vector<double> block(kTransposeBlockSize * num_bands);
+    for (int block_start = 0;
+         block_start < image_size.width;
+         block_start += kTransposeBlockSize) {
+      const int block_width =
+          std::min(kTransposeBlockSize, image_size.width - block_start);
+      for (int i = 0; i < block_width; ++i) {
+        const size_t span_start = GetValueIndex(
+            HSI_BINARY_INTERLEAVE_BIP,
+            parameters.num_data_rows,
+            parameters.num_data_cols,
+            parameters.num_data_bands,
+            row, data_range.start_col + block_start + i, data_range.start_band);
+        ConvertBinarySpan<T>(
+            data + span_start * sizeof(T),
+            num_bands,
+            reverse_bytes,
+            block.data() + i * num_bands);
+      }
+      for (int band = 0; band < num_bands; ++band) {
+        double* channel_data =
+            channel_images[band].ptr<double>(channel_row) + block_start;
+        for (int i = 0; i < block_width; ++i) {
+          channel_data[i] = block[i * num_bands + band];
         }
-        channel_image.at<double>(channel_row, channel_col) =
-            static_cast<double>(value);
-        current_index = next_index;
       }
     }
-    hsi_image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
+  });
+  return BuildImageFromChannels(&channel_images);
+}
+
+// Transposes one row of the given image from the planar ImageData layout into
+// pixel-interleaved (BIP) order, so that output[col * num_bands + band] is the
+// value of the given band at (row, col). Columns are processed in blocks so
+// that the reads of each channel row stay in cache.
+void InterleaveImageRow(const ImageData& image, const int row, double* output) {
+  const int num_cols = image.GetImageSize().width;
+  const int num_bands = image.GetNumChannels();
+  for (int block_start = 0;
+       block_start < num_cols;
+       block_start += kTransposeBlockSize) {
+    const int block_end = std::min(block_start + kTransposeBlockSize, num_cols);
+    for (int band = 0; band < num_bands; ++band) {
+      const double* row_data = image.GetRowData(band, row);
+      for (int col = block_start; col < block_end; ++col) {
+        output[col * num_bands + band] = row_data[col];
+      }
+    }
+  }
+}
+
+// Writes num_bytes of the given buffer into the file at the given byte
+// offset. pwrite does not use the file position, so multiple threads can write
+// different parts of the same file at the same time.
+void WriteToFileAtOffset(
+    const int file_descriptor,
+    const unsigned char* buffer,
+    const size_t num_bytes,
+    const size_t offset,
+    const std::string& file_path) {
+
+  size_t num_bytes_written = 0;
+  while (num_bytes_written < num_bytes) {
+    const ssize_t result = pwrite(
+        file_descriptor,
+        buffer + num_bytes_written,
+        num_bytes - num_bytes_written,
+        offset + num_bytes_written);
+    CHECK_GT(result, 0)
+        << "Failed to write to ENVI file '" << file_path << "'.";
+    num_bytes_written += static_cast<size_t>(result);
   }
-  input_file.close();
-  return hsi_image;
 }
 
+// Writes the binary data file in the given interleave format. The file is
+// split into equally sized contiguous chunks: a full band for BSQ, or all
+// bands of one row for BIL and BIP. Each chunk is converted into its own
+// buffer and written with a single pwrite call. Chunks are converted and
+// written in parallel.
 template <typename T>
-void WriteBinaryFileBSQ(
+void WriteBinaryFile(
     const ImageData& image,
     const std::string& hsi_file_path,
+    const HSIDataInterleaveFormat interleave,
     const bool reverse_bytes) {
 
-  // Write the binary file.
-  std::ofstream output_envi_file(hsi_file_path);
-  CHECK(output_envi_file.is_open())
-      << "ENVI file '" << hsi_file_path << "' could not be opened for writing.";
   const cv::Size image_size = image.GetImageSize();
   const int num_rows = image_size.height;
   const int num_cols = image_size.width;
   const int num_bands = image.GetNumChannels();
-  const int data_point_size = sizeof(T);
-  for (int band = 0; band < num_bands; ++band) {
-    for (int row = 0; row < num_rows; ++row) {
-      for (int col = 0; col < num_cols; ++col) {
-        const double pixel_value = image.GetPixelValue(band, row, col);
-        T output_value = static_cast<T>(pixel_value);
-        if (reverse_bytes) {
-          output_value = ReverseBytes<T>(output_value);
+  const int num_chunks =
+      (interleave == HSI_BINARY_INTERLEAVE_BSQ) ? num_bands : num_rows;
+  const size_t chunk_num_values =
+      static_cast<size_t>(num_cols) *
+      ((interleave == HSI_BINARY_INTERLEAVE_BSQ) ? num_rows : num_bands);
+  const size_t chunk_size = chunk_num_values * sizeof(T);
+
+  const int file_descriptor =
+      open(hsi_file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_GE(file_descriptor, 0)
+      << "ENVI file '" << hsi_file_path << "' could not be opened for writing.";
+  // Allocate the full file up front so the chunks can be written in any order.
+  CHECK_EQ(ftruncate(file_descriptor, chunk_size * num_chunks), 0)
+      << "Could not resize ENVI file '" << hsi_file_path << "'.";
+
+  const size_t row_size = num_cols * sizeof(T);
+  util::ParallelFor(num_chunks, [&](const int chunk) {
+    std::vector<unsigned char> buffer(chunk_size);
+    switch (interleave) {
+      case HSI_BINARY_INTERLEAVE_BIL:
+        for (int band = 0; band < num_bands; ++band) {
+          ConvertToBinarySpan<T>(
+              image.GetRowData(band, chunk),
+              num_cols,
+              reverse_bytes,
+              buffer.data() + band * row_size);
         }
-        output_envi_file.write(
-            reinterpret_cast<char*>(&output_value), data_point_size);
+        break;
+      case HSI_BINARY_INTERLEAVE_BIP: {
+        std::vector<double> interleaved_row(chunk_num_values);
+        InterleaveImageRow(image, chunk, interleaved_row.data());
+        ConvertToBinarySpan<T>(
+            interleaved_row.data(),
+            chunk_num_values,
+            reverse_bytes,
+            buffer.data());
+        break;
       }
+      case HSI_BINARY_INTERLEAVE_BSQ:
+      default:
+        for (int row = 0; row < num_rows; ++row) {
+          ConvertToBinarySpan<T>(
+              image.GetRowData(chunk, row),
+              num_cols,
+              reverse_bytes,
+              buffer.data() + row * row_size);
+        }
+        break;
     }
-  }
-  output_envi_file.close();
+    WriteToFileAtOffset(
+        file_descriptor,
+        buffer.data(),
+        chunk_size,
+        chunk * chunk_size,
+        hsi_file_path);
+  });
+  CHECK_EQ(close(file_descriptor), 0)
+      << "Failed to close ENVI file '" << hsi_file_path << "'.";
+}
+
+// Writes the ENVI header file (hsi_file_path + ".hdr") and the configuration
+// file (hsi_file_path + ".config") used by HyperspectralDataLoader to read the
+// data file back.
+void WriteHeaderAndConfigFiles(
+    const std::string& hsi_file_path,
+    const cv::Size& image_size,
+    const int num_bands,
+    const HSIBinaryDataFormat& binary_data_format) {
+
+  const int num_rows = image_size.height;
+  const int num_cols = image_size.width;
+  const std::string interleave =
+      GetInterleaveFormatName(binary_data_format.interleave);
+  const HSIDataTypeInfo& data_type_info =
+      GetDataTypeInfo(binary_data_format.data_type);
 
   // Write the header file.
   const std::string header_file_path = hsi_file_path + ".hdr";
@@ -161,9 +596,10 @@ void WriteBinaryFileBSQ(
   output_header_file << "bands = " << num_bands << "\n";
   output_header_file << "header offset = 0\n";
   output_header_file << "file type = ENVI Standard\n";
-  output_header_file << "data type = 4\n";  // TODO: 4 = float, might change.
-  output_header_file << "interleave = bsq\n";
-  output_header_file << "byte order = 0\n";  // TODO: This might also change.
+  output_header_file << "data type = " << data_type_info.envi_code << "\n";
+  output_header_file << "interleave = " << interleave << "\n";
+  output_header_file
+      << "byte order = " << (binary_data_format.big_endian ? 1 : 0) << "\n";
   // TODO: Verify that we don't need to generate the other "unknown" options.
   output_header_file.close();
 
@@ -177,9 +613,11 @@ void WriteBinaryFileBSQ(
       << "# Configuration file for reading '" << hsi_file_path
       << "', generated by HyperspectralDataLoader.\n";
   output_config_file << "file " << hsi_file_path << "\n";
-  output_config_file << "interleave bsq\n";
-  output_config_file << "data_type float\n";  // TODO: Might not be float.
-  output_config_file << "big_endian false\n";  // TODO: Might not be false.
+  output_config_file << "interleave " << interleave << "\n";
+  output_config_file << "data_type " << data_type_info.name << "\n";
+  output_config_file
+      << "big_endian "
+      << (binary_data_format.big_endian ? "true" : "false") << "\n";
   output_config_file << "header_offset 0\n";
   output_config_file << "num_data_rows " << num_rows << "\n";
   output_config_file << "num_data_cols " << num_cols << "\n";
@@ -193,6 +631,23 @@ void WriteBinaryFileBSQ(
   output_config_file.close();
 }
 
+// Reads the given data range of a file with values of type T in any of the
+// interleave formats.
+template <typename T>
+ImageData ReadBinaryFileOfType(
+    const util::MemoryMappedFile& hsi_file,
+    const HSIBinaryDataParameters& parameters,
+    const bool reverse_bytes,
+    const HSIDataRange& data_range) {
+
+  if (parameters.data_format.interleave == HSI_BINARY_INTERLEAVE_BIP) {
+    return ReadBinaryFileBIP<T>(
+        hsi_file, parameters, reverse_bytes, data_range);
+  }
+  return ReadBinaryFileRowSpans<T>(
+      hsi_file, parameters, reverse_bytes, data_range);
+}
+
 ImageData ReadBinaryFile(
     const std::string& hsi_file_path,
     const HSIBinaryDataParameters& parameters,
@@ -203,15 +658,35 @@ ImageData ReadBinaryFile(
   const bool reverse_bytes =
       (parameters.data_format.big_endian != machine_big_endian);
 
-  // TODO: This may change, depending on interleave format and data type.
-  return ReadBinaryFileBSQ<float>(
-      hsi_file_path,
-      parameters.num_data_rows,
-      parameters.num_data_cols,
-      parameters.num_data_bands,
-      parameters.header_offset,
-      reverse_bytes,
-      data_range);
+  const util::MemoryMappedFile hsi_file(hsi_file_path);
+  CHECK_GE(hsi_file.GetSize(), parameters.GetFileSize())
+      << "File '" << hsi_file_path
+      << "' is smaller than the specified data size.";
+
+  switch (parameters.data_format.data_type) {
+    case HSI_DATA_TYPE_UINT8:
+      return ReadBinaryFileOfType<uint8_t>(
+          hsi_file, parameters, reverse_bytes, data_range);
+    case HSI_DATA_TYPE_INT16:
+      return ReadBinaryFileOfType<int16_t>(
+          hsi_file, parameters, reverse_bytes, data_range);
+    case HSI_DATA_TYPE_UINT16:
+      return ReadBinaryFileOfType<uint16_t>(
+          hsi_file, parameters, reverse_bytes, data_range);
+    case HSI_DATA_TYPE_INT32:
+      return ReadBinaryFileOfType<int32_t>(
+          hsi_file, parameters, reverse_bytes, data_range);
+    case HSI_DATA_TYPE_DOUBLE:
+      return ReadBinaryFileOfType<double>(
+          hsi_file, parameters, reverse_bytes, data_range);
+    case HSI_DATA_TYPE_COMPLEX_FLOAT:
+      return ReadBinaryFileOfType<ComplexFloat>(
+          hsi_file, parameters, reverse_bytes, data_range);
+    case HSI_DATA_TYPE_FLOAT:
+    default:
+      return ReadBinaryFileOfType<float>(
+          hsi_file, parameters, reverse_bytes, data_range);
+  }
 }
 
 }  // namespace
@@ -224,20 +699,18 @@ void HSIBinaryDataParameters::ReadHeaderFromFile(
   config_reader.ReadFromFile(header_file_path);
   if (config_reader.HasValue("interleave")) {
     const std::string interleave = config_reader.GetValue("interleave");
-    if (interleave == "bsq") {
-      data_format.interleave = HSI_BINARY_INTERLEAVE_BSQ;
-    } else {
+    if (!ParseInterleaveFormat(interleave, &data_format.interleave)) {
       LOG(WARNING) << "Unknown/unsupported interleave format: "
                    << interleave << ". Using BSQ by default.";
+      data_format.interleave = HSI_BINARY_INTERLEAVE_BSQ;
     }
   }
   if (config_reader.HasValue("data type")) {
-    const std::string data_type = config_reader.GetValue("data type");
-    if (data_type == "4") {
-      data_format.data_type = HSI_DATA_TYPE_FLOAT;
-    } else {
+    const int data_type = config_reader.GetValueAsInt("data type");
+    if (!ParseENVIDataTypeCode(data_type, &data_format.data_type)) {
       LOG(WARNING) << "Unknown/unsupported data type: "
                    << data_type << ". Using float by default.";
+      data_format.data_type = HSI_DATA_TYPE_FLOAT;
     }
   }
   if (config_reader.HasValue("byte order")) {
@@ -262,118 +735,242 @@ void HSIBinaryDataParameters::ReadHeaderFromFile(
   }
 }
 
-// TODO: Support for different interleaves and data types.
+size_t HSIBinaryDataParameters::GetValueOffset(
+    const int row, const int col, const int band) const {
+
+  const size_t value_index = GetValueIndex(
+      data_format.interleave,
+      num_data_rows,
+      num_data_cols,
+      num_data_bands,
+      row, col, band);
+  return header_offset +
+      value_index * GetDataTypeInfo(data_format.data_type).size;
+}
+
+size_t HSIBinaryDataParameters::GetFileSize() const {
+  const size_t num_values =
+      static_cast<size_t>(num_data_rows) * num_data_cols * num_data_bands;
+  return header_offset +
+      num_values * GetDataTypeInfo(data_format.data_type).size;
+}
+
+HSIBinaryDataType GetHSIDataType(const std::string& data_type_name) {
+  HSIBinaryDataType data_type = HSI_DATA_TYPE_FLOAT;
+  if (!ParseDataTypeName(data_type_name, &data_type)) {
+    LOG(FATAL) << "Unknown data type '" << data_type_name << "'. Use 'uint8', "
+               << "'int16', 'uint16', 'int32', 'float', 'double', or "
+               << "'complex'.";
+  }
+  return data_type;
+}
+
+void ConvertHSIBinaryValues(
+    const unsigned char* data,
+    const int num_values,
+    const HSIBinaryDataFormat& data_format,
+    double* output) {
+
+  ConvertStridedHSIBinaryValues(
+      data,
+      num_values,
+      GetDataTypeInfo(data_format.data_type).size,
+      data_format,
+      output);
+}
+
+void ConvertStridedHSIBinaryValues(
+    const unsigned char* data,
+    const int num_values,
+    const size_t value_stride,
+    const HSIBinaryDataFormat& data_format,
+    double* output) {
+
+  // If endians don't match, the bytes from the file have to be reversed.
+  const bool reverse_bytes = (data_format.big_endian != IsMachineBigEndian());
+  switch (data_format.data_type) {
+    case HSI_DATA_TYPE_UINT8:
+      ConvertStridedBinaryValues<uint8_t>(
+          data, num_values, value_stride, reverse_bytes, output);
+      break;
+    case HSI_DATA_TYPE_INT16:
+      ConvertStridedBinaryValues<int16_t>(
+          data, num_values, value_stride, reverse_bytes, output);
+      break;
+    case HSI_DATA_TYPE_UINT16:
+      ConvertStridedBinaryValues<uint16_t>(
+          data, num_values, value_stride, reverse_bytes, output);
+      break;
+    case HSI_DATA_TYPE_INT32:
+      ConvertStridedBinaryValues<int32_t>(
+          data, num_values, value_stride, reverse_bytes, output);
+      break;
+    case HSI_DATA_TYPE_DOUBLE:
+      ConvertStridedBinaryValues<double>(
+          data, num_values, value_stride, reverse_bytes, output);
+      break;
+    case HSI_DATA_TYPE_COMPLEX_FLOAT:
+      ConvertStridedBinaryValues<ComplexFloat>(
+          data, num_values, value_stride, reverse_bytes, output);
+      break;
+    case HSI_DATA_TYPE_FLOAT:
+    default:
+      ConvertStridedBinaryValues<float>(
+          data, num_values, value_stride, reverse_bytes, output);
+      break;
+  }
+}
+
 // TODO: Allow a header to take place of some of the config file values (i.e.
 //       data size and format parameters) if the "header" key is given. Right
 //       now config file has to contain all of the information directly.
 void HyperspectralDataLoader::LoadImageFromENVIFile() {
+  std::string hsi_file_path;
+  HSIBinaryDataParameters parameters;
+  HSIDataRange data_range;
+  ReadConfigurationFile(&hsi_file_path, &parameters, &data_range);
+  hyperspectral_image_ = ReadBinaryFile(hsi_file_path, parameters, data_range);
+}
+
+void HyperspectralDataLoader::LoadImageFromENVIFile(
+    const cv::Rect& region, const int start_band, const int end_band) {
+
+  std::string hsi_file_path;
+  HSIBinaryDataParameters parameters;
+  HSIDataRange data_range;
+  ReadConfigurationFile(&hsi_file_path, &parameters, &data_range);
+
+  const cv::Rect configured_region(
+      0,
+      0,
+      data_range.end_col - data_range.start_col,
+      data_range.end_row - data_range.start_row);
+  CHECK_GT(region.area(), 0) << "The region must not be empty.";
+  CHECK_EQ(region & configured_region, region)
+      << "The region is outside of the configured data range.";
+  CHECK(0 <= start_band && start_band < end_band &&
+        end_band <= data_range.end_band - data_range.start_band)
+      << "The band range is outside of the configured data range.";
+
+  HSIDataRange region_range;
+  region_range.start_row = data_range.start_row + region.y;
+  region_range.end_row = region_range.start_row + region.height;
+  region_range.start_col = data_range.start_col + region.x;
+  region_range.end_col = region_range.start_col + region.width;
+  region_range.start_band = data_range.start_band + start_band;
+  region_range.end_band = data_range.start_band + end_band;
+  hyperspectral_image_ =
+      ReadBinaryFile(hsi_file_path, parameters, region_range);
+}
+
+void HyperspectralDataLoader::ReadConfigurationFile(
+    std::string* hsi_file_path,
+    HSIBinaryDataParameters* parameters,
+    HSIDataRange* data_range) const {
+
+  CHECK_NOTNULL(hsi_file_path);
+  CHECK_NOTNULL(parameters);
+  CHECK_NOTNULL(data_range);
+
   util::ConfigurationFileReader config_reader;
   config_reader.SetDelimiter(' ');
   config_reader.ReadFromFile(file_path_);
 
   // Get the path of the binary data file.
-  const std::string hsi_file_path = config_reader.GetValueOrDie("file");
-  CHECK(util::IsFile(hsi_file_path))
-      << "The HSI file path '" << hsi_file_path
+  *hsi_file_path = config_reader.GetValueOrDie("file");
+  CHECK(util::IsFile(*hsi_file_path))
+      << "The HSI file path '" << *hsi_file_path
       << "' specified in configuration file '" << file_path_
       << "' is not a valid ENVI file.";
 
   // Get all of the necessary HSI file metadata.
-  HSIBinaryDataParameters parameters;
   // Interleave format:
   const std::string interleave = config_reader.GetValueOrDie("interleave");
-  if (interleave == "bsq") {
-    parameters.data_format.interleave = HSI_BINARY_INTERLEAVE_BSQ;
-  } else {
+  if (!ParseInterleaveFormat(interleave, &parameters->data_format.interleave)) {
     LOG(FATAL) << "Unsupported interleave format: '" << interleave << "'.";
   }
   // Data type:
   const std::string data_type = config_reader.GetValueOrDie("data_type");
-  if (data_type == "float") {
-    parameters.data_format.data_type = HSI_DATA_TYPE_FLOAT;
-  } else {
+  if (!ParseDataTypeName(data_type, &parameters->data_format.data_type)) {
     LOG(FATAL) << "Unsupported data type: '" << data_type << "'.";
   }
   // Endian:
   const std::string big_endian = config_reader.GetValueOrDie("big_endian");
   if (big_endian == "true") {
-    parameters.data_format.big_endian = true;
+    parameters->data_format.big_endian = true;
   } else {
-    parameters.data_format.big_endian = false;
+    parameters->data_format.big_endian = false;
   }
   // Header offset:
   const std::string header_offset =
       config_reader.GetValueOrDie("header_offset");
-  parameters.header_offset = std::atoi(header_offset.c_str());
-  CHECK_GE(parameters.header_offset, 0)
+  parameters->header_offset = std::atoi(header_offset.c_str());
+  CHECK_GE(parameters->header_offset, 0)
       << "Header offset must be non-negative.";
   // Number of rows:
   const std::string num_data_rows =
       config_reader.GetValueOrDie("num_data_rows");
-  parameters.num_data_rows = std::atoi(num_data_rows.c_str());
-  CHECK_GT(parameters.num_data_rows, 0)
+  parameters->num_data_rows = std::atoi(num_data_rows.c_str());
+  CHECK_GT(parameters->num_data_rows, 0)
       << "Number of data rows must be positive.";
   // Number of columns:
   const std::string num_data_cols =
       config_reader.GetValueOrDie("num_data_cols");
-  parameters.num_data_cols = std::atoi(num_data_cols.c_str());
-  CHECK_GT(parameters.num_data_cols, 0)
+  parameters->num_data_cols = std::atoi(num_data_cols.c_str());
+  CHECK_GT(parameters->num_data_cols, 0)
       << "Number of data cols must be positive.";
   // Number of spectral bands:
   const std::string num_data_bands =
       config_reader.GetValueOrDie("num_data_bands");
-  parameters.num_data_bands = std::atoi(num_data_bands.c_str());
-  CHECK_GT(parameters.num_data_bands, 0)
+  parameters->num_data_bands = std::atoi(num_data_bands.c_str());
+  CHECK_GT(parameters->num_data_bands, 0)
       << "Number of data bands must be positive.";
 
   // Now get the data range parameters.
-  HSIDataRange data_range;
   // Start row:
   const std::string start_row_string = config_reader.GetValueOrDie("start_row");
-  data_range.start_row = std::atoi(start_row_string.c_str());
-  CHECK_GE(data_range.start_row, 0) << "Start row index cannot be negative.";
-  CHECK_LT(data_range.start_row, parameters.num_data_rows)
+  data_range->start_row = std::atoi(start_row_string.c_str());
+  CHECK_GE(data_range->start_row, 0) << "Start row index cannot be negative.";
+  CHECK_LT(data_range->start_row, parameters->num_data_rows)
       << "Start row index is out of bounds.";
   // End row:
   const std::string end_row_string = config_reader.GetValueOrDie("end_row");
-  data_range.end_row = std::atoi(end_row_string.c_str());
-  CHECK_GT(data_range.end_row, 0) << "End row index must be positive.";
-  CHECK_LE(data_range.end_row, parameters.num_data_rows)
+  data_range->end_row = std::atoi(end_row_string.c_str());
+  CHECK_GT(data_range->end_row, 0) << "End row index must be positive.";
+  CHECK_LE(data_range->end_row, parameters->num_data_rows)
       << "End row index is out of bounds.";
-  CHECK_GT(data_range.end_row - data_range.start_row, 0)
+  CHECK_GT(data_range->end_row - data_range->start_row, 0)
       << "Row range must be positive.";
   // Start column:
   const std::string start_col_string = config_reader.GetValueOrDie("start_col");
-  data_range.start_col = std::atoi(start_col_string.c_str());
-  CHECK_GE(data_range.start_col, 0) << "Start column index cannot be negative.";
-  CHECK_LT(data_range.start_col, parameters.num_data_cols)
+  data_range->start_col = std::atoi(start_col_string.c_str());
+  CHECK_GE(data_range->start_col, 0)
+      << "Start column index cannot be negative.";
+  CHECK_LT(data_range->start_col, parameters->num_data_cols)
       << "Start column index is out of bounds.";
   // End column:
   const std::string end_col_string = config_reader.GetValueOrDie("end_col");
-  data_range.end_col = std::atoi(end_col_string.c_str());
-  CHECK_GT(data_range.end_col, 0) << "End column index must be positive.";
-  CHECK_LE(data_range.end_col, parameters.num_data_cols)
+  data_range->end_col = std::atoi(end_col_string.c_str());
+  CHECK_GT(data_range->end_col, 0) << "End column index must be positive.";
+  CHECK_LE(data_range->end_col, parameters->num_data_cols)
       << "End column index is out of bounds.";
-  CHECK_GT(data_range.end_col - data_range.start_col, 0)
+  CHECK_GT(data_range->end_col - data_range->start_col, 0)
       << "Column range must be positive.";
   // Start band:
   const std::string start_band_string =
       config_reader.GetValueOrDie("start_band");
-  data_range.start_band = std::atoi(start_band_string.c_str());
-  CHECK_GE(data_range.start_band, 0) << "Start band index cannot be negative.";
-  CHECK_LT(data_range.start_band, parameters.num_data_bands)
+  data_range->start_band = std::atoi(start_band_string.c_str());
+  CHECK_GE(data_range->start_band, 0) << "Start band index cannot be negative.";
+  CHECK_LT(data_range->start_band, parameters->num_data_bands)
       << "Start band index is out of bounds.";
   // End band:
   const std::string end_band_string = config_reader.GetValueOrDie("end_band");
-  data_range.end_band = std::atoi(end_band_string.c_str());
-  CHECK_GT(data_range.end_band, 0) << "End band index must be positive.";
-  CHECK_LE(data_range.end_band, parameters.num_data_bands)
+  data_range->end_band = std::atoi(end_band_string.c_str());
+  CHECK_GT(data_range->end_band, 0) << "End band index must be positive.";
+  CHECK_LE(data_range->end_band, parameters->num_data_bands)
       << "End band index is out of bounds.";
-  CHECK_GT(data_range.end_band - data_range.start_band, 0)
+  CHECK_GT(data_range->end_band - data_range->start_band, 0)
       << "Band range must be positive.";
-
-  // And finally, read the data according to the parameters and range.
-  hyperspectral_image_ = ReadBinaryFile(hsi_file_path, parameters, data_range);
 }
 
 ImageData HyperspectralDataLoader::GetImage() const {
@@ -392,8 +989,37 @@ void HyperspectralDataLoader::SaveImage(
   const bool reverse_bytes =
       (binary_data_format.big_endian != machine_big_endian);
 
-  // TODO: This may change, depending on interleave format and data type.
-  WriteBinaryFileBSQ<float>(image, file_path_, reverse_bytes);
+  const HSIDataInterleaveFormat interleave = binary_data_format.interleave;
+  switch (binary_data_format.data_type) {
+    case HSI_DATA_TYPE_UINT8:
+      WriteBinaryFile<uint8_t>(image, file_path_, interleave, reverse_bytes);
+      break;
+    case HSI_DATA_TYPE_INT16:
+      WriteBinaryFile<int16_t>(image, file_path_, interleave, reverse_bytes);
+      break;
+    case HSI_DATA_TYPE_UINT16:
+      WriteBinaryFile<uint16_t>(image, file_path_, interleave, reverse_bytes);
+      break;
+    case HSI_DATA_TYPE_INT32:
+      WriteBinaryFile<int32_t>(image, file_path_, interleave, reverse_bytes);
+      break;
+    case HSI_DATA_TYPE_DOUBLE:
+      WriteBinaryFile<double>(image, file_path_, interleave, reverse_bytes);
+      break;
+    case HSI_DATA_TYPE_COMPLEX_FLOAT:
+      WriteBinaryFile<ComplexFloat>(
+          image, file_path_, interleave, reverse_bytes);
+      break;
+    case HSI_DATA_TYPE_FLOAT:
+    default:
+      WriteBinaryFile<float>(image, file_path_, interleave, reverse_bytes);
+      break;
+  }
+  WriteHeaderAndConfigFiles(
+      file_path_,
+      image.GetImageSize(),
+      image.GetNumChannels(),
+      binary_data_format);
 }
 
 }  // namespace super_resolution
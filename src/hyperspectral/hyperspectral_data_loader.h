@@ -3,6 +3,7 @@
 #ifndef SRC_HYPERSPECTRAL_HYPERSPECTRAL_DATA_LOADER_H_
 #define SRC_HYPERSPECTRAL_HYPERSPECTRAL_DATA_LOADER_H_
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -13,8 +14,6 @@ namespace super_resolution {
 // The possible formats of the hyperspectral image data to be loaded. Binary
 // formats do not specify any information other than the data itself, so header
 // information must be provided separately.
-//
-// TODO: Add support for BIP and BIL binary formats.
 enum HSIDataInterleaveFormat {
   // BSQ (band sequential) is a binary data format organized in order of
   // bands(rows(cols)). For example, for a file with 2 bands, 2 rows, and 2
@@ -27,15 +26,57 @@ enum HSIDataInterleaveFormat {
   //   b1,r0,c1
   //   b1,r1,c0
   //   b1,r1,c1
-  HSI_BINARY_INTERLEAVE_BSQ
+  HSI_BINARY_INTERLEAVE_BSQ,
+
+  // BIL (band interleaved by line) is organized in order of rows(bands(cols)).
+  // For the same example, the order would be:
+  //   r0,b0,c0
+  //   r0,b0,c1
+  //   r0,b1,c0
+  //   r0,b1,c1
+  //   r1,b0,c0
+  //   ...
+  HSI_BINARY_INTERLEAVE_BIL,
+
+  // BIP (band interleaved by pixel) is organized in order of rows(cols(bands)),
+  // so the full spectrum of each pixel is stored contiguously:
+  //   r0,c0,b0
+  //   r0,c0,b1
+  //   r0,c1,b0
+  //   r0,c1,b1
+  //   r1,c0,b0
+  //   ...
+  HSI_BINARY_INTERLEAVE_BIP
 };
 
 // The data type dictates how the binary HSI data is stored (e.g. as doubles,
-// floats, unsigned ints, etc.).
-//
-// TODO: Add support for other data types.
+// floats, unsigned ints, etc.). The ENVI header "data type" code of each type
+// is given in parentheses. Values of all types are converted to double
+// precision when the data is read.
 enum HSIBinaryDataType {
-  HSI_DATA_TYPE_FLOAT
+  // 32-bit floating point (4).
+  HSI_DATA_TYPE_FLOAT,
+
+  // 8-bit unsigned integer (1).
+  HSI_DATA_TYPE_UINT8,
+
+  // 16-bit signed integer (2).
+  HSI_DATA_TYPE_INT16,
+
+  // 16-bit unsigned integer (12).
+  HSI_DATA_TYPE_UINT16,
+
+  // 32-bit signed integer (3).
+  HSI_DATA_TYPE_INT32,
+
+  // 64-bit floating point (5).
+  HSI_DATA_TYPE_DOUBLE,
+
+  // Pair of 32-bit floating point values with the real part first (6). Images
+  // are written as the real part with a zero imaginary part. Since images are
+  // real-valued, values with a zero imaginary part are read as their (signed)
+  // real part, and all other values as their magnitude.
+  HSI_DATA_TYPE_COMPLEX_FLOAT
 };
 
 // Defines the formatting of the binary data file. This is used for reading and
@@ -46,6 +87,11 @@ struct HSIBinaryDataFormat {
   bool big_endian = false;
 };
 
+// Returns the data type with the given configuration file name: "uint8",
+// "int16", "uint16", "int32", "float", "double", or "complex". An error will
+// occur if the name is unknown.
+HSIBinaryDataType GetHSIDataType(const std::string& data_type_name);
+
 // Specifies parameters for reading binary HSI data. This information can
 // either be specified manually (or through a configuration file), or by
 // reading a header file provided with the HSI binary data.
@@ -59,10 +105,19 @@ struct HSIBinaryDataParameters {
   // TODO: Implement.
   void ReadHeaderFromFile(const std::string& header_file_path);
 
+  // Returns the position of the value at the given row, column, and band in
+  // the data file, in bytes from the start of the file (including the header
+  // offset).
+  size_t GetValueOffset(const int row, const int col, const int band) const;
+
+  // Returns the minimum size of the data file in bytes, including the header.
+  size_t GetFileSize() const;
+
   // The format and type of the data.
   HSIBinaryDataFormat data_format;
 
-  // Offset of the header (if there is a header directly attached to the data).
+  // Offset of the header in bytes (if there is a header directly attached to
+  // the data). The data starts immediately after the header.
   int header_offset = 0;
 
   // The size of the data. This is NOT the size of the chunk of data you want
@@ -73,6 +128,35 @@ struct HSIBinaryDataParameters {
   int num_data_bands = 0;
 };
 
+// The part of a binary HSI file that is read. Start indices are inclusive and
+// end indices are exclusive.
+struct HSIDataRange {
+  int start_row = 0;
+  int start_col = 0;
+  int end_row = 0;
+  int end_col = 0;
+  int start_band = 0;
+  int end_band = 0;
+};
+
+// Converts num_values consecutive values from a binary HSI file, stored in the
+// given data format, into doubles. The data does not need to be aligned.
+void ConvertHSIBinaryValues(
+    const unsigned char* data,
+    const int num_values,
+    const HSIBinaryDataFormat& data_format,
+    double* output);
+
+// Same as ConvertHSIBinaryValues(), but consecutive values are value_stride
+// bytes apart in the data (e.g. the values of one band for consecutive pixels
+// of a BIP file). The data type is dispatched once for all of the values.
+void ConvertStridedHSIBinaryValues(
+    const unsigned char* data,
+    const int num_values,
+    const size_t value_stride,
+    const HSIBinaryDataFormat& data_format,
+    double* output);
+
 class HyperspectralDataLoader {
  public:
   // The given file path can serve two potential purposes:
@@ -92,6 +176,22 @@ class HyperspectralDataLoader {
   // parameters.
   void LoadImageFromENVIFile();
 
+  // Same as LoadImageFromENVIFile(), but only reads the given spatial region
+  // and the bands in [start_band, end_band) of the data range given in the
+  // configuration file. The region and bands are relative to that range, and
+  // they must be inside of it. Values outside of them are not read.
+  void LoadImageFromENVIFile(
+      const cv::Rect& region, const int start_band, const int end_band);
+
+  // Reads the configuration file given to the constructor without reading any
+  // of the data. Sets the path of the binary data file, the format and size of
+  // the data, and the range of the data to be read. An error will occur if the
+  // configuration file is missing any values or if they are invalid.
+  void ReadConfigurationFile(
+      std::string* hsi_file_path,
+      HSIBinaryDataParameters* parameters,
+      HSIDataRange* data_range) const;
+
   // Returns the ImageData object containing the hyperspectral image data. The
   // image will be empty if one of the LoadData methods was never called.
   ImageData GetImage() const;
@@ -106,14 +206,16 @@ class HyperspectralDataLoader {
   // The configuration file may need to be modified with an absolute path if
   // the given file_path_ is a relative path.
   //
-  // The file formatting is dictated by the given HSIBinaryDataFormat.
+  // The file formatting is dictated by the given HSIBinaryDataFormat. When
+  // saving as an integer data type, values are rounded to the nearest integer
+  // and clamped to the range of the type.
   void SaveImage(
       const ImageData& image,
       const HSIBinaryDataFormat& binary_data_format) const;
 
  private:
   // The name of the data file to be loaded.
-  const std::string& file_path_;
+  const std::string file_path_;
 
   // The data is stored in an ImageData container.
   ImageData hyperspectral_image_;
@@ -0,0 +1,170 @@
+#include "hyperspectral/lazy_hyperspectral_image.h"
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hyperspectral/hyperspectral_data_loader.h"
+#include "image/image_data.h"
+#include "util/matrix_util.h"
+#include "util/memory_mapped_file.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+
+LazyHyperspectralImage::LazyHyperspectralImage(
+    const std::string& config_file_path, const size_t cache_size_bytes)
+    : cache_size_bytes_(cache_size_bytes) {
+
+  std::string hsi_file_path;
+  const HyperspectralDataLoader hs_data_loader(config_file_path);
+  hs_data_loader.ReadConfigurationFile(
+      &hsi_file_path, &parameters_, &data_range_);
+  image_size_ = cv::Size(
+      data_range_.end_col - data_range_.start_col,
+      data_range_.end_row - data_range_.start_row);
+
+  hsi_file_.reset(new util::MemoryMappedFile(hsi_file_path));
+  CHECK_GE(hsi_file_->GetSize(), parameters_.GetFileSize())
+      << "File '" << hsi_file_path
+      << "' is smaller than the specified data size.";
+}
+
+cv::Mat LazyHyperspectralImage::GetChannelImage(const int index) const {
+  CHECK_GE(index, 0) << "Channel index must be non-negative.";
+  CHECK_LT(index, GetNumChannels()) << "Channel index is out of bounds.";
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    const cv::Mat cached_channel_image = FindCachedChannelImage(index);
+    if (!cached_channel_image.empty()) {
+      return cached_channel_image;
+    }
+  }
+
+  // Read the band without holding the lock so that other bands can be read in
+  // parallel. If another thread read the same band in the meantime, its copy
+  // is used instead.
+  const cv::Mat channel_image = ReadChannelImage(index);
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  const cv::Mat cached_channel_image = FindCachedChannelImage(index);
+  if (!cached_channel_image.empty()) {
+    return cached_channel_image;
+  }
+  const size_t channel_size = channel_image.total() * channel_image.elemSize();
+  while (!cached_channel_indices_.empty() &&
+         num_cached_bytes_ + channel_size > cache_size_bytes_) {
+    const int evicted_index = cached_channel_indices_.back();
+    const cv::Mat& evicted_channel_image =
+        cached_channels_.at(evicted_index).first;
+    num_cached_bytes_ -=
+        evicted_channel_image.total() * evicted_channel_image.elemSize();
+    cached_channels_.erase(evicted_index);
+    cached_channel_indices_.pop_back();
+  }
+  cached_channel_indices_.push_front(index);
+  cached_channels_[index] =
+      std::make_pair(channel_image, cached_channel_indices_.begin());
+  num_cached_bytes_ += channel_size;
+  return channel_image;
+}
+
+void LazyHyperspectralImage::GetSpectralVector(
+    const int pixel_index, double* spectral_vector) const {
+
+  CHECK_NOTNULL(spectral_vector);
+  CHECK_GE(pixel_index, 0) << "Pixel index must be non-negative.";
+  CHECK_LT(pixel_index, GetNumPixels()) << "Pixel index is out of bounds.";
+  const int row = data_range_.start_row + pixel_index / image_size_.width;
+  const int col = data_range_.start_col + pixel_index % image_size_.width;
+  const unsigned char* data = hsi_file_->GetData();
+  if (parameters_.data_format.interleave == HSI_BINARY_INTERLEAVE_BIP) {
+    // The bands of each pixel are contiguous.
+    ConvertHSIBinaryValues(
+        data + parameters_.GetValueOffset(row, col, data_range_.start_band),
+        GetNumChannels(),
+        parameters_.data_format,
+        spectral_vector);
+    return;
+  }
+  // Otherwise the bands of the pixel are a constant number of bytes apart.
+  const size_t band_offset =
+      parameters_.GetValueOffset(row, col, data_range_.start_band);
+  const size_t band_stride =
+      parameters_.GetValueOffset(row, col, data_range_.start_band + 1) -
+      band_offset;
+  ConvertStridedHSIBinaryValues(
+      data + band_offset,
+      GetNumChannels(),
+      band_stride,
+      parameters_.data_format,
+      spectral_vector);
+}
+
+ImageData LazyHyperspectralImage::GetImage() const {
+  const int num_channels = GetNumChannels();
+  std::vector<cv::Mat> channel_images(num_channels);
+  util::ParallelFor(num_channels, [&](const int index) {
+    {
+      std::lock_guard<std::mutex> lock(cache_mutex_);
+      channel_images[index] = FindCachedChannelImage(index);
+    }
+    if (channel_images[index].empty()) {
+      channel_images[index] = ReadChannelImage(index);
+    }
+  });
+  ImageData image;
+  for (cv::Mat& channel_image : channel_images) {
+    image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
+    channel_image.release();
+  }
+  return image;
+}
+
+size_t LazyHyperspectralImage::GetNumCachedBytes() const {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  return num_cached_bytes_;
+}
+
+cv::Mat LazyHyperspectralImage::ReadChannelImage(const int index) const {
+  const int band = data_range_.start_band + index;
+  const unsigned char* data = hsi_file_->GetData();
+  // BSQ and BIL store the columns of each band row contiguously. BIP stores
+  // them a whole spectral vector apart. Either way, each row of the channel is
+  // converted with a single call, so the data type is only dispatched once per
+  // row.
+  const size_t column_stride =
+      parameters_.GetValueOffset(0, 1, band) -
+      parameters_.GetValueOffset(0, 0, band);
+  cv::Mat channel_image(image_size_, util::kOpenCvMatrixType);
+  for (int row = 0; row < image_size_.height; ++row) {
+    const int data_row = data_range_.start_row + row;
+    ConvertStridedHSIBinaryValues(
+        data + parameters_.GetValueOffset(
+            data_row, data_range_.start_col, band),
+        image_size_.width,
+        column_stride,
+        parameters_.data_format,
+        channel_image.ptr<double>(row));
+  }
+  return channel_image;
+}
+
+cv::Mat LazyHyperspectralImage::FindCachedChannelImage(const int index) const {
+  const auto cached_channel = cached_channels_.find(index);
+  if (cached_channel == cached_channels_.end()) {
+    return cv::Mat();
+  }
+  // Move the band to the front of the list (most recently used).
+  cached_channel_indices_.splice(
+      cached_channel_indices_.begin(),
+      cached_channel_indices_,
+      cached_channel->second.second);
+  return cached_channel->second.first;
+}
+
+}  // namespace super_resolution
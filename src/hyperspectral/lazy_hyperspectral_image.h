@@ -0,0 +1,118 @@
+// A hyperspectral image that is read from a binary ENVI file on demand. Unlike
+// HyperspectralDataLoader, which reads every band in the configured range up
+// front, the data file stays memory mapped and each band is only converted
+// when it is first accessed. Converted bands are kept in a least recently used
+// (LRU) cache limited to a given number of bytes, so the memory used scales
+// with the bands that are actually needed rather than with the file size.
+//
+// Spectral vectors can also be read directly from the file without converting
+// entire bands (e.g. for sampling pixels to train SpectralPCA).
+//
+// Use as follows:
+//   const LazyHyperspectralImage image(config_file_path, cache_size_bytes);
+//   const cv::Mat band = image.GetChannelImage(band_index);
+
+#ifndef SRC_HYPERSPECTRAL_LAZY_HYPERSPECTRAL_IMAGE_H_
+#define SRC_HYPERSPECTRAL_LAZY_HYPERSPECTRAL_IMAGE_H_
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "hyperspectral/hyperspectral_data_loader.h"
+#include "image/image_data.h"
+#include "util/memory_mapped_file.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+// The default maximum number of bytes of converted bands held in memory.
+constexpr size_t kDefaultBandCacheSizeBytes = 1024 * 1024 * 1024;
+
+class LazyHyperspectralImage {
+ public:
+  // Maps the data file described by the given configuration file (see
+  // HyperspectralDataLoader for the format). No data is read until it is
+  // accessed. At most cache_size_bytes of converted bands are held in memory
+  // at a time, except that the most recently accessed band is always kept
+  // even if it alone exceeds the budget.
+  explicit LazyHyperspectralImage(
+      const std::string& config_file_path,
+      const size_t cache_size_bytes = kDefaultBandCacheSizeBytes);
+
+  // The file mapping and band cache are owned by this object, so it cannot be
+  // copied.
+  LazyHyperspectralImage(const LazyHyperspectralImage&) = delete;
+  LazyHyperspectralImage& operator=(const LazyHyperspectralImage&) = delete;
+
+  // Returns the size of each band in the configured data range.
+  cv::Size GetImageSize() const {
+    return image_size_;
+  }
+
+  // Returns the number of bands in the configured data range.
+  int GetNumChannels() const {
+    return data_range_.end_band - data_range_.start_band;
+  }
+
+  // Returns the number of pixels in each band.
+  int GetNumPixels() const {
+    return image_size_.width * image_size_.height;
+  }
+
+  // Returns the band at the given index (relative to the start of the
+  // configured band range) as a double-precision matrix. The band is read from
+  // the file if it is not cached. The returned matrix shares its data with the
+  // cache, so it must not be modified. It remains valid even after the band is
+  // evicted from the cache. This method is thread safe.
+  cv::Mat GetChannelImage(const int index) const;
+
+  // Reads the spectral vector of the given pixel directly from the file into
+  // the given array, which must hold GetNumChannels() values. Pixels are
+  // indexed in row-major order as in ImageData. This does not use the cache.
+  void GetSpectralVector(const int pixel_index, double* spectral_vector) const;
+
+  // Reads every band into an ImageData object. Bands that are already cached
+  // are copied from the cache, but the bands that are read are not added to
+  // it.
+  ImageData GetImage() const;
+
+  // Returns the number of bytes of converted bands currently in the cache.
+  size_t GetNumCachedBytes() const;
+
+ private:
+  // Reads and converts the given band from the file.
+  cv::Mat ReadChannelImage(const int index) const;
+
+  // Returns the given band if it is cached (marking it as most recently used),
+  // or an empty matrix otherwise. cache_mutex_ must be held by the caller.
+  cv::Mat FindCachedChannelImage(const int index) const;
+
+  // The mapped binary data file.
+  std::unique_ptr<util::MemoryMappedFile> hsi_file_;
+
+  // The format and size of the data in the file, and the part of it that makes
+  // up this image.
+  HSIBinaryDataParameters parameters_;
+  HSIDataRange data_range_;
+  cv::Size image_size_;
+
+  // The LRU band cache. The list holds the cached band indices from most to
+  // least recently used, and the map holds each cached band along with its
+  // position in the list.
+  const size_t cache_size_bytes_;
+  mutable std::mutex cache_mutex_;
+  mutable std::list<int> cached_channel_indices_;
+  mutable std::unordered_map<
+      int, std::pair<cv::Mat, std::list<int>::iterator>> cached_channels_;
+  mutable size_t num_cached_bytes_ = 0;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_HYPERSPECTRAL_LAZY_HYPERSPECTRAL_IMAGE_H_
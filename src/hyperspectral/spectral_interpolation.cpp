@@ -0,0 +1,216 @@
+#include "hyperspectral/spectral_interpolation.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "image/image_data.h"
+#include "util/matrix_util.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Every band gets at least this fraction of the mean curvature as its weight
+// when placing key bands by curvature, so that flat parts of the spectrum
+// still get some key bands.
+constexpr double kMinCurvatureWeightFraction = 0.1;
+
+// Returns the given channel of the image in double precision.
+cv::Mat GetDoubleChannelImage(const ImageData& image, const int channel) {
+  cv::Mat channel_image;
+  image.GetChannelImage(channel).convertTo(
+      channel_image, util::kOpenCvMatrixType);
+  return channel_image;
+}
+
+// Returns the uniformly spaced key bands.
+std::vector<int> SelectUniformKeyBands(
+    const int num_bands, const int band_step) {
+
+  std::vector<int> key_bands;
+  for (int band = 0; band < num_bands - 1; band += band_step) {
+    key_bands.push_back(band);
+  }
+  key_bands.push_back(num_bands - 1);
+  return key_bands;
+}
+
+// Returns num_key_bands key bands spaced evenly by the cumulative spectral
+// curvature (the mean absolute second difference across the bands).
+std::vector<int> SelectKeyBandsByCurvature(
+    const ImageData& image, const int num_key_bands) {
+
+  const int num_bands = image.GetNumChannels();
+  std::vector<double> curvatures(num_bands, 0.0);
+  util::ParallelFor(num_bands - 2, [&](const int i) {
+    const int band = i + 1;
+    const cv::Mat second_difference =
+        GetDoubleChannelImage(image, band - 1) -
+        2 * GetDoubleChannelImage(image, band) +
+        GetDoubleChannelImage(image, band + 1);
+    curvatures[band] = cv::norm(second_difference, cv::NORM_L1) /
+        image.GetNumPixels();
+  });
+  double mean_curvature = 0.0;
+  for (const double curvature : curvatures) {
+    mean_curvature += curvature / num_bands;
+  }
+  const double min_weight =
+      std::max(kMinCurvatureWeightFraction * mean_curvature, 1.0e-12);
+  std::vector<double> cumulative_weights(num_bands);
+  double total_weight = 0.0;
+  for (int band = 0; band < num_bands; ++band) {
+    total_weight += std::max(curvatures[band], min_weight);
+    cumulative_weights[band] = total_weight;
+  }
+
+  // The first and last bands are always included.
+  std::vector<int> key_bands = {0};
+  for (int i = 1; i < num_key_bands - 1; ++i) {
+    const double target_weight = total_weight * i / (num_key_bands - 1);
+    const int band = std::lower_bound(
+        cumulative_weights.begin(),
+        cumulative_weights.end(),
+        target_weight) - cumulative_weights.begin();
+    if (band > key_bands.back() && band < num_bands - 1) {
+      key_bands.push_back(band);
+    }
+  }
+  key_bands.push_back(num_bands - 1);
+  return key_bands;
+}
+
+}  // namespace
+
+std::vector<int> SelectKeyBands(
+    const ImageData& image, const KeyBandOptions& options) {
+
+  const int num_bands = image.GetNumChannels();
+  CHECK_GT(num_bands, 0) << "Cannot select key bands of an empty image.";
+  if (options.band_step <= 1 || num_bands <= 2) {
+    std::vector<int> all_bands(num_bands);
+    for (int band = 0; band < num_bands; ++band) {
+      all_bands[band] = band;
+    }
+    return all_bands;
+  }
+  const std::vector<int> uniform_key_bands =
+      SelectUniformKeyBands(num_bands, options.band_step);
+  if (!options.select_by_curvature) {
+    return uniform_key_bands;
+  }
+  return SelectKeyBandsByCurvature(image, uniform_key_bands.size());
+}
+
+std::vector<int> GetSkippedBands(
+    const int num_bands, const std::vector<int>& key_bands) {
+
+  std::vector<bool> is_key_band(num_bands, false);
+  for (const int band : key_bands) {
+    CHECK(band >= 0 && band < num_bands) << "Invalid key band " << band << ".";
+    is_key_band[band] = true;
+  }
+  std::vector<int> skipped_bands;
+  for (int band = 0; band < num_bands; ++band) {
+    if (!is_key_band[band]) {
+      skipped_bands.push_back(band);
+    }
+  }
+  return skipped_bands;
+}
+
+ImageData SelectBands(const ImageData& image, const std::vector<int>& bands) {
+  ImageData band_image;
+  for (const int band : bands) {
+    band_image.AddChannel(image.GetChannelImage(band), DO_NOT_NORMALIZE_IMAGE);
+  }
+  band_image.SetSpectralMode(SPECTRAL_MODE_HYPERSPECTRAL);
+  return band_image;
+}
+
+void ReplaceBands(
+    const ImageData& band_image,
+    const std::vector<int>& bands,
+    ImageData* image) {
+
+  CHECK_NOTNULL(image);
+  CHECK_EQ(band_image.GetNumChannels(), bands.size())
+      << "There must be one channel per replaced band.";
+  CHECK_EQ(band_image.GetImageSize(), image->GetImageSize())
+      << "The image sizes do not match.";
+  for (int i = 0; i < bands.size(); ++i) {
+    // The channel images share their data with the image.
+    cv::Mat channel_image = image->GetChannelImage(bands[i]);
+    band_image.GetChannelImage(i).convertTo(
+        channel_image, channel_image.type());
+  }
+}
+
+ImageData InterpolateSkippedBands(
+    const ImageData& key_band_image,
+    const std::vector<int>& key_bands,
+    const ImageData& upsampled_image) {
+
+  const int num_key_bands = key_bands.size();
+  const int num_bands = upsampled_image.GetNumChannels();
+  CHECK_GT(num_key_bands, 0) << "At least one key band is required.";
+  CHECK_EQ(key_band_image.GetNumChannels(), num_key_bands)
+      << "There must be one channel per key band.";
+  CHECK_EQ(key_band_image.GetImageSize(), upsampled_image.GetImageSize())
+      << "The upsampled image must be the size of the key band image.";
+  for (int i = 0; i < num_key_bands; ++i) {
+    CHECK(key_bands[i] >= 0 && key_bands[i] < num_bands)
+        << "Invalid key band " << key_bands[i] << ".";
+    CHECK(i == 0 || key_bands[i] > key_bands[i - 1])
+        << "Key bands must be sorted and unique.";
+  }
+
+  // The detail that super-resolution added to each key band.
+  std::vector<cv::Mat> key_band_details(num_key_bands);
+  util::ParallelFor(num_key_bands, [&](const int i) {
+    key_band_details[i] =
+        GetDoubleChannelImage(key_band_image, i) -
+        GetDoubleChannelImage(upsampled_image, key_bands[i]);
+  });
+
+  std::vector<cv::Mat> channel_images(num_bands);
+  util::ParallelFor(num_bands, [&](const int band) {
+    // Find the first key band after this band.
+    const int next_index = std::upper_bound(
+        key_bands.begin(), key_bands.end(), band) - key_bands.begin();
+    const int previous_index = next_index - 1;
+    if (previous_index >= 0 && key_bands[previous_index] == band) {
+      channel_images[band] =
+          GetDoubleChannelImage(key_band_image, previous_index);
+      return;
+    }
+    cv::Mat detail;
+    if (previous_index < 0) {
+      detail = key_band_details[next_index];
+    } else if (next_index >= num_key_bands) {
+      detail = key_band_details[previous_index];
+    } else {
+      const double t =
+          static_cast<double>(band - key_bands[previous_index]) /
+          (key_bands[next_index] - key_bands[previous_index]);
+      detail = (1.0 - t) * key_band_details[previous_index] +
+          t * key_band_details[next_index];
+    }
+    channel_images[band] =
+        GetDoubleChannelImage(upsampled_image, band) + detail;
+  });
+
+  ImageData image;
+  for (cv::Mat& channel_image : channel_images) {
+    image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
+    channel_image.release();
+  }
+  image.SetSpectralMode(SPECTRAL_MODE_HYPERSPECTRAL);
+  return image;
+}
+
+}  // namespace super_resolution
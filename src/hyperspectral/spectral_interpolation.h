@@ -0,0 +1,71 @@
+// Provides tools for super-resolving only a subset of the bands of a
+// hyperspectral image (the key bands) and interpolating the rest.
+//
+// Neighboring bands of hyperspectral images (especially FT-IR) are highly
+// correlated, so most of the high-resolution detail recovered for one band
+// also applies to its neighbors. The skipped bands are reconstructed from
+// their own upsampled low-resolution observations plus the detail that
+// super-resolution added to the nearest key bands, interpolated across the
+// spectrum:
+//   HR(b) = U(b) + (1 - t) * (HR(b0) - U(b0)) + t * (HR(b1) - U(b1))
+// where U is the upsampled low-resolution image, b0 < b < b1 are the nearest
+// key bands, and t = (b - b0) / (b1 - b0).
+//
+// Use as follows:
+//   const std::vector<int> key_bands = SelectKeyBands(low_res_image, options);
+//   const ImageData key_band_result = solver.Solve(...);  // Key bands only.
+//   const ImageData result = InterpolateSkippedBands(
+//       key_band_result, key_bands, upsampled_image);
+
+#ifndef SRC_HYPERSPECTRAL_SPECTRAL_INTERPOLATION_H_
+#define SRC_HYPERSPECTRAL_SPECTRAL_INTERPOLATION_H_
+
+#include <vector>
+
+#include "image/image_data.h"
+
+namespace super_resolution {
+
+// Options for choosing the key bands.
+struct KeyBandOptions {
+  // Roughly every band_step-th band is a key band. The first and last bands
+  // are always key bands. If this is 1 or less, every band is a key band.
+  int band_step = 4;
+
+  // If true, the same number of key bands are placed according to the
+  // spectral curvature instead of uniformly, so that bands where the spectra
+  // bend sharply (e.g. absorption peaks) are sampled more densely.
+  bool select_by_curvature = false;
+};
+
+// Returns the (sorted) indices of the key bands of the given image.
+std::vector<int> SelectKeyBands(
+    const ImageData& image, const KeyBandOptions& options);
+
+// Returns the (sorted) indices of the bands that are not key bands.
+std::vector<int> GetSkippedBands(
+    const int num_bands, const std::vector<int>& key_bands);
+
+// Returns an image that contains only the given bands of the given image, in
+// the given order.
+ImageData SelectBands(const ImageData& image, const std::vector<int>& bands);
+
+// Overwrites the given bands of the image with the channels of band_image (in
+// the same order). The sizes of the images must match.
+void ReplaceBands(
+    const ImageData& band_image,
+    const std::vector<int>& bands,
+    ImageData* image);
+
+// Returns the full image reconstructed from the super-resolved key bands (see
+// the description above). The upsampled_image has all of the bands at the
+// size of the key band image, and its key bands are replaced by the
+// super-resolved ones.
+ImageData InterpolateSkippedBands(
+    const ImageData& key_band_image,
+    const std::vector<int>& key_bands,
+    const ImageData& upsampled_image);
+
+}  // namespace super_resolution
+
+#endif  // SRC_HYPERSPECTRAL_SPECTRAL_INTERPOLATION_H_
@@ -1,10 +1,17 @@
 #include "hyperspectral/spectral_pca.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
 #include <vector>
 
+#include "hyperspectral/lazy_hyperspectral_image.h"
 #include "image/image_data.h"
 #include "util/matrix_util.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
 
@@ -17,24 +24,60 @@ namespace {
 constexpr bool kForwardProjectionFlag = true;
 constexpr bool kBackProjectionFlag = false;
 
+// The number of pixels projected at a time by ConvertImage(). Each tile of
+// spectral vectors is converted with one matrix multiplication.
+constexpr int kProjectionTileSize = 1024;
+
+// Identifies PCA basis files (and the version of the format).
+constexpr char kPCABasisMagic[8] = {'S', 'R', 'P', 'C', 'A', '0', '0', '1'};
+
+// Written in native byte order, so a reader on a machine with a different
+// byte order can detect the mismatch.
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// The header at the start of every PCA basis file. It is followed by the mean
+// (num_spectral_bands values), the eigenvalues (num_pca_bands values), and the
+// eigenvectors (num_pca_bands rows of num_spectral_bands values), all stored
+// as doubles.
+struct PCABasisHeader {
+  char magic[8];
+  uint32_t byte_order_mark;
+  int32_t num_spectral_bands;
+  int32_t num_pca_bands;
+  int32_t reserved;  // Pads the header to a multiple of 8 bytes.
+  uint64_t source_fingerprint;
+  double explained_variance_ratio;
+};
+
 // The multiplication factor for the number of PCA samples to train on. If
 // there there are N dimensions in the data, PCA will be trained on 10*N
 // samples, or as many as are available.
 constexpr int kPCASamplesMultiplicationFactor = 10;
 
-// Returns the data from the given images (one or more required) in
-// pixel-vector form. That is, instead of the images being organized by
-// channel, each row of the returned matrix will be a pixel, and the columns
-// span the different channels. The number of rows is the total number of
-// pixels across all images.
-cv::Mat GetPCAInputData(const std::vector<ImageData>& hyperspectral_images) {
+// The number of pixels whose spectral vectors are added to the covariance at
+// a time by the streaming covariance training.
+constexpr int kCovarianceTileSize = 4096;
+
+// The number of partial covariance accumulators that the pixel tiles are
+// distributed over for parallel processing. This is fixed (instead of one per
+// thread) so that the result does not depend on the number of threads.
+constexpr int kNumCovariancePartitions = 16;
+
+// The seed of the random starting basis for randomized PCA training.
+constexpr uint64_t kRandomizedPCASeed = 0x5eed;
+
+// Checks that the given images (one or more required) can be used for PCA
+// training and returns their number of channels.
+template <typename ImageType>
+int GetNumTrainingChannels(
+    const std::vector<const ImageType*>& hyperspectral_images) {
   CHECK(!hyperspectral_images.empty())
       << "At least one image is required to compute the PCA basis.";
 
   // Make sure we have the right number of channels. Also it does not make
   // sense to do this on non-hyperspectral images, so warn the user if that's
   // the case.
-  const int num_channels = hyperspectral_images[0].GetNumChannels();
+  const int num_channels = hyperspectral_images[0]->GetNumChannels();
   CHECK_GT(num_channels, 0) << "Cannot compute PCA on empty images.";
   if (num_channels <= 3) {
     LOG(WARNING)
@@ -42,8 +85,29 @@ cv::Mat GetPCAInputData(const std::vector<ImageData>& hyperspectral_images) {
         << "(3 or fewer channels). PCA decomposition may not be "
         << "useful or applicable here.";
   }
+  for (const ImageType* image : hyperspectral_images) {
+    CHECK_EQ(image->GetNumChannels(), num_channels)
+        << "Inconsistent number of channels between the given images. "
+        << "Cannot perform PCA.";
+  }
+  return num_channels;
+}
+
+// Returns the data from the given images (one or more required) in
+// pixel-vector form. That is, instead of the images being organized by
+// channel, each row of the returned matrix will be a pixel, and the columns
+// span the different channels. The number of rows is the total number of
+// pixels across all images.
+//
+// ImageType can be ImageData or LazyHyperspectralImage. Only the sampled
+// spectral vectors are accessed, so lazily loaded images are never read in
+// full.
+template <typename ImageType>
+cv::Mat GetPCAInputData(
+    const std::vector<const ImageType*>& hyperspectral_images) {
+  const int num_channels = GetNumTrainingChannels(hyperspectral_images);
   const int num_images = hyperspectral_images.size();
-  const int num_pixels = hyperspectral_images[0].GetNumPixels();
+  const int num_pixels = hyperspectral_images[0]->GetNumPixels();
 
   // Compute the number of samples (data points) to use per image. This is for
   // subsampling the data, and cannot exceed the number of pixels available.
@@ -70,23 +134,486 @@ cv::Mat GetPCAInputData(const std::vector<ImageData>& hyperspectral_images) {
   // Format the input data as pixel vectors for PCA.
   cv::Mat input_data(num_data_points, num_channels, util::kOpenCvMatrixType);
   for (int image_index = 0; image_index < num_images; ++image_index) {
-    const ImageData& image = hyperspectral_images[image_index];
-    CHECK_EQ(image.GetNumChannels(), num_channels)
-        << "Inconsistent number of channels between the given images. "
-        << "Cannot perform PCA.";
-    // TODO: Faster to use cv::ROI and unfold the channel matrices that way.
-    for (int channel_index = 0; channel_index < num_channels; ++channel_index) {
-      for (int sample = 0; sample < num_samples_per_image; ++sample) {
-        const int data_row = image_index * num_samples_per_image + sample;
-        const int pixel_index = sample * num_pixels_to_skip;
-        input_data.at<double>(data_row, channel_index) =
-            image.GetPixelValue(channel_index, pixel_index);
-      }
+    const ImageType& image = *hyperspectral_images[image_index];
+    for (int sample = 0; sample < num_samples_per_image; ++sample) {
+      const int data_row = image_index * num_samples_per_image + sample;
+      const int pixel_index = sample * num_pixels_to_skip;
+      image.GetSpectralVector(pixel_index, input_data.ptr<double>(data_row));
     }
   }
   return input_data;
 }
 
+// Copies the pixel-major spectral vectors of the pixels in the range
+// [pixel_start, pixel_start + num_pixels) of the given image into the given
+// array (see ImageData::GatherSpectralVectors()).
+void GatherSpectralVectors(
+    const ImageData& image,
+    const int pixel_start,
+    const int num_pixels,
+    double* spectral_vectors) {
+
+  image.GatherSpectralVectors(pixel_start, num_pixels, spectral_vectors);
+}
+void GatherSpectralVectors(
+    const LazyHyperspectralImage& image,
+    const int pixel_start,
+    const int num_pixels,
+    double* spectral_vectors) {
+
+  const int num_channels = image.GetNumChannels();
+  for (int i = 0; i < num_pixels; ++i) {
+    image.GetSpectralVector(
+        pixel_start + i, spectral_vectors + i * num_channels);
+  }
+}
+
+// Accumulates the mean and the scatter matrix (the sum of the outer products
+// of the deviations from the mean) of a stream of spectral vectors. Blocks of
+// samples and partial results are combined with the pairwise update of Chan et
+// al., which generalizes Welford's algorithm and is similarly stable.
+struct CovarianceAccumulator {
+  explicit CovarianceAccumulator(const int num_channels)
+      : mean(cv::Mat::zeros(1, num_channels, util::kOpenCvMatrixType)),
+        scatter(cv::Mat::zeros(
+            num_channels, num_channels, util::kOpenCvMatrixType)) {}
+
+  // Adds the statistics of another set of samples.
+  void Merge(
+      const double other_num_samples,
+      const cv::Mat& other_mean,
+      const cv::Mat& other_scatter) {
+
+    if (other_num_samples == 0) {
+      return;
+    }
+    const double total_num_samples = num_samples + other_num_samples;
+    const cv::Mat delta = other_mean - mean;
+    scatter += other_scatter +
+        delta.t() * delta *
+        (num_samples * other_num_samples / total_num_samples);
+    mean += delta * (other_num_samples / total_num_samples);
+    num_samples = total_num_samples;
+  }
+
+  // Adds the given (samples x channels) block of spectral vectors.
+  void AddSamples(const cv::Mat& samples) {
+    cv::Mat samples_mean;
+    cv::reduce(samples, samples_mean, 0, cv::REDUCE_AVG);
+    cv::Mat samples_scatter;
+    cv::mulTransposed(samples, samples_scatter, true, samples_mean);
+    Merge(samples.rows, samples_mean, samples_scatter);
+  }
+
+  double num_samples = 0;
+  cv::Mat mean;
+  cv::Mat scatter;
+};
+
+// Returns the number of principal components to keep given the eigenvalues
+// (sorted in descending order) and the options. If neither a number of bands
+// nor a retained variance is given, all components are kept.
+int GetNumComponentsToKeep(
+    const cv::Mat& eigenvalues, const SpectralPCAOptions& options) {
+
+  const int num_eigenvalues = eigenvalues.total();
+  if (options.num_pca_bands > 0) {
+    return std::min(options.num_pca_bands, num_eigenvalues);
+  }
+  if (options.retained_variance <= 0) {
+    return num_eigenvalues;
+  }
+  const double total_variance = cv::sum(eigenvalues)[0];
+  double variance = 0;
+  for (int i = 0; i < num_eigenvalues; ++i) {
+    variance += eigenvalues.at<double>(i);
+    if (variance >= options.retained_variance * total_variance) {
+      return i + 1;
+    }
+  }
+  return num_eigenvalues;
+}
+
+// A range of consecutive pixels of one of the training images.
+template <typename ImageType>
+struct PixelTile {
+  const ImageType* image;
+  int pixel_start;
+  int num_pixels;
+};
+
+// Splits all pixels of the given images into tiles of at most
+// kCovarianceTileSize pixels.
+template <typename ImageType>
+std::vector<PixelTile<ImageType>> GetPixelTiles(
+    const std::vector<const ImageType*>& hyperspectral_images) {
+
+  std::vector<PixelTile<ImageType>> tiles;
+  for (const ImageType* image : hyperspectral_images) {
+    const int num_pixels = image->GetNumPixels();
+    for (int pixel_start = 0;
+         pixel_start < num_pixels;
+         pixel_start += kCovarianceTileSize) {
+      tiles.push_back({
+        image,
+        pixel_start,
+        std::min(kCovarianceTileSize, num_pixels - pixel_start)
+      });
+    }
+  }
+  return tiles;
+}
+
+// Returns the number of partitions that ForEachPixelTile() distributes the
+// given number of tiles over.
+int GetNumTilePartitions(const int num_tiles) {
+  return std::min(kNumCovariancePartitions, num_tiles);
+}
+
+// Gathers the spectral vectors of each tile into a (pixels x channels) matrix
+// and passes it to process_tile along with the index of the tile's partition.
+// Tile i belongs to partition i % GetNumTilePartitions(). Partitions are
+// processed in parallel and the tiles of each partition in order, so results
+// accumulated per partition and then reduced in order are deterministic. The
+// samples matrix may be modified by process_tile.
+template <typename ImageType>
+void ForEachPixelTile(
+    const std::vector<PixelTile<ImageType>>& tiles,
+    const int num_channels,
+    const std::function<void(int, cv::Mat*)>& process_tile) {
+
+  const int num_tiles = tiles.size();
+  const int num_partitions = GetNumTilePartitions(num_tiles);
+  util::ParallelFor(num_partitions, [&](const int partition) {
+    cv::Mat samples;
+    for (int i = partition; i < num_tiles; i += num_partitions) {
+      const PixelTile<ImageType>& tile = tiles[i];
+      samples.create(tile.num_pixels, num_channels, util::kOpenCvMatrixType);
+      GatherSpectralVectors(
+          *tile.image, tile.pixel_start, tile.num_pixels,
+          samples.ptr<double>());
+      process_tile(partition, &samples);
+    }
+  });
+}
+
+// Returns the total number of pixels in the given tiles.
+template <typename ImageType>
+int GetNumPixelsInTiles(const std::vector<PixelTile<ImageType>>& tiles) {
+  int num_pixels = 0;
+  for (const PixelTile<ImageType>& tile : tiles) {
+    num_pixels += tile.num_pixels;
+  }
+  return num_pixels;
+}
+
+// Returns the sum of the diagonal of the covariance (the total variance) of
+// the given (samples x channels) data matrix with the given mean.
+double GetTotalVariance(const cv::Mat& data, const cv::Mat& mean) {
+  double sum_squared_deviations = 0;
+  for (int i = 0; i < data.rows; ++i) {
+    sum_squared_deviations += cv::norm(data.row(i), mean, cv::NORM_L2SQR);
+  }
+  return sum_squared_deviations / data.rows;
+}
+
+// Computes the PCA basis from the mean and covariance of every pixel of the
+// given images. The pixels are streamed through covariance accumulators in
+// tiles, so the memory used only depends on the number of channels. The
+// (channels x channels) covariance matrix is then eigendecomposed.
+template <typename ImageType>
+cv::PCA ComputeStreamingCovariancePCA(
+    const std::vector<const ImageType*>& hyperspectral_images,
+    const SpectralPCAOptions& options,
+    double* total_variance) {
+
+  const int num_channels = GetNumTrainingChannels(hyperspectral_images);
+  const std::vector<PixelTile<ImageType>> tiles =
+      GetPixelTiles(hyperspectral_images);
+
+  // Accumulate the tiles into partial results in parallel, then reduce them
+  // in a fixed order.
+  const int num_partitions = GetNumTilePartitions(tiles.size());
+  std::vector<CovarianceAccumulator> partial_accumulators;
+  for (int i = 0; i < num_partitions; ++i) {
+    partial_accumulators.emplace_back(num_channels);
+  }
+  ForEachPixelTile<ImageType>(
+      tiles, num_channels, [&](const int partition, cv::Mat* samples) {
+    partial_accumulators[partition].AddSamples(*samples);
+  });
+  CovarianceAccumulator accumulator(num_channels);
+  for (const CovarianceAccumulator& partial : partial_accumulators) {
+    accumulator.Merge(partial.num_samples, partial.mean, partial.scatter);
+  }
+  CHECK_GT(accumulator.num_samples, 0) << "Cannot compute PCA on empty images.";
+  LOG(INFO) << "Computed the spectral covariance of "
+            << accumulator.num_samples << " pixels for PCA training.";
+
+  // Eigenvalues are returned in descending order, and the eigenvectors are
+  // the rows of the matrix.
+  const cv::Mat covariance = accumulator.scatter / accumulator.num_samples;
+  cv::Mat eigenvalues;
+  cv::Mat eigenvectors;
+  cv::eigen(covariance, eigenvalues, eigenvectors);
+  const int num_components = GetNumComponentsToKeep(eigenvalues, options);
+  *total_variance = cv::trace(covariance)[0];
+
+  cv::PCA pca;
+  pca.mean = accumulator.mean;
+  pca.eigenvalues = eigenvalues.rowRange(0, num_components).clone();
+  pca.eigenvectors = eigenvectors.rowRange(0, num_components).clone();
+  return pca;
+}
+
+// Computes the top num_pca_bands principal components with randomized subspace
+// iteration (Halko, Martinsson, and Tropp). The covariance C is never formed.
+// Instead, each pass over the pixels computes the product C * Q for a basis Q
+// of num_pca_bands + oversampling columns, which costs O(pixels x channels x
+// columns):
+//   1. Q = orthonormalized C * G for a random Gaussian matrix G.
+//   2. Q = orthonormalized C * Q, repeated num_power_iterations times.
+//   3. The eigenvectors of the small matrix Q^T * C * Q, mapped back by Q,
+//      approximate the top eigenvectors of C.
+// If the basis would span all channels anyway, the exact covariance PCA is
+// used instead.
+template <typename ImageType>
+cv::PCA ComputeRandomizedPCA(
+    const std::vector<const ImageType*>& hyperspectral_images,
+    const SpectralPCAOptions& options,
+    double* total_variance) {
+
+  const int num_channels = GetNumTrainingChannels(hyperspectral_images);
+  CHECK_GT(options.num_pca_bands, 0)
+      << "Randomized PCA training requires a number of PCA bands.";
+  CHECK_GE(options.oversampling, 0) << "Oversampling cannot be negative.";
+  CHECK_GE(options.num_power_iterations, 0)
+      << "The number of power iterations cannot be negative.";
+  const int num_components = std::min(options.num_pca_bands, num_channels);
+  const int subspace_size =
+      std::min(num_components + options.oversampling, num_channels);
+  if (subspace_size == num_channels) {
+    LOG(INFO) << "The randomized PCA subspace spans all spectral bands. "
+              << "Using the exact covariance PCA instead.";
+    return ComputeStreamingCovariancePCA(
+        hyperspectral_images, options, total_variance);
+  }
+
+  const std::vector<PixelTile<ImageType>> tiles =
+      GetPixelTiles(hyperspectral_images);
+  const int num_partitions = GetNumTilePartitions(tiles.size());
+  const int num_pixels = GetNumPixelsInTiles(tiles);
+  CHECK_GT(num_pixels, 0) << "Cannot compute PCA on empty images.";
+
+  // First pass: compute the mean spectral vector.
+  std::vector<cv::Mat> partial_sums;
+  for (int i = 0; i < num_partitions; ++i) {
+    partial_sums.push_back(
+        cv::Mat::zeros(1, num_channels, util::kOpenCvMatrixType));
+  }
+  ForEachPixelTile<ImageType>(
+      tiles, num_channels, [&](const int partition, cv::Mat* samples) {
+    cv::Mat samples_sum;
+    cv::reduce(*samples, samples_sum, 0, cv::REDUCE_SUM);
+    partial_sums[partition] += samples_sum;
+  });
+  cv::Mat mean = cv::Mat::zeros(1, num_channels, util::kOpenCvMatrixType);
+  for (const cv::Mat& partial_sum : partial_sums) {
+    mean += partial_sum;
+  }
+  mean /= num_pixels;
+
+  // Returns C * basis, computed in a pass over the pixels as the sum of
+  // X^T * (X * basis) over all tiles X of mean-centered spectral vectors. The
+  // total variance is accumulated in the same pass.
+  const auto multiply_by_covariance = [&](const cv::Mat& basis) {
+    std::vector<cv::Mat> partial_products;
+    std::vector<double> partial_variances(num_partitions, 0);
+    for (int i = 0; i < num_partitions; ++i) {
+      partial_products.push_back(cv::Mat::zeros(
+          num_channels, basis.cols, util::kOpenCvMatrixType));
+    }
+    ForEachPixelTile<ImageType>(
+        tiles, num_channels, [&](const int partition, cv::Mat* samples) {
+      for (int i = 0; i < samples->rows; ++i) {
+        cv::Mat sample = samples->row(i);
+        sample -= mean;
+      }
+      partial_products[partition] += samples->t() * (*samples * basis);
+      partial_variances[partition] += cv::norm(*samples, cv::NORM_L2SQR);
+    });
+    cv::Mat product =
+        cv::Mat::zeros(num_channels, basis.cols, util::kOpenCvMatrixType);
+    double sum_squared_deviations = 0;
+    for (int i = 0; i < num_partitions; ++i) {
+      product += partial_products[i];
+      sum_squared_deviations += partial_variances[i];
+    }
+    *total_variance = sum_squared_deviations / num_pixels;
+    return cv::Mat(product / num_pixels);
+  };
+
+  // Returns an orthonormal basis for the column space of the given matrix.
+  const auto orthonormalize = [](const cv::Mat& matrix) {
+    cv::Mat singular_values;
+    cv::Mat left_singular_vectors;
+    cv::Mat right_singular_vectors;
+    cv::SVDecomp(
+        matrix, singular_values, left_singular_vectors, right_singular_vectors);
+    return left_singular_vectors;
+  };
+
+  // The random starting matrix uses a fixed seed so that the basis is
+  // reproducible.
+  cv::RNG rng(kRandomizedPCASeed);
+  cv::Mat basis(num_channels, subspace_size, util::kOpenCvMatrixType);
+  for (int row = 0; row < num_channels; ++row) {
+    for (int col = 0; col < subspace_size; ++col) {
+      basis.at<double>(row, col) = rng.gaussian(1.0);
+    }
+  }
+  for (int i = 0; i <= options.num_power_iterations; ++i) {
+    basis = orthonormalize(multiply_by_covariance(basis));
+  }
+
+  // Rayleigh-Ritz step: eigendecompose the covariance restricted to the
+  // subspace. The small matrix is symmetrized to remove rounding errors.
+  const cv::Mat projected_covariance =
+      basis.t() * multiply_by_covariance(basis);
+  cv::Mat eigenvalues;
+  cv::Mat subspace_eigenvectors;
+  cv::eigen(
+      (projected_covariance + projected_covariance.t()) * 0.5,
+      eigenvalues,
+      subspace_eigenvectors);
+  LOG(INFO) << "Computed " << num_components
+            << " principal components with randomized subspace iteration ("
+            << options.num_power_iterations + 3 << " passes over "
+            << num_pixels << " pixels).";
+
+  cv::PCA pca;
+  pca.mean = mean;
+  pca.eigenvalues = eigenvalues.rowRange(0, num_components).clone();
+  pca.eigenvectors =
+      subspace_eigenvectors.rowRange(0, num_components) * basis.t();
+  return pca;
+}
+
+// Computes the PCA basis of the given images with the training method given
+// in the options. The total variance of the training data is returned in
+// total_variance.
+template <typename ImageType>
+cv::PCA TrainPCA(
+    const std::vector<const ImageType*>& hyperspectral_images,
+    const SpectralPCAOptions& options,
+    double* total_variance) {
+
+  CHECK_NOTNULL(total_variance);
+  switch (options.training_method) {
+    case PCA_TRAINING_STREAMING_COVARIANCE:
+      return ComputeStreamingCovariancePCA(
+          hyperspectral_images, options, total_variance);
+    case PCA_TRAINING_RANDOMIZED:
+      return ComputeRandomizedPCA(
+          hyperspectral_images, options, total_variance);
+    case PCA_TRAINING_SUBSAMPLED:
+    default: {
+      const cv::Mat input_data = GetPCAInputData(hyperspectral_images);
+      cv::PCA pca;
+      if (options.num_pca_bands <= 0 && options.retained_variance > 0) {
+        pca = cv::PCA(
+            input_data, cv::Mat(), CV_PCA_DATA_AS_ROW,
+            options.retained_variance);
+      } else {
+        pca = cv::PCA(
+            input_data, cv::Mat(), CV_PCA_DATA_AS_ROW, options.num_pca_bands);
+      }
+      *total_variance = GetTotalVariance(input_data, pca.mean);
+      return pca;
+    }
+  }
+}
+
+// Returns the given hash updated with the given bytes (64-bit FNV-1a).
+uint64_t HashBytes(const void* data, const size_t num_bytes, uint64_t hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < num_bytes; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Returns the given hash updated with the given value.
+template <typename ValueType>
+uint64_t HashValue(const ValueType& value, const uint64_t hash) {
+  return HashBytes(&value, sizeof(value), hash);
+}
+
+// Returns the given hash updated with the values of the given matrix.
+uint64_t HashMatrix(const cv::Mat& matrix, const uint64_t hash) {
+  const cv::Mat continuous_matrix =
+      matrix.isContinuous() ? matrix : matrix.clone();
+  return HashBytes(
+      continuous_matrix.data,
+      continuous_matrix.total() * continuous_matrix.elemSize(),
+      hash);
+}
+
+// Returns the source fingerprint of a basis trained on the given images with
+// the given options (see SpectralPCA::GetSourceFingerprint()). The pixels are
+// summarized by the resulting mean and eigenvalues instead of being hashed.
+template <typename ImageType>
+uint64_t ComputeSourceFingerprint(
+    const std::vector<const ImageType*>& hyperspectral_images,
+    const SpectralPCAOptions& options,
+    const cv::PCA& pca) {
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = HashValue(hyperspectral_images.size(), hash);
+  for (const ImageType* image : hyperspectral_images) {
+    hash = HashValue(image->GetImageSize().width, hash);
+    hash = HashValue(image->GetImageSize().height, hash);
+    hash = HashValue(image->GetNumChannels(), hash);
+  }
+  hash = HashValue(static_cast<int>(options.training_method), hash);
+  hash = HashValue(options.num_pca_bands, hash);
+  hash = HashValue(options.retained_variance, hash);
+  if (options.training_method == PCA_TRAINING_RANDOMIZED) {
+    hash = HashValue(options.oversampling, hash);
+    hash = HashValue(options.num_power_iterations, hash);
+  }
+  hash = HashMatrix(pca.mean, hash);
+  hash = HashMatrix(pca.eigenvalues, hash);
+  return hash;
+}
+
+// Returns options that keep the given number of PCA bands.
+SpectralPCAOptions GetOptionsForNumBands(const int num_pca_bands) {
+  SpectralPCAOptions options;
+  options.num_pca_bands = num_pca_bands;
+  return options;
+}
+
+// Returns options that keep the given fraction of the variance.
+SpectralPCAOptions GetOptionsForRetainedVariance(
+    const double retained_variance) {
+
+  SpectralPCAOptions options;
+  options.retained_variance = retained_variance;
+  return options;
+}
+
+// Returns pointers to each of the given images.
+std::vector<const ImageData*> GetImagePointers(
+    const std::vector<ImageData>& images) {
+
+  std::vector<const ImageData*> image_pointers;
+  for (const ImageData& image : images) {
+    image_pointers.push_back(&image);
+  }
+  return image_pointers;
+}
+
 // This function will either convert images from hyperspectral space to PCA
 // space or vice versa. Use the forward_projection flag to control the
 // projection direction (true = hyperspectral to PCA projection, false = PCA to
@@ -115,43 +642,55 @@ ImageData ConvertImage(
   CHECK_EQ(input_image.GetNumChannels(), num_input_bands)
       << "The input image does not have the correct number of channels.";
 
-  // Create empty OpenCV images for the output image channels.
-  std::vector<cv::Mat> output_image_channels;
-  output_image_channels.reserve(num_output_bands);
+  // Create an empty output image with the output number of channels.
+  ImageData output_image;
   for (int i = 0; i < num_output_bands; ++i) {
-    cv::Mat channel_image =
+    const cv::Mat channel_image =
         cv::Mat::zeros(input_image.GetImageSize(), util::kOpenCvMatrixType);
-    output_image_channels.push_back(channel_image);
+    output_image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
   }
 
-  // Project the input image into the ouput space pixel by pixel.
+  // Project the input image into the output space one tile of pixels at a
+  // time. Each tile is gathered into a (pixels x bands) matrix, so the
+  // projection of the whole tile is a single matrix multiplication with the
+  // eigenvectors:
+  //   forward:  Y = (X - mean) * A^T
+  //   backward: X = Y * A + mean
+  // Tiles are independent and are processed in parallel.
+  const cv::Mat& eigenvectors = pca.eigenvectors;
+  const cv::Mat& mean = pca.mean;
   const int num_pixels = input_image.GetNumPixels();
-  for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
-    // Extract the pixel vector from the input image.
-    cv::Mat input_pixel_vector(1, num_input_bands, util::kOpenCvMatrixType);
-    for (int i = 0; i < num_input_bands; ++i) {
-      input_pixel_vector.at<double>(i) =
-          input_image.GetPixelValue(i, pixel_index);
-    }
-    // Project the input pixel vector into the other space and set the output
-    // channel values.
-    cv::Mat output_pixel_vector;
+  const int num_tiles =
+      (num_pixels + kProjectionTileSize - 1) / kProjectionTileSize;
+  util::ParallelFor(num_tiles, [&](const int tile) {
+    const int pixel_start = tile * kProjectionTileSize;
+    const int tile_size =
+        std::min(kProjectionTileSize, num_pixels - pixel_start);
+    cv::Mat input_block(tile_size, num_input_bands, util::kOpenCvMatrixType);
+    input_image.GatherSpectralVectors(
+        pixel_start, tile_size, input_block.ptr<double>());
+    cv::Mat output_block;
     if (forward_projection) {
-      output_pixel_vector = pca.project(input_pixel_vector);
+      for (int i = 0; i < tile_size; ++i) {
+        cv::Mat input_row = input_block.row(i);
+        input_row -= mean;
+      }
+      cv::gemm(
+          input_block, eigenvectors, 1.0, cv::noArray(), 0.0, output_block,
+          cv::GEMM_2_T);
     } else {
-      output_pixel_vector = pca.backProject(input_pixel_vector);
-    }
-    for (int i = 0; i < num_output_bands; ++i) {
-      output_image_channels[i].at<double>(pixel_index) =
-          output_pixel_vector.at<double>(i);
+      cv::gemm(
+          input_block, eigenvectors, 1.0, cv::noArray(), 0.0, output_block);
+      for (int i = 0; i < tile_size; ++i) {
+        cv::Mat output_row = output_block.row(i);
+        output_row += mean;
+      }
     }
-  }
+    output_image.ScatterSpectralVectors(
+        pixel_start, tile_size, output_block.ptr<double>());
+  });
 
   // Return the projected image.
-  ImageData output_image;
-  for (const cv::Mat& channel_image : output_image_channels) {
-    output_image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
-  }
   if (forward_projection) {
     output_image.SetSpectralMode(SPECTRAL_MODE_HYPERSPECTRAL_PCA);
   } else {
@@ -162,30 +701,170 @@ ImageData ConvertImage(
 
 }  // namespace
 
+SpectralPCATrainingMethod GetSpectralPCATrainingMethod(
+    const std::string& method_name) {
+
+  if (method_name == "subsampled") {
+    return PCA_TRAINING_SUBSAMPLED;
+  }
+  if (method_name == "covariance") {
+    return PCA_TRAINING_STREAMING_COVARIANCE;
+  }
+  if (method_name == "randomized") {
+    return PCA_TRAINING_RANDOMIZED;
+  }
+  LOG(FATAL) << "Unknown PCA training method '" << method_name
+             << "'. Use 'subsampled', 'covariance', or 'randomized'.";
+  return PCA_TRAINING_SUBSAMPLED;
+}
+
 SpectralPCA::SpectralPCA(
     const std::vector<ImageData>& hyperspectral_images,
-    const int num_pca_bands) {
+    const SpectralPCAOptions& options) {
 
-  const cv::Mat input_data = GetPCAInputData(hyperspectral_images);
-  pca_ = cv::PCA(input_data, cv::Mat(), CV_PCA_DATA_AS_ROW, num_pca_bands);
+  const std::vector<const ImageData*> image_pointers =
+      GetImagePointers(hyperspectral_images);
+  double total_variance;
+  const cv::PCA pca = TrainPCA(image_pointers, options, &total_variance);
+  SetBasis(pca, total_variance);
+  source_fingerprint_ = ComputeSourceFingerprint(image_pointers, options, pca);
+}
 
-  // Set the number of spectral in the original and PCA spaces.
-  const cv::Size eigenvector_matrix_size = pca_.eigenvectors.size();
-  num_spectral_bands_ = eigenvector_matrix_size.width;
-  num_pca_bands_ = eigenvector_matrix_size.height;
+SpectralPCA::SpectralPCA(
+    const std::vector<const LazyHyperspectralImage*>& hyperspectral_images,
+    const SpectralPCAOptions& options) {
+
+  double total_variance;
+  const cv::PCA pca =
+      TrainPCA(hyperspectral_images, options, &total_variance);
+  SetBasis(pca, total_variance);
+  source_fingerprint_ =
+      ComputeSourceFingerprint(hyperspectral_images, options, pca);
 }
 
 SpectralPCA::SpectralPCA(
     const std::vector<ImageData>& hyperspectral_images,
-    const double retained_variance) {
+    const int num_pca_bands)
+    : SpectralPCA(hyperspectral_images, GetOptionsForNumBands(num_pca_bands)) {
+}
+
+SpectralPCA::SpectralPCA(
+    const std::vector<ImageData>& hyperspectral_images,
+    const double retained_variance)
+    : SpectralPCA(
+          hyperspectral_images,
+          GetOptionsForRetainedVariance(retained_variance)) {
+}
+
+SpectralPCA::SpectralPCA(
+    const std::vector<const LazyHyperspectralImage*>& hyperspectral_images,
+    const int num_pca_bands)
+    : SpectralPCA(hyperspectral_images, GetOptionsForNumBands(num_pca_bands)) {
+}
 
-  const cv::Mat input_data = GetPCAInputData(hyperspectral_images);
-  pca_ = cv::PCA(input_data, cv::Mat(), CV_PCA_DATA_AS_ROW, retained_variance);
+SpectralPCA::SpectralPCA(
+    const std::vector<const LazyHyperspectralImage*>& hyperspectral_images,
+    const double retained_variance)
+    : SpectralPCA(
+          hyperspectral_images,
+          GetOptionsForRetainedVariance(retained_variance)) {
+}
+
+SpectralPCA SpectralPCA::LoadBasis(const std::string& file_path) {
+  std::ifstream basis_file(file_path, std::ios::binary);
+  CHECK(basis_file.is_open())
+      << "PCA basis file '" << file_path << "' could not be opened.";
+
+  PCABasisHeader header;
+  basis_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  CHECK(basis_file.good())
+      << "File '" << file_path << "' is not a PCA basis file.";
+  CHECK_EQ(std::memcmp(header.magic, kPCABasisMagic, sizeof(header.magic)), 0)
+      << "File '" << file_path << "' is not a PCA basis file.";
+  CHECK_EQ(header.byte_order_mark, kByteOrderMark)
+      << "PCA basis file '" << file_path
+      << "' was written on a machine with a different byte order.";
+  CHECK_GT(header.num_spectral_bands, 0) << "Invalid number of bands.";
+  CHECK_GT(header.num_pca_bands, 0) << "Invalid number of PCA bands.";
+  CHECK_LE(header.num_pca_bands, header.num_spectral_bands)
+      << "Invalid number of PCA bands.";
+
+  SpectralPCA spectral_pca;
+  spectral_pca.num_spectral_bands_ = header.num_spectral_bands;
+  spectral_pca.num_pca_bands_ = header.num_pca_bands;
+  spectral_pca.explained_variance_ratio_ = header.explained_variance_ratio;
+  spectral_pca.source_fingerprint_ = header.source_fingerprint;
+
+  cv::PCA& pca = spectral_pca.pca_;
+  pca.mean.create(1, header.num_spectral_bands, util::kOpenCvMatrixType);
+  pca.eigenvalues.create(header.num_pca_bands, 1, util::kOpenCvMatrixType);
+  pca.eigenvectors.create(
+      header.num_pca_bands, header.num_spectral_bands,
+      util::kOpenCvMatrixType);
+  for (cv::Mat* matrix : {&pca.mean, &pca.eigenvalues, &pca.eigenvectors}) {
+    basis_file.read(
+        reinterpret_cast<char*>(matrix->data),
+        matrix->total() * matrix->elemSize());
+  }
+  CHECK(basis_file.good())
+      << "PCA basis file '" << file_path << "' is truncated.";
+  return spectral_pca;
+}
+
+void SpectralPCA::SaveBasis(const std::string& file_path) const {
+  PCABasisHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kPCABasisMagic, sizeof(header.magic));
+  header.byte_order_mark = kByteOrderMark;
+  header.num_spectral_bands = num_spectral_bands_;
+  header.num_pca_bands = num_pca_bands_;
+  header.source_fingerprint = source_fingerprint_;
+  header.explained_variance_ratio = explained_variance_ratio_;
+
+  std::ofstream basis_file(file_path, std::ios::binary);
+  CHECK(basis_file.is_open())
+      << "PCA basis file '" << file_path
+      << "' could not be opened for writing.";
+  basis_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  // The matrices are written as doubles regardless of how they are stored.
+  const std::vector<cv::Mat> matrices = {
+    pca_.mean, pca_.eigenvalues, pca_.eigenvectors
+  };
+  for (const cv::Mat& matrix : matrices) {
+    cv::Mat double_matrix;
+    matrix.convertTo(double_matrix, util::kOpenCvMatrixType);
+    basis_file.write(
+        reinterpret_cast<const char*>(double_matrix.data),
+        double_matrix.total() * double_matrix.elemSize());
+  }
+  CHECK(basis_file.good())
+      << "Failed to write PCA basis file '" << file_path << "'.";
+  basis_file.close();
+}
+
+std::vector<double> SpectralPCA::GetEigenvalues() const {
+  std::vector<double> eigenvalues;
+  for (int i = 0; i < num_pca_bands_; ++i) {
+    eigenvalues.push_back(pca_.eigenvalues.at<double>(i));
+  }
+  return eigenvalues;
+}
+
+void SpectralPCA::SetBasis(const cv::PCA& pca, const double total_variance) {
+  pca_ = pca;
 
   // Set the number of spectral in the original and PCA spaces.
   const cv::Size eigenvector_matrix_size = pca_.eigenvectors.size();
   num_spectral_bands_ = eigenvector_matrix_size.width;
   num_pca_bands_ = eigenvector_matrix_size.height;
+
+  // Constant data has no variance to lose.
+  const double retained_variance = cv::sum(pca_.eigenvalues)[0];
+  explained_variance_ratio_ =
+      (total_variance > 0) ? std::min(retained_variance / total_variance, 1.0)
+                           : 1.0;
+  LOG(INFO) << "The " << num_pca_bands_ << " PCA bands explain "
+            << explained_variance_ratio_ * 100.0 << "% of the variance.";
 }
 
 ImageData SpectralPCA::GetPCAImage(const ImageData& image_data) const {
@@ -31,10 +31,17 @@
 //   SpectralPCA spectral_pca(low_res_images);
 //   pca_images[0] = spectral_pca.GetPCAImage(low_res_images[0]);
 //   hr_estimate = spectral_pca.ReconstructImage(high_res_pca_estimate);
+//
+// Training can be slow for large images, so a basis can also be saved once
+// and reused for other images from the same instrument and scene:
+//   spectral_pca.SaveBasis(basis_path);
+//   const SpectralPCA loaded_pca = SpectralPCA::LoadBasis(basis_path);
 
 #ifndef SRC_HYPERSPECTRAL_SPECTRAL_PCA_H_
 #define SRC_HYPERSPECTRAL_SPECTRAL_PCA_H_
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #include "image/image_data.h"
@@ -43,8 +50,62 @@
 
 namespace super_resolution {
 
+class LazyHyperspectralImage;
+
+// The method used to compute the PCA basis from the training images.
+enum SpectralPCATrainingMethod {
+  // Runs cv::PCA on a subsample of the pixels, taken at a fixed stride. The
+  // number of samples is ten times the number of spectral bands (or all of the
+  // pixels if there are fewer).
+  PCA_TRAINING_SUBSAMPLED,
+
+  // Streams every pixel of every image through a running mean and covariance
+  // computation in parallel, and then eigendecomposes the (bands x bands)
+  // covariance matrix. Memory use does not depend on the number of pixels.
+  PCA_TRAINING_STREAMING_COVARIANCE,
+
+  // Finds only the top num_pca_bands components with randomized subspace
+  // iteration, which takes a few passes over the pixels and never forms or
+  // fully eigendecomposes the covariance matrix. This is much faster when only
+  // a few components are kept out of hundreds or thousands of bands. Requires
+  // num_pca_bands to be set (retained_variance is not supported).
+  PCA_TRAINING_RANDOMIZED
+};
+
+// Options for computing the PCA basis.
+struct SpectralPCAOptions {
+  SpectralPCATrainingMethod training_method = PCA_TRAINING_SUBSAMPLED;
+
+  // If positive, the basis keeps this many PCA bands (capped by the number of
+  // spectral bands). Otherwise, if retained_variance is positive, the basis
+  // keeps the minimum number of bands that preserve that fraction of the
+  // variance (see the constructors below). If neither is set, all bands are
+  // kept.
+  int num_pca_bands = 0;
+  double retained_variance = 0.0;
+
+  // Randomized training only: the number of extra random dimensions searched
+  // beyond num_pca_bands, and the number of extra passes over the data used
+  // to refine the subspace. Larger values improve accuracy when the
+  // eigenvalues decay slowly.
+  int oversampling = 10;
+  int num_power_iterations = 2;
+};
+
+// Returns the training method with the given name: "subsampled",
+// "covariance" (streaming covariance), or "randomized". An error will occur if
+// the name is unknown.
+SpectralPCATrainingMethod GetSpectralPCATrainingMethod(
+    const std::string& method_name);
+
 class SpectralPCA {
  public:
+  // Uses the given set of images to generate the PCA decomposition with the
+  // given options.
+  SpectralPCA(
+      const std::vector<ImageData>& hyperspectral_images,
+      const SpectralPCAOptions& options);
+
   // Uses the given set of images to generate the PCA decomposition and finds
   // the top PCA bands.
   //
@@ -66,6 +127,27 @@ class SpectralPCA {
       const std::vector<ImageData>& hyperspectral_images,
       const double retained_variance);
 
+  // Same as the constructors above, but the training pixels are read directly
+  // from the files of lazily loaded images, so the images never have to be
+  // fully loaded into memory.
+  SpectralPCA(
+      const std::vector<const LazyHyperspectralImage*>& hyperspectral_images,
+      const SpectralPCAOptions& options);
+  SpectralPCA(
+      const std::vector<const LazyHyperspectralImage*>& hyperspectral_images,
+      const int num_pca_bands = 0);
+  SpectralPCA(
+      const std::vector<const LazyHyperspectralImage*>& hyperspectral_images,
+      const double retained_variance);
+
+  // Loads a basis saved with SaveBasis(). An error will occur if the file is
+  // not a valid PCA basis file.
+  static SpectralPCA LoadBasis(const std::string& file_path);
+
+  // Saves the PCA basis (mean, eigenvectors, eigenvalues, band counts, and
+  // source fingerprint) to a binary file at the given path.
+  void SaveBasis(const std::string& file_path) const;
+
   // Returns an image with PCA spectral channels (each pixel is converted into
   // the precomputed PCA space).
   ImageData GetPCAImage(const ImageData& image_data) const;
@@ -75,7 +157,43 @@ class SpectralPCA {
   // SpectralPCA object using GetPCAImage() for a valid reconstruction.
   ImageData ReconstructImage(const ImageData& pca_image_data) const;
 
+  // Returns the number of spectral bands of the images that the basis applies
+  // to.
+  int GetNumSpectralBands() const {
+    return num_spectral_bands_;
+  }
+
+  // Returns the number of PCA bands in the decomposition.
+  int GetNumPCABands() const {
+    return num_pca_bands_;
+  }
+
+  // Returns the eigenvalues of the PCA bands (the variance of the training
+  // data along each band) in descending order.
+  std::vector<double> GetEigenvalues() const;
+
+  // Returns the fraction of the variance of the training data (between 0 and
+  // 1) that is preserved by the PCA bands.
+  double GetExplainedVarianceRatio() const {
+    return explained_variance_ratio_;
+  }
+
+  // Returns a hash of the sizes of the training images, the training options,
+  // and the resulting basis. Bases trained on the same data with the same
+  // options have the same fingerprint, so it can be used to check which data a
+  // saved basis came from.
+  uint64_t GetSourceFingerprint() const {
+    return source_fingerprint_;
+  }
+
  private:
+  // Used by LoadBasis().
+  SpectralPCA() = default;
+
+  // Sets the PCA basis and the derived band counts and explained variance
+  // ratio. The total_variance is the variance of the training data.
+  void SetBasis(const cv::PCA& pca, const double total_variance);
+
   // The OpenCV PCA object that is used to compute the decomposition and
   // convert to and from PCA space.
   cv::PCA pca_;
@@ -87,6 +205,12 @@ class SpectralPCA {
   // equals the original number of channels, then the image can be
   // reconstructed exactly.
   int num_pca_bands_;
+
+  // The fraction of the training data's variance preserved by the PCA bands.
+  double explained_variance_ratio_;
+
+  // Identifies the training data and options (see GetSourceFingerprint()).
+  uint64_t source_fingerprint_;
 };
 
 }  // namespace super_resolution
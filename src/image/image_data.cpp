@@ -1,12 +1,14 @@
 #include "image/image_data.h"
 
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "util/matrix_util.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
 
@@ -73,64 +75,215 @@ void InitializeFromImage(
   }
 }
 
-// Resize each of the given image channels using additive interpolation (see
-// the description of INTERPOLATE_ADDITIVE in image_data.h). If upsample is
-// true, the scale will be used as an upsampling scale, otherwise it will be
-// the downsampling scale. The new image size will be returned.
-cv::Size ResizeAdditiveInterpolation(
-    const cv::Size& new_size, std::vector<cv::Mat>* channels) {
+// Returns true if the large size is an exact integer multiple of the small
+// size in both dimensions, and sets the scale factors accordingly.
+bool GetIntegerScaleFactors(
+    const cv::Size& small_size,
+    const cv::Size& large_size,
+    int* x_scale,
+    int* y_scale) {
 
-  const int num_image_channels = channels->size();
-  CHECK_GT(num_image_channels, 0)
-      << "Cannot upsample an image with no channels.";
+  if (large_size.width % small_size.width != 0 ||
+      large_size.height % small_size.height != 0) {
+    return false;
+  }
+  *x_scale = large_size.width / small_size.width;
+  *y_scale = large_size.height / small_size.height;
+  return true;
+}
 
-  const cv::Size original_size = channels->at(0).size();
+// Prepares the destination matrix to hold a resized channel. The existing
+// allocation is reused if it already has the right size and type. If the
+// destination shares its data with the source (e.g. after a shallow copy), it
+// is detached first so the source is not overwritten while being read.
+void PrepareDestination(
+    const cv::Mat& source, const cv::Size& new_size, cv::Mat* destination) {
+
+  if (destination->data != nullptr && destination->data == source.data) {
+    destination->release();
+  }
+  destination->create(new_size, source.type());
+}
+
+// Zero-insertion upsampling (the upsampling case of INTERPOLATE_ADDITIVE).
+// Each source pixel (row, col) is copied to (row * y_scale, col * x_scale) and
+// all other destination pixels are set to zero.
+template <typename T>
+void UpsampleAdditive(
+    const cv::Mat& source,
+    const int x_scale,
+    const int y_scale,
+    const cv::Size& new_size,
+    cv::Mat* destination) {
+
+  PrepareDestination(source, new_size, destination);
+  const int num_source_rows = std::min(
+      source.rows, (new_size.height + y_scale - 1) / y_scale);
+  const int num_source_cols = std::min(
+      source.cols, (new_size.width + x_scale - 1) / x_scale);
+  for (int row = 0; row < new_size.height; ++row) {
+    T* destination_row = destination->ptr<T>(row);
+    std::fill(destination_row, destination_row + new_size.width, T(0));
+    if (row % y_scale != 0 || row / y_scale >= num_source_rows) {
+      continue;
+    }
+    const T* source_row = source.ptr<T>(row / y_scale);
+    for (int col = 0; col < num_source_cols; ++col) {
+      destination_row[col * x_scale] = source_row[col];
+    }
+  }
+}
+
+// Additive decimation (the downsampling case of INTERPOLATE_ADDITIVE). Each
+// destination pixel is the sum of the x_scale by y_scale block of source
+// pixels that maps to it. Source pixels outside of the last full block are
+// ignored. The summation order is row-major within each block.
+template <typename T>
+void DownsampleAdditive(
+    const cv::Mat& source,
+    const int x_scale,
+    const int y_scale,
+    const cv::Size& new_size,
+    cv::Mat* destination) {
+
+  PrepareDestination(source, new_size, destination);
+  for (int row = 0; row < new_size.height; ++row) {
+    T* destination_row = destination->ptr<T>(row);
+    std::fill(destination_row, destination_row + new_size.width, T(0));
+    for (int block_row = 0; block_row < y_scale; ++block_row) {
+      const T* source_row = source.ptr<T>(row * y_scale + block_row);
+      if (x_scale == 1) {
+        for (int col = 0; col < new_size.width; ++col) {
+          destination_row[col] += source_row[col];
+        }
+        continue;
+      }
+      for (int col = 0; col < new_size.width; ++col) {
+        const T* block = source_row + col * x_scale;
+        T sum = destination_row[col];
+        for (int block_col = 0; block_col < x_scale; ++block_col) {
+          sum += block[block_col];
+        }
+        destination_row[col] = sum;
+      }
+    }
+  }
+}
+
+// Integer-factor nearest neighbor decimation. Destination pixel (row, col) is
+// source pixel (row * y_scale, col * x_scale), which is identical to what
+// cv::resize with INTER_NEAREST produces for integer scale factors.
+template <typename T>
+void DownsampleNearest(
+    const cv::Mat& source,
+    const int x_scale,
+    const int y_scale,
+    const cv::Size& new_size,
+    cv::Mat* destination) {
+
+  PrepareDestination(source, new_size, destination);
+  for (int row = 0; row < new_size.height; ++row) {
+    const T* source_row = source.ptr<T>(row * y_scale);
+    T* destination_row = destination->ptr<T>(row);
+    for (int col = 0; col < new_size.width; ++col) {
+      destination_row[col] = source_row[col * x_scale];
+    }
+  }
+}
+
+// Calls the float or double instantiation of the given resize kernel
+// depending on the depth of the source matrix.
+#define CALL_RESIZE_KERNEL(kernel, source, ...) \
+  ((source).depth() == CV_32F ? \
+      kernel<float>((source), __VA_ARGS__) : \
+      kernel<double>((source), __VA_ARGS__))
+
+// Resizes each of the source channels into the corresponding destination
+// channel. The destination must have the same number of channels as the
+// source; any already-allocated destination matrices of the right size are
+// reused. Channels are resized in parallel and keep their precision.
+//
+// INTERPOLATE_ADDITIVE and integer-factor INTERPOLATE_NEAREST downsampling
+// use the specialized row kernels above. Everything else uses cv::resize.
+void ResizeChannels(
+    const std::vector<cv::Mat>& source_channels,
+    const cv::Size& new_size,
+    const ResizeInterpolationMethod interpolation_method,
+    std::vector<cv::Mat>* destination_channels) {
+
+  CHECK_EQ(source_channels.size(), destination_channels->size());
+  const int num_image_channels = source_channels.size();
+  CHECK_GT(num_image_channels, 0) << "Cannot resize an image with no channels.";
+
+  const cv::Size original_size = source_channels[0].size();
   const bool upsample =
       original_size.width <= new_size.width &&
       original_size.height <= new_size.height;
   const bool downsample =
       original_size.width >= new_size.width &&
       original_size.height >= new_size.height;
-  CHECK(upsample || downsample)
-      << "Axis-independent up/downsampling is not supported.";
-
-  // TODO: do the more efficient implementation? Also clean up, it's messy
-  // repetitive code.
-  if (upsample) {
-    const int y_scale = new_size.height / original_size.height;
-    const int x_scale = new_size.width / original_size.width;
-    for (int i = 0; i < num_image_channels; ++i) {
-      const cv::Mat channel_image = channels->at(i);
-      cv::Mat resized_image = cv::Mat::zeros(new_size, channel_image.type());
-      for (int row = 0; row < original_size.height; ++row) {
-        for (int col = 0; col < original_size.width; ++col) {
-          const int new_row = row * y_scale;
-          const int new_col = col * x_scale;
-          resized_image.at<double>(new_row, new_col) =
-              channel_image.at<double>(row, col);
-        }
-      }
-      (*channels)[i] = resized_image;
+
+  int x_scale = 0;
+  int y_scale = 0;
+  std::function<void(const cv::Mat&, cv::Mat*)> resize_channel;
+  if (interpolation_method == INTERPOLATE_ADDITIVE) {
+    CHECK(upsample || downsample)
+        << "Axis-independent up/downsampling is not supported.";
+    if (upsample) {
+      y_scale = new_size.height / original_size.height;
+      x_scale = new_size.width / original_size.width;
+      resize_channel = [&](const cv::Mat& source, cv::Mat* destination) {
+        CALL_RESIZE_KERNEL(
+            UpsampleAdditive, source, x_scale, y_scale, new_size, destination);
+      };
+    } else {
+      y_scale = original_size.height / new_size.height;
+      x_scale = original_size.width / new_size.width;
+      resize_channel = [&](const cv::Mat& source, cv::Mat* destination) {
+        CALL_RESIZE_KERNEL(
+            DownsampleAdditive, source, x_scale, y_scale, new_size,
+            destination);
+      };
     }
-    return new_size;
+  } else if (interpolation_method == INTERPOLATE_NEAREST &&
+             downsample &&
+             GetIntegerScaleFactors(
+                 new_size, original_size, &x_scale, &y_scale)) {
+    resize_channel = [&](const cv::Mat& source, cv::Mat* destination) {
+      CALL_RESIZE_KERNEL(
+          DownsampleNearest, source, x_scale, y_scale, new_size, destination);
+    };
   } else {
-    const int y_scale = original_size.height / new_size.height;
-    const int x_scale = original_size.width / new_size.width;
-    for (int i = 0; i < num_image_channels; ++i) {
-      const cv::Mat channel_image = channels->at(i);
-      cv::Mat resized_image = cv::Mat::zeros(new_size, channel_image.type());
-      for (int row = 0; row < original_size.height; ++row) {
-        for (int col = 0; col < original_size.width; ++col) {
-          const int new_row = row / y_scale;
-          const int new_col = col / x_scale;
-          resized_image.at<double>(new_row, new_col) +=
-              channel_image.at<double>(row, col);
-        }
-      }
-      (*channels)[i] = resized_image;
+    int opencv_interpolation_method = 0;
+    switch (interpolation_method) {
+      case INTERPOLATE_LINEAR:
+        opencv_interpolation_method = cv::INTER_LINEAR;
+        break;
+      case INTERPOLATE_CUBIC:
+        opencv_interpolation_method = cv::INTER_CUBIC;
+        break;
+      case INTERPOLATE_NEAREST:
+      default:
+        opencv_interpolation_method = cv::INTER_NEAREST;
+        break;
     }
-    return new_size;
+    resize_channel = [&](const cv::Mat& source, cv::Mat* destination) {
+      PrepareDestination(source, new_size, destination);
+      cv::resize(
+          source,         // Source image.
+          *destination,   // Dest image.
+          new_size,       // Desired image size.
+          0,              // Set x, y scale to 0 to use the given Size instead.
+          0,
+          opencv_interpolation_method);
+    };
   }
+
+  util::ParallelFor(num_image_channels, [&](const int channel_index) {
+    resize_channel(
+        source_channels[channel_index],
+        &(*destination_channels)[channel_index]);
+  });
 }
 
 // Given two vectors, each with exactly 3 cv::Mat channels, interpolates the
@@ -207,7 +360,8 @@ ImageData::ImageData() {
 ImageData::ImageData(const ImageData& other)
     : spectral_mode_(other.spectral_mode_),
       luminance_channel_only_(other.luminance_channel_only_),
-      image_size_(other.image_size_) {
+      image_size_(other.image_size_),
+      precision_(other.precision_) {
 
   for (const cv::Mat& channel_image : other.channels_) {
     channels_.push_back(channel_image.clone());
@@ -283,11 +437,11 @@ void ImageData::AddChannel(
   // convert to the standard Matrix type in any case.
   double min_pixel_value, max_pixel_value;
   cv::minMaxLoc(channel_image, &min_pixel_value, &max_pixel_value);
+  const int matrix_type = GetOpenCvMatrixType();
   if ((normalize_mode == NORMALIZE_IMAGE) && (max_pixel_value > 1.0)) {
-    converted_image.convertTo(
-        converted_image, util::kOpenCvMatrixType, 1.0 / 255.0);
-  } else if (converted_image.type() != util::kOpenCvMatrixType) {
-    converted_image.convertTo(converted_image, util::kOpenCvMatrixType);
+    converted_image.convertTo(converted_image, matrix_type, 1.0 / 255.0);
+  } else if (converted_image.type() != matrix_type) {
+    converted_image.convertTo(converted_image, matrix_type);
   }
   channels_.push_back(converted_image);
 
@@ -307,6 +461,30 @@ void ImageData::AddChannel(const double* pixel_values, const cv::Size& size) {
   AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
 }
 
+void ImageData::SetPixelValues(
+    const double* pixel_values, const cv::Size& size, const int num_channels) {
+
+  CHECK_NOTNULL(pixel_values);
+  CHECK_GE(num_channels, 1) << "The image must have at least one channel.";
+  CHECK_GT(size.width * size.height, 0) << "Invalid image size.";
+
+  image_size_ = size;
+  const int num_pixels = GetNumPixels();
+  const int matrix_type = GetOpenCvMatrixType();
+  channels_.resize(num_channels);
+  for (int channel_index = 0; channel_index < num_channels; ++channel_index) {
+    const double* channel_pixels = &pixel_values[channel_index * num_pixels];
+    const cv::Mat channel_image(
+        size,
+        util::kOpenCvMatrixType,
+        const_cast<void*>(reinterpret_cast<const void*>(channel_pixels)));
+    // convertTo() only reallocates the channel if its size or type differs.
+    channel_image.convertTo(channels_[channel_index], matrix_type);
+  }
+  spectral_mode_ = GetDefaultSpectralMode(channels_.size());
+  luminance_channel_only_ = false;
+}
+
 void ImageData::ResizeImage(
     const cv::Size& new_size,
     const ResizeInterpolationMethod interpolation_method) {
@@ -316,40 +494,32 @@ void ImageData::ResizeImage(
   CHECK_GT(new_size.width, 0) << "Images must have a positive width.";
   CHECK_GT(new_size.height, 0) << "Images must have a positive height.";
 
-  int opencv_interpolation_method = 0;
-  switch (interpolation_method) {
-    case INTERPOLATE_ADDITIVE:
-      // Custom implementation (not in OpenCV).
-      image_size_ = ResizeAdditiveInterpolation(new_size, &channels_);
-      return;
-      break;
-    case INTERPOLATE_LINEAR:
-      opencv_interpolation_method = cv::INTER_LINEAR;
-      break;
-    case INTERPOLATE_CUBIC:
-      opencv_interpolation_method = cv::INTER_CUBIC;
-      break;
-    case INTERPOLATE_NEAREST:
-    default:
-      opencv_interpolation_method = cv::INTER_NEAREST;
-      break;
-  }
-
-  const int num_image_channels = GetNumChannels();
-  for (int i = 0; i < num_image_channels; ++i) {
-    cv::Mat scaled_image;
-    cv::resize(
-        channels_[i],   // Source image.
-        scaled_image,   // Dest image.
-        new_size,       // Desired image size.
-        0,              // Set x, y scale to 0 to use the given Size instead.
-        0,
-        opencv_interpolation_method);
-    channels_[i] = scaled_image;
-  }
+  std::vector<cv::Mat> resized_channels(channels_.size());
+  ResizeChannels(channels_, new_size, interpolation_method, &resized_channels);
+  channels_.swap(resized_channels);
   image_size_ = new_size;
 }
 
+void ImageData::ResizeImage(
+    const cv::Size& new_size,
+    const ResizeInterpolationMethod interpolation_method,
+    ImageData* resized_image) const {
+
+  CHECK_NOTNULL(resized_image);
+  CHECK_NE(resized_image, this) << "Use ResizeImage(size) to resize in place.";
+  CHECK(!channels_.empty()) << "Cannot resize an empty image.";
+  CHECK_GT(new_size.width, 0) << "Images must have a positive width.";
+  CHECK_GT(new_size.height, 0) << "Images must have a positive height.";
+
+  resized_image->channels_.resize(channels_.size());
+  ResizeChannels(
+      channels_, new_size, interpolation_method, &resized_image->channels_);
+  resized_image->image_size_ = new_size;
+  resized_image->spectral_mode_ = spectral_mode_;
+  resized_image->luminance_channel_only_ = luminance_channel_only_;
+  resized_image->precision_ = precision_;
+}
+
 void ImageData::ResizeImage(
     const double scale_factor,
     const ResizeInterpolationMethod interpolation_method) {
@@ -450,6 +620,17 @@ void ImageData::SetSpectralMode(const ImageSpectralMode& spectral_mode) {
   }
 }
 
+void ImageData::SetPrecision(const ImagePrecision precision) {
+  if (precision == precision_) {
+    return;
+  }
+  precision_ = precision;
+  const int matrix_type = GetOpenCvMatrixType();
+  for (cv::Mat& channel_image : channels_) {
+    channel_image.convertTo(channel_image, matrix_type);
+  }
+}
+
 void ImageData::InterpolateColorFrom(const ImageData& color_image) {
   CHECK_EQ(GetNumChannels(), 1)  // If other 2 channels are hidden, ignore them.
       << "Color can only be interpolated for single-channel images.";
@@ -520,6 +701,9 @@ double ImageData::GetPixelValue(
   CHECK(0 <= row && row < image_size_.height) << "Row index is out of bounds.";
   CHECK(0 <= col && col < image_size_.width) << "Col index is out of bounds.";
 
+  if (precision_ == IMAGE_PRECISION_FLOAT) {
+    return channels_[channel_index].at<float>(row, col);
+  }
   return channels_[channel_index].at<double>(row, col);
 }
 
@@ -530,12 +714,60 @@ const double* ImageData::GetChannelData(const int channel_index) const {
 double* ImageData::GetMutableChannelData(const int channel_index) const {
   CHECK_GE(channel_index, 0) << "Channel index must be at least 0.";
   CHECK_LT(channel_index, GetNumChannels()) << "Channel index out of bounds.";
+  CHECK_EQ(precision_, IMAGE_PRECISION_DOUBLE)
+      << "Channel data is only available for double precision images.";
 
   // TODO: verify that this is the correct approach of getting the data array.
   // static_cast doesn't work here because the data is apparently uchar*.
   return (double*)(channels_[channel_index].data);  // NOLINT
 }
 
+void ImageData::GatherSpectralVectors(
+    const int pixel_start,
+    const int num_pixels,
+    double* spectral_vectors) const {
+
+  CHECK_NOTNULL(spectral_vectors);
+  CHECK(0 <= pixel_start && pixel_start + num_pixels <= GetNumPixels())
+      << "Pixel range is out of bounds.";
+  CHECK_EQ(precision_, IMAGE_PRECISION_DOUBLE)
+      << "Spectral vectors are only available for double precision images.";
+
+  // Walk each channel contiguously and stride the writes instead of doing the
+  // opposite. The channels are much larger than a spectral vector, so this
+  // keeps the reads sequential.
+  const int num_channels = GetNumChannels();
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_data =
+        channels_[channel].ptr<double>() + pixel_start;
+    double* output = spectral_vectors + channel;
+    for (int i = 0; i < num_pixels; ++i) {
+      output[i * num_channels] = channel_data[i];
+    }
+  }
+}
+
+void ImageData::ScatterSpectralVectors(
+    const int pixel_start,
+    const int num_pixels,
+    const double* spectral_vectors) {
+
+  CHECK_NOTNULL(spectral_vectors);
+  CHECK(0 <= pixel_start && pixel_start + num_pixels <= GetNumPixels())
+      << "Pixel range is out of bounds.";
+  CHECK_EQ(precision_, IMAGE_PRECISION_DOUBLE)
+      << "Spectral vectors are only available for double precision images.";
+
+  const int num_channels = GetNumChannels();
+  for (int channel = 0; channel < num_channels; ++channel) {
+    double* channel_data = channels_[channel].ptr<double>() + pixel_start;
+    const double* input = spectral_vectors + channel;
+    for (int i = 0; i < num_pixels; ++i) {
+      channel_data[i] = input[i * num_channels];
+    }
+  }
+}
+
 cv::Mat ImageData::GetVisualizationImage() const {
   cv::Mat visualization_image;
   if (channels_.empty()) {
@@ -607,6 +839,14 @@ ImageDataReport ImageData::GetImageDataReport() const {
   return report;
 }
 
+// private
+int ImageData::GetOpenCvMatrixType() const {
+  if (precision_ == IMAGE_PRECISION_FLOAT) {
+    return util::kOpenCvSinglePrecisionMatrixType;
+  }
+  return util::kOpenCvMatrixType;
+}
+
 // private
 cv::Point ImageData::GetPixelCoordinatesFromIndex(const int index) const {
   CHECK_GE(index, 0) << "Pixel index must be at least 0.";
@@ -12,6 +12,8 @@
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 
+#include "glog/logging.h"
+
 namespace super_resolution {
 
 // Methods within ImageData that add channels from OpenCV Mat images may
@@ -67,6 +69,16 @@ enum ResizeInterpolationMethod {
   INTERPOLATE_ADDITIVE
 };
 
+// The numerical precision used to store the pixel values of an image. Double
+// precision is the default and is required by the raw data accessors (e.g.
+// GetChannelData()). Single precision halves the memory footprint and
+// bandwidth of the image operators (resizing, convolution, warping), and is
+// intended for data that is 8-bit or 32-bit float to begin with.
+enum ImagePrecision {
+  IMAGE_PRECISION_DOUBLE,  // util::kOpenCvMatrixType (CV_64FC1).
+  IMAGE_PRECISION_FLOAT    // util::kOpenCvSinglePrecisionMatrixType (CV_32FC1).
+};
+
 // The image spectral mode. For color images, this is used to determine the
 // color space (default BGR). For hyperspectral images, this is used to
 // determine if the image has been converted into a basis (e.g. using PCA).
@@ -161,6 +173,18 @@ class ImageData {
   // normalization happens.
   void AddChannel(const double* pixel_values, const cv::Size& size);
 
+  // Replaces all channels of this image with the given pixel value array, laid
+  // out as for the ImageData(const double*, size, num_channels) constructor.
+  // The values are converted straight to the precision of this image, and the
+  // existing channel buffers are reused when they already have the given size,
+  // so repeatedly setting an image of the same size does not reallocate memory.
+  //
+  // As with the constructor, the pixel values are not normalized.
+  void SetPixelValues(
+      const double* pixel_values,
+      const cv::Size& size,
+      const int num_channels = 1);
+
   // Resizes this image to the given Size. The given Size must be valid (i.e.
   // positive values for width and height). All channels will be resized
   // equally. Any new channels added to this image must be the same size as the
@@ -175,6 +199,16 @@ class ImageData {
       const ResizeInterpolationMethod interpolation_method
           = INTERPOLATE_NEAREST);
 
+  // Same as ResizeImage(size), but writes the resized image into the given
+  // destination image instead of modifying this image. The destination's
+  // existing channel buffers are reused when they already have the new size,
+  // so repeatedly resizing into the same destination does not reallocate
+  // memory. The destination cannot be this image.
+  void ResizeImage(
+      const cv::Size& new_size,
+      const ResizeInterpolationMethod interpolation_method,
+      ImageData* resized_image) const;
+
   // Resizes this image by the given scale factor, in the same manner as
   // ResizeImage(size). The new dimensions will be (width * scale_factor,
   // height * scale_factor). The given scale factor must be larger than 0.
@@ -199,6 +233,20 @@ class ImageData {
   // for potentially invalid settings.
   void SetSpectralMode(const ImageSpectralMode& spectral_mode);
 
+  // Converts the stored pixel values of every channel to the given precision.
+  // Channels added afterwards are converted to the same precision. Images are
+  // stored in double precision by default.
+  //
+  // The raw data accessors (GetChannelData(), GetRowData(), and the spectral
+  // vector methods) are only available for double precision images. Use
+  // GetChannelImage() or GetPixelValue() for single precision images.
+  void SetPrecision(const ImagePrecision precision);
+
+  // Returns the precision that the pixel values of this image are stored in.
+  ImagePrecision GetPrecision() const {
+    return precision_;
+  }
+
   // This method will interpolate the color information from the given image
   // into this monochrome image. Typically, this image would be higher
   // resolution than the other given image so that structure is preserved and
@@ -288,6 +336,53 @@ class ImageData {
   // the values of the returned array.
   double* GetMutableChannelData(const int channel_index) const;
 
+  // Returns a data pointer to the first pixel of the given row in the given
+  // channel. The array contains GetImageSize().width values.
+  //
+  // Unlike GetPixelValue(), the indices are NOT verified in release builds.
+  // These accessors are intended for tight loops where the caller already
+  // guarantees valid indices. The precision is always verified, since reading
+  // float data as doubles would silently return garbage.
+  const double* GetRowData(const int channel_index, const int row) const {
+    CheckRowAccess(channel_index, row);
+    return channels_[channel_index].ptr<double>(row);
+  }
+
+  // Same as GetRowData(), but allows the row values to be modified.
+  double* GetMutableRowData(const int channel_index, const int row) const {
+    CheckRowAccess(channel_index, row);
+    return const_cast<double*>(channels_[channel_index].ptr<double>(row));
+  }
+
+  // Copies the spectral vector (the values of every channel) of each pixel in
+  // the range [pixel_start, pixel_start + num_pixels) into the given array.
+  // The output is pixel-major: the spectral vector of pixel i is stored at
+  // spectral_vectors[(i - pixel_start) * GetNumChannels()]. The array must
+  // have space for num_pixels * GetNumChannels() values.
+  //
+  // Channels are traversed contiguously, so this is much faster than calling
+  // GetPixelValue() for every (channel, pixel) pair.
+  void GatherSpectralVectors(
+      const int pixel_start,
+      const int num_pixels,
+      double* spectral_vectors) const;
+
+  // The inverse of GatherSpectralVectors(). Writes the pixel-major spectral
+  // vectors from the given array into the channels of this image.
+  void ScatterSpectralVectors(
+      const int pixel_start,
+      const int num_pixels,
+      const double* spectral_vectors);
+
+  // Single-pixel versions of the gather/scatter methods above. The given
+  // array must hold GetNumChannels() values.
+  void GetSpectralVector(const int pixel_index, double* spectral_vector) const {
+    GatherSpectralVectors(pixel_index, 1, spectral_vector);
+  }
+  void SetSpectralVector(const int pixel_index, const double* spectral_vector) {
+    ScatterSpectralVectors(pixel_index, 1, spectral_vector);
+  }
+
   // Returns an OpenCV Mat image which is a naively-constructed monochrome or
   // RGB image combined from the channels in this image for visualization
   // purposes. An empty OpenCV Mat will be returned (and a warning will be
@@ -316,6 +411,22 @@ class ImageData {
   // are (x [col], y [row]).
   cv::Point GetPixelCoordinatesFromIndex(const int index) const;
 
+  // Verifies the arguments of the row accessors. The channel and row indices
+  // are only verified in debug builds, but the precision is always verified
+  // (as in GetChannelData()).
+  void CheckRowAccess(const int channel_index, const int row) const {
+    DCHECK(0 <= channel_index && channel_index < GetNumChannels())
+        << "Channel index is out of bounds.";
+    DCHECK(0 <= row && row < image_size_.height)
+        << "Row index is out of bounds.";
+    CHECK_EQ(precision_, IMAGE_PRECISION_DOUBLE)
+        << "Row data is only available for double precision images.";
+  }
+
+  // Returns the OpenCV matrix type used to store channels at the current
+  // precision.
+  int GetOpenCvMatrixType() const;
+
   // The spectral mode of this image. SPECTRAL_MODE_COLOR_* is for 3-channel
   // color images. By default, it is assumed that all 3-channel images are
   // represented in the BGR color space. All images with more than 3 channels
@@ -347,6 +458,9 @@ class ImageData {
   // image. Empty images have a size of (0, 0).
   cv::Size image_size_;
 
+  // The precision of the stored pixel values. See SetPrecision().
+  ImagePrecision precision_ = IMAGE_PRECISION_DOUBLE;
+
   // The data is stored as OpenCV Mat images, one for each channel to support
   // an arbitrary number of channels.
   std::vector<cv::Mat> channels_;
@@ -28,9 +28,9 @@ void AdditiveNoiseModule::ApplyToImage(
   const cv::Size image_size = image_data->GetImageSize();
   const int num_image_channels = image_data->GetNumChannels();
   for (int i = 0; i < num_image_channels; ++i) {
-    cv::Mat noise = cv::Mat(image_size, util::kOpenCvMatrixType);
-    cv::randn(noise, 0, scaled_sigma);
     cv::Mat channel_image = image_data->GetChannelImage(i);
+    cv::Mat noise = cv::Mat(image_size, channel_image.type());
+    cv::randn(noise, 0, scaled_sigma);
     channel_image += noise;
   }
 }
@@ -1,7 +1,12 @@
 #include "image_model/blur_module.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include "image/image_data.h"
 #include "util/matrix_util.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
@@ -9,30 +14,208 @@
 #include "glog/logging.h"
 
 namespace super_resolution {
+namespace {
+
+// The estimated cost per pixel of the FFT method is this factor times log2 of
+// the padded image area (covering the forward and inverse transforms), in
+// units of one multiply-add of the separable passes.
+constexpr double kFftCostFactor = 5.0;
+
+// Returns the size that images are zero-padded to for the FFT method, such
+// that the circular correlation with the kernel does not wrap around.
+cv::Size GetDftSize(const cv::Size& image_size, const int kernel_size) {
+  return cv::Size(
+      cv::getOptimalDFTSize(image_size.width + kernel_size - 1),
+      cv::getOptimalDFTSize(image_size.height + kernel_size - 1));
+}
+
+// Correlates each row of the input image with the given 1D kernel, with zeros
+// outside of the image. If kKernelSize is positive, it must be the size of the
+// kernel, and the loop over the kernel is specialized for it.
+template <typename T, int kKernelSize>
+void CorrelateRows(
+    const cv::Mat& input_image,
+    const std::vector<double>& kernel,
+    cv::Mat* output_image) {
+
+  const int kernel_size =
+      (kKernelSize > 0) ? kKernelSize : static_cast<int>(kernel.size());
+  const int half_size = kernel_size / 2;
+  const int num_cols = input_image.cols;
+  const double* weights = kernel.data();
+  for (int row = 0; row < input_image.rows; ++row) {
+    const T* input = input_image.ptr<T>(row);
+    double* output = output_image->ptr<double>(row);
+    for (int col = 0; col < num_cols; ++col) {
+      double sum = 0.0;
+      if (col >= half_size && col + half_size < num_cols) {
+        const T* window = input + col - half_size;
+        for (int k = 0; k < kernel_size; ++k) {
+          sum += weights[k] * window[k];
+        }
+      } else {
+        const int start = std::max(0, half_size - col);
+        const int end = std::min(kernel_size, num_cols - col + half_size);
+        for (int k = start; k < end; ++k) {
+          sum += weights[k] * input[col - half_size + k];
+        }
+      }
+      output[col] = sum;
+    }
+  }
+}
+
+// Correlates each column of the input image with the given 1D kernel, with
+// zeros outside of the image. Whole rows are accumulated at a time.
+template <typename T, int kKernelSize>
+void CorrelateColumns(
+    const cv::Mat& input_image,
+    const std::vector<double>& kernel,
+    cv::Mat* output_image) {
+
+  const int kernel_size =
+      (kKernelSize > 0) ? kKernelSize : static_cast<int>(kernel.size());
+  const int half_size = kernel_size / 2;
+  const int num_rows = input_image.rows;
+  const int num_cols = input_image.cols;
+  std::vector<double> sums(num_cols);
+  for (int row = 0; row < num_rows; ++row) {
+    std::fill(sums.begin(), sums.end(), 0.0);
+    const int start = std::max(0, half_size - row);
+    const int end = std::min(kernel_size, num_rows - row + half_size);
+    for (int k = start; k < end; ++k) {
+      const double weight = kernel[k];
+      const double* input = input_image.ptr<double>(row - half_size + k);
+      for (int col = 0; col < num_cols; ++col) {
+        sums[col] += weight * input[col];
+      }
+    }
+    T* output = output_image->ptr<T>(row);
+    for (int col = 0; col < num_cols; ++col) {
+      output[col] = static_cast<T>(sums[col]);
+    }
+  }
+}
+
+// Correlates the image in place with the separable kernel given by its 1D
+// factors.
+template <typename T, int kKernelSize>
+void CorrelateSeparablePasses(
+    const std::vector<double>& kernel_x,
+    const std::vector<double>& kernel_y,
+    cv::Mat* image) {
+
+  cv::Mat row_correlation(image->size(), CV_64FC1);
+  CorrelateRows<T, kKernelSize>(*image, kernel_x, &row_correlation);
+  CorrelateColumns<T, kKernelSize>(row_correlation, kernel_y, image);
+}
+
+// Dispatches to the passes specialized for the kernel size, if any. Both
+// kernels must have the same size.
+template <typename T>
+void CorrelateSeparable(
+    const std::vector<double>& kernel_x,
+    const std::vector<double>& kernel_y,
+    cv::Mat* image) {
+
+  switch (kernel_x.size()) {
+    case 3:
+      CorrelateSeparablePasses<T, 3>(kernel_x, kernel_y, image);
+      break;
+    case 5:
+      CorrelateSeparablePasses<T, 5>(kernel_x, kernel_y, image);
+      break;
+    case 7:
+      CorrelateSeparablePasses<T, 7>(kernel_x, kernel_y, image);
+      break;
+    default:
+      CorrelateSeparablePasses<T, 0>(kernel_x, kernel_y, image);
+      break;
+  }
+}
+
+// Returns the spectrum of the given 2D kernel, zero-padded to the given size.
+cv::Mat GetKernelSpectrum(const cv::Mat& kernel, const cv::Size& dft_size) {
+  cv::Mat padded_kernel;
+  cv::copyMakeBorder(
+      kernel,
+      padded_kernel,
+      0,
+      dft_size.height - kernel.rows,
+      0,
+      dft_size.width - kernel.cols,
+      cv::BORDER_CONSTANT,
+      cv::Scalar(0));
+  cv::Mat kernel_spectrum;
+  cv::dft(padded_kernel, kernel_spectrum, cv::DFT_COMPLEX_OUTPUT);
+  return kernel_spectrum;
+}
+
+// Correlates the image in place with the kernel of the given size whose
+// spectrum (see GetKernelSpectrum()) is given. The image is placed into the
+// padded buffer offset by half of the kernel size, so that the circular
+// correlation starts at the top-left corner of the image and only wraps into
+// zero padding.
+void CorrelateWithSpectrum(
+    const cv::Mat& kernel_spectrum,
+    const cv::Size& kernel_size,
+    cv::Mat* image) {
 
-BlurModule::BlurModule(const int blur_radius, const double sigma)
-    : blur_radius_(blur_radius) {
+  const int half_width = kernel_size.width / 2;
+  const int half_height = kernel_size.height / 2;
+  cv::Mat padded_image;
+  image->convertTo(padded_image, CV_64FC1);
+  cv::copyMakeBorder(
+      padded_image,
+      padded_image,
+      half_height,
+      kernel_spectrum.rows - image->rows - half_height,
+      half_width,
+      kernel_spectrum.cols - image->cols - half_width,
+      cv::BORDER_CONSTANT,
+      cv::Scalar(0));
+  cv::Mat spectrum;
+  cv::dft(padded_image, spectrum, cv::DFT_COMPLEX_OUTPUT);
+  cv::mulSpectrums(spectrum, kernel_spectrum, spectrum, 0, true);
+  cv::Mat correlation;
+  cv::idft(spectrum, correlation, cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+  // The image header shares its data with the ImageData, so the result is
+  // written back into the image.
+  correlation(cv::Rect(0, 0, image->cols, image->rows)).convertTo(
+      *image, image->type());
+}
+
+}  // namespace
+
+BlurModule::BlurModule(
+    const int blur_radius, const double sigma, const BlurMethod blur_method)
+    : blur_radius_(blur_radius), blur_method_(blur_method) {
 
   CHECK_GE(blur_radius, 1);
   CHECK_GT(sigma, 0.0);
   CHECK(blur_radius % 2 == 1) << "Blur radius must be an odd number.";
 
-  const cv::Mat kernel_x = cv::getGaussianKernel(blur_radius, sigma);
-  const cv::Mat kernel_y = cv::getGaussianKernel(blur_radius, sigma);
-  blur_kernel_ = kernel_x * kernel_y.t();
+  const cv::Mat kernel_x =
+      cv::getGaussianKernel(blur_radius, sigma, util::kOpenCvMatrixType);
+  const cv::Mat kernel_y =
+      cv::getGaussianKernel(blur_radius, sigma, util::kOpenCvMatrixType);
+  kernel_x_.assign(
+      kernel_x.ptr<double>(), kernel_x.ptr<double>() + blur_radius);
+  kernel_y_.assign(
+      kernel_y.ptr<double>(), kernel_y.ptr<double>() + blur_radius);
+  blur_kernel_ = kernel_y * kernel_x.t();
 }
 
 void BlurModule::ApplyToImage(ImageData* image_data, const int index) const {
   CHECK_NOTNULL(image_data);
-  util::ApplyConvolutionToImage(image_data, blur_kernel_);
+  ApplyBlur(image_data, false);
 }
 
 void BlurModule::ApplyTransposeToImage(
     ImageData* image_data, const int index) const {
 
   CHECK_NOTNULL(image_data);
-
-  util::ApplyConvolutionToImage(image_data, blur_kernel_.t());
+  ApplyBlur(image_data, true);
 }
 
 cv::Mat BlurModule::GetOperatorMatrix(
@@ -41,4 +224,59 @@ cv::Mat BlurModule::GetOperatorMatrix(
   return ConvertKernelToOperatorMatrix(blur_kernel_, image_size);
 }
 
+BlurMethod BlurModule::GetBlurMethod(const cv::Size& image_size) const {
+  if (blur_method_ != BLUR_METHOD_AUTO) {
+    return blur_method_;
+  }
+  const double padded_area = GetDftSize(image_size, blur_radius_).area();
+  const double fft_cost = kFftCostFactor * std::log2(padded_area) *
+                          padded_area / image_size.area();
+  const double separable_cost = kernel_x_.size() + kernel_y_.size();
+  return (fft_cost < separable_cost) ? BLUR_METHOD_FFT : BLUR_METHOD_SEPARABLE;
+}
+
+void BlurModule::ApplyBlur(
+    ImageData* image_data, const bool transpose) const {
+
+  const int num_channels = image_data->GetNumChannels();
+  if (num_channels == 0) {
+    return;
+  }
+  const cv::Size image_size = image_data->GetImageSize();
+  const bool is_double_precision =
+      (image_data->GetPrecision() == IMAGE_PRECISION_DOUBLE);
+
+  // The transpose of a correlation (with zeros outside of the image) is the
+  // correlation with the kernel flipped in both directions.
+  if (GetBlurMethod(image_size) == BLUR_METHOD_FFT) {
+    cv::Mat kernel = blur_kernel_;
+    if (transpose) {
+      cv::flip(blur_kernel_, kernel, -1);
+    }
+    // The kernel spectrum is shared by all channels.
+    const cv::Mat kernel_spectrum =
+        GetKernelSpectrum(kernel, GetDftSize(image_size, blur_radius_));
+    util::ParallelFor(num_channels, [&](const int index) {
+      cv::Mat channel_image = image_data->GetChannelImage(index);
+      CorrelateWithSpectrum(kernel_spectrum, kernel.size(), &channel_image);
+    });
+    return;
+  }
+
+  std::vector<double> kernel_x = kernel_x_;
+  std::vector<double> kernel_y = kernel_y_;
+  if (transpose) {
+    std::reverse(kernel_x.begin(), kernel_x.end());
+    std::reverse(kernel_y.begin(), kernel_y.end());
+  }
+  util::ParallelFor(num_channels, [&](const int index) {
+    cv::Mat channel_image = image_data->GetChannelImage(index);
+    if (is_double_precision) {
+      CorrelateSeparable<double>(kernel_x, kernel_y, &channel_image);
+    } else {
+      CorrelateSeparable<float>(kernel_x, kernel_y, &channel_image);
+    }
+  });
+}
+
 }  // namespace super_resolution
@@ -1,22 +1,44 @@
 // A standard blurring kernel that applies a Gaussian blur, emulating a point
 // spread function (PSF). The PSF is assumed to be the same in both the x and y
 // directions.
+//
+// The Gaussian is separable, so it is applied as a horizontal and a vertical
+// 1D pass, which costs O(r) per pixel instead of O(r^2) for the full 2D
+// kernel. For very large kernels, the blur is applied in the frequency domain
+// instead.
 
 #ifndef SRC_IMAGE_MODEL_BLUR_MODULE_H_
 #define SRC_IMAGE_MODEL_BLUR_MODULE_H_
 
+#include <vector>
+
 #include "image_model/degradation_operator.h"
 
 #include "opencv2/core/core.hpp"
 
 namespace super_resolution {
 
+// How the blur is applied to the image.
+enum BlurMethod {
+  // Chooses the cheaper of the methods below for each image size.
+  BLUR_METHOD_AUTO,
+
+  // Two 1D passes. Kernel sizes 3, 5, and 7 use specialized passes.
+  BLUR_METHOD_SEPARABLE,
+
+  // Multiplication with the spectrum of the kernel.
+  BLUR_METHOD_FFT
+};
+
 class BlurModule : public DegradationOperator {
  public:
   // The given blur radius and sigma (in pixels) will define the Gaussian blur.
   // The blur radius must be at least 1 and sigma must be greater than 0.
   // The blur radius must be an odd number.
-  BlurModule(const int blur_radius, const double sigma);
+  BlurModule(
+      const int blur_radius,
+      const double sigma,
+      const BlurMethod blur_method = BLUR_METHOD_AUTO);
 
   virtual void ApplyToImage(ImageData* image_data, const int index) const;
 
@@ -26,11 +48,26 @@ class BlurModule : public DegradationOperator {
   virtual cv::Mat GetOperatorMatrix(
       const cv::Size& image_size, const int index) const;
 
+  // Returns the method that is used to blur images of the given size. If the
+  // method was not given explicitly, this compares the estimated cost per
+  // pixel of the separable passes and of the FFT for the image size.
+  BlurMethod GetBlurMethod(const cv::Size& image_size) const;
+
  private:
+  // Applies the blur (or its transpose, which correlates with the flipped
+  // kernel) to every channel of the image.
+  void ApplyBlur(ImageData* image_data, const bool transpose) const;
+
   const int blur_radius_;
+  const BlurMethod blur_method_;
+
+  // The 1D factors of the kernel, applied along the rows (x) and the columns
+  // (y) of the image.
+  std::vector<double> kernel_x_;
+  std::vector<double> kernel_y_;
 
-  // This kernel is created in the constructor and is used for the blurring
-  // convolution and for getting the operator matrix.
+  // The full 2D kernel (the outer product of the 1D factors). This is used by
+  // the FFT method and for getting the operator matrix.
   cv::Mat blur_kernel_;
 };
 
@@ -9,6 +9,7 @@
 #include "image_model/degradation_operator.h"
 #include "image_model/downsampling_module.h"
 #include "image_model/motion_module.h"
+#include "image_model/warp_motion_module.h"
 
 #include "glog/logging.h"
 
@@ -38,6 +39,21 @@ ImageModel ImageModel::CreateImageModel(
     image_model.AddDegradationOperator(motion_module);
   }
 
+  // Add general motion if a warp motion file is provided.
+  if (!parameters.warp_motion_path.empty()) {
+    CHECK(parameters.motion_sequence_path.empty() &&
+          parameters.motion_sequence.GetNumMotionShifts() == 0)
+        << "Use either a motion shift sequence or warp motions, not both.";
+    CHECK_GT(parameters.image_size.area(), 0)
+        << "The image size is required for warp motions.";
+    std::shared_ptr<WarpMotionModule> warp_motion_module(
+        new WarpMotionModule(
+            parameters.image_size,
+            parameters.warp_motion_type,
+            LoadWarpMotionsFromFile(parameters.warp_motion_path)));
+    image_model.AddDegradationOperator(warp_motion_module);
+  }
+
   // Add blur if the blur parameters are non-zero.
   if (parameters.blur_radius > 0 && parameters.blur_sigma > 0.0) {
     std::shared_ptr<BlurModule> blur_module(
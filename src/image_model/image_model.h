@@ -15,6 +15,7 @@
 
 #include "image/image_data.h"
 #include "image_model/degradation_operator.h"
+#include "image_model/warp_motion_module.h"
 #include "motion/motion_shift.h"
 
 #include "opencv2/core/core.hpp"
@@ -37,6 +38,14 @@ struct ImageModelParameters {
   std::string motion_sequence_path = "";
   MotionShiftSequence motion_sequence;
 
+  // General motion (M). Set the path of a warp motion file (see
+  // LoadWarpMotionsFromFile()) to warp each frame with an affine transform or
+  // a dense flow field instead of a shift. The warps are precomputed for the
+  // given high-resolution image size, which must be set in that case.
+  std::string warp_motion_path = "";
+  WarpMotionType warp_motion_type = WARP_MOTION_AFFINE;
+  cv::Size image_size;
+
   // Noise. Set to a positive value to include noise. This is just for
   // generating artificial data. Do not add noise for modeling a forward image
   // model in super-resolution.
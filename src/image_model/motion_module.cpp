@@ -2,28 +2,137 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #include "image/image_data.h"
 #include "motion/motion_shift.h"
 #include "util/matrix_util.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
-#include "opencv2/imgproc/imgproc.hpp"
 
 #include "glog/logging.h"
 
 namespace super_resolution {
 namespace {
 
-void ApplyWarpKernel(const cv::Mat& warp_kernel, ImageData* image_data) {
-  const cv::Size image_size = image_data->GetImageSize();
-  int num_image_channels = image_data->GetNumChannels();
-  for (int i = 0; i < num_image_channels; ++i) {
-    cv::Mat channel_image = image_data->GetChannelImage(i);
-    cv::warpAffine(channel_image, channel_image, warp_kernel, image_size);
+// Returns true if the given shift moves the image by a whole number of pixels
+// in both directions.
+bool IsIntegerShift(const double dx, const double dy) {
+  return dx == std::round(dx) && dy == std::round(dy);
+}
+
+// Shifts the given image in place by a whole number of pixels, such that
+// image(row, col) = original(row - dy, col - dx). Pixels that are shifted in
+// from outside of the image are set to zero. This gives the same result as
+// warpAffine with an integer translation, but only moves memory. Shifting by
+// (-dx, -dy) is the exact transpose of shifting by (dx, dy).
+void ShiftImageByInteger(const int dx, const int dy, cv::Mat* image) {
+  const int num_rows = image->rows;
+  const int num_cols = image->cols;
+  const size_t pixel_size = image->elemSize();
+  const int num_copied_cols = std::max(num_cols - std::abs(dx), 0);
+  const size_t copied_size = num_copied_cols * pixel_size;
+  const size_t zero_size = (num_cols - num_copied_cols) * pixel_size;
+
+  // Rows are moved in the direction of the shift, starting at the far end, so
+  // that every source row is read before it gets overwritten.
+  const int first_row = (dy > 0) ? (num_rows - 1) : 0;
+  const int row_step = (dy > 0) ? -1 : 1;
+  for (int i = 0; i < num_rows; ++i) {
+    const int row = first_row + i * row_step;
+    const int source_row = row - dy;
+    unsigned char* row_data = image->ptr(row);
+    if (source_row < 0 || source_row >= num_rows || num_copied_cols == 0) {
+      std::memset(row_data, 0, num_cols * pixel_size);
+      continue;
+    }
+    const unsigned char* source_data = image->ptr(source_row);
+    if (dx >= 0) {
+      std::memmove(row_data + zero_size, source_data, copied_size);
+      std::memset(row_data, 0, zero_size);
+    } else {
+      std::memmove(row_data, source_data + zero_size, copied_size);
+      std::memset(row_data + copied_size, 0, zero_size);
+    }
   }
 }
 
+// Shifts the given image by (dx, dy) with bilinear interpolation, such that
+// image(row, col) is interpolated at original(row - dy, col - dx). Pixels
+// outside of the original image are taken as zero. This matches warpAffine
+// with the same translation (up to warpAffine's quantization of the weights),
+// but since a translation uses the same four interpolation weights for every
+// pixel, each output row is just a weighted sum of four shifted source rows.
+template <typename T>
+void ShiftImageBySubpixel(const double dx, const double dy, cv::Mat* image) {
+  const int num_rows = image->rows;
+  const int num_cols = image->cols;
+
+  // Output pixel (row, col) reads source rows row + y_offset + i and columns
+  // col + x_offset + j for i, j in {0, 1}.
+  const double x_floor = std::floor(-dx);
+  const double y_floor = std::floor(-dy);
+  const double fx = -dx - x_floor;
+  const double fy = -dy - y_floor;
+  const int x_offset = static_cast<int>(x_floor);
+  const int y_offset = static_cast<int>(y_floor);
+  const double weights[2][2] = {
+    {(1.0 - fx) * (1.0 - fy), fx * (1.0 - fy)},
+    {(1.0 - fx) * fy, fx * fy}
+  };
+
+  const cv::Mat source_image = image->clone();
+  for (int row = 0; row < num_rows; ++row) {
+    T* output = image->ptr<T>(row);
+    std::fill(output, output + num_cols, static_cast<T>(0));
+    for (int i = 0; i < 2; ++i) {
+      const int source_row = row + y_offset + i;
+      if (source_row < 0 || source_row >= num_rows) {
+        continue;
+      }
+      const T* source = source_image.ptr<T>(source_row);
+      for (int j = 0; j < 2; ++j) {
+        const double weight = weights[i][j];
+        if (weight == 0.0) {
+          continue;
+        }
+        const int col_offset = x_offset + j;
+        const int start_col = std::max(0, -col_offset);
+        const int end_col = std::min(num_cols, num_cols - col_offset);
+        for (int col = start_col; col < end_col; ++col) {
+          output[col] += weight * source[col + col_offset];
+        }
+      }
+    }
+  }
+}
+
+// Shifts every channel of the given image by (dx, dy). Integer shifts are
+// applied as memory moves, and sub-pixel shifts are interpolated bilinearly
+// with weights that are shared by all pixels and channels. Channels are
+// shifted in parallel.
+void ApplyShift(const double dx, const double dy, ImageData* image_data) {
+  if (dx == 0 && dy == 0) {
+    return;
+  }
+  const bool is_integer_shift = IsIntegerShift(dx, dy);
+  const bool is_double_precision =
+      (image_data->GetPrecision() == IMAGE_PRECISION_DOUBLE);
+  util::ParallelFor(image_data->GetNumChannels(), [&](const int index) {
+    cv::Mat channel_image = image_data->GetChannelImage(index);
+    if (is_integer_shift) {
+      ShiftImageByInteger(
+          static_cast<int>(dx), static_cast<int>(dy), &channel_image);
+    } else if (is_double_precision) {
+      ShiftImageBySubpixel<double>(dx, dy, &channel_image);
+    } else {
+      ShiftImageBySubpixel<float>(dx, dy, &channel_image);
+    }
+  });
+}
+
 }  // namespace
 
 void MotionModule::ApplyToImage(ImageData* image_data, const int index) const {
@@ -31,10 +140,7 @@ void MotionModule::ApplyToImage(ImageData* image_data, const int index) const {
 
   const MotionShift motion_shift =
       motion_shift_sequence_.GetMotionShift(index);
-  const cv::Mat shift_kernel = (cv::Mat_<double>(2, 3)
-      << 1, 0, motion_shift.dx,
-         0, 1, motion_shift.dy);
-  ApplyWarpKernel(shift_kernel, image_data);
+  ApplyShift(motion_shift.dx, motion_shift.dy, image_data);
 }
 
 void MotionModule::ApplyTransposeToImage(
@@ -44,10 +150,7 @@ void MotionModule::ApplyTransposeToImage(
 
   const MotionShift motion_shift =
       motion_shift_sequence_.GetMotionShift(index);
-  const cv::Mat reverse_shift_kernel = (cv::Mat_<double>(2, 3)
-      << 1, 0, -motion_shift.dx,
-         0, 1, -motion_shift.dy);
-  ApplyWarpKernel(reverse_shift_kernel, image_data);
+  ApplyShift(-motion_shift.dx, -motion_shift.dy, image_data);
 }
 
 cv::Mat MotionModule::GetOperatorMatrix(
@@ -1,5 +1,7 @@
 // This motion degradation module simply applies a translational transformation
 // on each image in the frame sequence based on the given MotionShiftSequence.
+// Whole-pixel shifts are applied as exact memory moves, and only sub-pixel
+// shifts are interpolated.
 
 #ifndef SRC_IMAGE_MODEL_MOTION_MODULE_H_
 #define SRC_IMAGE_MODEL_MOTION_MODULE_H_
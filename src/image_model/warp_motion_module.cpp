@@ -0,0 +1,312 @@
+#include "image_model/warp_motion_module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "image/image_data.h"
+#include "util/matrix_util.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Returns the reference image coordinates (x, y) that each pixel of the frame
+// is sampled from, as a CV_64FC2 image.
+cv::Mat GetSourceCoordinates(
+    const cv::Size& image_size,
+    const WarpMotionType motion_type,
+    const cv::Mat& frame_motion) {
+
+  cv::Mat source_coordinates(image_size, CV_64FC2);
+  if (motion_type == WARP_MOTION_AFFINE) {
+    CHECK(frame_motion.rows == 2 && frame_motion.cols == 3)
+        << "Affine frame motions must be 2x3 matrices.";
+    cv::Mat affine_transform;
+    frame_motion.convertTo(affine_transform, CV_64FC1);
+    cv::Mat inverse_transform;
+    cv::invertAffineTransform(affine_transform, inverse_transform);
+    const double* a = inverse_transform.ptr<double>(0);
+    const double* b = inverse_transform.ptr<double>(1);
+    for (int row = 0; row < image_size.height; ++row) {
+      cv::Vec2d* coordinates = source_coordinates.ptr<cv::Vec2d>(row);
+      for (int col = 0; col < image_size.width; ++col) {
+        coordinates[col][0] = a[0] * col + a[1] * row + a[2];
+        coordinates[col][1] = b[0] * col + b[1] * row + b[2];
+      }
+    }
+    return source_coordinates;
+  }
+
+  CHECK_EQ(frame_motion.size(), image_size)
+      << "Flow fields must be the same size as the image.";
+  CHECK_EQ(frame_motion.channels(), 2)
+      << "Flow fields must have an x and a y channel.";
+  cv::Mat flow;
+  frame_motion.convertTo(flow, CV_64FC2);
+  for (int row = 0; row < image_size.height; ++row) {
+    const cv::Vec2d* flow_vectors = flow.ptr<cv::Vec2d>(row);
+    cv::Vec2d* coordinates = source_coordinates.ptr<cv::Vec2d>(row);
+    for (int col = 0; col < image_size.width; ++col) {
+      coordinates[col][0] = col - flow_vectors[col][0];
+      coordinates[col][1] = row - flow_vectors[col][1];
+    }
+  }
+  return source_coordinates;
+}
+
+// Computes output = W * input for every channel, where W is a sparse warp in
+// compressed row form (see WarpMotionModule::SparseWarp). All channels are
+// accumulated in a single pass over the nonzero weights. The input channels
+// must be continuous.
+template <typename T>
+void GatherChannels(
+    const std::vector<int>& row_offsets,
+    const std::vector<int>& input_indices,
+    const std::vector<double>& weights,
+    const std::vector<cv::Mat>& input_channels,
+    std::vector<cv::Mat>* output_channels) {
+
+  const int num_channels = input_channels.size();
+  const int num_rows = output_channels->at(0).rows;
+  const int num_cols = output_channels->at(0).cols;
+  util::ParallelFor(num_rows, [&](const int row) {
+    std::vector<const T*> inputs(num_channels);
+    std::vector<T*> outputs(num_channels);
+    for (int channel = 0; channel < num_channels; ++channel) {
+      inputs[channel] = input_channels[channel].ptr<T>();
+      outputs[channel] = output_channels->at(channel).ptr<T>(row);
+    }
+    std::vector<double> sums(num_channels);
+    for (int col = 0; col < num_cols; ++col) {
+      const int pixel_index = row * num_cols + col;
+      std::fill(sums.begin(), sums.end(), 0.0);
+      for (int j = row_offsets[pixel_index];
+           j < row_offsets[pixel_index + 1]; ++j) {
+        const int input_index = input_indices[j];
+        const double weight = weights[j];
+        for (int channel = 0; channel < num_channels; ++channel) {
+          sums[channel] += weight * inputs[channel][input_index];
+        }
+      }
+      for (int channel = 0; channel < num_channels; ++channel) {
+        outputs[channel][col] = static_cast<T>(sums[channel]);
+      }
+    }
+  });
+}
+
+}  // namespace
+
+WarpMotionType GetWarpMotionType(const std::string& type_name) {
+  if (type_name == "affine") {
+    return WARP_MOTION_AFFINE;
+  }
+  if (type_name == "flow") {
+    return WARP_MOTION_DENSE_FLOW;
+  }
+  LOG(FATAL) << "Unknown warp motion type '" << type_name
+             << "'. Use 'affine' or 'flow'.";
+  return WARP_MOTION_AFFINE;
+}
+
+std::vector<cv::Mat> LoadWarpMotionsFromFile(const std::string& file_path) {
+  cv::FileStorage file_storage(file_path, cv::FileStorage::READ);
+  CHECK(file_storage.isOpened()) << "Could not open file " << file_path;
+
+  const cv::FileNode frame_motions_node = file_storage["frame_motions"];
+  CHECK(frame_motions_node.isSeq())
+      << "File " << file_path << " has no 'frame_motions' sequence.";
+  std::vector<cv::Mat> frame_motions;
+  for (cv::FileNodeIterator it = frame_motions_node.begin();
+       it != frame_motions_node.end(); ++it) {
+    cv::Mat frame_motion;
+    *it >> frame_motion;
+    CHECK(!frame_motion.empty())
+        << "Frame motion " << frame_motions.size() << " in " << file_path
+        << " is empty.";
+    frame_motions.push_back(frame_motion);
+  }
+  file_storage.release();
+
+  LOG(INFO) << "Loaded " << frame_motions.size() << " frame motions from '"
+            << file_path << "'.";
+  return frame_motions;
+}
+
+WarpMotionModule::WarpMotionModule(
+    const cv::Size& image_size,
+    const WarpMotionType motion_type,
+    const std::vector<cv::Mat>& frame_motions)
+    : image_size_(image_size) {
+
+  CHECK_GT(image_size_.area(), 0) << "The image size must not be empty.";
+  const int num_frames = frame_motions.size();
+  frame_warps_.resize(num_frames);
+  util::ParallelFor(num_frames, [&](const int index) {
+    const cv::Mat source_coordinates =
+        GetSourceCoordinates(image_size_, motion_type, frame_motions[index]);
+    frame_warps_[index].warp = GetBilinearWarp(source_coordinates);
+    frame_warps_[index].transpose_warp =
+        GetTransposeWarp(frame_warps_[index].warp);
+  });
+}
+
+void WarpMotionModule::ApplyToImage(
+    ImageData* image_data, const int index) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_GE(index, 0) << "Frame index must be non-negative.";
+  CHECK_LT(index, GetNumFrames()) << "Frame index is out of bounds.";
+  ApplySparseWarp(frame_warps_[index].warp, image_data);
+}
+
+void WarpMotionModule::ApplyTransposeToImage(
+    ImageData* image_data, const int index) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_GE(index, 0) << "Frame index must be non-negative.";
+  CHECK_LT(index, GetNumFrames()) << "Frame index is out of bounds.";
+  ApplySparseWarp(frame_warps_[index].transpose_warp, image_data);
+}
+
+cv::Mat WarpMotionModule::GetOperatorMatrix(
+    const cv::Size& image_size, const int index) const {
+
+  CHECK_EQ(image_size, image_size_)
+      << "The warps were computed for a different image size.";
+  CHECK_GE(index, 0) << "Frame index must be non-negative.";
+  CHECK_LT(index, GetNumFrames()) << "Frame index is out of bounds.";
+
+  const int num_pixels = image_size.area();
+  cv::Mat motion_matrix =
+      cv::Mat::zeros(num_pixels, num_pixels, util::kOpenCvMatrixType);
+  const SparseWarp& sparse_warp = frame_warps_[index].warp;
+  for (int i = 0; i < num_pixels; ++i) {
+    for (int j = sparse_warp.row_offsets[i];
+         j < sparse_warp.row_offsets[i + 1]; ++j) {
+      motion_matrix.at<double>(i, sparse_warp.input_indices[j]) +=
+          sparse_warp.weights[j];
+    }
+  }
+  return motion_matrix;
+}
+
+WarpMotionModule::SparseWarp WarpMotionModule::GetBilinearWarp(
+    const cv::Mat& source_coordinates) const {
+
+  const int num_rows = image_size_.height;
+  const int num_cols = image_size_.width;
+  SparseWarp sparse_warp;
+  sparse_warp.row_offsets.reserve(image_size_.area() + 1);
+  sparse_warp.input_indices.reserve(4 * image_size_.area());
+  sparse_warp.weights.reserve(4 * image_size_.area());
+  sparse_warp.row_offsets.push_back(0);
+  for (int row = 0; row < num_rows; ++row) {
+    const cv::Vec2d* coordinates = source_coordinates.ptr<cv::Vec2d>(row);
+    for (int col = 0; col < num_cols; ++col) {
+      const double x = coordinates[col][0];
+      const double y = coordinates[col][1];
+      // Samples more than a pixel outside of the image (or invalid flow
+      // values) have no neighbors in the image.
+      if (x > -1.0 && x < num_cols && y > -1.0 && y < num_rows) {
+        const double x_floor = std::floor(x);
+        const double y_floor = std::floor(y);
+        const double fx = x - x_floor;
+        const double fy = y - y_floor;
+        const int x0 = static_cast<int>(x_floor);
+        const int y0 = static_cast<int>(y_floor);
+        const double neighbor_weights[4] = {
+          (1.0 - fx) * (1.0 - fy), fx * (1.0 - fy), (1.0 - fx) * fy, fx * fy
+        };
+        for (int k = 0; k < 4; ++k) {
+          const int neighbor_x = x0 + k % 2;
+          const int neighbor_y = y0 + k / 2;
+          if (neighbor_weights[k] > 0.0 &&
+              neighbor_x >= 0 && neighbor_x < num_cols &&
+              neighbor_y >= 0 && neighbor_y < num_rows) {
+            sparse_warp.input_indices.push_back(
+                neighbor_y * num_cols + neighbor_x);
+            sparse_warp.weights.push_back(neighbor_weights[k]);
+          }
+        }
+      }
+      sparse_warp.row_offsets.push_back(sparse_warp.input_indices.size());
+    }
+  }
+  return sparse_warp;
+}
+
+WarpMotionModule::SparseWarp WarpMotionModule::GetTransposeWarp(
+    const SparseWarp& sparse_warp) const {
+
+  // Count the weights that read from each input pixel, which are the rows of
+  // the transpose, and then place every weight in its transposed row.
+  const int num_pixels = image_size_.area();
+  SparseWarp transpose_warp;
+  transpose_warp.row_offsets.assign(num_pixels + 1, 0);
+  for (const int input_index : sparse_warp.input_indices) {
+    transpose_warp.row_offsets[input_index + 1]++;
+  }
+  for (int i = 0; i < num_pixels; ++i) {
+    transpose_warp.row_offsets[i + 1] += transpose_warp.row_offsets[i];
+  }
+  transpose_warp.input_indices.resize(sparse_warp.input_indices.size());
+  transpose_warp.weights.resize(sparse_warp.weights.size());
+  std::vector<int> next_positions(
+      transpose_warp.row_offsets.begin(), transpose_warp.row_offsets.end() - 1);
+  for (int i = 0; i < num_pixels; ++i) {
+    for (int j = sparse_warp.row_offsets[i];
+         j < sparse_warp.row_offsets[i + 1]; ++j) {
+      const int position = next_positions[sparse_warp.input_indices[j]]++;
+      transpose_warp.input_indices[position] = i;
+      transpose_warp.weights[position] = sparse_warp.weights[j];
+    }
+  }
+  return transpose_warp;
+}
+
+void WarpMotionModule::ApplySparseWarp(
+    const SparseWarp& sparse_warp, ImageData* image_data) const {
+
+  CHECK_EQ(image_data->GetImageSize(), image_size_)
+      << "The warps were computed for a different image size.";
+
+  // The warped values are written directly into the channel images, so the
+  // original values are gathered from a copy. The copy is kept in a per-thread
+  // buffer whose channels are reused while the image size and type match.
+  const int num_channels = image_data->GetNumChannels();
+  if (num_channels == 0) {
+    return;
+  }
+  thread_local std::vector<cv::Mat> input_channels;
+  input_channels.resize(num_channels);
+  std::vector<cv::Mat> output_channels(num_channels);
+  for (int channel = 0; channel < num_channels; ++channel) {
+    output_channels[channel] = image_data->GetChannelImage(channel);
+    output_channels[channel].copyTo(input_channels[channel]);
+  }
+  if (image_data->GetPrecision() == IMAGE_PRECISION_DOUBLE) {
+    GatherChannels<double>(
+        sparse_warp.row_offsets,
+        sparse_warp.input_indices,
+        sparse_warp.weights,
+        input_channels,
+        &output_channels);
+  } else {
+    GatherChannels<float>(
+        sparse_warp.row_offsets,
+        sparse_warp.input_indices,
+        sparse_warp.weights,
+        input_channels,
+        &output_channels);
+  }
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,101 @@
+// This motion degradation module warps each image in the frame sequence with
+// a general per-frame motion, given either as an affine transform (e.g. for
+// rotation or zoom) or as a dense flow field (for local motion).
+//
+// Unlike the MotionModule, which builds the warp on every call, the bilinear
+// interpolation weights of every frame are precomputed once when the module is
+// created, both for the warp and for its exact transpose. Applying the module
+// is then a sparse gather that warps all channels in one pass over the image.
+
+#ifndef SRC_IMAGE_MODEL_WARP_MOTION_MODULE_H_
+#define SRC_IMAGE_MODEL_WARP_MOTION_MODULE_H_
+
+#include <string>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/degradation_operator.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+// How the motion of each frame is given.
+enum WarpMotionType {
+  // A 2x3 affine transform that maps reference image coordinates to frame
+  // coordinates, as in cv::warpAffine: frame(A * p) = reference(p). A pure
+  // translation gives the same warp as the MotionModule.
+  WARP_MOTION_AFFINE,
+
+  // A two-channel (x, y) flow field of the image size, such that
+  // frame(p) = reference(p - flow(p)). A constant flow d is a shift by d.
+  WARP_MOTION_DENSE_FLOW
+};
+
+// Returns the motion type with the given name: "affine" or "flow" (dense
+// flow). An error will occur if the name is unknown.
+WarpMotionType GetWarpMotionType(const std::string& type_name);
+
+// Loads the frame motions (one per frame, in order) from the given OpenCV
+// FileStorage file (e.g. YAML or XML). The file must contain a sequence named
+// "frame_motions" of matrices: 2x3 affine transforms or two-channel flow
+// fields, as described by WarpMotionType.
+std::vector<cv::Mat> LoadWarpMotionsFromFile(const std::string& file_path);
+
+class WarpMotionModule : public DegradationOperator {
+ public:
+  // Precomputes the warps of the given frame motions for images of the given
+  // size. Pixels that are warped in from outside of the image are zero.
+  WarpMotionModule(
+      const cv::Size& image_size,
+      const WarpMotionType motion_type,
+      const std::vector<cv::Mat>& frame_motions);
+
+  virtual void ApplyToImage(ImageData* image_data, const int index) const;
+
+  virtual void ApplyTransposeToImage(
+      ImageData* image_data, const int index) const;
+
+  virtual cv::Mat GetOperatorMatrix(
+      const cv::Size& image_size, const int index) const;
+
+  int GetNumFrames() const {
+    return frame_warps_.size();
+  }
+
+ private:
+  // A warp stored as a sparse matrix in compressed row form. Output pixel i
+  // is the sum of weights[j] * input[input_indices[j]] over all j in
+  // [row_offsets[i], row_offsets[i + 1]).
+  struct SparseWarp {
+    std::vector<int> row_offsets;
+    std::vector<int> input_indices;
+    std::vector<double> weights;
+  };
+
+  // The warp of a frame and its transpose. The transpose is stored as its own
+  // gather so that it can be applied in parallel without conflicting writes.
+  struct FrameWarp {
+    SparseWarp warp;
+    SparseWarp transpose_warp;
+  };
+
+  // Returns the bilinear interpolation weights of the given per-pixel source
+  // coordinates (a CV_64FC2 image of the module's image size).
+  SparseWarp GetBilinearWarp(const cv::Mat& source_coordinates) const;
+
+  // Returns the transpose of the given warp.
+  SparseWarp GetTransposeWarp(const SparseWarp& sparse_warp) const;
+
+  // Applies the given warp to every channel of the image.
+  void ApplySparseWarp(
+      const SparseWarp& sparse_warp, ImageData* image_data) const;
+
+  const cv::Size image_size_;
+
+  std::vector<FrameWarp> frame_warps_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_IMAGE_MODEL_WARP_MOTION_MODULE_H_
@@ -1,15 +1,19 @@
 #include "motion/registration.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <utility>
 #include <vector>
 
 #include "image/image_data.h"
 #include "motion/motion_shift.h"
+#include "util/util.h"
 
 #include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/core/core.hpp"
 #include "opencv2/features2d/features2d.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/video/tracking.hpp"
 
 #include "glog/logging.h"
@@ -21,10 +25,33 @@ namespace {
 // TODO: Adjust these parameters as needed. Right now, the system may throw
 // an error if these parameters do not yield a sufficient number of keypoint
 // matches between two images.
-constexpr double kFlannDistanceScalingFactor = 5.0;
-constexpr double kFlannDistanceThreshold = 0.04;
+constexpr double kMatchDistanceScalingFactor = 5.0;
+constexpr double kMatchDistanceThreshold = 0.04;
 constexpr double kRansacReprojectionThreshold = 0.1;
 
+// Images are not downsampled below this size for phase correlation, and
+// patches smaller than this are not used for refinement.
+constexpr int kMinPhaseCorrelationSize = 16;
+
+// Cross-power spectrum values with a smaller magnitude, relative to the
+// largest one, are ignored when normalizing the cross-power spectrum. Their
+// phase is dominated by rounding errors (e.g. at the high frequencies of
+// smooth images), and normalizing would weight them like the signal.
+constexpr double kMinRelativeSpectrumMagnitude = 1e-6;
+
+// Only frequencies up to this (in cycles per pixel, in both directions) are
+// used to fit the sub-pixel shift. The phase of higher frequencies is biased
+// by the interpolation of shifted images.
+constexpr double kMaxSubpixelFitFrequency = 0.25;
+
+// The number of times the sub-pixel fit is repeated on realigned patches if
+// the fitted shift is more than half a pixel from the integer alignment.
+constexpr int kMaxSubpixelFitIterations = 2;
+
+// Phase correlation peaks lower than this (1 is a perfect match) are unlikely
+// to be reliable.
+constexpr double kMinPhaseCorrelationPeak = 0.03;
+
 // A parallel array (two vectors) for storing keypoint match pairs.
 using KeypointPairing =
     std::pair<std::vector<cv::Point2f>, std::vector<cv::Point2f>>;
@@ -46,8 +73,10 @@ KeypointsAndDescriptors DetectKeypoints(const ImageData& image) {
   cv::Mat detection_image;
   image.GetChannelImage(0).convertTo(detection_image, CV_8U, 255);
 
+  // Building the BRISK sampling pattern is not free, so each thread creates
+  // its detector once. Detectors are not shared between threads.
+  thread_local const cv::Ptr<cv::BRISK> detector = cv::BRISK::create();
   KeypointsAndDescriptors keypoints_and_descriptors;
-  cv::Ptr<cv::BRISK> detector = cv::BRISK::create();
   detector->detectAndCompute(
       detection_image,
       cv::noArray(),
@@ -61,31 +90,52 @@ KeypointsAndDescriptors DetectKeypoints(const ImageData& image) {
   return keypoints_and_descriptors;
 }
 
-// Computes pairwise keypoint matches between the two given feature descriptor
-// sets. This does does not guarantee ideal matches. Further filtering, such as
-// RANSAC, may be necessary.
-KeypointPairing FindMatchingFeatures(
-    const KeypointsAndDescriptors& keypoints_and_descriptors_1,
-    const KeypointsAndDescriptors& keypoints_and_descriptors_2) {
+// Matches the keypoints of a reference image against those of other images.
+// Every reference keypoint is matched to its nearest neighbor among the other
+// image's keypoints (as in the original per-pair registration), using an
+// exact brute-force search so that the matches do not depend on any random
+// index construction. The reference descriptors are converted once and only
+// read afterwards, so matching can run from multiple threads.
+class ReferenceKeypointMatcher {
+ public:
+  explicit ReferenceKeypointMatcher(
+      const KeypointsAndDescriptors& reference_keypoints)
+      : reference_keypoints_(reference_keypoints) {
+
+    // Descriptors are compared as CV_32F vectors with the L2 distance, which
+    // the distance thresholds are tuned for.
+    reference_keypoints_.descriptors.convertTo(
+        reference_descriptors_, CV_32F);
+  }
+
+  // Computes pairwise keypoint matches between the reference image and the
+  // given image. The first vector of the pairing holds the reference image
+  // points. This does does not guarantee ideal matches. Further filtering,
+  // such as RANSAC, may be necessary.
+  KeypointPairing FindMatchingFeatures(
+      const KeypointsAndDescriptors& image_keypoints) const;
+
+ private:
+  const KeypointsAndDescriptors& reference_keypoints_;
+  cv::Mat reference_descriptors_;
+};
+
+KeypointPairing ReferenceKeypointMatcher::FindMatchingFeatures(
+    const KeypointsAndDescriptors& image_keypoints) const {
 
   // If there are no features available for one of the images, returns an empty
   // set of matches.
   KeypointPairing keypoint_matches;
-  if (keypoints_and_descriptors_1.descriptors.empty() ||
-      keypoints_and_descriptors_2.descriptors.empty()) {
+  if (reference_descriptors_.empty() || image_keypoints.descriptors.empty()) {
     return keypoint_matches;
   }
 
-  // Need to convert to CV_32F so that the OpenCV Flann-based matcher can work.
-  cv::Mat descriptors_1;
-  keypoints_and_descriptors_1.descriptors.convertTo(descriptors_1, CV_32F);
-  cv::Mat descriptors_2;
-  keypoints_and_descriptors_2.descriptors.convertTo(descriptors_2, CV_32F);
-
-  // Run the Flann-based matcher.
-  cv::FlannBasedMatcher matcher;
+  // Find the nearest neighbor of every reference descriptor.
+  cv::Mat image_descriptors;
+  image_keypoints.descriptors.convertTo(image_descriptors, CV_32F);
+  cv::BFMatcher matcher(cv::NORM_L2);
   std::vector<cv::DMatch> feature_matches;
-  matcher.match(descriptors_1, descriptors_2, feature_matches);
+  matcher.match(reference_descriptors_, image_descriptors, feature_matches);
 
   // Filter out the keypoint matches to only keep the best ones based on
   // feature-space distance thresholding.
@@ -101,8 +151,8 @@ KeypointPairing FindMatchingFeatures(
   }
   std::vector<cv::DMatch> good_feature_matches;
   const double distance_threshold = std::max(
-      kFlannDistanceScalingFactor * smallest_feature_distance,
-      kFlannDistanceThreshold);
+      kMatchDistanceScalingFactor * smallest_feature_distance,
+      kMatchDistanceThreshold);
   for (const cv::DMatch& match : feature_matches) {
     if (match.distance <= distance_threshold) {
       good_feature_matches.push_back(match);
@@ -111,12 +161,12 @@ KeypointPairing FindMatchingFeatures(
 
   // Build a parallel list of keypoint match pairs.
   for (const cv::DMatch& match : good_feature_matches) {
-    cv::Point2f pixel_loc_1 =
-        keypoints_and_descriptors_1.keypoints[match.queryIdx].pt;
-    cv::Point2f pixel_loc_2 =
-        keypoints_and_descriptors_2.keypoints[match.trainIdx].pt;
-    keypoint_matches.first.push_back(pixel_loc_1);
-    keypoint_matches.second.push_back(pixel_loc_2);
+    cv::Point2f reference_pixel_loc =
+        reference_keypoints_.keypoints[match.queryIdx].pt;
+    cv::Point2f image_pixel_loc =
+        image_keypoints.keypoints[match.trainIdx].pt;
+    keypoint_matches.first.push_back(reference_pixel_loc);
+    keypoint_matches.second.push_back(image_pixel_loc);
   }
 
   return keypoint_matches;
@@ -156,10 +206,305 @@ KeypointPairing ApplyRANSAC(const KeypointPairing& unfiltered_matches) {
   return filtered_matches;
 }
 
+// Returns the average of all channels of the given image in double precision.
+// This has more structure than any single band of a hyperspectral image.
+cv::Mat GetStructureImage(const ImageData& image) {
+  CHECK_GT(image.GetNumChannels(), 0) << "Cannot register an empty image.";
+  cv::Mat structure_image = cv::Mat::zeros(image.GetImageSize(), CV_64FC1);
+  for (int channel = 0; channel < image.GetNumChannels(); ++channel) {
+    cv::Mat channel_image;
+    image.GetChannelImage(channel).convertTo(channel_image, CV_64FC1);
+    structure_image += channel_image;
+  }
+  structure_image /= image.GetNumChannels();
+  return structure_image;
+}
+
+// Returns the spectrum of the given image after removing its mean, applying
+// the optional window, and zero-padding it to the given (FFT-friendly) size.
+cv::Mat GetSpectrum(
+    const cv::Mat& image, const cv::Mat& window, const cv::Size& dft_size) {
+
+  cv::Mat prepared_image = image - cv::mean(image);
+  if (!window.empty()) {
+    prepared_image = prepared_image.mul(window);
+  }
+  cv::copyMakeBorder(
+      prepared_image,
+      prepared_image,
+      0,
+      dft_size.height - image.rows,
+      0,
+      dft_size.width - image.cols,
+      cv::BORDER_CONSTANT,
+      cv::Scalar(0));
+  cv::Mat spectrum;
+  cv::dft(prepared_image, spectrum, cv::DFT_COMPLEX_OUTPUT);
+  return spectrum;
+}
+
+// Returns the cross-power spectrum of the given image and the reference
+// image (both single-channel double images of the same size). At frequency f,
+// its phase is -2 pi f . d for an image shifted by d.
+cv::Mat GetCrossPowerSpectrum(
+    const cv::Mat& reference_image,
+    const cv::Mat& image,
+    const bool use_window) {
+
+  CHECK_EQ(reference_image.size(), image.size())
+      << "Images must be the same size for phase correlation.";
+
+  cv::Mat window;
+  if (use_window) {
+    cv::createHanningWindow(window, image.size(), CV_64FC1);
+  }
+  const cv::Size dft_size(
+      cv::getOptimalDFTSize(image.cols), cv::getOptimalDFTSize(image.rows));
+  const cv::Mat reference_spectrum =
+      GetSpectrum(reference_image, window, dft_size);
+  const cv::Mat image_spectrum = GetSpectrum(image, window, dft_size);
+  cv::Mat cross_power_spectrum;
+  cv::mulSpectrums(
+      image_spectrum, reference_spectrum, cross_power_spectrum, 0, true);
+  return cross_power_spectrum;
+}
+
+// Returns the signed frequency (in cycles per pixel) of the given DFT index.
+double GetSignedFrequency(const int index, const int dft_size) {
+  const int signed_index = (index <= dft_size / 2) ? index : index - dft_size;
+  return static_cast<double>(signed_index) / dft_size;
+}
+
+// Returns the integer shift of the given image relative to the reference
+// image (both single-channel double images of the same size) as the peak of
+// the phase correlation. The height of the peak is returned in peak_value.
+cv::Point PhaseCorrelate(
+    const cv::Mat& reference_image,
+    const cv::Mat& image,
+    const bool use_window,
+    double* peak_value) {
+
+  cv::Mat cross_power_spectrum =
+      GetCrossPowerSpectrum(reference_image, image, use_window);
+
+  // Normalize the cross-power spectrum so that only the phase difference,
+  // which encodes the shift, remains.
+  cv::Mat magnitudes(cross_power_spectrum.size(), CV_64FC1);
+  for (int row = 0; row < cross_power_spectrum.rows; ++row) {
+    const cv::Vec2d* values = cross_power_spectrum.ptr<cv::Vec2d>(row);
+    double* row_magnitudes = magnitudes.ptr<double>(row);
+    for (int col = 0; col < cross_power_spectrum.cols; ++col) {
+      row_magnitudes[col] = std::hypot(values[col][0], values[col][1]);
+    }
+  }
+  double max_magnitude = 0.0;
+  cv::minMaxLoc(magnitudes, nullptr, &max_magnitude);
+  const double min_magnitude = kMinRelativeSpectrumMagnitude * max_magnitude;
+  for (int row = 0; row < cross_power_spectrum.rows; ++row) {
+    cv::Vec2d* values = cross_power_spectrum.ptr<cv::Vec2d>(row);
+    const double* row_magnitudes = magnitudes.ptr<double>(row);
+    for (int col = 0; col < cross_power_spectrum.cols; ++col) {
+      const double magnitude = row_magnitudes[col];
+      const double scale =
+          (magnitude > min_magnitude) ? (1.0 / magnitude) : 0.0;
+      values[col][0] *= scale;
+      values[col][1] *= scale;
+    }
+  }
+  cv::Mat correlation;
+  cv::idft(
+      cross_power_spectrum,
+      correlation,
+      cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+
+  // The peak of the correlation is at the shift (modulo the image size).
+  cv::Point peak_location;
+  cv::minMaxLoc(correlation, nullptr, peak_value, nullptr, &peak_location);
+  const int num_rows = correlation.rows;
+  const int num_cols = correlation.cols;
+  return cv::Point(
+      (peak_location.x > num_cols / 2) ?
+          (peak_location.x - num_cols) : peak_location.x,
+      (peak_location.y > num_rows / 2) ?
+          (peak_location.y - num_rows) : peak_location.y);
+}
+
+// Returns the sub-pixel shift of the given image relative to the reference
+// image, which must already be aligned to within about half a pixel. The
+// shift is the weighted least squares fit of the plane -2 pi f . d to the
+// phase of the cross-power spectrum, weighted by its magnitude. Unlike
+// interpolating the phase correlation peak, this is not biased toward integer
+// shifts, and frequencies without signal have (almost) no weight.
+cv::Point2d FitSubpixelShift(
+    const cv::Mat& reference_image,
+    const cv::Mat& image,
+    const bool use_window) {
+
+  const cv::Mat cross_power_spectrum =
+      GetCrossPowerSpectrum(reference_image, image, use_window);
+  double sum_xx = 0.0;
+  double sum_xy = 0.0;
+  double sum_yy = 0.0;
+  double sum_x_phase = 0.0;
+  double sum_y_phase = 0.0;
+  for (int row = 0; row < cross_power_spectrum.rows; ++row) {
+    const double fy = GetSignedFrequency(row, cross_power_spectrum.rows);
+    if (std::abs(fy) > kMaxSubpixelFitFrequency) {
+      continue;
+    }
+    const cv::Vec2d* values = cross_power_spectrum.ptr<cv::Vec2d>(row);
+    for (int col = 0; col < cross_power_spectrum.cols; ++col) {
+      const double fx = GetSignedFrequency(col, cross_power_spectrum.cols);
+      if (std::abs(fx) > kMaxSubpixelFitFrequency) {
+        continue;
+      }
+      const double weight = std::hypot(values[col][0], values[col][1]);
+      const double phase = std::atan2(values[col][1], values[col][0]);
+      sum_xx += weight * fx * fx;
+      sum_xy += weight * fx * fy;
+      sum_yy += weight * fy * fy;
+      sum_x_phase += weight * fx * phase;
+      sum_y_phase += weight * fy * phase;
+    }
+  }
+  const double determinant = sum_xx * sum_yy - sum_xy * sum_xy;
+  if (determinant <= 0.0) {
+    return cv::Point2d(0, 0);
+  }
+  const double scale = -1.0 / (2.0 * CV_PI * determinant);
+  return cv::Point2d(
+      scale * (sum_yy * sum_x_phase - sum_xy * sum_y_phase),
+      scale * (sum_xx * sum_y_phase - sum_xy * sum_x_phase));
+}
+
+// Sets the patches of the reference image and of the image that the given
+// integer shift aligns. The patches are at most max_patch_size x
+// max_patch_size pixels, taken from the center of the region where the
+// shifted images overlap. Returns false if the images barely overlap.
+bool GetAlignedPatches(
+    const cv::Size& image_size,
+    const cv::Point& shift,
+    const int max_patch_size,
+    cv::Rect* reference_patch,
+    cv::Rect* image_patch) {
+
+  const int overlap_width = image_size.width - std::abs(shift.x);
+  const int overlap_height = image_size.height - std::abs(shift.y);
+  if (std::min(overlap_width, overlap_height) < kMinPhaseCorrelationSize) {
+    return false;
+  }
+  const int patch_width = std::min(overlap_width, max_patch_size);
+  const int patch_height = std::min(overlap_height, max_patch_size);
+  *reference_patch = cv::Rect(
+      std::max(0, -shift.x) + (overlap_width - patch_width) / 2,
+      std::max(0, -shift.y) + (overlap_height - patch_height) / 2,
+      patch_width,
+      patch_height);
+  *image_patch = cv::Rect(
+      reference_patch->x + shift.x,
+      reference_patch->y + shift.y,
+      patch_width,
+      patch_height);
+  return true;
+}
+
+// Estimates the integer shift on the images (downsampled if pyramid levels
+// are used) and then refines it at full resolution on patches that the
+// estimate aligns. Besides bounding the size of the full resolution FFT, the
+// refinement removes the bias of the window toward zero shift, since the
+// window does not move with the image content. The sub-pixel shift is then
+// fitted on the patches that the refined integer shift aligns.
+cv::Point2d EstimateShift(
+    const cv::Mat& reference_image,
+    const cv::Mat& image,
+    const RegistrationOptions& options,
+    double* peak_value) {
+
+  cv::Mat coarse_reference_image = reference_image;
+  cv::Mat coarse_image = image;
+  int scale = 1;
+  for (int level = 0; level < options.num_pyramid_levels; ++level) {
+    if (std::min(coarse_image.rows, coarse_image.cols) <
+        2 * kMinPhaseCorrelationSize) {
+      break;
+    }
+    cv::pyrDown(coarse_reference_image, coarse_reference_image);
+    cv::pyrDown(coarse_image, coarse_image);
+    scale *= 2;
+  }
+  const cv::Point coarse_shift = PhaseCorrelate(
+      coarse_reference_image,
+      coarse_image,
+      options.use_window,
+      peak_value) * scale;
+
+  cv::Rect reference_patch;
+  cv::Rect image_patch;
+  if (!GetAlignedPatches(
+          image.size(),
+          coarse_shift,
+          options.max_patch_size,
+          &reference_patch,
+          &image_patch)) {
+    LOG(WARNING) << "Images barely overlap. Using the coarse shift estimate.";
+    return cv::Point2d(coarse_shift);
+  }
+  cv::Point shift = coarse_shift + PhaseCorrelate(
+      reference_image(reference_patch),
+      image(image_patch),
+      options.use_window,
+      peak_value);
+
+  // If the fitted shift is off by more than half a pixel (e.g. for a shift of
+  // almost exactly half a pixel), the patches are realigned and refitted.
+  cv::Point2d subpixel_shift(0, 0);
+  for (int iteration = 0; iteration < kMaxSubpixelFitIterations; ++iteration) {
+    if (!GetAlignedPatches(
+            image.size(),
+            shift,
+            options.max_patch_size,
+            &reference_patch,
+            &image_patch)) {
+      break;
+    }
+    subpixel_shift = FitSubpixelShift(
+        reference_image(reference_patch),
+        image(image_patch),
+        options.use_window);
+    if (std::abs(subpixel_shift.x) <= 0.5 &&
+        std::abs(subpixel_shift.y) <= 0.5) {
+      break;
+    }
+    shift += cv::Point(
+        static_cast<int>(std::round(subpixel_shift.x)),
+        static_cast<int>(std::round(subpixel_shift.y)));
+    subpixel_shift = cv::Point2d(0, 0);
+  }
+  return cv::Point2d(shift) + subpixel_shift;
+}
+
 }  // namespace
 
+MotionShift PhaseCorrelationRegistration(
+    const ImageData& reference_image,
+    const ImageData& image,
+    const RegistrationOptions& options) {
+
+  const cv::Mat reference_structure_image = GetStructureImage(reference_image);
+  const cv::Mat structure_image = GetStructureImage(image);
+  double peak_value = 0.0;
+  const cv::Point2d shift = EstimateShift(
+      reference_structure_image, structure_image, options, &peak_value);
+  if (peak_value < kMinPhaseCorrelationPeak) {
+    LOG(WARNING) << "Weak phase correlation peak (" << peak_value
+                 << "). The estimated shift may be unreliable.";
+  }
+  return MotionShift(shift.x, shift.y);
+}
+
 MotionShiftSequence TranslationalRegistration(
-    const std::vector<ImageData>& images) {
+    const std::vector<ImageData>& images,
+    const RegistrationOptions& options) {
 
   // If no images, return an empty sequence.
   if (images.empty()) {
@@ -168,21 +513,36 @@ MotionShiftSequence TranslationalRegistration(
   }
 
   // The first image is relative to itself, so its shift is always (0, 0).
-  std::vector<MotionShift> motion_shifts;
-  motion_shifts.push_back(MotionShift(0, 0));
+  // Every other image is registered independently against the first one, so
+  // the images are processed in parallel. Each result only depends on the
+  // first image and that image.
+  const int num_images = images.size();
+  std::vector<MotionShift> motion_shifts(num_images, MotionShift(0, 0));
+  if (options.method == REGISTRATION_PHASE_CORRELATION) {
+    util::ParallelFor(num_images - 1, [&](const int index) {
+      const int i = index + 1;
+      motion_shifts[i] =
+          PhaseCorrelationRegistration(images[0], images[i], options);
+    });
+    return MotionShiftSequence(motion_shifts);
+  }
+
+  // Detect the keypoints of all images, and prepare the keypoints of the first
+  // image once for matching against all other images.
+  std::vector<KeypointsAndDescriptors> image_keypoints(num_images);
+  util::ParallelFor(num_images, [&](const int i) {
+    image_keypoints[i] = DetectKeypoints(images[i]);
+  });
+  const ReferenceKeypointMatcher matcher(image_keypoints[0]);
 
   // Run keypoint matching between the first image and all other images.
-  const KeypointsAndDescriptors& image_0_keypoints =
-      DetectKeypoints(images[0]);
-  const int num_images = images.size();
-  for (int i = 1; i < num_images; ++i) {
-    const KeypointsAndDescriptors& image_i_keypoints =
-        DetectKeypoints(images[i]);
+  util::ParallelFor(num_images - 1, [&](const int index) {
+    const int i = index + 1;
 
     // Get keypoint matches between images 0 and i, and apply RANSAC to remove
     // bad matches.
     const KeypointPairing& keypoint_matches =
-        FindMatchingFeatures(image_0_keypoints, image_i_keypoints);
+        matcher.FindMatchingFeatures(image_keypoints[i]);
     const KeypointPairing& good_matches = ApplyRANSAC(keypoint_matches);
 
     // Compute the affine transformation between the matched keypoints.
@@ -191,12 +551,17 @@ MotionShiftSequence TranslationalRegistration(
     //   true = finds full affine transformation (6 degrees of freedom).
     const cv::Mat affine_transform = cv::estimateRigidTransform(
         good_matches.first, good_matches.second, false);
-    CHECK(!affine_transform.empty())
-        << "Could not determine motion shift between images.";
+    if (affine_transform.empty()) {
+      LOG(WARNING) << "Could not match keypoints for image " << i
+                   << ". Using phase correlation instead.";
+      motion_shifts[i] =
+          PhaseCorrelationRegistration(images[0], images[i], options);
+      return;
+    }
     const double dx = affine_transform.at<double>(0, 2);
     const double dy = affine_transform.at<double>(1, 2);
-    motion_shifts.push_back(MotionShift(dx, dy));
-  }
+    motion_shifts[i] = MotionShift(dx, dy);
+  });
   return MotionShiftSequence(motion_shifts);
 }
 
@@ -17,10 +17,53 @@
 namespace super_resolution {
 namespace registration {
 
+// The algorithm used for translational registration.
+enum RegistrationMethod {
+  // Matches BRISK keypoints between the images and fits a rigid transform to
+  // the RANSAC inliers. This requires textured images.
+  REGISTRATION_KEYPOINTS,
+
+  // FFT-based phase correlation, with the sub-pixel shift fitted to the
+  // phase of the cross-power spectrum. This is much faster than keypoint
+  // matching and also works on images with little texture (e.g. individual
+  // hyperspectral bands).
+  REGISTRATION_PHASE_CORRELATION
+};
+
+struct RegistrationOptions {
+  RegistrationMethod method = REGISTRATION_KEYPOINTS;
+
+  // The following options only apply to phase correlation.
+
+  // Multiply the images by a Hann window before the FFT to suppress the
+  // discontinuities at the image borders (which the FFT treats as periodic).
+  bool use_window = true;
+
+  // The shift is first estimated on images downsampled this many times (by
+  // half each time), and then refined at full resolution on patches of at
+  // most max_patch_size x max_patch_size pixels which the first estimate
+  // aligns. Downsampling makes the first estimate cheap, and the patch size
+  // bounds the cost of the full resolution FFT.
+  int num_pyramid_levels = 0;
+  int max_patch_size = 256;
+};
+
 // Performs translational registration on the given images, with the first
-// image in the list as the reference image.
+// image in the list as the reference image. If keypoint registration fails
+// for an image (e.g. because it has no texture), phase correlation is used
+// for that image instead. The images are registered in parallel, and each
+// result is the same as registering that image alone against the reference.
 MotionShiftSequence TranslationalRegistration(
-    const std::vector<ImageData>& images);
+    const std::vector<ImageData>& images,
+    const RegistrationOptions& options = RegistrationOptions());
+
+// Returns the shift of the given image relative to the reference image,
+// estimated with phase correlation on the average of all channels. The images
+// must have the same size.
+MotionShift PhaseCorrelationRegistration(
+    const ImageData& reference_image,
+    const ImageData& image,
+    const RegistrationOptions& options = RegistrationOptions());
 
 }  // namespace registration
 }  // namespace super_resolution
@@ -1,6 +1,7 @@
 #include "optimization/irls_map_solver.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -13,6 +14,7 @@
 #include "optimization/objective_data_term.h"
 #include "optimization/objective_function.h"
 #include "optimization/objective_irls_regularization_term.h"
+#include "util/matrix_util.h"
 
 #include "alglib/src/optimization.h"
 
@@ -170,6 +172,70 @@ void IRLSMapSolverOptions::AdjustThresholdsAdaptively(
   irls_cost_difference_threshold *= threshold_scale;
 }
 
+std::vector<double> IRLSMapSolverOptions::GetChannelIterationShares() const {
+  const int num_channels = channel_weights.size();
+  double total_weight = 0.0;
+  for (const double weight : channel_weights) {
+    total_weight += std::max(weight, 0.0);
+  }
+  std::vector<int> active_channels;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const double weight = channel_weights[channel];
+    if (weight > 0 && weight >= min_channel_weight_fraction * total_weight) {
+      active_channels.push_back(channel);
+    }
+  }
+
+  // Distribute the budget in proportion to the weights. Channels that would
+  // get more than the full iterations are capped, and the rest of the budget
+  // is distributed again over the remaining channels.
+  std::vector<double> shares(num_channels, 0.0);
+  double remaining_budget = channel_iteration_budget;
+  while (!active_channels.empty() && remaining_budget > 0) {
+    double active_weight = 0.0;
+    for (const int channel : active_channels) {
+      active_weight += channel_weights[channel];
+    }
+    std::vector<int> uncapped_channels;
+    for (const int channel : active_channels) {
+      const double share =
+          remaining_budget * channel_weights[channel] / active_weight;
+      if (share >= 1.0) {
+        shares[channel] = 1.0;
+      } else {
+        uncapped_channels.push_back(channel);
+      }
+    }
+    if (uncapped_channels.size() == active_channels.size()) {
+      for (const int channel : active_channels) {
+        shares[channel] =
+            remaining_budget * channel_weights[channel] / active_weight;
+      }
+      break;
+    }
+    remaining_budget -= active_channels.size() - uncapped_channels.size();
+    active_channels = uncapped_channels;
+  }
+  return shares;
+}
+
+IRLSMapSolverOptions IRLSMapSolverOptions::GetBudgetedOptions(
+    const double share) const {
+
+  IRLSMapSolverOptions budgeted_options = *this;
+  if (max_num_irls_iterations <= 0 || max_num_solver_iterations <= 0) {
+    return budgeted_options;
+  }
+  const double num_irls_iterations = share * max_num_irls_iterations;
+  budgeted_options.max_num_irls_iterations =
+      std::max(1, static_cast<int>(std::round(num_irls_iterations)));
+  if (num_irls_iterations < 1.0) {
+    budgeted_options.max_num_solver_iterations = std::max(1, static_cast<int>(
+        std::round(num_irls_iterations * max_num_solver_iterations)));
+  }
+  return budgeted_options;
+}
+
 void IRLSMapSolverOptions::PrintSolverOptions() const {
   std::cout << "IRLSMapSolver Options" << std::endl;
   std::cout << "  Objective:                           "
@@ -179,6 +245,11 @@ void IRLSMapSolverOptions::PrintSolverOptions() const {
   MapSolverOptions::PrintSolverOptions();
   std::cout << "  IRLS cost difference threshold:      "
             << irls_cost_difference_threshold << std::endl;
+  if (!channel_weights.empty() && channel_iteration_budget > 0) {
+    std::cout << "  Channel iteration budget:            "
+              << channel_iteration_budget << " (min weight fraction "
+              << min_channel_weight_fraction << ")" << std::endl;
+  }
 }
 
 IRLSMapSolver::IRLSMapSolver(
@@ -219,6 +290,44 @@ ImageData IRLSMapSolver::Solve(const ImageData& initial_estimate) {
     solver_options_scaled.PrintSolverOptions();
   }
 
+  // If the iterations are budgeted, find each channel's share of the full
+  // iterations.
+  const bool use_iteration_budget =
+      !solver_options_.channel_weights.empty() &&
+      solver_options_.channel_iteration_budget > 0;
+  std::vector<double> channel_iteration_shares;
+  if (use_iteration_budget) {
+    if (num_channels_per_split == 1) {
+      CHECK_EQ(solver_options_.channel_weights.size(), num_channels)
+          << "There must be exactly one weight per channel.";
+      channel_iteration_shares =
+          solver_options_.GetChannelIterationShares();
+    } else {
+      LOG(WARNING) << "Channel iteration budgets require split_channels. "
+                   << "Using the full iterations for all channels.";
+    }
+  }
+
+  // The data term applies the image model in the precision of the
+  // observations. Observations in a different precision are converted in a
+  // local copy, so the solver's own observations are left unchanged for later
+  // calls.
+  const ImagePrecision observation_precision =
+      solver_options_.use_single_precision ?
+      IMAGE_PRECISION_FLOAT : IMAGE_PRECISION_DOUBLE;
+  std::vector<ImageData> converted_observations;
+  const std::vector<ImageData>* data_term_observations = &observations_;
+  for (const ImageData& observation : observations_) {
+    if (observation.GetPrecision() != observation_precision) {
+      converted_observations = observations_;
+      for (ImageData& converted_observation : converted_observations) {
+        converted_observation.SetPrecision(observation_precision);
+      }
+      data_term_observations = &converted_observations;
+      break;
+    }
+  }
+
   ImageData estimated_image;
   for (int i = 0; i < num_solver_rounds; ++i) {
     if (num_solver_rounds > 1) {
@@ -227,26 +336,53 @@ ImageData IRLSMapSolver::Solve(const ImageData& initial_estimate) {
     const int channel_start = i * num_channels_per_split;
     const int channel_end = channel_start + num_channels_per_split;
 
+    // Channels without any iteration budget keep the initial estimate.
+    IRLSMapSolverOptions round_options = solver_options_scaled;
+    if (!channel_iteration_shares.empty()) {
+      const double share = channel_iteration_shares[channel_start];
+      if (share <= 0) {
+        LOG(INFO) << "Skipping channel " << channel_start
+                  << " (no iteration budget).";
+        cv::Mat channel_image;
+        initial_estimate.GetChannelImage(channel_start).convertTo(
+            channel_image, util::kOpenCvMatrixType);
+        estimated_image.AddChannel(channel_image.ptr<double>(), image_size);
+        continue;
+      }
+      round_options = solver_options_scaled.GetBudgetedOptions(share);
+      LOG(INFO) << "Solving channel " << channel_start << " with "
+                << round_options.max_num_irls_iterations
+                << " IRLS iteration(s) of "
+                << round_options.max_num_solver_iterations
+                << " solver iteration(s).";
+    }
+
     // Copy the initial estimate data (within the appropriate channel range) to
     // the solver's array.
     alglib::real_1d_array solver_data;
     solver_data.setlength(num_data_points);
+    // The initial estimate may be in either precision, so convert into the
+    // solver's array instead of copying raw data.
     for (int channel = 0; channel < num_channels_per_split; ++channel) {
       double* data_ptr = solver_data.getcontent() + (num_pixels * channel);
-      const double* channel_ptr = initial_estimate.GetChannelData(
-          channel_start + channel);
-      std::copy(channel_ptr, channel_ptr + num_pixels, data_ptr);
+      cv::Mat data_image(image_size, util::kOpenCvMatrixType, data_ptr);
+      initial_estimate.GetChannelImage(channel_start + channel).convertTo(
+          data_image, util::kOpenCvMatrixType);
     }
 
     // Set up the base objective function (just data term). The regularization
     // term depends on the IRLS weights, so it gets added in the IRLS loop.
     ObjectiveFunction objective_function_data_term_only(num_data_points);
     std::shared_ptr<ObjectiveTerm> data_term(new ObjectiveDataTerm(
-        image_model_, observations_, channel_start, channel_end, image_size));
+        image_model_,
+        *data_term_observations,
+        channel_start,
+        channel_end,
+        image_size));
     objective_function_data_term_only.AddTerm(data_term);
 
     RunIRLSLoop(
-        solver_options_scaled,
+        round_options,
         objective_function_data_term_only,
         regularizers_,
         image_size,
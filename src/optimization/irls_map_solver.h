@@ -21,6 +21,18 @@ struct IRLSMapSolverOptions : public MapSolverOptions {
   // Print also includes specific IRLS parameters.
   virtual void PrintSolverOptions() const;
 
+  // Returns each channel's share of the full number of iterations (between 0
+  // and 1) under the channel iteration budget described below. Channels with a
+  // share of 0 should not be solved.
+  std::vector<double> GetChannelIterationShares() const;
+
+  // Returns a copy of these options for solving a channel with the given share
+  // (0 < share <= 1) of the full iterations. The IRLS iterations are reduced
+  // first, and shares of less than one IRLS iteration reduce the solver
+  // iterations of that single IRLS iteration instead. Unlimited (0) iteration
+  // counts are not reduced.
+  IRLSMapSolverOptions GetBudgetedOptions(const double share) const;
+
   // Maximum number of outer loop iterations. Each outer loop runs Conjugate
   // Gradient which has its own max number of iterations
   // (max_num_solver_iterations).
@@ -33,6 +45,31 @@ struct IRLSMapSolverOptions : public MapSolverOptions {
   // The stopping criteria for the inner loop (conjugate gradient) is defined
   // independently in MapSolverOptions.
   double irls_cost_difference_threshold = 1.0e-5;
+
+  // Optionally budgets the iterations across channels when split_channels is
+  // set. This is useful when the channels differ in importance, such as the
+  // components when solving in PCA space, where the trailing components carry
+  // very little of the variance.
+  //
+  // channel_weights gives the relative importance of each channel (e.g. the
+  // PCA eigenvalues), and channel_iteration_budget is the total amount of work
+  // to spend, in units of one channel solved with the full
+  // max_num_irls_iterations and max_num_solver_iterations. The budget is
+  // distributed in proportion to the weights, but no channel gets more than
+  // the full iterations (the excess goes to the other channels). Channels with
+  // less than a full share get fewer IRLS iterations, and channels with less
+  // than one IRLS iteration's worth get a single IRLS iteration with fewer
+  // solver iterations.
+  //
+  // Channels whose weight is less than min_channel_weight_fraction of the
+  // total weight (or not positive), or that get no budget, are not solved at
+  // all and keep their initial estimate (e.g. bilinear upsampling).
+  //
+  // Budgeting is disabled if channel_weights is empty or the budget is not
+  // positive.
+  std::vector<double> channel_weights;
+  double channel_iteration_budget = 0.0;
+  double min_channel_weight_fraction = 0.0;
 };
 
 class IRLSMapSolver : public MapSolver {
@@ -41,6 +41,9 @@ void MapSolverOptions::PrintSolverOptions() const {
   if (split_channels) {
     std::cout << "  Channel splitting enabled." << std::endl;
   }
+  if (use_single_precision) {
+    std::cout << "  Single precision image operators enabled." << std::endl;
+  }
   std::cout << "  Threshold 1 (gradient norm):         "
             << gradient_norm_threshold << std::endl;
   std::cout << "  Threshold 2 (cost decrease):         "
@@ -76,6 +76,13 @@ struct MapSolverOptions {
   // option will prevent it from seeing multiple channels. Not recommended for
   // 3D regularizers.
   bool split_channels = false;
+
+  // If this is set to true, the observations are stored in single precision
+  // and the image model is applied to the estimate in single precision when
+  // computing the data term. This halves the memory footprint and bandwidth
+  // of the image operators. Cost sums and the solver's parameter and gradient
+  // arrays remain in double precision.
+  bool use_single_precision = false;
 };
 
 class MapSolver : public Solver {
@@ -12,6 +12,52 @@
 namespace super_resolution {
 namespace {
 
+// Replaces each channel of the degraded image with its residual against the
+// corresponding observation channel, and returns the sum of squared residuals.
+// The pixel type T must match the precision of both images. The squared
+// residuals are always accumulated in double precision.
+template <typename T>
+double ComputeResidualImage(
+    const ImageData& observation,
+    const int channel_start,
+    ImageData* degraded_hr_image) {
+
+  double residual_sum = 0;
+  const int num_channels = degraded_hr_image->GetNumChannels();
+  const int num_pixels = degraded_hr_image->GetNumPixels();
+  for (int channel = 0; channel < num_channels; ++channel) {
+    cv::Mat degraded_hr_channel = degraded_hr_image->GetChannelImage(channel);
+    const cv::Mat observation_channel =
+        observation.GetChannelImage(channel + channel_start);
+    T* degraded_hr_channel_data = degraded_hr_channel.ptr<T>();
+    const T* observation_channel_data = observation_channel.ptr<T>();
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      const T residual =
+          degraded_hr_channel_data[pixel_index] -
+          observation_channel_data[pixel_index];
+      degraded_hr_channel_data[pixel_index] = residual;
+      residual_sum += static_cast<double>(residual) * residual;
+    }
+  }
+  return residual_sum;
+}
+
+// Adds two times the transposed residual image to the gradient array.
+template <typename T>
+void AddResidualToGradient(const ImageData& residual_image, double* gradient) {
+  const int num_channels = residual_image.GetNumChannels();
+  const int num_pixels = residual_image.GetNumPixels();
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const int channel_index = channel * num_pixels;
+    const T* residual_channel_data =
+        residual_image.GetChannelImage(channel).ptr<T>();
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      const int index = channel_index + pixel_index;
+      gradient[index] += 2 * residual_channel_data[pixel_index];
+    }
+  }
+}
+
 double ComputeTermForObservation(
     const ImageData& observation,
     const int image_index,
@@ -22,52 +68,57 @@ double ComputeTermForObservation(
     const double* estimated_image_data,
     double* gradient) {
 
-  // Degrade (and re-upsample) the HR estimate with the image model.
+  // The image model is applied in the same precision as the observations.
+  const bool single_precision =
+      observation.GetPrecision() == IMAGE_PRECISION_FLOAT;
+
+  // Degrade (and re-upsample) the HR estimate with the image model. The
+  // estimate is converted straight from the solver's double array into a
+  // per-thread image in the precision of the observation, so single precision
+  // does not go through a temporary double precision copy.
   const int num_channels = channel_end - channel_start;
-  ImageData degraded_hr_image(estimated_image_data, image_size, num_channels);
-  image_model.ApplyToImage(&degraded_hr_image, image_index);
-  degraded_hr_image.ResizeImage(image_size, INTERPOLATE_NEAREST);
+  thread_local ImageData degraded_hr_buffer;
+  ImageData* degraded_hr_image = &degraded_hr_buffer;
+  degraded_hr_image->SetPrecision(observation.GetPrecision());
+  degraded_hr_image->SetPixelValues(
+      estimated_image_data, image_size, num_channels);
+  image_model.ApplyToImage(degraded_hr_image, image_index);
+
+  // The residual is computed in a per-thread buffer that keeps its channels
+  // between evaluations, so upsampling the degraded image does not allocate.
+  thread_local ImageData residual_buffer;
+  ImageData* residual_image = &residual_buffer;
+  degraded_hr_image->ResizeImage(
+      image_size, INTERPOLATE_NEAREST, residual_image);
 
   // Compute the individual residuals by comparing pixel values. Sum them up
   // for the final residual sum.
   double residual_sum = 0;
-  const int num_pixels = image_size.width * image_size.height;
-  const int num_data_points = num_pixels * num_channels;
-  std::vector<double> residuals;
-  residuals.reserve(num_data_points);
-  for (int channel = 0; channel < num_channels; ++channel) {
-    const double* degraded_hr_channel_data =
-        degraded_hr_image.GetChannelData(channel);
-    const double* observation_channel_data =
-        observation.GetChannelData(channel + channel_start);
-    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
-      const double residual =
-          degraded_hr_channel_data[pixel_index] -
-          observation_channel_data[pixel_index];
-      residuals.push_back(residual);
-      residual_sum += (residual * residual);
-    }
+  if (single_precision) {
+    residual_sum =
+        ComputeResidualImage<float>(observation, channel_start, residual_image);
+  } else {
+    residual_sum = ComputeResidualImage<double>(
+        observation, channel_start, residual_image);
   }
 
   // If gradient is not null, apply transpose operations to the residual image.
   // This is used to compute the gradient.
   if (gradient != nullptr) {
-    ImageData residual_image(residuals.data(), image_size, num_channels);
+    // The degraded image is no longer needed, and it is already at the low
+    // resolution, so its channels are reused for the downsampled residual.
     const int scale = image_model.GetDownsamplingScale();
-    residual_image.ResizeImage(
+    residual_image->ResizeImage(
         cv::Size(image_size.width / scale, image_size.height / scale),
-        INTERPOLATE_ADDITIVE);
-    image_model.ApplyTransposeToImage(&residual_image, image_index);
+        INTERPOLATE_ADDITIVE,
+        degraded_hr_image);
+    image_model.ApplyTransposeToImage(degraded_hr_image, image_index);
 
     // Add to the gradient.
-    for (int channel = 0; channel < num_channels; ++channel) {
-      const int channel_index = channel * num_pixels;
-      const double* residual_channel_data =
-          residual_image.GetChannelData(channel);
-      for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
-        const int index = channel_index + pixel_index;
-        gradient[index] += 2 * residual_channel_data[pixel_index];
-      }
+    if (single_precision) {
+      AddResidualToGradient<float>(*degraded_hr_image, gradient);
+    } else {
+      AddResidualToGradient<double>(*degraded_hr_image, gradient);
     }
   }
 
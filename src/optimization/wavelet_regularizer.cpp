@@ -0,0 +1,98 @@
+#include "optimization/wavelet_regularizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+#include "util/matrix_util.h"
+#include "util/util.h"
+#include "wavelet/wavelet_transform.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+
+WaveletRegularizer::WaveletRegularizer(
+    const cv::Size& image_size,
+    const wavelet::WaveletType wavelet_type,
+    const int num_levels)
+    : Regularizer(image_size),
+      wavelet_type_(wavelet_type),
+      num_levels_(num_levels) {
+
+  CHECK_GT(num_levels_, 0)
+      << "The wavelet transform needs at least one level.";
+}
+
+std::vector<double> WaveletRegularizer::ApplyToImage(
+    const double* image_data, const int num_channels) const {
+
+  std::vector<double> residuals =
+      GetDetailCoefficients(image_data, num_channels);
+  for (double& residual : residuals) {
+    residual = std::abs(residual);
+  }
+  return residuals;
+}
+
+std::pair<std::vector<double>, std::vector<double>>
+WaveletRegularizer::ApplyToImageWithDifferentiation(
+    const double* image_data,
+    const std::vector<double>& gradient_constants,
+    const int num_channels) const {
+
+  const std::vector<double> coefficients =
+      GetDetailCoefficients(image_data, num_channels);
+  const int num_pixels = image_size_.area();
+  const int num_values = num_pixels * num_channels;
+  CHECK_EQ(gradient_constants.size(), num_values)
+      << "There must be one gradient constant per pixel.";
+
+  // Each residual is |c_i| for a coefficient c_i = (W x)_i, so the derivative
+  // of constant_i * |c_i|^2 with respect to the image is
+  // 2 * constant_i * c_i * (row i of W), and the full gradient is
+  // 2 * W^T (constants .* c).
+  std::vector<double> residuals(num_values);
+  std::vector<double> gradient(num_values);
+  for (int i = 0; i < num_values; ++i) {
+    residuals[i] = std::abs(coefficients[i]);
+    gradient[i] = 2.0 * gradient_constants[i] * coefficients[i];
+  }
+  util::ParallelFor(num_channels, [&](const int channel) {
+    cv::Mat channel_gradient(
+        image_size_,
+        util::kOpenCvMatrixType,
+        gradient.data() + channel * num_pixels);
+    wavelet::AdjointMultiLevelWaveletTransformInPlace(
+        wavelet_type_, num_levels_, &channel_gradient);
+  });
+  return std::make_pair(residuals, gradient);
+}
+
+std::vector<double> WaveletRegularizer::GetDetailCoefficients(
+    const double* image_data, const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const int num_pixels = image_size_.area();
+  const cv::Rect low_pass_region = wavelet::GetSubbandRegion(
+      image_size_, num_levels_, wavelet::SUBBAND_LL);
+  std::vector<double> coefficients(
+      image_data, image_data + num_pixels * num_channels);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    cv::Mat channel_coefficients(
+        image_size_,
+        util::kOpenCvMatrixType,
+        coefficients.data() + channel * num_pixels);
+    wavelet::MultiLevelWaveletTransformInPlace(
+        wavelet_type_, num_levels_, &channel_coefficients);
+    channel_coefficients(low_pass_region) = 0.0;
+  });
+  return coefficients;
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,57 @@
+// The wavelet sparsity regularizer penalizes the 1-norm of the multi-level
+// wavelet detail coefficients of the image. Natural images (including highly
+// textured ones) are sparse in the wavelet domain, so this prior suppresses
+// noise and aliasing while keeping edges and texture. Both the residuals and
+// the gradient take a single fast (lifting) wavelet transform per channel, so
+// the cost is linear in the number of pixels.
+
+#ifndef SRC_OPTIMIZATION_WAVELET_REGULARIZER_H_
+#define SRC_OPTIMIZATION_WAVELET_REGULARIZER_H_
+
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+#include "wavelet/wavelet_transform.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+class WaveletRegularizer : public Regularizer {
+ public:
+  // The wavelet type and number of decomposition levels define the transform.
+  // The coarsest low-pass (LL) coefficients are not penalized.
+  WaveletRegularizer(
+      const cv::Size& image_size,
+      const wavelet::WaveletType wavelet_type,
+      const int num_levels);
+
+  // Returns the absolute value of the wavelet coefficient stored at each
+  // pixel in the standard pyramid layout (see wavelet_transform.h), and 0 for
+  // the coarsest LL coefficients. With IRLS weights, the squared residuals
+  // sum to the 1-norm of the detail coefficients.
+  virtual std::vector<double> ApplyToImage(
+      const double* image_data, const int num_channels) const;
+
+  // The gradient is computed by applying the adjoint wavelet transform to the
+  // weighted coefficients.
+  virtual std::pair<std::vector<double>, std::vector<double>>
+  ApplyToImageWithDifferentiation(
+      const double* image_data,
+      const std::vector<double>& gradient_constants,
+      const int num_channels) const;
+
+ private:
+  // Returns the signed wavelet coefficients of every channel of the given
+  // image, with the coarsest LL coefficients set to zero.
+  std::vector<double> GetDetailCoefficients(
+      const double* image_data, const int num_channels) const;
+
+  const wavelet::WaveletType wavelet_type_;
+  const int num_levels_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_WAVELET_REGULARIZER_H_
@@ -6,10 +6,12 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "evaluation/peak_signal_to_noise_ratio.h"
 #include "evaluation/structural_similarity.h"
+#include "hyperspectral/spectral_interpolation.h"
 #include "hyperspectral/spectral_pca.h"
 #include "image/image_data.h"
 #include "image_model/additive_noise_module.h"
@@ -17,10 +19,12 @@
 #include "image_model/downsampling_module.h"
 #include "image_model/image_model.h"
 #include "image_model/motion_module.h"
+#include "image_model/warp_motion_module.h"
 #include "motion/motion_shift.h"
 #include "optimization/btv_regularizer.h"
 #include "optimization/irls_map_solver.h"
 #include "optimization/tv_regularizer.h"
+#include "optimization/wavelet_regularizer.h"
 #include "util/data_loader.h"
 #include "util/macros.h"
 #include "util/string_util.h"
@@ -65,6 +69,11 @@ DEFINE_double(blur_sigma, 1.0,
     "The sigma value of the Gaussian blur. Set to 0 to inactivate blurring.");
 DEFINE_string(motion_sequence_path, "",
     "Path to a file containing the motion shifts for each image.");
+DEFINE_string(warp_motion_path, "",
+    "Path to a YAML/XML file of per-frame affine transforms or flow fields "
+    "(at the super-resolved size) to use instead of the motion shifts.");
+DEFINE_string(warp_motion_type, "affine",
+    "The type of the warp motions: 'affine' or 'flow'.");
 
 // Solver strategy parameters:
 // TODO: Add support for different solver strategies (e.g. ADMM).
@@ -72,6 +81,16 @@ DEFINE_int32(optimization_iterations, 20,
     "Max number of optimization iterations (e.g. number of IRLS iterations).");
 DEFINE_bool(solve_in_wavelet_domain, false,
     "Run super-resolution in the wavelet domain (experimental).");
+DEFINE_string(wavelet_band_iterations, "",
+    "With solve_in_wavelet_domain, comma-separated IRLS iterations for the "
+    "LL, LH, HL, and HH bands (0 = interpolate; empty = "
+    "optimization_iterations for all).");
+DEFINE_double(wavelet_min_band_energy, 0.0,
+    "With solve_in_wavelet_domain, detail bands with a smaller fraction of "
+    "the coefficient energy are interpolated instead of solved.");
+DEFINE_bool(wavelet_zero_empty_bands, false,
+    "With wavelet_min_band_energy, set the near-empty detail bands to zero "
+    "instead of interpolating them.");
 DEFINE_bool(interpolate_color, false,
     "Run SR only on the luminance channel and interpolate colors later.");
 DEFINE_bool(solve_in_pca_space, false,
@@ -80,17 +99,40 @@ DEFINE_int32(num_pca_components, 0,
     "Number of PCA components to use (0 = all) if solve_in_pca_space is set.");
 DEFINE_double(pca_retained_variance, 0.0,
     "Retained variance for PCA (1.0 = all, 0.0 = use num_pca_components).");
+DEFINE_string(pca_training_method, "subsampled",
+    "How to train PCA ('subsampled', 'covariance', or 'randomized').");
+DEFINE_int32(pca_oversampling, 10,
+    "Extra subspace dimensions for 'randomized' PCA training (for accuracy).");
+DEFINE_string(pca_basis_path, "",
+    "Load the PCA basis from this file (see TrainSpectralPCA) instead of "
+    "training it on the input images.");
 DEFINE_bool(split_channels, false,
     "Each channel will be solved as an independent image.");
+DEFINE_int32(band_step, 1,
+    "Only super-resolve every k-th band and interpolate the rest (1 = all).");
+DEFINE_bool(select_bands_by_curvature, false,
+    "With band_step, place the solved bands where the spectra curve the most.");
+DEFINE_int32(band_refinement_iterations, 0,
+    "With band_step, solver iterations to refine the interpolated bands.");
+DEFINE_double(pca_iteration_budget, 0.0,
+    "With split_channels, total iterations (in full channel solves) to split "
+    "over the PCA components by variance (0 = full iterations for all).");
+DEFINE_double(pca_min_variance_fraction, 0.0,
+    "With pca_iteration_budget, components with a smaller fraction of the "
+    "variance are only upsampled bilinearly.");
 
 // Regularization options:
 // TODO: Add support for multiple regularizers simultaneously.
 DEFINE_string(regularizer, "tv",
-    "The regularizer to use ('tv', '3dtv', 'btv').");
+    "The regularizer to use ('tv', '3dtv', 'btv', 'wavelet').");
 DEFINE_int32(btv_scale_range, 3,
     "The range (window size) for BTV regularization. Minumum range is 1.");
 DEFINE_double(btv_spatial_decay, 0.5,
     "The spatial decay factor for BTV regularization (0 < decay <= 1).");
+DEFINE_string(wavelet_regularizer_type, "cdf97",
+    "The wavelet for wavelet regularization ('haar', 'cdf53', or 'cdf97').");
+DEFINE_int32(wavelet_regularizer_levels, 3,
+    "The number of decomposition levels for wavelet regularization.");
 DEFINE_double(regularization_parameter, 0.01,
     "The regularization parameter (lambda). 0 to not use regularization.");
 
@@ -101,6 +143,8 @@ DEFINE_int32(solver_iterations, 50,
     "The maximum number of solver iterations.");
 DEFINE_bool(use_numerical_differentiation, false,
     "Use numerical differentiation (very slow) for test purposes.");
+DEFINE_bool(single_precision, false,
+    "Store observations and apply the image model in float32 (less memory).");
 
 // Evaluation and testing:
 DEFINE_bool(verbose, false,
@@ -120,15 +164,8 @@ struct InputData {
   std::vector<ImageData> low_res_images;  // Necessary for super-resolution.
 };
 
-// Runs the solver on the given inputs and returns the output. All solver
-// options are set based on the user input flags. Post-processing the result
-// (such as changing color space back to BGR) is not handled here.
-ImageData SetupAndRunSolver(
-    const ImageModel& image_model,
-    const std::vector<ImageData>& input_images,
-    const ImageData& initial_estimate) {
-
-  // Set up the solver.
+// Returns the solver options set based on the user input flags.
+super_resolution::IRLSMapSolverOptions GetSolverOptions() {
   // TODO: let the user choose the solver (once more solvers are supported).
   super_resolution::IRLSMapSolverOptions solver_options;
   if (FLAGS_solver == "cg") {
@@ -145,6 +182,22 @@ ImageData SetupAndRunSolver(
   solver_options.use_numerical_differentiation =
       FLAGS_use_numerical_differentiation;
   solver_options.split_channels = FLAGS_split_channels;
+  solver_options.use_single_precision = FLAGS_single_precision;
+  return solver_options;
+}
+
+// Runs the solver on the given inputs and returns the output. The solver
+// options are set based on the user input flags unless given. Post-processing
+// the result (such as changing color space back to BGR) is not handled here.
+// This may be called from multiple threads at once.
+ImageData SetupAndRunSolver(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& input_images,
+    const ImageData& initial_estimate,
+    const super_resolution::IRLSMapSolverOptions& solver_options =
+        GetSolverOptions()) {
+
+  // Set up the solver.
   super_resolution::IRLSMapSolver solver(
       solver_options, image_model, input_images);
   if (!FLAGS_verbose) {
@@ -153,35 +206,45 @@ ImageData SetupAndRunSolver(
 
   // Add the appropriate regularizer based on user input.
   // TODO: support for multiple regularizers at once.
+  // The flag is copied since solvers may be set up concurrently.
   std::shared_ptr<super_resolution::Regularizer> regularizer;
+  std::string regularizer_name = FLAGS_regularizer;
   if (FLAGS_regularization_parameter > 0.0) {
-    if (FLAGS_regularizer == "tv" || FLAGS_regularizer == "3dtv") {
+    if (regularizer_name == "tv" || regularizer_name == "3dtv") {
       regularizer =
           std::shared_ptr<super_resolution::Regularizer>(
               new super_resolution::TotalVariationRegularizer(
                   initial_estimate.GetImageSize()));
-      if (FLAGS_regularizer == "3dtv") {
+      if (regularizer_name == "3dtv") {
         dynamic_cast<super_resolution::TotalVariationRegularizer*>(
             regularizer.get())->SetUse3dTotalVariation(true);
       }
-    } else if (FLAGS_regularizer == "btv") {
+    } else if (regularizer_name == "btv") {
       regularizer =
           std::shared_ptr<super_resolution::Regularizer>(
               new super_resolution::BilateralTotalVariationRegularizer(
                   initial_estimate.GetImageSize(),
                   FLAGS_btv_scale_range,
                   FLAGS_btv_spatial_decay));
+    } else if (regularizer_name == "wavelet") {
+      regularizer =
+          std::shared_ptr<super_resolution::Regularizer>(
+              new super_resolution::WaveletRegularizer(
+                  initial_estimate.GetImageSize(),
+                  super_resolution::wavelet::GetWaveletType(
+                      FLAGS_wavelet_regularizer_type),
+                  FLAGS_wavelet_regularizer_levels));
     } else {
-      LOG(WARNING) << "Unknown regularizer option '" << FLAGS_regularizer
+      LOG(WARNING) << "Unknown regularizer option '" << regularizer_name
                    << "'. Using default Total Variation regularizer.";
-      FLAGS_regularizer = "tv";
+      regularizer_name = "tv";
       regularizer =
           std::shared_ptr<super_resolution::Regularizer>(
               new super_resolution::TotalVariationRegularizer(
                   initial_estimate.GetImageSize()));
     }
     solver.AddRegularizer(regularizer, FLAGS_regularization_parameter);
-    LOG(INFO) << "Added " << FLAGS_regularizer
+    LOG(INFO) << "Added " << regularizer_name
               << " regularizer with regularization parameter "
               << FLAGS_regularization_parameter;
   }
@@ -198,60 +261,156 @@ ImageData SetupAndRunSolver(
   return result;
 }
 
+// Super-resolves only the key bands (see spectral_interpolation.h) with the
+// solver and interpolates the skipped bands from them. The skipped bands are
+// then optionally refined with a few solver iterations.
+ImageData SolveWithBandSubsampling(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& input_images,
+    const ImageData& initial_estimate) {
+
+  super_resolution::KeyBandOptions key_band_options;
+  key_band_options.band_step = FLAGS_band_step;
+  key_band_options.select_by_curvature = FLAGS_select_bands_by_curvature;
+  const std::vector<int> key_bands =
+      super_resolution::SelectKeyBands(input_images[0], key_band_options);
+  const std::vector<int> skipped_bands = super_resolution::GetSkippedBands(
+      initial_estimate.GetNumChannels(), key_bands);
+  LOG(INFO) << "Super-resolving " << key_bands.size() << " key bands and "
+            << "interpolating " << skipped_bands.size() << " bands.";
+
+  std::vector<ImageData> key_band_input_images;
+  for (const ImageData& input_image : input_images) {
+    key_band_input_images.push_back(
+        super_resolution::SelectBands(input_image, key_bands));
+  }
+  const ImageData key_band_result = SetupAndRunSolver(
+      image_model,
+      key_band_input_images,
+      super_resolution::SelectBands(initial_estimate, key_bands));
+  ImageData result = super_resolution::InterpolateSkippedBands(
+      key_band_result, key_bands, initial_estimate);
+
+  if (FLAGS_band_refinement_iterations > 0 && !skipped_bands.empty()) {
+    std::vector<ImageData> skipped_band_input_images;
+    for (const ImageData& input_image : input_images) {
+      skipped_band_input_images.push_back(
+          super_resolution::SelectBands(input_image, skipped_bands));
+    }
+    super_resolution::IRLSMapSolverOptions refinement_options =
+        GetSolverOptions();
+    refinement_options.max_num_irls_iterations = 1;
+    refinement_options.max_num_solver_iterations =
+        FLAGS_band_refinement_iterations;
+    const ImageData refined_bands = SetupAndRunSolver(
+        image_model,
+        skipped_band_input_images,
+        super_resolution::SelectBands(result, skipped_bands),
+        refinement_options);
+    super_resolution::ReplaceBands(refined_bands, skipped_bands, &result);
+  }
+  return result;
+}
+
+// Returns the number of IRLS iterations for each wavelet sub-band (LL, LH, HL,
+// HH) based on the user input flags.
+std::vector<int> GetWaveletBandIterations() {
+  if (FLAGS_wavelet_band_iterations.empty()) {
+    return std::vector<int>(4, FLAGS_optimization_iterations);
+  }
+  const std::vector<std::string> iteration_strings =
+      super_resolution::util::SplitString(FLAGS_wavelet_band_iterations, ',');
+  CHECK_EQ(iteration_strings.size(), 4)
+      << "Wavelet band iterations must be given for LL, LH, HL, and HH.";
+  std::vector<int> band_iterations;
+  for (const std::string& iteration_string : iteration_strings) {
+    band_iterations.push_back(std::stoi(
+        super_resolution::util::TrimString(iteration_string)));
+    CHECK_GE(band_iterations.back(), 0)
+        << "Wavelet band iterations must be non-negative.";
+  }
+  return band_iterations;
+}
+
+// Super-resolves each wavelet sub-band (LL, LH, HL, HH) independently and
+// reconstructs the result. The sub-band solves share no data, so they run
+// concurrently on their own threads. Detail bands with little energy in the
+// reference image, or with no iterations, are only interpolated (or zeroed).
 ImageData SolveInWaveletDomain(
     const ImageModel& image_model,
     const std::vector<ImageData>& input_images) {
 
   // Generate coefficients for each input image.
-  std::vector<ImageData> input_dwt_ll_coefficients;
-  std::vector<ImageData> input_dwt_lh_coefficients;
-  std::vector<ImageData> input_dwt_hl_coefficients;
-  std::vector<ImageData> input_dwt_hh_coefficients;
+  constexpr int kNumSubbands = 4;
+  const std::vector<std::string> subband_names = {"LL", "LH", "HL", "HH"};
+  std::vector<std::vector<ImageData>> input_subbands(kNumSubbands);
+  std::vector<double> energy_fractions;
   for (const ImageData& input : input_images) {
     super_resolution::wavelet::WaveletCoefficients coefficients
         = super_resolution::wavelet::WaveletTransform(input);
-    input_dwt_ll_coefficients.push_back(coefficients.ll);
-    input_dwt_lh_coefficients.push_back(coefficients.lh);
-    input_dwt_hl_coefficients.push_back(coefficients.hl);
-    input_dwt_hh_coefficients.push_back(coefficients.hh);
+    if (energy_fractions.empty()) {
+      energy_fractions =
+          super_resolution::wavelet::GetSubbandEnergyFractions(coefficients);
+    }
+    input_subbands[0].push_back(coefficients.ll);
+    input_subbands[1].push_back(coefficients.lh);
+    input_subbands[2].push_back(coefficients.hl);
+    input_subbands[3].push_back(coefficients.hh);
   }
 
-  // Run super-resolution on each component individually.
-  // TODO: Allow selecting which of these actually get super-resolved.
-  // LL:
-  ImageData initial_estimate_ll = input_dwt_ll_coefficients[0];
-  initial_estimate_ll.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
-  ImageData result_ll = SetupAndRunSolver(
-      image_model, input_dwt_ll_coefficients, initial_estimate_ll);
-  // LH:
-  ImageData initial_estimate_lh = input_dwt_lh_coefficients[0];
-  initial_estimate_lh.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
-  ImageData result_lh = SetupAndRunSolver(
-      image_model, input_dwt_lh_coefficients, initial_estimate_lh);
-  // HL:
-  ImageData initial_estimate_hl = input_dwt_hl_coefficients[0];
-  initial_estimate_hl.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
-  ImageData result_hl = SetupAndRunSolver(
-      image_model, input_dwt_hl_coefficients, initial_estimate_hl);
-  // HH:
-  ImageData initial_estimate_hh = input_dwt_hh_coefficients[0];
-  initial_estimate_hh.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
-  ImageData result_hh = SetupAndRunSolver(
-      image_model, input_dwt_hh_coefficients, initial_estimate_hh);
+  const std::vector<int> band_iterations = GetWaveletBandIterations();
+  const super_resolution::IRLSMapSolverOptions solver_options =
+      GetSolverOptions();
+  std::vector<ImageData> results(kNumSubbands);
+  std::vector<std::thread> solver_threads;
+  for (int band = 0; band < kNumSubbands; ++band) {
+    ImageData initial_estimate = input_subbands[band][0];
+    initial_estimate.ResizeImage(
+        FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+
+    // The LL band holds most of the image and is always solved unless it has
+    // no iterations.
+    const bool is_empty_detail_band =
+        (band > 0 && energy_fractions[band] < FLAGS_wavelet_min_band_energy);
+    if (band_iterations[band] == 0 || is_empty_detail_band) {
+      if (is_empty_detail_band && FLAGS_wavelet_zero_empty_bands) {
+        for (int i = 0; i < initial_estimate.GetNumChannels(); ++i) {
+          initial_estimate.GetChannelImage(i).setTo(0.0);
+        }
+      }
+      LOG(INFO) << "Not solving the " << subband_names[band] << " band "
+                << "(" << (energy_fractions[band] * 100.0)
+                << "% of the energy).";
+      results[band] = initial_estimate;
+      continue;
+    }
+
+    super_resolution::IRLSMapSolverOptions band_solver_options =
+        solver_options;
+    band_solver_options.max_num_irls_iterations = band_iterations[band];
+    solver_threads.emplace_back(
+        [&image_model, &input_subbands, &results, band,
+         band_solver_options, initial_estimate]() {
+          results[band] = SetupAndRunSolver(
+              image_model,
+              input_subbands[band],
+              initial_estimate,
+              band_solver_options);
+        });
+  }
+  for (std::thread& solver_thread : solver_threads) {
+    solver_thread.join();
+  }
 
   // Merge and reconstruct. Because of size precision errors where the lower
   // resolutions don't divide evenly by the upsampling scale, scale the ll
   // coefficient to the same size as the others. Then once reconstructed, scale
   // everything back to the target size. This offset should be only one pixel.
   super_resolution::wavelet::WaveletCoefficients result_coefficients;
-  result_coefficients.ll = result_ll;
-  result_coefficients.lh = result_lh;
-  result_coefficients.hl = result_hl;
-  result_coefficients.hh = result_hh;
+  result_coefficients.ll = results[0];
+  result_coefficients.lh = results[1];
+  result_coefficients.hl = results[2];
+  result_coefficients.hh = results[3];
   // result_coefficients.ll.ResizeImage(  // TODO: Put back if needed.
   //     result_coefficients.lh.GetImageSize(),
   //     super_resolution::INTERPOLATE_CUBIC);
@@ -271,15 +430,21 @@ int main(int argc, char** argv) {
 
   REQUIRE_ARG(FLAGS_data_path);
 
-  // Create the forward image model.
+  // Set up the forward image model parameters.
   super_resolution::ImageModelParameters model_parameters;
   model_parameters.scale = FLAGS_upsampling_scale;
   model_parameters.blur_radius = FLAGS_blur_radius;
   model_parameters.blur_sigma = FLAGS_blur_sigma;
   model_parameters.motion_sequence_path = FLAGS_motion_sequence_path;
-
-  const ImageModel image_model =
-      ImageModel::CreateImageModel(model_parameters);
+  if (!FLAGS_warp_motion_path.empty()) {
+    // The warps are precomputed for the full image size, so they cannot be
+    // applied to the wavelet sub-bands.
+    CHECK(!FLAGS_solve_in_wavelet_domain)
+        << "Warp motions are not supported when solving in the wavelet domain.";
+    model_parameters.warp_motion_path = FLAGS_warp_motion_path;
+    model_parameters.warp_motion_type =
+        super_resolution::GetWarpMotionType(FLAGS_warp_motion_type);
+  }
 
   // Load in or generate the low-resolution images.
   InputData input_data;
@@ -290,9 +455,13 @@ int main(int argc, char** argv) {
     input_data.high_res_image =
         super_resolution::util::LoadImage(FLAGS_data_path);
     // Create another image model with the noise module to generate LR images.
-    model_parameters.noise_sigma = FLAGS_noise_sigma;
+    super_resolution::ImageModelParameters noisy_model_parameters =
+        model_parameters;
+    noisy_model_parameters.noise_sigma = FLAGS_noise_sigma;
+    noisy_model_parameters.image_size =
+        input_data.high_res_image.GetImageSize();
     ImageModel image_model_with_noise =
-        ImageModel::CreateImageModel(model_parameters);
+        ImageModel::CreateImageModel(noisy_model_parameters);
     for (int i = 0; i < FLAGS_number_of_frames; ++i) {
       const ImageData low_res_frame =
           image_model_with_noise.ApplyToImage(input_data.high_res_image, i);
@@ -312,6 +481,15 @@ int main(int argc, char** argv) {
   CHECK_GT(input_data.low_res_images.size(), 0)
       << "At least one low-resolution image is required for super-resolution.";
 
+  // Create the forward image model. It is created once the images are loaded
+  // because warp motions need the size of the super-resolved image.
+  const cv::Size low_res_size = input_data.low_res_images[0].GetImageSize();
+  model_parameters.image_size = cv::Size(
+      low_res_size.width * FLAGS_upsampling_scale,
+      low_res_size.height * FLAGS_upsampling_scale);
+  const ImageModel image_model =
+      ImageModel::CreateImageModel(model_parameters);
+
   // Set flags for evaluation. We will evaluate if ground truth is available
   // and if an evaluator is specified.
   const bool has_ground_truth =
@@ -346,15 +524,30 @@ int main(int argc, char** argv) {
   // Cannot use this option if using the color interpolation scheme.
   std::unique_ptr<super_resolution::SpectralPCA> spectral_pca;
   if (FLAGS_solve_in_pca_space && !FLAGS_interpolate_color) {
-    // TODO: Get the sampling options and number of PCA bands from user args!
-    if (FLAGS_pca_retained_variance > 0.0) {
+    if (!FLAGS_pca_basis_path.empty()) {
       spectral_pca = std::unique_ptr<super_resolution::SpectralPCA>(
           new super_resolution::SpectralPCA(
-              input_data.low_res_images, FLAGS_pca_retained_variance));
+              super_resolution::SpectralPCA::LoadBasis(FLAGS_pca_basis_path)));
+      CHECK_EQ(spectral_pca->GetNumSpectralBands(),
+               input_data.low_res_images[0].GetNumChannels())
+          << "The PCA basis does not match the number of image bands.";
+      LOG(INFO) << "Loaded PCA basis from " << FLAGS_pca_basis_path
+                << " (source fingerprint " << std::hex
+                << spectral_pca->GetSourceFingerprint() << std::dec << ").";
     } else {
+      super_resolution::SpectralPCAOptions pca_options;
+      pca_options.training_method =
+          super_resolution::GetSpectralPCATrainingMethod(
+              FLAGS_pca_training_method);
+      pca_options.oversampling = FLAGS_pca_oversampling;
+      if (FLAGS_pca_retained_variance > 0.0) {
+        pca_options.retained_variance = FLAGS_pca_retained_variance;
+      } else {
+        pca_options.num_pca_bands = FLAGS_num_pca_components;
+      }
       spectral_pca = std::unique_ptr<super_resolution::SpectralPCA>(
           new super_resolution::SpectralPCA(
-              input_data.low_res_images, FLAGS_num_pca_components));
+              input_data.low_res_images, pca_options));
     }
     for (int i = 0; i < input_data.low_res_images.size(); ++i) {
       input_data.low_res_images[i] =
@@ -378,8 +571,29 @@ int main(int argc, char** argv) {
     result = SolveInWaveletDomain(image_model, input_data.low_res_images);
   } else {
     // Solving is handled in the SetupAndRunSolver function above.
-    result = SetupAndRunSolver(
-        image_model, input_data.low_res_images, initial_estimate);
+    super_resolution::IRLSMapSolverOptions solver_options = GetSolverOptions();
+    if (spectral_pca != nullptr && FLAGS_pca_iteration_budget > 0.0) {
+      solver_options.channel_weights = spectral_pca->GetEigenvalues();
+      solver_options.channel_iteration_budget = FLAGS_pca_iteration_budget;
+      solver_options.min_channel_weight_fraction =
+          FLAGS_pca_min_variance_fraction;
+    }
+    // Band subsampling relies on the correlation of neighboring bands, which
+    // PCA components do not have.
+    if (FLAGS_band_step > 1 && spectral_pca != nullptr) {
+      LOG(WARNING) << "Band subsampling is not supported in PCA space. "
+                   << "Super-resolving all PCA components.";
+    }
+    if (FLAGS_band_step > 1 && spectral_pca == nullptr) {
+      result = SolveWithBandSubsampling(
+          image_model, input_data.low_res_images, initial_estimate);
+    } else {
+      result = SetupAndRunSolver(
+          image_model,
+          input_data.low_res_images,
+          initial_estimate,
+          solver_options);
+    }
   }
 
   // If SR was only done on the luminance channel, interpolate the colors now
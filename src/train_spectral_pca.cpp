@@ -0,0 +1,85 @@
+// This binary trains a spectral PCA basis on a representative set of
+// hyperspectral images and saves it to a file. The SuperResolution binary can
+// then load the basis with the pca_basis_path flag instead of training it on
+// the input images of every run.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hyperspectral/lazy_hyperspectral_image.h"
+#include "hyperspectral/spectral_pca.h"
+#include "image/image_data.h"
+#include "util/data_loader.h"
+#include "util/macros.h"
+#include "util/util.h"
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+// Required input and output files.
+DEFINE_string(data_path, "",
+    "Path to an image or a directory of images to train the PCA basis on.");
+DEFINE_string(output_basis_path, "",
+    "Path to the file where the trained PCA basis will be saved.");
+
+// Training options (same as for the SuperResolution binary).
+DEFINE_string(pca_training_method, "covariance",
+    "How to train PCA ('subsampled', 'covariance', or 'randomized').");
+DEFINE_int32(num_pca_components, 0,
+    "Number of PCA components to keep (0 = all).");
+DEFINE_double(pca_retained_variance, 0.0,
+    "Retained variance for PCA (1.0 = all, 0.0 = use num_pca_components).");
+DEFINE_int32(pca_oversampling, 10,
+    "Extra subspace dimensions for 'randomized' PCA training (for accuracy).");
+
+// Reads binary hyperspectral images (ENVI configuration files) on demand
+// instead of loading them fully into memory, so the training set can be
+// larger than the available memory.
+DEFINE_bool(lazy_load_images, false,
+    "Read binary hyperspectral images from disk during training.");
+
+int main(int argc, char** argv) {
+  super_resolution::util::InitApp(argc, argv,
+      "Train a spectral PCA basis and save it for SuperResolution runs.");
+
+  REQUIRE_ARG(FLAGS_data_path);
+  REQUIRE_ARG(FLAGS_output_basis_path);
+
+  super_resolution::SpectralPCAOptions pca_options;
+  pca_options.training_method = super_resolution::GetSpectralPCATrainingMethod(
+      FLAGS_pca_training_method);
+  pca_options.oversampling = FLAGS_pca_oversampling;
+  if (FLAGS_pca_retained_variance > 0.0) {
+    pca_options.retained_variance = FLAGS_pca_retained_variance;
+  } else {
+    pca_options.num_pca_bands = FLAGS_num_pca_components;
+  }
+
+  std::unique_ptr<super_resolution::SpectralPCA> spectral_pca;
+  if (FLAGS_lazy_load_images) {
+    std::vector<std::unique_ptr<super_resolution::LazyHyperspectralImage>>
+        images;
+    std::vector<const super_resolution::LazyHyperspectralImage*> image_pointers;
+    for (const std::string& file_path :
+         super_resolution::util::ListImageFiles(FLAGS_data_path)) {
+      images.push_back(
+          super_resolution::util::LoadLazyHyperspectralImage(file_path));
+      image_pointers.push_back(images.back().get());
+    }
+    spectral_pca = std::unique_ptr<super_resolution::SpectralPCA>(
+        new super_resolution::SpectralPCA(image_pointers, pca_options));
+  } else {
+    const std::vector<super_resolution::ImageData> images =
+        super_resolution::util::LoadImages(FLAGS_data_path);
+    spectral_pca = std::unique_ptr<super_resolution::SpectralPCA>(
+        new super_resolution::SpectralPCA(images, pca_options));
+  }
+
+  spectral_pca->SaveBasis(FLAGS_output_basis_path);
+  LOG(INFO) << "Saved a basis of " << spectral_pca->GetNumPCABands()
+            << " PCA bands for " << spectral_pca->GetNumSpectralBands()
+            << " spectral bands to " << FLAGS_output_basis_path << ".";
+
+  return EXIT_SUCCESS;
+}
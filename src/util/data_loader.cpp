@@ -6,12 +6,20 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
+#include "hyperspectral/chunked_cube_file.h"
 #include "hyperspectral/hyperspectral_data_loader.h"
+#include "hyperspectral/lazy_hyperspectral_image.h"
 #include "image/image_data.h"
+#include "util/string_util.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
@@ -41,6 +49,71 @@ bool DoesSetContain(
   return set.find(key) != set.end();
 }
 
+// Fills in the defaults of the given load range (see ImageLoadRange) for an
+// image of the given size and number of bands, and verifies that the range is
+// inside of the image.
+ImageLoadRange ResolveLoadRange(
+    const ImageLoadRange& load_range,
+    const cv::Size& image_size,
+    const int num_bands) {
+
+  ImageLoadRange resolved_range = load_range;
+  const cv::Rect image_region(cv::Point(0, 0), image_size);
+  if (resolved_range.region.area() <= 0) {
+    resolved_range.region = image_region;
+  }
+  if (resolved_range.end_band <= 0) {
+    resolved_range.end_band = num_bands;
+  }
+  CHECK_EQ(resolved_range.region & image_region, resolved_range.region)
+      << "The region is outside of the image.";
+  CHECK(0 <= resolved_range.start_band &&
+        resolved_range.start_band < resolved_range.end_band &&
+        resolved_range.end_band <= num_bands)
+      << "The band range is outside of the image.";
+  return resolved_range;
+}
+
+// Returns the given range of the image.
+ImageData CropImage(const ImageData& image, const ImageLoadRange& load_range) {
+  const ImageLoadRange resolved_range = ResolveLoadRange(
+      load_range, image.GetImageSize(), image.GetNumChannels());
+  if (resolved_range.region.size() == image.GetImageSize() &&
+      resolved_range.end_band - resolved_range.start_band ==
+          image.GetNumChannels()) {
+    return image;
+  }
+  ImageData cropped_image;
+  for (int band = resolved_range.start_band;
+       band < resolved_range.end_band; ++band) {
+    cropped_image.AddChannel(
+        image.GetChannelImage(band)(resolved_range.region),
+        DO_NOT_NORMALIZE_IMAGE);
+  }
+  return cropped_image;
+}
+
+// Parses a comma-separated list of exactly num_values integers.
+std::vector<int> ParseIntegerList(
+    const std::string& list_string, const int num_values) {
+
+  const std::vector<std::string> pieces = SplitString(list_string, ',');
+  CHECK_EQ(pieces.size(), num_values)
+      << "Expected " << num_values << " comma-separated values in '"
+      << list_string << "'.";
+  std::vector<int> values;
+  for (const std::string& piece : pieces) {
+    const std::string value_string = TrimString(piece);
+    char* end = nullptr;
+    const long value = std::strtol(value_string.c_str(), &end, 10);  // NOLINT
+    CHECK(!value_string.empty() && *end == '\0')
+        << "Invalid integer '" << value_string << "' in '" << list_string
+        << "'.";
+    values.push_back(static_cast<int>(value));
+  }
+  return values;
+}
+
 }  // namespace
 
 bool IsDirectory(const std::string& path) {
@@ -72,8 +145,8 @@ bool IsSupportedImageExtension(const std::string& extension) {
   return DoesSetContain(kSupportedImageExtensions, extension);
 }
 
-std::vector<ImageData> LoadImages(const std::string& data_path) {
-  std::vector<ImageData> images;
+std::vector<std::string> ListImageFiles(const std::string& data_path) {
+  std::vector<std::string> file_paths;
   if (IsDirectory(data_path)) {
     DIR* dir;
     struct dirent* ent;
@@ -82,18 +155,54 @@ std::vector<ImageData> LoadImages(const std::string& data_path) {
         const std::string file_name(ent->d_name);
         const std::string file_path = data_path + "/" + file_name;
         if (IsFile(file_path)) {
-          images.push_back(LoadImage(file_path));
+          file_paths.push_back(file_path);
         }
       }
       closedir(dir);
     }
+    // The order of readdir depends on the file system.
+    std::sort(file_paths.begin(), file_paths.end());
   } else {
-    images.push_back(LoadImage(data_path));
+    file_paths.push_back(data_path);
   }
+  return file_paths;
+}
+
+std::vector<ImageData> LoadImages(const std::string& data_path) {
+  const std::vector<std::string> file_paths = ListImageFiles(data_path);
+  std::vector<ImageData> images(file_paths.size());
+  ParallelFor(file_paths.size(), [&](const int index) {
+    images[index] = LoadImage(file_paths[index]);
+  });
   return images;
 }
 
 ImageData LoadImage(const std::string& file_path) {
+  return LoadImage(file_path, ImageLoadRange());
+}
+
+ImageLoadRange GetImageLoadRange(
+    const std::string& region_string, const std::string& band_range_string) {
+
+  ImageLoadRange load_range;
+  if (!region_string.empty()) {
+    const std::vector<int> values = ParseIntegerList(region_string, 4);
+    load_range.region = cv::Rect(values[0], values[1], values[2], values[3]);
+    CHECK_GT(load_range.region.area(), 0) << "The region must not be empty.";
+  }
+  if (!band_range_string.empty()) {
+    const std::vector<int> values = ParseIntegerList(band_range_string, 2);
+    load_range.start_band = values[0];
+    load_range.end_band = values[1];
+    CHECK_GT(load_range.end_band, load_range.start_band)
+        << "The band range must not be empty.";
+  }
+  return load_range;
+}
+
+ImageData LoadImage(
+    const std::string& file_path, const ImageLoadRange& load_range) {
+
   CHECK(IsFile(file_path))
       << "The given path '" << file_path << "' is not a file.";
   std::string extension = file_path.substr(file_path.find_last_of(".") + 1);
@@ -103,26 +212,133 @@ ImageData LoadImage(const std::string& file_path) {
   if (IsSupportedImageExtension(extension)) {
     const cv::Mat image = cv::imread(file_path, cv::IMREAD_UNCHANGED);
     CHECK(!image.empty()) << "Could not load image '" << file_path << "'.";
-    return ImageData(image);
+    return CropImage(ImageData(image), load_range);
+  } else if (extension == kChunkedCubeFileExtension) {
+    // Chunked cube files are self-describing, so they are read directly. Only
+    // the chunks inside of the range are decoded.
+    const ChunkedCubeFile cube_file(file_path);
+    const ImageLoadRange resolved_range = ResolveLoadRange(
+        load_range, cube_file.GetImageSize(), cube_file.GetNumChannels());
+    return cube_file.ReadImage(
+        resolved_range.region,
+        resolved_range.start_band,
+        resolved_range.end_band);
   } else {
     // Otherwise, try loading it as a hyperspectral image (assuming the given
-    // path was a configuration file).
+    // path was a configuration file). Every band is needed here, so the file
+    // is read eagerly rather than through a LazyHyperspectralImage: the loader
+    // converts BIP pixels in blocks, while the lazy image reads one band (and
+    // so one value of every pixel) at a time.
     HyperspectralDataLoader hs_data_loader(file_path);
-    hs_data_loader.LoadImageFromENVIFile();
+    std::string hsi_file_path;
+    HSIBinaryDataParameters parameters;
+    HSIDataRange data_range;
+    hs_data_loader.ReadConfigurationFile(
+        &hsi_file_path, &parameters, &data_range);
+    const ImageLoadRange resolved_range = ResolveLoadRange(
+        load_range,
+        cv::Size(
+            data_range.end_col - data_range.start_col,
+            data_range.end_row - data_range.start_row),
+        data_range.end_band - data_range.start_band);
+    hs_data_loader.LoadImageFromENVIFile(
+        resolved_range.region,
+        resolved_range.start_band,
+        resolved_range.end_band);
     return hs_data_loader.GetImage();
   }
 }
 
+ImagePrefetcher::ImagePrefetcher(
+    const std::string& data_path, const int num_threads)
+    : file_paths_(ListImageFiles(data_path)),
+      images_(file_paths_.size()),
+      next_image_index_(0),
+      is_image_loaded_(file_paths_.size(), false) {
+
+  int num_loading_threads = num_threads;
+  if (num_loading_threads <= 0) {
+    num_loading_threads = std::thread::hardware_concurrency();
+  }
+  num_loading_threads = std::max(
+      std::min(num_loading_threads, GetNumImages()), 1);
+  for (int i = 0; i < num_loading_threads; ++i) {
+    threads_.emplace_back(&ImagePrefetcher::LoadRemainingImages, this);
+  }
+}
+
+ImagePrefetcher::~ImagePrefetcher() {
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+const ImageData& ImagePrefetcher::GetImage(const int index) const {
+  CHECK_GE(index, 0) << "Image index must be non-negative.";
+  CHECK_LT(index, GetNumImages()) << "Image index is out of bounds.";
+  std::unique_lock<std::mutex> lock(mutex_);
+  image_loaded_.wait(lock, [&]() {
+    return is_image_loaded_[index];
+  });
+  return images_[index];
+}
+
+std::vector<ImageData> ImagePrefetcher::GetImages() const {
+  std::vector<ImageData> images;
+  for (int i = 0; i < GetNumImages(); ++i) {
+    images.push_back(GetImage(i));
+  }
+  return images;
+}
+
+void ImagePrefetcher::LoadRemainingImages() {
+  while (true) {
+    const int index = next_image_index_++;
+    if (index >= GetNumImages()) {
+      return;
+    }
+    // Each thread writes to a different image, so only the flag needs to be
+    // protected.
+    images_[index] = LoadImage(file_paths_[index]);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      is_image_loaded_[index] = true;
+    }
+    image_loaded_.notify_all();
+  }
+}
+
+std::unique_ptr<LazyHyperspectralImage> LoadLazyHyperspectralImage(
+    const std::string& file_path, const size_t cache_size_bytes) {
+
+  CHECK(IsFile(file_path))
+      << "The given path '" << file_path << "' is not a file.";
+  return std::unique_ptr<LazyHyperspectralImage>(
+      new LazyHyperspectralImage(file_path, cache_size_bytes));
+}
+
 void SaveImage(const ImageData& image, const std::string& data_path) {
+  SaveImage(image, data_path, HSIBinaryDataFormat());
+}
+
+void SaveImage(
+    const ImageData& image,
+    const std::string& data_path,
+    const HSIBinaryDataFormat& hsi_data_format) {
+
   const int num_channels = image.GetNumChannels();
-  if (num_channels == 1 || num_channels == 3) {
+  const bool save_as_cube =
+      (GetFileExtension(data_path) == kChunkedCubeFileExtension);
+  if (num_channels > 0 && save_as_cube) {
+    // Any image can be saved as a chunked cube if requested by the extension.
+    SaveChunkedCube(image, data_path);
+  } else if (num_channels == 1 || num_channels == 3) {
     // Monochrome or RGB images are put back together and saved with OpenCV.
     cv::imwrite(data_path, image.GetVisualizationImage());
   } else if (num_channels > 0) {
     // 2 or 4+ channel images are saved as hyperspectral images.
     const HyperspectralDataLoader hs_data_loader(data_path);
-    HSIBinaryDataFormat binary_data_format;  // Default format.
-    hs_data_loader.SaveImage(image, binary_data_format);
+    hs_data_loader.SaveImage(image, hsi_data_format);
   } else {
     // Can't save an empty image.
     LOG(WARNING) << "Cannot save an empty image. Nothing was saved.";
@@ -4,11 +4,21 @@
 #ifndef SRC_UTIL_DATA_LOADER_H_
 #define SRC_UTIL_DATA_LOADER_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "hyperspectral/hyperspectral_data_loader.h"
+#include "hyperspectral/lazy_hyperspectral_image.h"
 #include "image/image_data.h"
 
+#include "opencv2/core/core.hpp"
+
 namespace super_resolution {
 namespace util {
 
@@ -29,30 +39,131 @@ bool IsFile(const std::string& path, const bool include_hidden_files = false);
 // that can be read or written with OpenCV.
 bool IsSupportedImageExtension(const std::string& extension);
 
+// Returns the paths of the files that LoadImages() loads for the given
+// data_path. If the data_path points to a directory, these are all (non-hidden)
+// files in that directory, sorted by name so that the order does not depend on
+// the file system. Otherwise, it is just the given path.
+std::vector<std::string> ListImageFiles(const std::string& data_path);
+
 // Returns a list of images loaded from the given data_path. If the data_path
 // points to a directory, the list will contain images loaded from all files in
-// that directory. If it is the name of a file, the returned list will contain
-// that single image.
+// that directory, sorted by file name. If it is the name of a file, the
+// returned list will contain that single image. The files are decoded in
+// parallel.
 //
 // The given data_path should be an image file or directory containing
 // multiple image files. The file(s) can be one of the following formats:
 //   - Standard image file (.jpg, .png, etc.)
 //   - TODO: Standard video file (.avi, .mpg, etc.)
 //   - Hyperspectral data in text format.
-//   - TODO: Binary hyperspectral data files.
+//   - Binary hyperspectral data files (ENVI configuration files or chunked
+//     cube files with the ".cube" extension).
 // Unsupported or invalid files or directories will result in an error.
 std::vector<ImageData> LoadImages(const std::string& data_path);
 
 // A shortcut for LoadImages if only a single image is needed.
 ImageData LoadImage(const std::string& data_path);
 
+// The part of an image that LoadImage() reads: the pixels inside of the
+// region, and the bands in [start_band, end_band). An empty region reads all
+// pixels, and a non-positive end_band reads through the last band. For ENVI
+// files, the range is relative to the data range in the configuration file.
+struct ImageLoadRange {
+  cv::Rect region;
+  int start_band = 0;
+  int end_band = 0;
+};
+
+// Returns the load range described by the given strings, as given on the
+// command line: "x,y,width,height" for the region and "start,end" for the
+// bands. Empty strings select the whole image or all bands, respectively. An
+// error will occur if a string is malformed.
+ImageLoadRange GetImageLoadRange(
+    const std::string& region_string, const std::string& band_range_string);
+
+// Same as LoadImage(), but only returns the given range of the image. Chunked
+// cube files only decode the chunks that overlap the range, and ENVI files
+// only read the values inside of it. Standard images are read entirely and
+// then cropped. An error will occur if the range is not inside of the image.
+ImageData LoadImage(
+    const std::string& data_path, const ImageLoadRange& load_range);
+
+// Loads the same images as LoadImages() in the background, so that each image
+// can be used as soon as it is decoded instead of waiting for all of them. The
+// images are decoded in order by a pool of threads, so earlier images become
+// available first. For example, registration can start on the first frame
+// while the later frames are still being decoded:
+//   const ImagePrefetcher prefetcher(data_path);
+//   const ImageData& reference_frame = prefetcher.GetImage(0);
+class ImagePrefetcher {
+ public:
+  // Starts loading the images at the given data path. If num_threads is not
+  // positive, one thread per available core is used.
+  explicit ImagePrefetcher(
+      const std::string& data_path, const int num_threads = 0);
+
+  // Waits for all images to finish loading.
+  ~ImagePrefetcher();
+
+  ImagePrefetcher(const ImagePrefetcher&) = delete;
+  ImagePrefetcher& operator=(const ImagePrefetcher&) = delete;
+
+  // Returns the total number of images (including those not yet loaded).
+  int GetNumImages() const {
+    return file_paths_.size();
+  }
+
+  // Returns the image at the given index, waiting for it to be loaded first
+  // if necessary.
+  const ImageData& GetImage(const int index) const;
+
+  // Waits for all images to be loaded and returns them, in the same order as
+  // LoadImages().
+  std::vector<ImageData> GetImages() const;
+
+ private:
+  // Loads images until there are none left. Run by each thread.
+  void LoadRemainingImages();
+
+  const std::vector<std::string> file_paths_;
+  std::vector<ImageData> images_;
+
+  // The index of the next image to be loaded by any of the threads.
+  std::atomic<int> next_image_index_;
+
+  // is_image_loaded_[i] is set once images_[i] is available.
+  std::vector<bool> is_image_loaded_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable image_loaded_;
+
+  std::vector<std::thread> threads_;
+};
+
+// Opens the binary hyperspectral image described by the given configuration
+// file without reading any of its data (see LazyHyperspectralImage). Bands are
+// read as they are accessed, and at most cache_size_bytes of them are kept in
+// memory at a time. Use LazyHyperspectralImage::GetImage() to read the entire
+// image as LoadImage() would.
+std::unique_ptr<LazyHyperspectralImage> LoadLazyHyperspectralImage(
+    const std::string& file_path,
+    const size_t cache_size_bytes = kDefaultBandCacheSizeBytes);
+
 // Saves the given image to a file at the given path. If the image has one or
 // three channels (monochrome or RGB, respectively), it will be saved as an
 // OpenCV image. Otherwise, it will be saved as a hyperspectral image. The user
 // provides the extension which defines the type of image that is saved (e.g.
-// JPEG or PNG).
+// JPEG or PNG). Images of any kind are saved as chunked cube files (see
+// ChunkedCubeFile) with default options if the extension is ".cube".
 void SaveImage(const ImageData& image, const std::string& data_path);
 
+// Same as SaveImage(), but images that are saved as ENVI hyperspectral files
+// use the given binary data format (e.g. an integer data type to reduce the
+// file size). Other file types are not affected.
+void SaveImage(
+    const ImageData& image,
+    const std::string& data_path,
+    const HSIBinaryDataFormat& hsi_data_format);
+
 }  // namespace util
 }  // namespace super_resolution
 
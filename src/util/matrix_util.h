@@ -13,6 +13,10 @@ namespace util {
 // This is the OpenCV matrix format that every matrix should use.
 constexpr int kOpenCvMatrixType = CV_64FC1;
 
+// The matrix format used by images stored in single precision (see
+// IMAGE_PRECISION_FLOAT in image/image_data.h).
+constexpr int kOpenCvSinglePrecisionMatrixType = CV_32FC1;
+
 // Applies a 2D convolution to the given ImageData. The convolution is applied
 // independently to all channels of the image. Specify border mode as needed.
 void ApplyConvolutionToImage(
@@ -0,0 +1,66 @@
+#include "util/memory_mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace util {
+
+MemoryMappedFile::MemoryMappedFile(const std::string& file_path)
+    : file_path_(file_path) {
+
+  file_descriptor_ = open(file_path.c_str(), O_RDONLY);
+  CHECK_GE(file_descriptor_, 0)
+      << "File '" << file_path << "' could not be opened for reading.";
+
+  struct stat file_status;
+  CHECK_EQ(fstat(file_descriptor_, &file_status), 0)
+      << "Could not get the size of file '" << file_path << "'.";
+  size_ = static_cast<size_t>(file_status.st_size);
+  if (size_ == 0) {
+    return;
+  }
+
+  void* mapped_data =
+      mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_descriptor_, 0);
+  CHECK(mapped_data != MAP_FAILED)
+      << "File '" << file_path << "' could not be memory mapped.";
+  data_ = static_cast<const unsigned char*>(mapped_data);
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<unsigned char*>(data_), size_);
+  }
+  if (file_descriptor_ >= 0) {
+    close(file_descriptor_);
+  }
+}
+
+void MemoryMappedFile::AdviseSequentialRead(
+    const size_t offset, const size_t num_bytes) const {
+
+  if (data_ == nullptr || offset >= size_) {
+    return;
+  }
+  // madvise requires a page-aligned start address.
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t aligned_offset = offset - (offset % page_size);
+  const size_t end = std::min(offset + num_bytes, size_);
+  unsigned char* range_start =
+      const_cast<unsigned char*>(data_) + aligned_offset;
+  // MADV_SEQUENTIAL makes the kernel read ahead aggressively (and drop pages
+  // behind the reader), and MADV_WILLNEED starts reading the range right away.
+  madvise(range_start, end - aligned_offset, MADV_SEQUENTIAL);
+  madvise(range_start, end - aligned_offset, MADV_WILLNEED);
+}
+
+}  // namespace util
+}  // namespace super_resolution
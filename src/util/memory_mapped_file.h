@@ -0,0 +1,59 @@
+// Provides read-only access to the contents of a file through a memory
+// mapping. This avoids the per-read stream overhead of std::ifstream for large
+// binary files (e.g. hyperspectral data cubes), since any byte range of the
+// file can be accessed directly as a pointer.
+
+#ifndef SRC_UTIL_MEMORY_MAPPED_FILE_H_
+#define SRC_UTIL_MEMORY_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+namespace super_resolution {
+namespace util {
+
+class MemoryMappedFile {
+ public:
+  // Opens and maps the entire given file. An error will occur if the file
+  // does not exist or cannot be mapped. Empty files are allowed, in which case
+  // GetData() returns nullptr.
+  explicit MemoryMappedFile(const std::string& file_path);
+
+  // Unmaps and closes the file.
+  ~MemoryMappedFile();
+
+  // The mapping is owned by this object, so it cannot be copied.
+  MemoryMappedFile(const MemoryMappedFile&) = delete;
+  MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+  // Returns a pointer to the first byte of the file.
+  const unsigned char* GetData() const {
+    return data_;
+  }
+
+  // Returns the size of the file in bytes.
+  size_t GetSize() const {
+    return size_;
+  }
+
+  // Returns the path of the mapped file.
+  const std::string& GetFilePath() const {
+    return file_path_;
+  }
+
+  // Hints to the operating system that the given byte range will be read
+  // sequentially soon, so it is read ahead from disk starting now. The range
+  // is clamped to the size of the file.
+  void AdviseSequentialRead(const size_t offset, const size_t num_bytes) const;
+
+ private:
+  const std::string file_path_;
+  int file_descriptor_ = -1;
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace util
+}  // namespace super_resolution
+
+#endif  // SRC_UTIL_MEMORY_MAPPED_FILE_H_
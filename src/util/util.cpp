@@ -2,6 +2,7 @@
 
 #include <dirent.h>
 
+#include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -21,6 +22,22 @@ namespace {
 // processed from the argv list. Any other misc input parameters will remain.
 constexpr bool kRemoveFlagsAfterParsing = true;
 
+// Adapts a std::function to OpenCV's parallel loop interface.
+class ParallelForBody : public cv::ParallelLoopBody {
+ public:
+  explicit ParallelForBody(const std::function<void(int)>& function)
+      : function_(function) {}
+
+  void operator()(const cv::Range& range) const override {
+    for (int i = range.start; i < range.end; ++i) {
+      function_(i);
+    }
+  }
+
+ private:
+  const std::function<void(int)>& function_;
+};
+
 }  // namespace
 
 void InitApp(int argc, char** argv, const std::string& usage_message) {
@@ -88,5 +105,18 @@ int GetPixelIndex(
   return channel_index + (row * image_size.width + col);
 }
 
+void ParallelFor(
+    const int num_iterations, const std::function<void(int)>& function) {
+
+  if (num_iterations <= 0) {
+    return;
+  }
+  if (num_iterations == 1) {
+    function(0);
+    return;
+  }
+  cv::parallel_for_(cv::Range(0, num_iterations), ParallelForBody(function));
+}
+
 }  // namespace util
 }  // namespace super_resolution
@@ -3,6 +3,7 @@
 #ifndef SRC_UTIL_UTIL_H_
 #define SRC_UTIL_UTIL_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -45,6 +46,14 @@ int GetPixelIndex(
     const int row,
     const int col);
 
+// Calls function(i) for every i in [0, num_iterations) using OpenCV's parallel
+// framework. Iterations may run concurrently and in any order, so the function
+// must be safe to call from multiple threads as long as each call works on
+// independent data (e.g. one image channel per iteration). Nested calls are
+// run sequentially by OpenCV.
+void ParallelFor(
+    const int num_iterations, const std::function<void(int)>& function);
+
 }  // namespace util
 }  // namespace super_resolution
 
@@ -19,6 +19,13 @@
 DEFINE_string(image_path, "",
     "The path to an input image file (regular or hyperspectral config).");
 
+// Optionally, only a part of the image is loaded and displayed. Chunked cube
+// and ENVI files only read the values inside of the range.
+DEFINE_string(region, "",
+    "Region of the image to load, as x,y,width,height. All if empty.");
+DEFINE_string(bands, "",
+    "Range of bands to load, as start,end (end exclusive). All if empty.");
+
 // Optionally, set this flag to enable automatic image resizing. This will
 // scale smaller images up and scale larger images down to visualize them more
 // uniformly on the screen.
@@ -37,8 +44,9 @@ int main(int argc, char** argv) {
 
   REQUIRE_ARG(FLAGS_image_path);
 
-  super_resolution::ImageData image =
-      super_resolution::util::LoadImage(FLAGS_image_path);
+  super_resolution::ImageData image = super_resolution::util::LoadImage(
+      FLAGS_image_path,
+      super_resolution::util::GetImageLoadRange(FLAGS_region, FLAGS_bands));
   if (FLAGS_print_image_info) {
     image.GetImageDataReport().Print();
   }
@@ -1,14 +1,416 @@
 #include "wavelet/wavelet_transform.h"
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "opencv2/core/core.hpp"
 
 #include "image/image_data.h"
+#include "util/matrix_util.h"
+#include "util/util.h"
 
 #include "glog/logging.h"
 
 namespace super_resolution {
 namespace wavelet {
 
+namespace {
+
+// Lifting coefficients of the CDF 9/7 wavelet (Daubechies and Sweldens,
+// "Factoring wavelet transforms into lifting steps").
+constexpr double kCDF97Alpha = -1.586134342059924;
+constexpr double kCDF97Beta = -0.052980118572961;
+constexpr double kCDF97Gamma = 0.882911075530934;
+constexpr double kCDF97Delta = 0.443506852043971;
+constexpr double kCDF97Scale = 1.230174104914001;
+
+// A single lifting step. Predict steps add the weighted sum of the two
+// neighboring even (low-pass) samples to each odd (high-pass) sample, and
+// update steps add the weighted sum of the two neighboring odd samples to each
+// even sample.
+struct LiftingStep {
+  bool is_predict;
+  double coefficient;
+};
+
+// The factorization of a wavelet into lifting steps followed by a scaling of
+// the low-pass and high-pass samples.
+struct LiftingScheme {
+  std::vector<LiftingStep> steps;
+
+  // Haar only uses the two samples of each pair instead of both neighbors.
+  bool is_haar;
+
+  double low_pass_scale;
+  double high_pass_scale;
+};
+
+LiftingScheme GetLiftingScheme(const WaveletType wavelet_type) {
+  switch (wavelet_type) {
+    case WAVELET_HAAR: {
+      // For each pair (a, b), d = b - a and s = a + d / 2 = (a + b) / 2. The
+      // scaling makes these (a + b) / sqrt(2) and (a - b) / sqrt(2).
+      const double sqrt2 = std::sqrt(2.0);
+      return {{{true, -0.5}, {false, 0.25}}, true, sqrt2, -1.0 / sqrt2};
+    }
+    case WAVELET_CDF_5_3:
+      return {{{true, -0.5}, {false, 0.25}}, false, 1.0, 1.0};
+    case WAVELET_CDF_9_7:
+      return {
+        {
+          {true, kCDF97Alpha},
+          {false, kCDF97Beta},
+          {true, kCDF97Gamma},
+          {false, kCDF97Delta}
+        },
+        false,
+        1.0 / kCDF97Scale,
+        kCDF97Scale
+      };
+    default:
+      LOG(FATAL) << "Unsupported wavelet type " << wavelet_type << ".";
+  }
+  return LiftingScheme();
+}
+
+// Computes target += coefficient * (first + second) over a row of values.
+// This is the inner loop of every lifting step. It only touches contiguous
+// memory so that the compiler can vectorize it.
+void AddScaledSum(
+    const double* first,
+    const double* second,
+    const double coefficient,
+    const int length,
+    double* target) {
+
+  for (int i = 0; i < length; ++i) {
+    target[i] += coefficient * (first[i] + second[i]);
+  }
+}
+
+// Computes target += coefficient * source over a row of values.
+void AddScaledRow(
+    const double* source,
+    const double coefficient,
+    const int length,
+    double* target) {
+
+  for (int i = 0; i < length; ++i) {
+    target[i] += coefficient * source[i];
+  }
+}
+
+void ScaleRow(const double scale, const int length, double* row) {
+  for (int i = 0; i < length; ++i) {
+    row[i] *= scale;
+  }
+}
+
+// Applies a lifting step to every column of the given matrix. Each row of the
+// matrix is one sample, so the even rows are the low-pass samples and the odd
+// rows are the high-pass samples. Missing neighbors at the borders are
+// replaced by their symmetric counterparts.
+void ApplyLiftingStep(
+    const LiftingStep& step, const bool is_haar, cv::Mat* lines) {
+
+  const int num_low_pass = (lines->rows + 1) / 2;
+  const int num_high_pass = lines->rows / 2;
+  const int length = lines->cols;
+  if (step.is_predict) {
+    for (int i = 0; i < num_high_pass; ++i) {
+      const int next = is_haar ? i : std::min(i + 1, num_low_pass - 1);
+      AddScaledSum(
+          lines->ptr<double>(2 * i),
+          lines->ptr<double>(2 * next),
+          step.coefficient,
+          length,
+          lines->ptr<double>(2 * i + 1));
+    }
+    return;
+  }
+  for (int i = 0; i < num_low_pass; ++i) {
+    int previous = std::max(i - 1, 0);
+    int next = std::min(i, num_high_pass - 1);
+    if (is_haar) {
+      // The last sample of an odd-length signal has no pair.
+      if (i >= num_high_pass) {
+        continue;
+      }
+      previous = i;
+      next = i;
+    }
+    AddScaledSum(
+        lines->ptr<double>(2 * previous + 1),
+        lines->ptr<double>(2 * next + 1),
+        step.coefficient,
+        length,
+        lines->ptr<double>(2 * i));
+  }
+}
+
+// Applies the transpose of ApplyLiftingStep(). Instead of adding its two
+// neighbors to each sample, each sample is added to its two neighbors.
+void ApplyTransposedLiftingStep(
+    const LiftingStep& step, const bool is_haar, cv::Mat* lines) {
+
+  const int num_low_pass = (lines->rows + 1) / 2;
+  const int num_high_pass = lines->rows / 2;
+  const int length = lines->cols;
+  if (step.is_predict) {
+    for (int i = 0; i < num_high_pass; ++i) {
+      const int next = is_haar ? i : std::min(i + 1, num_low_pass - 1);
+      const double* high_pass_row = lines->ptr<double>(2 * i + 1);
+      AddScaledRow(
+          high_pass_row,
+          step.coefficient,
+          length,
+          lines->ptr<double>(2 * i));
+      AddScaledRow(
+          high_pass_row,
+          step.coefficient,
+          length,
+          lines->ptr<double>(2 * next));
+    }
+    return;
+  }
+  for (int i = 0; i < num_low_pass; ++i) {
+    int previous = std::max(i - 1, 0);
+    int next = std::min(i, num_high_pass - 1);
+    if (is_haar) {
+      if (i >= num_high_pass) {
+        continue;
+      }
+      previous = i;
+      next = i;
+    }
+    const double* low_pass_row = lines->ptr<double>(2 * i);
+    AddScaledRow(
+        low_pass_row,
+        step.coefficient,
+        length,
+        lines->ptr<double>(2 * previous + 1));
+    AddScaledRow(
+        low_pass_row,
+        step.coefficient,
+        length,
+        lines->ptr<double>(2 * next + 1));
+  }
+}
+
+// Scales the low-pass (even) and high-pass (odd) rows of the given matrix.
+void ScaleLines(
+    const double low_pass_scale,
+    const double high_pass_scale,
+    cv::Mat* lines) {
+
+  for (int row = 0; row < lines->rows; ++row) {
+    const double scale = (row % 2 == 0) ? low_pass_scale : high_pass_scale;
+    ScaleRow(scale, lines->cols, lines->ptr<double>(row));
+  }
+}
+
+// Work buffers for transforming a single channel. They are allocated once for
+// the finest level and reused for every level.
+class LiftingBuffers {
+ public:
+  explicit LiftingBuffers(const cv::Size& size)
+      : transposed_data_(size.area()), reordered_data_(size.area()) {}
+
+  // Returns a matrix of the given size that uses the buffer for transposed
+  // regions. The size may not be larger than the one given to the
+  // constructor.
+  cv::Mat GetTransposedBuffer(const int num_rows, const int num_cols) {
+    return cv::Mat(
+        num_rows, num_cols, util::kOpenCvMatrixType, transposed_data_.data());
+  }
+
+  // Same as GetTransposedBuffer(), but for reordering rows.
+  cv::Mat GetReorderedBuffer(const int num_rows, const int num_cols) {
+    return cv::Mat(
+        num_rows, num_cols, util::kOpenCvMatrixType, reordered_data_.data());
+  }
+
+ private:
+  std::vector<double> transposed_data_;
+  std::vector<double> reordered_data_;
+};
+
+// Which linear operator a transform applies.
+enum TransformDirection {
+  TRANSFORM_FORWARD,
+  TRANSFORM_INVERSE,
+  TRANSFORM_ADJOINT
+};
+
+// Moves the even rows of the given matrix before the odd rows if is_forward is
+// true, and reverses that reordering otherwise.
+void ReorderLines(
+    const bool is_forward, cv::Mat* lines, LiftingBuffers* buffers) {
+
+  const int num_low_pass = (lines->rows + 1) / 2;
+  cv::Mat reordered = buffers->GetReorderedBuffer(lines->rows, lines->cols);
+  for (int row = 0; row < lines->rows; ++row) {
+    const int split_row =
+        (row % 2 == 0) ? (row / 2) : (num_low_pass + row / 2);
+    const double* source = lines->ptr<double>(is_forward ? row : split_row);
+    double* target = reordered.ptr<double>(is_forward ? split_row : row);
+    std::copy(source, source + lines->cols, target);
+  }
+  reordered.copyTo(*lines);
+}
+
+// Transforms every column of the given matrix (see ApplyLiftingStep()). The
+// forward transform reorders the rows afterwards so that all low-pass rows
+// come before all high-pass rows. The inverse and adjoint transforms expect
+// that order.
+void LiftLines(
+    const LiftingScheme& scheme,
+    const TransformDirection direction,
+    cv::Mat* lines,
+    LiftingBuffers* buffers) {
+
+  if (lines->rows < 2) {
+    return;
+  }
+  switch (direction) {
+    case TRANSFORM_FORWARD:
+      for (const LiftingStep& step : scheme.steps) {
+        ApplyLiftingStep(step, scheme.is_haar, lines);
+      }
+      ScaleLines(scheme.low_pass_scale, scheme.high_pass_scale, lines);
+      ReorderLines(true, lines, buffers);
+      break;
+    case TRANSFORM_INVERSE:
+      ReorderLines(false, lines, buffers);
+      ScaleLines(
+          1.0 / scheme.low_pass_scale, 1.0 / scheme.high_pass_scale, lines);
+      for (auto step = scheme.steps.rbegin();
+           step != scheme.steps.rend();
+           ++step) {
+        ApplyLiftingStep(
+            {step->is_predict, -step->coefficient}, scheme.is_haar, lines);
+      }
+      break;
+    case TRANSFORM_ADJOINT:
+      // The transposes of the forward operations in reverse order. The
+      // reordering is a permutation, so its transpose is its inverse.
+      ReorderLines(false, lines, buffers);
+      ScaleLines(scheme.low_pass_scale, scheme.high_pass_scale, lines);
+      for (auto step = scheme.steps.rbegin();
+           step != scheme.steps.rend();
+           ++step) {
+        ApplyTransposedLiftingStep(*step, scheme.is_haar, lines);
+      }
+      break;
+  }
+}
+
+// Computes a single level of the 2D transform of the given region in place.
+// The forward transform lifts the columns first and then the rows, and the
+// inverse and adjoint transforms undo that in reverse order. The rows are
+// transposed so that both passes work on contiguous rows.
+void TransformLevel(
+    const LiftingScheme& scheme,
+    const TransformDirection direction,
+    cv::Mat region,
+    LiftingBuffers* buffers) {
+
+  if (direction == TRANSFORM_FORWARD) {
+    LiftLines(scheme, direction, &region, buffers);
+  }
+  cv::Mat transposed = buffers->GetTransposedBuffer(region.cols, region.rows);
+  cv::transpose(region, transposed);
+  LiftLines(scheme, direction, &transposed, buffers);
+  cv::transpose(transposed, region);
+  if (direction != TRANSFORM_FORWARD) {
+    LiftLines(scheme, direction, &region, buffers);
+  }
+}
+
+// Returns the size of the low-pass (LL) region after the given number of
+// levels. Each level halves the size, rounding up.
+cv::Size GetLowPassSize(const cv::Size& image_size, const int num_levels) {
+  cv::Size size = image_size;
+  for (int level = 0; level < num_levels; ++level) {
+    size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+  }
+  return size;
+}
+
+// Applies the multi-level transform to the given channel in place. The
+// forward transform goes from the finest to the coarsest level, and the
+// inverse and adjoint transforms go the other way.
+void TransformChannel(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    const TransformDirection direction,
+    cv::Mat* channel_image) {
+
+  CHECK_NOTNULL(channel_image);
+  CHECK_GT(num_levels, 0) << "The transform needs at least one level.";
+  CHECK_EQ(channel_image->type(), util::kOpenCvMatrixType)
+      << "Wavelet transforms require double precision images.";
+
+  const LiftingScheme scheme = GetLiftingScheme(wavelet_type);
+  const cv::Size image_size = channel_image->size();
+  LiftingBuffers buffers(image_size);
+  for (int i = 0; i < num_levels; ++i) {
+    const int level =
+        (direction == TRANSFORM_FORWARD) ? i : (num_levels - 1 - i);
+    TransformLevel(
+        scheme,
+        direction,
+        (*channel_image)(
+            cv::Rect(cv::Point(0, 0), GetLowPassSize(image_size, level))),
+        &buffers);
+  }
+}
+
+// Applies the multi-level transform to every channel of the given image in
+// place.
+void TransformChannels(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    const TransformDirection direction,
+    ImageData* image) {
+
+  CHECK_NOTNULL(image);
+  util::ParallelFor(image->GetNumChannels(), [&](const int channel_index) {
+    cv::Mat channel_image = image->GetChannelImage(channel_index);
+    TransformChannel(wavelet_type, num_levels, direction, &channel_image);
+  });
+}
+
+// Copies the given image into the output image, reusing the output image's
+// buffers if it has the same size and number of channels.
+void CopyIntoImage(const ImageData& image, ImageData* output_image) {
+  CHECK_NOTNULL(output_image);
+  CHECK_EQ(image.GetPrecision(), IMAGE_PRECISION_DOUBLE)
+      << "Wavelet transforms require double precision images.";
+
+  const int num_channels = image.GetNumChannels();
+  if (output_image->GetNumChannels() != num_channels ||
+      output_image->GetImageSize() != image.GetImageSize() ||
+      output_image->GetPrecision() != IMAGE_PRECISION_DOUBLE) {
+    *output_image = ImageData();
+    for (int channel = 0; channel < num_channels; ++channel) {
+      output_image->AddChannel(
+          image.GetChannelImage(channel), DO_NOT_NORMALIZE_IMAGE);
+    }
+    return;
+  }
+  util::ParallelFor(num_channels, [&](const int channel) {
+    cv::Mat output_channel_image = output_image->GetChannelImage(channel);
+    image.GetChannelImage(channel).copyTo(output_channel_image);
+  });
+}
+
+}  // namespace
+
 ImageData WaveletCoefficients::GetCoefficientsImage() const {
   const int num_channels = ll.GetNumChannels();
   CHECK_GT(num_channels, 0)
@@ -65,52 +467,32 @@ WaveletCoefficients WaveletTransform(const ImageData& image) {
 
   const cv::Size image_size = image.GetImageSize();
   const cv::Size target_size(image_size.width / 2, image_size.height / 2);
-  WaveletCoefficients coefficients;
+  const cv::Size even_size(target_size.width * 2, target_size.height * 2);
+  const int num_channels = image.GetNumChannels();
 
-  // TODO: This is haar filter only.
-  // TODO: Can this be done with a convolution?
-  for (int channel = 0; channel < image.GetNumChannels(); ++channel) {
-    const cv::Mat channel_image = image.GetChannelImage(channel);
-    cv::Mat channel_ll(target_size, channel_image.type());
-    cv::Mat channel_lh(target_size, channel_image.type());
-    cv::Mat channel_hl(target_size, channel_image.type());
-    cv::Mat channel_hh(target_size, channel_image.type());
-
-    // This code has been adapted from
-    // http://stackoverflow.com/questions/20071854/wavelet-transform-in-opencv
-    for (int row = 0; row < target_size.height; ++row) {
-      for (int col = 0; col < target_size.width; ++col) {
-        channel_ll.at<double>(row, col) = 0.5 * (
-            channel_image.at<double>(2 * row, 2 * col)
-            + channel_image.at<double>(2 * row, 2 * col + 1)
-            + channel_image.at<double>(2 * row + 1, 2 * col)
-            + channel_image.at<double>(2 * row + 1, 2 * col + 1));
-
-        channel_lh.at<double>(row, col) = 0.5 * (
-            channel_image.at<double>(2 * row, 2 * col)
-            - channel_image.at<double>(2 * row, 2 * col + 1)
-            + channel_image.at<double>(2 * row + 1, 2 * col)
-            - channel_image.at<double>(2 * row + 1, 2 * col + 1));
-
-        channel_hl.at<double>(row, col) = 0.5 * (
-            channel_image.at<double>(2 * row, 2 * col)
-            + channel_image.at<double>(2 * row, 2 * col + 1)
-            - channel_image.at<double>(2 * row + 1, 2 * col)
-            - channel_image.at<double>(2 * row + 1, 2 * col + 1));
-
-        channel_hh.at<double>(row, col) = 0.5 * (
-            channel_image.at<double>(2 * row, 2 * col)
-            - channel_image.at<double>(2 * row, 2 * col + 1)
-            - channel_image.at<double>(2 * row + 1, 2 * col)
-            + channel_image.at<double>(2 * row + 1, 2 * col + 1));
-      }
-    }
-    coefficients.ll.AddChannel(channel_ll, DO_NOT_NORMALIZE_IMAGE);
-    coefficients.lh.AddChannel(channel_lh, DO_NOT_NORMALIZE_IMAGE);
-    coefficients.hl.AddChannel(channel_hl, DO_NOT_NORMALIZE_IMAGE);
-    coefficients.hh.AddChannel(channel_hh, DO_NOT_NORMALIZE_IMAGE);
-  }
+  std::vector<cv::Mat> transformed_channels(num_channels);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    image.GetChannelImage(channel)(cv::Rect(cv::Point(0, 0), even_size))
+        .convertTo(transformed_channels[channel], util::kOpenCvMatrixType);
+    TransformChannel(
+        WAVELET_HAAR, 1, TRANSFORM_FORWARD, &transformed_channels[channel]);
+  });
 
+  WaveletCoefficients coefficients;
+  for (const cv::Mat& transformed_channel : transformed_channels) {
+    coefficients.ll.AddChannel(
+        transformed_channel(GetSubbandRegion(even_size, 1, SUBBAND_LL)),
+        DO_NOT_NORMALIZE_IMAGE);
+    coefficients.lh.AddChannel(
+        transformed_channel(GetSubbandRegion(even_size, 1, SUBBAND_LH)),
+        DO_NOT_NORMALIZE_IMAGE);
+    coefficients.hl.AddChannel(
+        transformed_channel(GetSubbandRegion(even_size, 1, SUBBAND_HL)),
+        DO_NOT_NORMALIZE_IMAGE);
+    coefficients.hh.AddChannel(
+        transformed_channel(GetSubbandRegion(even_size, 1, SUBBAND_HH)),
+        DO_NOT_NORMALIZE_IMAGE);
+  }
   return coefficients;
 }
 
@@ -134,43 +516,162 @@ ImageData InverseWaveletTransform(const WaveletCoefficients& coefficients) {
   CHECK_EQ(coefficients_size, coefficients.hh.GetImageSize())
       << "All coefficients must be the same size.";
 
-  // TODO: Can this be done with more efficiently by utilizing OpenCV?
-  ImageData reconstructed_image;
   const cv::Size original_size(
       coefficients_size.width * 2, coefficients_size.height * 2);
-  for (int channel = 0; channel < coefficients.ll.GetNumChannels(); ++channel) {
-    const cv::Mat channel_ll = coefficients.ll.GetChannelImage(channel);
-    const cv::Mat channel_lh = coefficients.lh.GetChannelImage(channel);
-    const cv::Mat channel_hl = coefficients.hl.GetChannelImage(channel);
-    const cv::Mat channel_hh = coefficients.hh.GetChannelImage(channel);
-    cv::Mat channel_image(original_size, channel_ll.type());
-
-    // This code has been adapted from
-    // http://stackoverflow.com/questions/20071854/wavelet-transform-in-opencv
-    for (int row = 0; row < coefficients_size.height; ++row) {
-      for (int col = 0; col < coefficients_size.width; ++col) {
-        const double ll_value = channel_ll.at<double>(row, col);
-        const double lh_value = channel_lh.at<double>(row, col);
-        const double hl_value = channel_hl.at<double>(row, col);
-        const double hh_value = channel_hh.at<double>(row, col);
-
-        // TODO: Shrinkage?
-
-        channel_image.at<double>(row * 2, col * 2) =
-            0.5 * (ll_value + lh_value + hl_value + hh_value);
-        channel_image.at<double>(row * 2, col * 2 + 1) =
-            0.5 * (ll_value - lh_value + hl_value - hh_value);
-        channel_image.at<double>(row * 2 + 1, col * 2) =
-            0.5 * (ll_value + lh_value - hl_value - hh_value);
-        channel_image.at<double>(row * 2 + 1, col * 2 + 1) =
-            0.5 * (ll_value - lh_value - hl_value + hh_value);
-      }
+  std::vector<cv::Mat> channel_images(num_channels);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    cv::Mat& channel_image = channel_images[channel];
+    channel_image = cv::Mat(original_size, util::kOpenCvMatrixType);
+    const std::vector<std::pair<const ImageData*, WaveletSubband>> subbands = {
+      {&coefficients.ll, SUBBAND_LL},
+      {&coefficients.lh, SUBBAND_LH},
+      {&coefficients.hl, SUBBAND_HL},
+      {&coefficients.hh, SUBBAND_HH}
+    };
+    for (const auto& subband : subbands) {
+      cv::Mat region = channel_image(
+          GetSubbandRegion(original_size, 1, subband.second));
+      subband.first->GetChannelImage(channel).convertTo(
+          region, util::kOpenCvMatrixType);
     }
+    TransformChannel(WAVELET_HAAR, 1, TRANSFORM_INVERSE, &channel_image);
+  });
+
+  ImageData reconstructed_image;
+  for (cv::Mat& channel_image : channel_images) {
     reconstructed_image.AddChannel(channel_image, DO_NOT_NORMALIZE_IMAGE);
+    channel_image.release();
   }
-
   return reconstructed_image;
 }
 
+std::vector<double> GetSubbandEnergyFractions(
+    const WaveletCoefficients& coefficients) {
+
+  std::vector<double> energies;
+  for (const ImageData* subband : {
+      &coefficients.ll, &coefficients.lh, &coefficients.hl, &coefficients.hh}) {
+    double energy = 0.0;
+    for (int channel = 0; channel < subband->GetNumChannels(); ++channel) {
+      energy += cv::norm(subband->GetChannelImage(channel), cv::NORM_L2SQR);
+    }
+    energies.push_back(energy);
+  }
+  const double total_energy =
+      std::accumulate(energies.begin(), energies.end(), 0.0);
+  if (total_energy > 0.0) {
+    for (double& energy : energies) {
+      energy /= total_energy;
+    }
+  }
+  return energies;
+}
+
+void MultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type, const int num_levels, ImageData* image) {
+
+  TransformChannels(wavelet_type, num_levels, TRANSFORM_FORWARD, image);
+}
+
+void InverseMultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    ImageData* coefficients) {
+
+  TransformChannels(
+      wavelet_type, num_levels, TRANSFORM_INVERSE, coefficients);
+}
+
+void MultiLevelWaveletTransform(
+    const ImageData& image,
+    const WaveletType wavelet_type,
+    const int num_levels,
+    ImageData* coefficients) {
+
+  CopyIntoImage(image, coefficients);
+  TransformChannels(
+      wavelet_type, num_levels, TRANSFORM_FORWARD, coefficients);
+}
+
+void InverseMultiLevelWaveletTransform(
+    const ImageData& coefficients,
+    const WaveletType wavelet_type,
+    const int num_levels,
+    ImageData* image) {
+
+  CopyIntoImage(coefficients, image);
+  TransformChannels(wavelet_type, num_levels, TRANSFORM_INVERSE, image);
+}
+
+void MultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    cv::Mat* channel_image) {
+
+  TransformChannel(wavelet_type, num_levels, TRANSFORM_FORWARD, channel_image);
+}
+
+void InverseMultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    cv::Mat* channel_coefficients) {
+
+  TransformChannel(
+      wavelet_type, num_levels, TRANSFORM_INVERSE, channel_coefficients);
+}
+
+void AdjointMultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    cv::Mat* channel_coefficients) {
+
+  TransformChannel(
+      wavelet_type, num_levels, TRANSFORM_ADJOINT, channel_coefficients);
+}
+
+WaveletType GetWaveletType(const std::string& wavelet_name) {
+  if (wavelet_name == "haar") {
+    return WAVELET_HAAR;
+  }
+  if (wavelet_name == "cdf53") {
+    return WAVELET_CDF_5_3;
+  }
+  if (wavelet_name == "cdf97") {
+    return WAVELET_CDF_9_7;
+  }
+  LOG(FATAL) << "Unknown wavelet '" << wavelet_name << "'.";
+  return WAVELET_HAAR;
+}
+
+cv::Rect GetSubbandRegion(
+    const cv::Size& image_size,
+    const int level,
+    const WaveletSubband subband) {
+
+  CHECK_GT(level, 0) << "Level 1 is the finest level.";
+  const cv::Size region_size = GetLowPassSize(image_size, level - 1);
+  const cv::Size low_pass_size = GetLowPassSize(image_size, level);
+  const cv::Size high_pass_size(
+      region_size.width - low_pass_size.width,
+      region_size.height - low_pass_size.height);
+  switch (subband) {
+    case SUBBAND_LL:
+      return cv::Rect(cv::Point(0, 0), low_pass_size);
+    case SUBBAND_LH:
+      return cv::Rect(
+          low_pass_size.width, 0, high_pass_size.width, low_pass_size.height);
+    case SUBBAND_HL:
+      return cv::Rect(
+          0, low_pass_size.height, low_pass_size.width, high_pass_size.height);
+    case SUBBAND_HH:
+      return cv::Rect(
+          cv::Point(low_pass_size.width, low_pass_size.height),
+          high_pass_size);
+    default:
+      LOG(FATAL) << "Unsupported sub-band " << subband << ".";
+  }
+  return cv::Rect();
+}
+
 }  // namespace wavelet
 }  // namespace super_resolution
@@ -1,11 +1,38 @@
 #ifndef SRC_WAVELET_WAVELET_TRANSFORM_H_
 #define SRC_WAVELET_WAVELET_TRANSFORM_H_
 
+#include <string>
+#include <vector>
+
 #include "image/image_data.h"
 
+#include "opencv2/core/core.hpp"
+
 namespace super_resolution {
 namespace wavelet {
 
+// The wavelets supported by the lifting-scheme transforms below.
+enum WaveletType {
+  // The orthonormal Haar wavelet (the same filter as WaveletTransform()).
+  WAVELET_HAAR,
+
+  // The LeGall (CDF) 5/3 biorthogonal wavelet, as used by lossless JPEG 2000.
+  WAVELET_CDF_5_3,
+
+  // The CDF 9/7 biorthogonal wavelet, as used by lossy JPEG 2000.
+  WAVELET_CDF_9_7
+};
+
+// The four sub-bands of each level of a 2D wavelet decomposition. LH has the
+// horizontal details (low-pass vertically and high-pass horizontally) and HL
+// has the vertical details.
+enum WaveletSubband {
+  SUBBAND_LL,
+  SUBBAND_LH,
+  SUBBAND_HL,
+  SUBBAND_HH
+};
+
 // Contains the four wavelet coefficients (LL, LH, HL, HH) which contain the
 // low-frequency and high-frequency coefficients of the DWT image
 // decomposition.
@@ -21,7 +48,9 @@ struct WaveletCoefficients {
   ImageData GetCoefficientsImage() const;
 };
 
-// Computes a discrete wavelet transform (DWT) of the given image.
+// Computes a single-level Haar discrete wavelet transform (DWT) of the given
+// image. If the image has an odd width or height, the last column or row is
+// ignored.
 WaveletCoefficients WaveletTransform(const ImageData& image);
 
 // Returns an image reconstructed from the given wavelet components. If the
@@ -30,6 +59,89 @@ WaveletCoefficients WaveletTransform(const ImageData& image);
 // image, save for small numerical errors.
 ImageData InverseWaveletTransform(const WaveletCoefficients& coefficients);
 
+// Returns the fraction of the total energy (sum of squared coefficients over
+// all channels) in each sub-band, in the order LL, LH, HL, HH. Since the Haar
+// transform is orthonormal, the total is also the energy of the image. A
+// detail band with a near-zero fraction carries almost no information. If all
+// coefficients are zero, all fractions are zero.
+std::vector<double> GetSubbandEnergyFractions(
+    const WaveletCoefficients& coefficients);
+
+// Multi-level wavelet transforms using the lifting scheme.
+//
+// The coefficients of each channel are stored in a matrix of the same size as
+// the channel in the standard pyramid layout: each level splits the low-pass
+// region in the top-left corner into LL (top-left), LH (top-right), HL
+// (bottom-left), and HH (bottom-right), and the next level splits that LL
+// region again. Level 1 is the finest level. The low-pass half of a row or
+// column of length n has ceil(n / 2) values and the high-pass half has
+// floor(n / 2) values, so images of any size are supported. The signal is
+// extended symmetrically at the borders.
+//
+// All channels must be in double precision. Channels are transformed in
+// parallel.
+
+// Transforms every channel of the given image in place, replacing the pixel
+// values with the wavelet coefficients.
+void MultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type, const int num_levels, ImageData* image);
+
+// Inverts MultiLevelWaveletTransformInPlace(), replacing the coefficients with
+// the reconstructed pixel values. The wavelet type and number of levels must
+// be the same as for the forward transform.
+void InverseMultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    ImageData* coefficients);
+
+// Same as the in-place versions, but writes the output into the given image.
+// If the output image already has the same size and number of channels as the
+// input (e.g. from a previous call), its buffers are reused without any
+// allocation. Otherwise, it is replaced by a new image.
+void MultiLevelWaveletTransform(
+    const ImageData& image,
+    const WaveletType wavelet_type,
+    const int num_levels,
+    ImageData* coefficients);
+void InverseMultiLevelWaveletTransform(
+    const ImageData& coefficients,
+    const WaveletType wavelet_type,
+    const int num_levels,
+    ImageData* image);
+
+// Same as the in-place image transforms above, but for a single channel in
+// double precision. These do not use any parallelism of their own.
+void MultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    cv::Mat* channel_image);
+void InverseMultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    cv::Mat* channel_coefficients);
+
+// Applies the adjoint (transpose) of the linear operator computed by
+// MultiLevelWaveletTransformInPlace() to the given coefficients. This maps
+// gradients with respect to the coefficients to gradients with respect to the
+// pixels. For the orthonormal Haar wavelet this equals the inverse transform,
+// but for the biorthogonal CDF wavelets it does not.
+void AdjointMultiLevelWaveletTransformInPlace(
+    const WaveletType wavelet_type,
+    const int num_levels,
+    cv::Mat* channel_coefficients);
+
+// Returns the wavelet type for the given name ('haar', 'cdf53', or 'cdf97').
+// An error occurs for unknown names.
+WaveletType GetWaveletType(const std::string& wavelet_name);
+
+// Returns the region of the given sub-band at the given level (1 is the finest
+// level) in the coefficient layout of an image of the given size. The LL
+// region of a level is the region that is decomposed by the next level.
+cv::Rect GetSubbandRegion(
+    const cv::Size& image_size,
+    const int level,
+    const WaveletSubband subband);
+
 }  // namespace wavelet
 }  // namespace super_resolution
 
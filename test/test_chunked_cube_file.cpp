@@ -0,0 +1,133 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "hyperspectral/chunked_cube_file.h"
+#include "image/image_data.h"
+#include "util/data_loader.h"
+#include "util/test_util.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::ChunkedCubeFile;
+using super_resolution::ImageData;
+using super_resolution::test::AreImagesEqual;
+using super_resolution::test::AreMatricesEqual;
+using super_resolution::util::GetAbsoluteCodePath;
+
+// Values are stored as floats.
+constexpr double kPrecisionErrorTolerance = 1e-6;
+
+static const std::string kTestCubeFilePath =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/chunked_cube_file.cube");
+
+// Tests saving and reading back entire images and regions with and without
+// compression. The image size is not a multiple of the chunk size, so the
+// edge chunks are smaller.
+TEST(ChunkedCubeFile, SaveAndReadRegions) {
+  const int num_rows = 11;
+  const int num_cols = 13;
+  const int num_bands = 7;
+  ImageData image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        // Half of the values are constant to exercise the run-length coding.
+        channel.at<double>(row, col) =
+            (col < num_cols / 2) ? 0.25 : std::sin(band + row * 0.3 + col);
+      }
+    }
+    image.AddChannel(channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+
+  for (const auto compression : {
+      super_resolution::CUBE_COMPRESSION_NONE,
+      super_resolution::CUBE_COMPRESSION_RUN_LENGTH}) {
+    super_resolution::ChunkedCubeOptions options;
+    options.chunk_rows = 4;
+    options.chunk_cols = 5;
+    options.chunk_bands = 3;
+    options.compression = compression;
+    super_resolution::SaveChunkedCube(image, kTestCubeFilePath, options);
+
+    const ChunkedCubeFile cube_file(kTestCubeFilePath);
+    EXPECT_EQ(cube_file.GetImageSize(), cv::Size(num_cols, num_rows));
+    EXPECT_EQ(cube_file.GetNumChannels(), num_bands);
+    EXPECT_TRUE(AreImagesEqual(
+        cube_file.ReadImage(), image, kPrecisionErrorTolerance));
+
+    // Rows 3-8 and columns 6-12 overlap 2 x 2 chunks, and bands 2-3 overlap 2
+    // band chunks.
+    const cv::Rect region(6, 3, 6, 5);
+    EXPECT_EQ(cube_file.GetNumChunksInRange(region, 2, 4), 8);
+    const ImageData region_image = cube_file.ReadImage(region, 2, 4);
+    ASSERT_EQ(region_image.GetNumChannels(), 2);
+    for (int channel = 0; channel < 2; ++channel) {
+      EXPECT_TRUE(AreMatricesEqual(
+          region_image.GetChannelImage(channel),
+          image.GetChannelImage(channel + 2)(region),
+          kPrecisionErrorTolerance));
+    }
+
+    // A region inside of a single chunk only needs that chunk.
+    EXPECT_EQ(cube_file.GetNumChunksInRange(cv::Rect(5, 4, 5, 4), 3, 6), 1);
+  }
+
+  // The file can also be read with the generic image loader.
+  super_resolution::util::SaveImage(image, kTestCubeFilePath);
+  EXPECT_TRUE(AreImagesEqual(
+      super_resolution::util::LoadImage(kTestCubeFilePath),
+      image,
+      kPrecisionErrorTolerance));
+
+  // So can regions and band ranges, given as on the command line.
+  const ImageData loaded_region_image = super_resolution::util::LoadImage(
+      kTestCubeFilePath,
+      super_resolution::util::GetImageLoadRange("6,3,6,5", "2,4"));
+  ASSERT_EQ(loaded_region_image.GetNumChannels(), 2);
+  for (int channel = 0; channel < 2; ++channel) {
+    EXPECT_TRUE(AreMatricesEqual(
+        loaded_region_image.GetChannelImage(channel),
+        image.GetChannelImage(channel + 2)(cv::Rect(6, 3, 6, 5)),
+        kPrecisionErrorTolerance));
+  }
+  const ImageData loaded_bands_image = super_resolution::util::LoadImage(
+      kTestCubeFilePath,
+      super_resolution::util::GetImageLoadRange("", "1,3"));
+  ASSERT_EQ(loaded_bands_image.GetNumChannels(), 2);
+  EXPECT_EQ(loaded_bands_image.GetImageSize(), image.GetImageSize());
+  EXPECT_TRUE(AreMatricesEqual(
+      loaded_bands_image.GetChannelImage(1),
+      image.GetChannelImage(2),
+      kPrecisionErrorTolerance));
+}
+
+// Tests that single precision images are saved with the same values.
+TEST(ChunkedCubeFile, SaveSinglePrecisionImage) {
+  ImageData image;
+  for (int band = 0; band < 3; ++band) {
+    cv::Mat channel(6, 5, CV_64FC1);
+    for (int row = 0; row < channel.rows; ++row) {
+      for (int col = 0; col < channel.cols; ++col) {
+        channel.at<double>(row, col) = std::cos(band * 0.7 + row - col * 0.2);
+      }
+    }
+    image.AddChannel(channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+  ImageData float_image = image;
+  float_image.SetPrecision(super_resolution::IMAGE_PRECISION_FLOAT);
+
+  super_resolution::ChunkedCubeOptions options;
+  options.chunk_rows = 4;
+  options.chunk_cols = 4;
+  options.chunk_bands = 2;
+  super_resolution::SaveChunkedCube(float_image, kTestCubeFilePath, options);
+  const ChunkedCubeFile cube_file(kTestCubeFilePath);
+  EXPECT_TRUE(AreImagesEqual(
+      cube_file.ReadImage(), image, kPrecisionErrorTolerance));
+}
@@ -1,7 +1,13 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <string>
+#include <vector>
 
 #include "hyperspectral/hyperspectral_data_loader.h"
 #include "image/image_data.h"
+#include "util/data_loader.h"
 #include "util/test_util.h"
 #include "util/util.h"
 
@@ -30,6 +36,15 @@ static const std::string kTestConfigFilePath =
 static const std::string kTestOutputFilePath =
     GetAbsoluteCodePath("test_data/test_tmp_dir/hs_data_loader_envi_out");
 
+static const std::string kTestInterleaveFilePath =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/hs_data_loader_interleave");
+
+static const std::string kTestDataTypeFilePath =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/hs_data_loader_data_type");
+
+static const std::string kTestBigEndianFilePath =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/hs_data_loader_big_endian");
+
 // This test verifies that the HSIBinaryDataParameters::ReadHeaderFromFile
 // method works correctly.
 TEST(HyperspectralDataLoader, ReadHSIHeaderFromFile) {
@@ -109,3 +124,298 @@ TEST(HyperspectralDataLoader, SaveBinaryData) {
   EXPECT_TRUE(AreImagesEqual(
       original_image, saved_image, kPrecisionErrorTolerance));
 }
+
+// Tests that images saved in each interleave format are laid out correctly in
+// the file and can be read back, both entirely and partially.
+TEST(HyperspectralDataLoader, SaveAndLoadInterleaveFormats) {
+  const int num_rows = 3;
+  const int num_cols = 70;  // More than one transposition block.
+  const int num_bands = 4;
+
+  // Each value is band * 1000 + row * 100 + col.
+  super_resolution::ImageData image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        channel.at<double>(row, col) = band * 1000 + row * 100 + col;
+      }
+    }
+    image.AddChannel(channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+
+  const std::vector<super_resolution::HSIDataInterleaveFormat> formats = {
+    super_resolution::HSI_BINARY_INTERLEAVE_BSQ,
+    super_resolution::HSI_BINARY_INTERLEAVE_BIL,
+    super_resolution::HSI_BINARY_INTERLEAVE_BIP
+  };
+  for (const auto interleave : formats) {
+    super_resolution::HSIBinaryDataFormat data_format;
+    data_format.interleave = interleave;
+    super_resolution::HyperspectralDataLoader writer(kTestInterleaveFilePath);
+    writer.SaveImage(image, data_format);
+
+    // Check the layout of the raw file.
+    std::ifstream data_file(kTestInterleaveFilePath, std::ios::binary);
+    ASSERT_TRUE(data_file.is_open());
+    std::vector<float> values(num_rows * num_cols * num_bands);
+    data_file.read(
+        reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+    data_file.close();
+    for (int band = 0; band < num_bands; ++band) {
+      for (int row = 0; row < num_rows; ++row) {
+        for (int col = 0; col < num_cols; ++col) {
+          int index = 0;
+          if (interleave == super_resolution::HSI_BINARY_INTERLEAVE_BSQ) {
+            index = (band * num_rows + row) * num_cols + col;
+          } else if (
+              interleave == super_resolution::HSI_BINARY_INTERLEAVE_BIL) {
+            index = (row * num_bands + band) * num_cols + col;
+          } else {
+            index = (row * num_cols + col) * num_bands + band;
+          }
+          EXPECT_EQ(values[index], band * 1000 + row * 100 + col);
+        }
+      }
+    }
+
+    // Read back the entire image using the generated config file.
+    super_resolution::HyperspectralDataLoader reader(
+        kTestInterleaveFilePath + ".config");
+    reader.LoadImageFromENVIFile();
+    EXPECT_TRUE(AreImagesEqual(reader.GetImage(), image));
+
+    // The header should report the interleave format.
+    super_resolution::HSIBinaryDataParameters parameters;
+    parameters.ReadHeaderFromFile(kTestInterleaveFilePath + ".hdr");
+    EXPECT_EQ(parameters.data_format.interleave, interleave);
+
+    // Read back a partial range.
+    std::string interleave_name = "bsq";
+    if (interleave == super_resolution::HSI_BINARY_INTERLEAVE_BIL) {
+      interleave_name = "bil";
+    } else if (interleave == super_resolution::HSI_BINARY_INTERLEAVE_BIP) {
+      interleave_name = "bip";
+    }
+    const std::string config_file_path =
+        kTestInterleaveFilePath + "_range.config";
+    std::ofstream config_file(config_file_path);
+    ASSERT_TRUE(config_file.is_open());
+    config_file << "file " << kTestInterleaveFilePath << "\n"
+                << "interleave " << interleave_name << "\n"
+                << "data_type float\n"
+                << "big_endian false\n"
+                << "header_offset 0\n"
+                << "num_data_rows " << num_rows << "\n"
+                << "num_data_cols " << num_cols << "\n"
+                << "num_data_bands " << num_bands << "\n"
+                << "start_row 1\n"
+                << "end_row 3\n"
+                << "start_col 3\n"
+                << "end_col 68\n"
+                << "start_band 1\n"
+                << "end_band 3\n";
+    config_file.close();
+
+    super_resolution::HyperspectralDataLoader range_reader(config_file_path);
+    range_reader.LoadImageFromENVIFile();
+    const super_resolution::ImageData range_image = range_reader.GetImage();
+    ASSERT_EQ(range_image.GetNumChannels(), 2);
+    EXPECT_EQ(range_image.GetImageSize(), cv::Size(65, 2));
+    for (int channel = 0; channel < 2; ++channel) {
+      EXPECT_TRUE(AreMatricesEqual(
+          range_image.GetChannelImage(channel),
+          image.GetChannelImage(channel + 1)(cv::Rect(3, 1, 65, 2))));
+    }
+  }
+}
+
+// Tests reading big-endian data with a header offset (in bytes) and a column
+// range that skips values at the start and end of every row.
+TEST(HyperspectralDataLoader, LoadBigEndianDataWithHeaderOffset) {
+  const int num_rows = 3;
+  const int num_cols = 4;
+  const int num_bands = 2;
+  const int header_offset = 7;
+
+  // Each value is band * 100 + row * 10 + col.
+  std::ofstream data_file(kTestBigEndianFilePath, std::ios::binary);
+  ASSERT_TRUE(data_file.is_open());
+  const std::string header(header_offset, 'h');
+  data_file.write(header.data(), header_offset);
+  for (int band = 0; band < num_bands; ++band) {
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        const float value = band * 100 + row * 10 + col;
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(float));
+        const unsigned char bytes[4] = {
+          static_cast<unsigned char>(bits >> 24),
+          static_cast<unsigned char>(bits >> 16),
+          static_cast<unsigned char>(bits >> 8),
+          static_cast<unsigned char>(bits)
+        };
+        data_file.write(reinterpret_cast<const char*>(bytes), 4);
+      }
+    }
+  }
+  data_file.close();
+
+  const std::string config_file_path = kTestBigEndianFilePath + ".config";
+  std::ofstream config_file(config_file_path);
+  ASSERT_TRUE(config_file.is_open());
+  config_file << "file " << kTestBigEndianFilePath << "\n"
+              << "interleave bsq\n"
+              << "data_type float\n"
+              << "big_endian true\n"
+              << "header_offset " << header_offset << "\n"
+              << "num_data_rows " << num_rows << "\n"
+              << "num_data_cols " << num_cols << "\n"
+              << "num_data_bands " << num_bands << "\n"
+              << "start_row 1\n"
+              << "end_row 3\n"
+              << "start_col 1\n"
+              << "end_col 3\n"
+              << "start_band 0\n"
+              << "end_band 2\n";
+  config_file.close();
+
+  super_resolution::HyperspectralDataLoader hs_data_loader(config_file_path);
+  hs_data_loader.LoadImageFromENVIFile();
+  const super_resolution::ImageData image = hs_data_loader.GetImage();
+  EXPECT_EQ(image.GetImageSize(), cv::Size(2, 2));
+  EXPECT_EQ(image.GetNumChannels(), 2);
+  const cv::Mat expected_channel_0 = (cv::Mat_<double>(2, 2)
+      << 11, 12,
+         21, 22);
+  const cv::Mat expected_channel_1 = (cv::Mat_<double>(2, 2)
+      << 111, 112,
+         121, 122);
+  EXPECT_TRUE(AreMatricesEqual(image.GetChannelImage(0), expected_channel_0));
+  EXPECT_TRUE(AreMatricesEqual(image.GetChannelImage(1), expected_channel_1));
+}
+
+// Tests saving and loading images with each of the supported data types. The
+// test values fit all of the types except for the ones that are saturated.
+TEST(HyperspectralDataLoader, SaveAndLoadDataTypes) {
+  const cv::Mat channel_0 = (cv::Mat_<double>(2, 3)
+      << 0, 1, 2,
+         100, 200, 255);
+  const cv::Mat channel_1 = (cv::Mat_<double>(2, 3)
+      << 3, 4.4, 5.6,
+         -1, 70000, 8);
+  super_resolution::ImageData image;
+  image.AddChannel(channel_0, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  image.AddChannel(channel_1, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+
+  struct DataTypeTestCase {
+    super_resolution::HSIBinaryDataType data_type;
+    int envi_code;
+    size_t value_size;
+    cv::Mat expected_channel_1;
+  };
+  const std::vector<DataTypeTestCase> test_cases = {
+    {super_resolution::HSI_DATA_TYPE_UINT8, 1, 1,
+     (cv::Mat_<double>(2, 3) << 3, 4, 6, 0, 255, 8)},
+    {super_resolution::HSI_DATA_TYPE_INT16, 2, 2,
+     (cv::Mat_<double>(2, 3) << 3, 4, 6, -1, 32767, 8)},
+    {super_resolution::HSI_DATA_TYPE_INT32, 3, 4,
+     (cv::Mat_<double>(2, 3) << 3, 4, 6, -1, 70000, 8)},
+    {super_resolution::HSI_DATA_TYPE_FLOAT, 4, 4, channel_1},
+    {super_resolution::HSI_DATA_TYPE_DOUBLE, 5, 8, channel_1},
+    // Complex values round-trip with their sign (the imaginary part is 0).
+    {super_resolution::HSI_DATA_TYPE_COMPLEX_FLOAT, 6, 8, channel_1},
+    {super_resolution::HSI_DATA_TYPE_UINT16, 12, 2,
+     (cv::Mat_<double>(2, 3) << 3, 4, 6, 0, 65535, 8)}
+  };
+  for (const DataTypeTestCase& test_case : test_cases) {
+    for (const bool big_endian : {false, true}) {
+      super_resolution::HSIBinaryDataFormat data_format;
+      data_format.data_type = test_case.data_type;
+      data_format.big_endian = big_endian;
+      super_resolution::HyperspectralDataLoader writer(kTestDataTypeFilePath);
+      writer.SaveImage(image, data_format);
+
+      // The file should only take up as many bytes as the data type needs.
+      std::ifstream data_file(
+          kTestDataTypeFilePath, std::ios::binary | std::ios::ate);
+      ASSERT_TRUE(data_file.is_open());
+      EXPECT_EQ(static_cast<size_t>(data_file.tellg()),
+                2 * 3 * 2 * test_case.value_size);
+      data_file.close();
+
+      super_resolution::HSIBinaryDataParameters parameters;
+      parameters.ReadHeaderFromFile(kTestDataTypeFilePath + ".hdr");
+      EXPECT_EQ(parameters.data_format.data_type, test_case.data_type);
+      EXPECT_EQ(parameters.data_format.big_endian, big_endian);
+      std::ifstream header_file(kTestDataTypeFilePath + ".hdr");
+      const std::string header_contents(
+          (std::istreambuf_iterator<char>(header_file)),
+          std::istreambuf_iterator<char>());
+      EXPECT_THAT(
+          header_contents,
+          testing::HasSubstr(
+              "data type = " + std::to_string(test_case.envi_code) + "\n"));
+
+      super_resolution::HyperspectralDataLoader reader(
+          kTestDataTypeFilePath + ".config");
+      reader.LoadImageFromENVIFile();
+      const super_resolution::ImageData loaded_image = reader.GetImage();
+      ASSERT_EQ(loaded_image.GetNumChannels(), 2);
+      EXPECT_TRUE(AreMatricesEqual(
+          loaded_image.GetChannelImage(0), channel_0,
+          kPrecisionErrorTolerance));
+      EXPECT_TRUE(AreMatricesEqual(
+          loaded_image.GetChannelImage(1), test_case.expected_channel_1,
+          kPrecisionErrorTolerance));
+    }
+  }
+
+  // Complex values with an imaginary part (not written by the loader) are read
+  // as their magnitude. The first value of a big-endian file is replaced with
+  // 3 + 4i.
+  super_resolution::HSIBinaryDataFormat complex_data_format;
+  complex_data_format.data_type = super_resolution::HSI_DATA_TYPE_COMPLEX_FLOAT;
+  complex_data_format.big_endian = true;
+  super_resolution::HyperspectralDataLoader complex_writer(
+      kTestDataTypeFilePath);
+  complex_writer.SaveImage(image, complex_data_format);
+  std::fstream complex_file(
+      kTestDataTypeFilePath, std::ios::binary | std::ios::in | std::ios::out);
+  ASSERT_TRUE(complex_file.is_open());
+  for (const float part : {3.0f, 4.0f}) {
+    uint32_t bits;
+    std::memcpy(&bits, &part, sizeof(float));
+    const unsigned char bytes[4] = {
+      static_cast<unsigned char>(bits >> 24),
+      static_cast<unsigned char>(bits >> 16),
+      static_cast<unsigned char>(bits >> 8),
+      static_cast<unsigned char>(bits)
+    };
+    complex_file.write(reinterpret_cast<const char*>(bytes), 4);
+  }
+  complex_file.close();
+  super_resolution::HyperspectralDataLoader complex_reader(
+      kTestDataTypeFilePath + ".config");
+  complex_reader.LoadImageFromENVIFile();
+  EXPECT_NEAR(
+      complex_reader.GetImage().GetPixelValue(0, 0),
+      5.0,
+      kPrecisionErrorTolerance);
+  EXPECT_NEAR(
+      complex_reader.GetImage().GetPixelValue(1, 3),
+      -1.0,
+      kPrecisionErrorTolerance);
+
+  // The data type can also be given by name to the generic image saver.
+  super_resolution::HSIBinaryDataFormat named_data_format;
+  named_data_format.data_type = super_resolution::GetHSIDataType("uint16");
+  EXPECT_EQ(named_data_format.data_type,
+            super_resolution::HSI_DATA_TYPE_UINT16);
+  super_resolution::util::SaveImage(
+      image, kTestDataTypeFilePath, named_data_format);
+  super_resolution::HSIBinaryDataParameters named_parameters;
+  named_parameters.ReadHeaderFromFile(kTestDataTypeFilePath + ".hdr");
+  EXPECT_EQ(named_parameters.data_format.data_type,
+            super_resolution::HSI_DATA_TYPE_UINT16);
+}
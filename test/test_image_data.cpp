@@ -400,6 +400,141 @@ TEST(ImageData, ResizeImage) {
       expected_additive_downsampled));
 }
 
+// Tests that resizing into a destination image gives the same result as
+// resizing in place, and that the destination buffers are reused.
+TEST(ImageData, ResizeImageIntoDestination) {
+  cv::Mat image_matrix;
+  cv::merge(kTestColorChannels, image_matrix);
+  const ImageData image(image_matrix, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  const cv::Size small_size(2, 2);
+  const cv::Size large_size(12, 8);
+
+  const std::vector<super_resolution::ResizeInterpolationMethod> methods = {
+    super_resolution::INTERPOLATE_NEAREST,
+    super_resolution::INTERPOLATE_ADDITIVE,
+    super_resolution::INTERPOLATE_LINEAR
+  };
+  ImageData destination;
+  for (const auto method : methods) {
+    for (const cv::Size& size : {small_size, large_size}) {
+      ImageData expected_image = image;
+      expected_image.ResizeImage(size, method);
+      image.ResizeImage(size, method, &destination);
+      EXPECT_EQ(destination.GetImageSize(), size);
+      EXPECT_EQ(destination.GetNumChannels(), image.GetNumChannels());
+      EXPECT_TRUE(AreImagesEqual(destination, expected_image, 0));
+
+      // Resizing again to the same size should reuse the same memory.
+      const double* channel_data = destination.GetChannelData(0);
+      image.ResizeImage(size, method, &destination);
+      EXPECT_EQ(destination.GetChannelData(0), channel_data);
+      EXPECT_TRUE(AreImagesEqual(destination, expected_image, 0));
+    }
+  }
+  // The source image should not have been modified.
+  EXPECT_EQ(image.GetImageSize(), cv::Size(4, 4));
+  EXPECT_DOUBLE_EQ(image.GetPixelValue(0, 0), 0.1);
+}
+
+// Tests converting images to single precision and applying the resize and
+// arithmetic operations on them.
+TEST(ImageData, SinglePrecision) {
+  cv::Mat image_matrix;
+  cv::merge(kTestColorChannels, image_matrix);
+  const ImageData image(image_matrix, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  EXPECT_EQ(image.GetPrecision(), super_resolution::IMAGE_PRECISION_DOUBLE);
+
+  ImageData float_image = image;
+  float_image.SetPrecision(super_resolution::IMAGE_PRECISION_FLOAT);
+  EXPECT_EQ(
+      float_image.GetPrecision(), super_resolution::IMAGE_PRECISION_FLOAT);
+  EXPECT_EQ(float_image.GetChannelImage(0).type(), CV_32FC1);
+  for (int channel_index = 0; channel_index < 3; ++channel_index) {
+    for (int pixel_index = 0; pixel_index < 16; ++pixel_index) {
+      EXPECT_NEAR(
+          float_image.GetPixelValue(channel_index, pixel_index),
+          image.GetPixelValue(channel_index, pixel_index),
+          1.0e-6);
+    }
+  }
+
+  // Copies and added channels keep the precision.
+  ImageData float_image_copy = float_image;
+  EXPECT_EQ(
+      float_image_copy.GetPrecision(), super_resolution::IMAGE_PRECISION_FLOAT);
+  float_image_copy.AddChannel(
+      kTestChannelB, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  EXPECT_EQ(float_image_copy.GetChannelImage(3).type(), CV_32FC1);
+  EXPECT_NEAR(float_image_copy.GetPixelValue(3, 5), 0.25, 1.0e-6);
+
+  // Resizing in single precision should match the double precision results.
+  const std::vector<super_resolution::ResizeInterpolationMethod> methods = {
+    super_resolution::INTERPOLATE_NEAREST,
+    super_resolution::INTERPOLATE_ADDITIVE,
+    super_resolution::INTERPOLATE_LINEAR
+  };
+  for (const auto method : methods) {
+    for (const cv::Size& size : {cv::Size(2, 2), cv::Size(8, 8)}) {
+      ImageData resized_image = image;
+      resized_image.ResizeImage(size, method);
+      ImageData resized_float_image = float_image;
+      resized_float_image.ResizeImage(size, method);
+      EXPECT_EQ(resized_float_image.GetChannelImage(0).type(), CV_32FC1);
+      // Images can only be compared if they have the same precision.
+      resized_float_image.SetPrecision(
+          super_resolution::IMAGE_PRECISION_DOUBLE);
+      EXPECT_TRUE(AreImagesEqual(resized_float_image, resized_image, 1.0e-6));
+    }
+  }
+
+  // Converting back to double precision restores the raw data accessors.
+  float_image.MultiplyByScalar(2.0);
+  float_image.SetPrecision(super_resolution::IMAGE_PRECISION_DOUBLE);
+  EXPECT_EQ(float_image.GetChannelImage(0).type(), CV_64FC1);
+  EXPECT_NEAR(float_image.GetChannelData(0)[5], 0.5, 1.0e-6);
+}
+
+// Tests that setting the pixel values from an array converts them to the
+// precision of the image and reuses the channel buffers.
+TEST(ImageData, SetPixelValues) {
+  const cv::Size size(3, 2);
+  const std::vector<double> pixel_values = {
+    0.1, 0.2, 0.3, 0.4, 0.5, 0.6,  // Channel 0.
+    -1.0, 2.0, -3.0, 4.0, -5.0, 6.0  // Channel 1.
+  };
+  const ImageData expected_image(pixel_values.data(), size, 2);
+
+  ImageData image;
+  image.SetPixelValues(pixel_values.data(), size, 2);
+  EXPECT_EQ(image.GetImageSize(), size);
+  EXPECT_EQ(image.GetNumChannels(), 2);
+  EXPECT_TRUE(AreImagesEqual(image, expected_image, 0));
+
+  // Setting values of the same size again writes into the same memory.
+  const double* channel_data = image.GetChannelData(1);
+  image.SetPixelValues(pixel_values.data(), size, 2);
+  EXPECT_EQ(image.GetChannelData(1), channel_data);
+
+  // Single precision images are converted straight from the array.
+  ImageData float_image;
+  float_image.SetPrecision(super_resolution::IMAGE_PRECISION_FLOAT);
+  float_image.SetPixelValues(pixel_values.data(), size, 2);
+  EXPECT_EQ(float_image.GetChannelImage(0).type(), CV_32FC1);
+  for (int channel_index = 0; channel_index < 2; ++channel_index) {
+    for (int pixel_index = 0; pixel_index < 6; ++pixel_index) {
+      EXPECT_NEAR(
+          float_image.GetPixelValue(channel_index, pixel_index),
+          pixel_values[channel_index * 6 + pixel_index],
+          1.0e-6);
+    }
+  }
+
+  // Fewer channels drop the extra ones.
+  image.SetPixelValues(pixel_values.data(), size, 1);
+  EXPECT_EQ(image.GetNumChannels(), 1);
+  EXPECT_DOUBLE_EQ(image.GetPixelValue(0, 5), 0.6);
+}
+
 // Tests the ChangeColorSpace method to see that the image is in fact being
 // converted correctly.
 TEST(ImageData, ChangeColorSpace) {
@@ -636,6 +771,71 @@ TEST(ImageData, AddMultiplyDivideImage) {
   EXPECT_DOUBLE_EQ(test_image_4.GetPixelValue(2, 2), 0.35);  // 0.3 + 0.05.
 }
 
+// Tests the row and spectral vector accessors, which should return the same
+// values as the per-pixel accessor.
+TEST(ImageData, RowAndSpectralVectorAccess) {
+  cv::Mat image_matrix;
+  cv::merge(kTestColorChannels, image_matrix);
+  ImageData image(image_matrix, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  const int num_channels = image.GetNumChannels();
+  const int num_pixels = image.GetNumPixels();
+  const cv::Size image_size = image.GetImageSize();
+
+  // Row data should match the individual pixel values.
+  for (int channel_index = 0; channel_index < num_channels; ++channel_index) {
+    for (int row = 0; row < image_size.height; ++row) {
+      const double* row_data = image.GetRowData(channel_index, row);
+      for (int col = 0; col < image_size.width; ++col) {
+        EXPECT_DOUBLE_EQ(
+            row_data[col],
+            image.GetPixelValue(channel_index, row * image_size.width + col));
+      }
+    }
+  }
+
+  // Gathered spectral vectors should be pixel-major.
+  std::vector<double> spectral_vectors((num_pixels - 2) * num_channels);
+  image.GatherSpectralVectors(2, num_pixels - 2, spectral_vectors.data());
+  for (int i = 0; i < num_pixels - 2; ++i) {
+    for (int channel_index = 0; channel_index < num_channels; ++channel_index) {
+      EXPECT_DOUBLE_EQ(
+          spectral_vectors[i * num_channels + channel_index],
+          image.GetPixelValue(channel_index, i + 2));
+    }
+  }
+
+  // Scattering the vectors back into a blank image should reproduce the
+  // original values in that range and leave the others untouched.
+  ImageData scattered_image(image);
+  for (int channel_index = 0; channel_index < num_channels; ++channel_index) {
+    double* row_data = scattered_image.GetMutableRowData(channel_index, 0);
+    for (int col = 0; col < image_size.width; ++col) {
+      row_data[col] = -1.0;
+    }
+  }
+  scattered_image.ScatterSpectralVectors(
+      2, num_pixels - 2, spectral_vectors.data());
+  for (int channel_index = 0; channel_index < num_channels; ++channel_index) {
+    EXPECT_DOUBLE_EQ(scattered_image.GetPixelValue(channel_index, 0), -1.0);
+    EXPECT_DOUBLE_EQ(scattered_image.GetPixelValue(channel_index, 1), -1.0);
+    for (int pixel_index = 2; pixel_index < num_pixels; ++pixel_index) {
+      EXPECT_DOUBLE_EQ(
+          scattered_image.GetPixelValue(channel_index, pixel_index),
+          image.GetPixelValue(channel_index, pixel_index));
+    }
+  }
+
+  // Single-pixel versions.
+  std::vector<double> spectral_vector(num_channels);
+  image.GetSpectralVector(5, spectral_vector.data());
+  EXPECT_DOUBLE_EQ(spectral_vector[0], 0.25);  // kTestChannelB (1, 1).
+  spectral_vector[0] = 0.5;
+  image.SetSpectralVector(5, spectral_vector.data());
+  EXPECT_DOUBLE_EQ(image.GetPixelValue(0, 5), 0.5);
+  EXPECT_DOUBLE_EQ(
+      image.GetPixelValue(1, 5), kTestChannelG.at<double>(1, 1));
+}
+
 // Tests that the report for analyzing images is correctly generated.
 TEST(ImageData, GetImageDataReport) {
   const double pixel_values[(5 * 3) * 2] = {
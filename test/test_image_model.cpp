@@ -1,4 +1,6 @@
+#include <cmath>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "image_model/additive_noise_module.h"
@@ -6,9 +8,11 @@
 #include "image_model/downsampling_module.h"
 #include "image_model/image_model.h"
 #include "image_model/motion_module.h"
+#include "image_model/warp_motion_module.h"
 #include "motion/motion_shift.h"
 #include "util/matrix_util.h"
 #include "util/test_util.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
@@ -17,6 +21,7 @@
 #include "gmock/gmock.h"
 
 using super_resolution::test::AreMatricesEqual;
+using super_resolution::util::GetAbsoluteCodePath;
 using testing::_;
 using testing::Return;
 
@@ -347,6 +352,194 @@ TEST(ImageModel, MotionModule) {
   EXPECT_TRUE(AreMatricesEqual(motion_matrix_3, expected_matrix_3));
 }
 
+// Tests that integer shifts (applied as memory moves) and their transposes
+// match the operator matrix, and that sub-pixel shifts are still interpolated.
+TEST(ImageModel, MotionModuleIntegerShifts) {
+  const super_resolution::MotionShiftSequence motion_shift_sequence({
+    super_resolution::MotionShift(2, 1),
+    super_resolution::MotionShift(-3, 2),
+    super_resolution::MotionShift(1, -3),
+    super_resolution::MotionShift(-7, 0),
+    super_resolution::MotionShift(0.5, 0)
+  });
+  const super_resolution::MotionModule motion_module(motion_shift_sequence);
+
+  const cv::Mat input_vector = kSmallTestImage.reshape(1, 24);
+  for (int index = 0; index < 4; ++index) {
+    const cv::Mat operator_matrix =
+        motion_module.GetOperatorMatrix(kSmallTestImageSize, index);
+
+    super_resolution::ImageData shifted_image(
+        kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+    motion_module.ApplyToImage(&shifted_image, index);
+    const cv::Mat shifted_vector = operator_matrix * input_vector;
+    const cv::Mat expected_image =
+        shifted_vector.reshape(1, kSmallTestImageSize.height);
+    EXPECT_TRUE(AreMatricesEqual(
+        shifted_image.GetChannelImage(0), expected_image));
+
+    super_resolution::ImageData transposed_image(
+        kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+    motion_module.ApplyTransposeToImage(&transposed_image, index);
+    const cv::Mat transposed_vector = operator_matrix.t() * input_vector;
+    const cv::Mat expected_transposed_image =
+        transposed_vector.reshape(1, kSmallTestImageSize.height);
+    EXPECT_TRUE(AreMatricesEqual(
+        transposed_image.GetChannelImage(0), expected_transposed_image));
+  }
+
+  // A half-pixel shift averages horizontally adjacent pixels.
+  super_resolution::ImageData shifted_image(
+      kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  motion_module.ApplyToImage(&shifted_image, 4);
+  EXPECT_NEAR(shifted_image.GetPixelValue(0, 7), 7.5, 1e-6);
+  EXPECT_NEAR(shifted_image.GetPixelValue(0, 14), 6.0, 1e-6);
+}
+
+// Tests that the WarpMotionModule matches the MotionModule for translations,
+// and that its precomputed warps and their transposes match the operator
+// matrix for rotations and dense flow on every channel.
+TEST(ImageModel, WarpMotionModule) {
+  const cv::Size image_size = kSmallTestImageSize;
+  const cv::Mat translation = (cv::Mat_<double>(2, 3)
+      << 1, 0, 0.25,
+         0, 1, -1.5);
+  const double angle = 0.3;
+  const cv::Mat rotation = (cv::Mat_<double>(2, 3)
+      << std::cos(angle), -std::sin(angle), 0.5,
+         std::sin(angle), std::cos(angle), -0.7);
+  const super_resolution::WarpMotionModule affine_module(
+      image_size,
+      super_resolution::WARP_MOTION_AFFINE,
+      {translation, rotation});
+  EXPECT_EQ(affine_module.GetNumFrames(), 2);
+
+  // A constant flow is the same as the translation.
+  cv::Mat constant_flow(image_size, CV_64FC2, cv::Scalar(0.25, -1.5));
+  cv::Mat varying_flow(image_size, CV_64FC2);
+  for (int row = 0; row < image_size.height; ++row) {
+    for (int col = 0; col < image_size.width; ++col) {
+      varying_flow.at<cv::Vec2d>(row, col) =
+          cv::Vec2d(0.1 * col - 0.3, 0.2 * row * row - 0.5);
+    }
+  }
+  const super_resolution::WarpMotionModule flow_module(
+      image_size,
+      super_resolution::WARP_MOTION_DENSE_FLOW,
+      {constant_flow, varying_flow});
+
+  const super_resolution::MotionModule motion_module(
+      super_resolution::MotionShiftSequence({
+        super_resolution::MotionShift(0.25, -1.5)
+      }));
+  super_resolution::ImageData expected_image(
+      kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  motion_module.ApplyToImage(&expected_image, 0);
+  super_resolution::ImageData affine_image(
+      kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  affine_module.ApplyToImage(&affine_image, 0);
+  super_resolution::ImageData flow_image(
+      kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  flow_module.ApplyToImage(&flow_image, 0);
+  EXPECT_TRUE(AreMatricesEqual(
+      affine_image.GetChannelImage(0),
+      expected_image.GetChannelImage(0),
+      1e-6));
+  EXPECT_TRUE(AreMatricesEqual(
+      flow_image.GetChannelImage(0),
+      expected_image.GetChannelImage(0),
+      1e-6));
+
+  // Both channels of a two-channel image are warped in the same pass.
+  const cv::Mat second_channel = 2.0 * kSmallTestImage + 1.0;
+  super_resolution::ImageData input_image(
+      kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  input_image.AddChannel(
+      second_channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  const std::vector<const super_resolution::WarpMotionModule*> modules = {
+    &affine_module, &flow_module
+  };
+  for (const super_resolution::WarpMotionModule* module : modules) {
+    for (int index = 0; index < 2; ++index) {
+      const cv::Mat operator_matrix =
+          module->GetOperatorMatrix(image_size, index);
+      super_resolution::ImageData warped_image = input_image;
+      module->ApplyToImage(&warped_image, index);
+      super_resolution::ImageData transposed_image = input_image;
+      module->ApplyTransposeToImage(&transposed_image, index);
+      for (int channel = 0; channel < 2; ++channel) {
+        const cv::Mat input_vector =
+            input_image.GetChannelImage(channel).reshape(1, 24);
+        const cv::Mat warped_vector = operator_matrix * input_vector;
+        EXPECT_TRUE(AreMatricesEqual(
+            warped_image.GetChannelImage(channel),
+            warped_vector.reshape(1, image_size.height),
+            1e-12));
+        const cv::Mat transposed_vector = operator_matrix.t() * input_vector;
+        EXPECT_TRUE(AreMatricesEqual(
+            transposed_image.GetChannelImage(channel),
+            transposed_vector.reshape(1, image_size.height),
+            1e-12));
+      }
+    }
+  }
+}
+
+// Tests that warp motions are loaded from a file and added to the standard
+// image model in place of the motion shifts.
+TEST(ImageModel, CreateImageModelWithWarpMotions) {
+  const std::string warp_motion_path =
+      GetAbsoluteCodePath("test_data/test_tmp_dir/warp_motions.yaml");
+  const double angle = 0.3;
+  const std::vector<cv::Mat> frame_motions = {
+    (cv::Mat_<double>(2, 3)
+        << 1, 0, 0.25,
+           0, 1, -1.5),
+    (cv::Mat_<double>(2, 3)
+        << std::cos(angle), -std::sin(angle), 0.5,
+           std::sin(angle), std::cos(angle), -0.7)
+  };
+  cv::FileStorage file_storage(warp_motion_path, cv::FileStorage::WRITE);
+  file_storage << "frame_motions" << "[";
+  for (const cv::Mat& frame_motion : frame_motions) {
+    file_storage << frame_motion;
+  }
+  file_storage << "]";
+  file_storage.release();
+
+  const std::vector<cv::Mat> loaded_frame_motions =
+      super_resolution::LoadWarpMotionsFromFile(warp_motion_path);
+  ASSERT_EQ(loaded_frame_motions.size(), 2);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(AreMatricesEqual(
+        loaded_frame_motions[i], frame_motions[i], 1e-12));
+  }
+
+  super_resolution::ImageModelParameters parameters;
+  parameters.scale = 1;
+  parameters.warp_motion_path = warp_motion_path;
+  parameters.warp_motion_type =
+      super_resolution::GetWarpMotionType("affine");
+  parameters.image_size = kSmallTestImageSize;
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(parameters);
+  const super_resolution::WarpMotionModule warp_motion_module(
+      kSmallTestImageSize, super_resolution::WARP_MOTION_AFFINE, frame_motions);
+
+  const super_resolution::ImageData input_image(
+      kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  for (int index = 0; index < 2; ++index) {
+    const super_resolution::ImageData model_image =
+        image_model.ApplyToImage(input_image, index);
+    super_resolution::ImageData expected_image = input_image;
+    warp_motion_module.ApplyToImage(&expected_image, index);
+    EXPECT_TRUE(AreMatricesEqual(
+        model_image.GetChannelImage(0),
+        expected_image.GetChannelImage(0),
+        1e-12));
+  }
+}
+
 TEST(ImageModel, BlurModule) {
   /* Verify that blur operator works as expected. */
 
@@ -407,6 +600,57 @@ TEST(ImageModel, BlurModule) {
       image_data2.GetChannelImage(0), expected_blurred_image, diff_tolerance));
 }
 
+// Tests that the separable and FFT blur methods match the operator matrix for
+// the specialized and the generic kernel sizes (including kernels wider than
+// the image), and that the method is chosen from the kernel and image sizes.
+TEST(ImageModel, BlurModuleMethods) {
+  const cv::Mat input_vector = kSmallTestImage.reshape(1, 24);
+  for (const int blur_radius : {3, 5, 7, 9}) {
+    for (const super_resolution::BlurMethod blur_method : {
+        super_resolution::BLUR_METHOD_SEPARABLE,
+        super_resolution::BLUR_METHOD_FFT}) {
+      const super_resolution::BlurModule blur_module(
+          blur_radius, 1.5, blur_method);
+      EXPECT_EQ(blur_module.GetBlurMethod(kSmallTestImageSize), blur_method);
+      const cv::Mat blur_matrix =
+          blur_module.GetOperatorMatrix(kSmallTestImageSize, 0);
+
+      super_resolution::ImageData blurred_image(
+          kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+      blur_module.ApplyToImage(&blurred_image, 0);
+      const cv::Mat blurred_vector = blur_matrix * input_vector;
+      EXPECT_TRUE(AreMatricesEqual(
+          blurred_image.GetChannelImage(0),
+          blurred_vector.reshape(1, kSmallTestImageSize.height),
+          1e-9));
+
+      super_resolution::ImageData transposed_image(
+          kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+      blur_module.ApplyTransposeToImage(&transposed_image, 0);
+      const cv::Mat transposed_vector = blur_matrix.t() * input_vector;
+      EXPECT_TRUE(AreMatricesEqual(
+          transposed_image.GetChannelImage(0),
+          transposed_vector.reshape(1, kSmallTestImageSize.height),
+          1e-9));
+    }
+  }
+
+  // Small kernels are applied separably, and only very large kernels on
+  // large images use the FFT.
+  const cv::Size large_image_size(512, 512);
+  const super_resolution::BlurModule small_blur_module(7, 2.0);
+  EXPECT_EQ(
+      small_blur_module.GetBlurMethod(large_image_size),
+      super_resolution::BLUR_METHOD_SEPARABLE);
+  EXPECT_EQ(
+      small_blur_module.GetBlurMethod(kSmallTestImageSize),
+      super_resolution::BLUR_METHOD_SEPARABLE);
+  const super_resolution::BlurModule large_blur_module(151, 40.0);
+  EXPECT_EQ(
+      large_blur_module.GetBlurMethod(large_image_size),
+      super_resolution::BLUR_METHOD_FFT);
+}
+
 // Tests that both the ApplyToImage and the ApplyToPixel methods correctly
 // return the right values of the degraded image. This does not test the
 // method's efficiency, but verifies its correctness and compares the two
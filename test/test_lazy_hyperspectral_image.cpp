@@ -0,0 +1,130 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "hyperspectral/hyperspectral_data_loader.h"
+#include "hyperspectral/lazy_hyperspectral_image.h"
+#include "hyperspectral/spectral_pca.h"
+#include "image/image_data.h"
+#include "util/test_util.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::ImageData;
+using super_resolution::LazyHyperspectralImage;
+using super_resolution::test::AreImagesEqual;
+using super_resolution::test::AreMatricesEqual;
+using super_resolution::util::GetAbsoluteCodePath;
+
+static const std::string kTestLazyImageFilePath =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/lazy_hyperspectral_image");
+
+// Returns an image where each value is band * 100 + row * 10 + col.
+ImageData MakeTestImage(
+    const int num_rows, const int num_cols, const int num_bands) {
+
+  ImageData image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        channel.at<double>(row, col) = band * 100 + row * 10 + col;
+      }
+    }
+    image.AddChannel(channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+  return image;
+}
+
+// Tests that bands are read on demand and that the cache stays within its
+// budget, for each interleave format.
+TEST(LazyHyperspectralImage, ReadBandsOnDemand) {
+  const int num_rows = 4;
+  const int num_cols = 5;
+  const int num_bands = 6;
+  const ImageData image = MakeTestImage(num_rows, num_cols, num_bands);
+  const size_t band_size = num_rows * num_cols * sizeof(double);
+
+  const std::vector<super_resolution::HSIDataInterleaveFormat> formats = {
+    super_resolution::HSI_BINARY_INTERLEAVE_BSQ,
+    super_resolution::HSI_BINARY_INTERLEAVE_BIL,
+    super_resolution::HSI_BINARY_INTERLEAVE_BIP
+  };
+  for (const auto interleave : formats) {
+    super_resolution::HSIBinaryDataFormat data_format;
+    data_format.interleave = interleave;
+    data_format.data_type = super_resolution::HSI_DATA_TYPE_DOUBLE;
+    const super_resolution::HyperspectralDataLoader writer(
+        kTestLazyImageFilePath);
+    writer.SaveImage(image, data_format);
+
+    // Only two bands fit into the cache.
+    const LazyHyperspectralImage lazy_image(
+        kTestLazyImageFilePath + ".config", 2 * band_size);
+    EXPECT_EQ(lazy_image.GetImageSize(), cv::Size(num_cols, num_rows));
+    EXPECT_EQ(lazy_image.GetNumChannels(), num_bands);
+    EXPECT_EQ(lazy_image.GetNumCachedBytes(), 0);
+
+    for (int band = 0; band < num_bands; ++band) {
+      EXPECT_TRUE(AreMatricesEqual(
+          lazy_image.GetChannelImage(band), image.GetChannelImage(band)));
+      EXPECT_LE(lazy_image.GetNumCachedBytes(), 2 * band_size);
+    }
+    EXPECT_EQ(lazy_image.GetNumCachedBytes(), 2 * band_size);
+
+    // Reading a cached band again returns the same data.
+    const cv::Mat cached_band = lazy_image.GetChannelImage(num_bands - 1);
+    EXPECT_EQ(
+        cached_band.data, lazy_image.GetChannelImage(num_bands - 1).data);
+
+    // Spectral vectors are read directly from the file.
+    const int pixel_index = 2 * num_cols + 3;
+    std::vector<double> spectral_vector(num_bands);
+    lazy_image.GetSpectralVector(pixel_index, spectral_vector.data());
+    for (int band = 0; band < num_bands; ++band) {
+      EXPECT_EQ(spectral_vector[band], band * 100 + 23);
+    }
+
+    EXPECT_TRUE(AreImagesEqual(lazy_image.GetImage(), image));
+  }
+}
+
+// Tests that training PCA on lazily loaded images gives the same basis as
+// training it on fully loaded images.
+TEST(LazyHyperspectralImage, TrainSpectralPCA) {
+  const int num_rows = 6;
+  const int num_cols = 7;
+  const int num_bands = 5;
+  ImageData image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        channel.at<double>(row, col) =
+            std::sin(band * 1.3 + row * 0.7 + col * col * 0.11);
+      }
+    }
+    image.AddChannel(channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+
+  super_resolution::HSIBinaryDataFormat data_format;
+  data_format.data_type = super_resolution::HSI_DATA_TYPE_DOUBLE;
+  const super_resolution::HyperspectralDataLoader writer(
+      kTestLazyImageFilePath);
+  writer.SaveImage(image, data_format);
+  const LazyHyperspectralImage lazy_image(kTestLazyImageFilePath + ".config");
+
+  const super_resolution::SpectralPCA spectral_pca({image}, 3);
+  const super_resolution::SpectralPCA lazy_spectral_pca(
+      std::vector<const LazyHyperspectralImage*>({&lazy_image}), 3);
+  EXPECT_TRUE(AreImagesEqual(
+      spectral_pca.GetPCAImage(image),
+      lazy_spectral_pca.GetPCAImage(image)));
+
+  // No bands had to be read into the cache for training.
+  EXPECT_EQ(lazy_image.GetNumCachedBytes(), 0);
+}
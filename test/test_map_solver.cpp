@@ -198,6 +198,128 @@ TEST(MapSolver, SmallDataTest) {
   }
 }
 
+// Tests that with a channel iteration budget, the important channels are
+// still solved while channels with too little weight keep the initial
+// estimate.
+TEST(MapSolver, ChannelIterationBudget) {
+  const cv::Mat lr_image_1 = (cv::Mat_<double>(2, 2)
+    << 0.4, 0.4,
+       0.4, 0.4);
+  const cv::Mat lr_image_2 = (cv::Mat_<double>(2, 2)
+    << 0.2, 0.2,
+       0.2, 0.2);
+  const cv::Mat lr_image_3 = (cv::Mat_<double>(2, 2)
+    << 0.0, 0.0,
+       0.0, 0.0);
+  const cv::Mat lr_image_4 = (cv::Mat_<double>(2, 2)
+    << 1.0, 1.0,
+       1.0, 1.0);
+  const int num_channels = 3;
+  std::vector<ImageData> low_res_images;
+  for (const cv::Mat& lr_image_matrix :
+       {lr_image_1, lr_image_2, lr_image_3, lr_image_4}) {
+    ImageData multichannel_image;
+    for (int i = 0; i < num_channels; ++i) {
+      multichannel_image.AddChannel(lr_image_matrix);
+    }
+    low_res_images.push_back(multichannel_image);
+  }
+
+  super_resolution::MotionShiftSequence motion_shift_sequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(-1, 0),
+    super_resolution::MotionShift(0, -1),
+    super_resolution::MotionShift(-1, -1)
+  });
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.motion_sequence = motion_shift_sequence;
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+
+  const cv::Mat ground_truth_matrix = (cv::Mat_<double>(4, 4)
+    << 0.4, 0.2, 0.4, 0.2,
+       0.0, 1.0, 0.0, 1.0,
+       0.4, 0.2, 0.4, 0.2,
+       0.0, 1.0, 0.0, 1.0);
+  const cv::Mat initial_estimate_matrix =
+      cv::Mat::ones(4, 4, CV_64FC1) * 0.5;
+  ImageData initial_estimate;
+  for (int i = 0; i < num_channels; ++i) {
+    initial_estimate.AddChannel(initial_estimate_matrix);
+  }
+
+  // The budget covers the first two channels fully, and the last channel is
+  // below the minimum weight fraction.
+  super_resolution::IRLSMapSolverOptions options = kDefaultSolverOptions;
+  options.split_channels = true;
+  options.channel_weights = {10.0, 1.0, 0.001};
+  options.channel_iteration_budget = 2.0;
+  options.min_channel_weight_fraction = 0.01;
+  super_resolution::IRLSMapSolver solver(
+      options, image_model, low_res_images, kPrintSolverOutput);
+  const ImageData result = solver.Solve(initial_estimate);
+
+  ASSERT_EQ(result.GetNumChannels(), num_channels);
+  EXPECT_TRUE(AreMatricesEqual(
+      result.GetChannelImage(0),
+      ground_truth_matrix,
+      kSolverResultErrorTolerance));
+  EXPECT_TRUE(AreMatricesEqual(
+      result.GetChannelImage(1),
+      ground_truth_matrix,
+      kSolverResultErrorTolerance));
+  EXPECT_TRUE(AreMatricesEqual(
+      result.GetChannelImage(2), initial_estimate_matrix));
+}
+
+// Tests how a fractional iteration budget is split between the channels, and
+// how partial shares reduce the IRLS and then the solver iterations.
+TEST(MapSolver, ChannelIterationShares) {
+  super_resolution::IRLSMapSolverOptions options;
+  options.max_num_irls_iterations = 6;
+  options.max_num_solver_iterations = 20;
+  options.channel_weights = {10.0, 3.0, 1.0};
+  options.channel_iteration_budget = 1.5;
+
+  // The first channel's proportional share (1.5 * 10 / 14) is capped at the
+  // full iterations, and the remaining 0.5 is split 3:1 between the others.
+  const std::vector<double> shares = options.GetChannelIterationShares();
+  ASSERT_EQ(shares.size(), 3);
+  EXPECT_DOUBLE_EQ(shares[0], 1.0);
+  EXPECT_DOUBLE_EQ(shares[1], 0.375);
+  EXPECT_DOUBLE_EQ(shares[2], 0.125);
+
+  // A full share keeps all iterations.
+  const super_resolution::IRLSMapSolverOptions full_options =
+      options.GetBudgetedOptions(shares[0]);
+  EXPECT_EQ(full_options.max_num_irls_iterations, 6);
+  EXPECT_EQ(full_options.max_num_solver_iterations, 20);
+
+  // 0.375 of 6 IRLS iterations rounds to 2 full IRLS iterations.
+  const super_resolution::IRLSMapSolverOptions partial_options =
+      options.GetBudgetedOptions(shares[1]);
+  EXPECT_EQ(partial_options.max_num_irls_iterations, 2);
+  EXPECT_EQ(partial_options.max_num_solver_iterations, 20);
+
+  // 0.125 of 6 IRLS iterations is 0.75 of one IRLS iteration, so a single
+  // IRLS iteration runs 0.75 of the solver iterations.
+  const super_resolution::IRLSMapSolverOptions reduced_options =
+      options.GetBudgetedOptions(shares[2]);
+  EXPECT_EQ(reduced_options.max_num_irls_iterations, 1);
+  EXPECT_EQ(reduced_options.max_num_solver_iterations, 15);
+
+  // Channels below the minimum weight fraction get no share, and their
+  // budget goes to the other channels (here 1.5 split 10:3, capped at 1).
+  options.min_channel_weight_fraction = 0.1;
+  const std::vector<double> thresholded_shares =
+      options.GetChannelIterationShares();
+  ASSERT_EQ(thresholded_shares.size(), 3);
+  EXPECT_DOUBLE_EQ(thresholded_shares[0], 1.0);
+  EXPECT_DOUBLE_EQ(thresholded_shares[1], 0.5);
+  EXPECT_DOUBLE_EQ(thresholded_shares[2], 0.0);
+}
+
 // Tests on a small icon (real image) and compares the solver result to the
 // mathematical derivation result. This will be a single-channel test since
 // it also test the mathematical implementation, which only supports a single
@@ -479,3 +601,67 @@ TEST(MapSolver, RegularizationTest) {
         "Ground Truth, Upsampled, Unregualrzed, TV, TV Split, BTV");
   }
 }
+
+// Tests that solving with single precision image operators gives results of
+// the same quality as the default double precision solver.
+TEST(MapSolver, SinglePrecisionParity) {
+  const cv::Mat image = cv::imread(kTestIconPath, CV_LOAD_IMAGE_COLOR);
+  ImageData ground_truth(image);
+  ground_truth.ResizeImage(cv::Size(27, 27));
+  const cv::Size image_size = ground_truth.GetImageSize();
+
+  const int downsampling_scale = 3;
+  const super_resolution::MotionShiftSequence motion_shift_sequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(0, 2),
+    super_resolution::MotionShift(1, 0),
+    super_resolution::MotionShift(1, 2),
+    super_resolution::MotionShift(2, 0)
+  });
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = downsampling_scale;
+  model_parameters.motion_sequence = motion_shift_sequence;
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 3.0;
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+
+  const int num_images = motion_shift_sequence.GetNumMotionShifts();
+  std::vector<ImageData> low_res_images;
+  for (int i = 0; i < num_images; ++i) {
+    low_res_images.push_back(image_model.ApplyToImage(ground_truth, i));
+  }
+  ImageData initial_estimate = low_res_images[0];
+  initial_estimate.ResizeImage(
+      downsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+
+  const std::shared_ptr<super_resolution::Regularizer> tv_regularizer(
+      new super_resolution::TotalVariationRegularizer(image_size));
+
+  super_resolution::IRLSMapSolver solver_double(
+      kDefaultSolverOptions, image_model, low_res_images, kPrintSolverOutput);
+  solver_double.AddRegularizer(tv_regularizer, 0.01);
+  const ImageData result_double = solver_double.Solve(initial_estimate);
+
+  super_resolution::IRLSMapSolverOptions options_single_precision =
+      kDefaultSolverOptions;
+  options_single_precision.use_single_precision = true;
+  super_resolution::IRLSMapSolver solver_single(
+      options_single_precision,
+      image_model,
+      low_res_images,
+      kPrintSolverOutput);
+  solver_single.AddRegularizer(tv_regularizer, 0.01);
+  const ImageData result_single = solver_single.Solve(initial_estimate);
+
+  // The solver output is always in double precision.
+  EXPECT_EQ(
+      result_single.GetPrecision(), super_resolution::IMAGE_PRECISION_DOUBLE);
+
+  const super_resolution::PeakSignalToNoiseRatioEvaluator psnr_evaluator(
+      ground_truth);
+  const double psnr_double = psnr_evaluator.Evaluate(result_double);
+  const double psnr_single = psnr_evaluator.Evaluate(result_single);
+  EXPECT_NEAR(psnr_single, psnr_double, 0.1);
+  EXPECT_TRUE(AreImagesEqual(result_single, result_double, 0.01));
+}
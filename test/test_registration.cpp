@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -8,59 +9,278 @@
 #include "util/data_loader.h"
 #include "util/util.h"
 
+#include "opencv2/calib3d/calib3d.hpp"
+#include "opencv2/core/core.hpp"
+#include "opencv2/features2d/features2d.hpp"
+#include "opencv2/video/tracking.hpp"
+
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 
 using super_resolution::ImageData;
 using super_resolution::MotionShift;
 using super_resolution::MotionShiftSequence;
+using super_resolution::registration::REGISTRATION_PHASE_CORRELATION;
+using super_resolution::registration::RegistrationOptions;
 
 // The maximum number error allowed for the registration algorithm (distance in
 // number of pixels).
 constexpr double kTranslationEstimateErrorTolerance = 0.01;
 
+// The maximum error allowed for fractional shifts. The interpolation of the
+// shifted images slightly changes their phase, which biases the estimate.
+constexpr double kSubpixelTranslationEstimateErrorTolerance = 0.1;
+
 // Path to the test image for testing registration.
 static const std::string kTestImagePath =
     super_resolution::util::GetAbsoluteCodePath("test_data/dallas_half.jpg");
 
-// Tests that the peak signal to noise ratio evaluator gives the correct scores.
-TEST(Registration, TranslationalRegistration) {
-  std::vector<MotionShift> ground_truth_shifts({
-    MotionShift(0, 0),
-    MotionShift(0, 1),
-    MotionShift(2, 0),
-    MotionShift(5, 5),
-    MotionShift(-5, -1)
-  });
-  const MotionShiftSequence ground_truth_sequence(ground_truth_shifts);
+// The shifts applied to the test image.
+static const std::vector<MotionShift> kGroundTruthShifts({
+  MotionShift(0, 0),
+  MotionShift(0, 1),
+  MotionShift(2, 0),
+  MotionShift(5, 5),
+  MotionShift(-5, -1)
+});
 
-  // Load the original image and apply motion shifts to it.
-  const ImageData original_image =
-      super_resolution::util::LoadImage(kTestImagePath);
-  const super_resolution::MotionModule motion_module(ground_truth_sequence);
+// Fractional shifts applied to the test image for testing sub-pixel accuracy.
+static const std::vector<MotionShift> kGroundTruthSubpixelShifts({
+  MotionShift(0, 0),
+  MotionShift(0.25, -1.5),
+  MotionShift(-2.5, 0.75),
+  MotionShift(1.25, 0.5),
+  MotionShift(-3.75, -0.1)
+});
+
+// Returns copies of the given image shifted by each of the given motion shifts.
+std::vector<ImageData> GetShiftedImages(
+    const ImageData& original_image,
+    const MotionShiftSequence& motion_shift_sequence) {
+
+  const super_resolution::MotionModule motion_module(motion_shift_sequence);
   std::vector<ImageData> shifted_images;
-  const int num_motion_shifts = ground_truth_sequence.GetNumMotionShifts();
+  const int num_motion_shifts = motion_shift_sequence.GetNumMotionShifts();
   for (int i = 0; i < num_motion_shifts; ++i) {
     ImageData shifted_image = original_image;
     motion_module.ApplyToImage(&shifted_image, i);
     shifted_images.push_back(shifted_image);
   }
+  return shifted_images;
+}
 
-  // Try to register it and test that the registered results are close to the
-  // ground truth.
-  const MotionShiftSequence registered_sequence =
-      super_resolution::registration::TranslationalRegistration(shifted_images);
-  EXPECT_EQ(registered_sequence.GetNumMotionShifts(), num_motion_shifts);
+// Expects the registered motion shifts to be within the given tolerance of
+// the ground truth.
+void ExpectShiftsNear(
+    const MotionShiftSequence& ground_truth_sequence,
+    const MotionShiftSequence& registered_sequence,
+    const double tolerance = kTranslationEstimateErrorTolerance) {
+
+  const int num_motion_shifts = ground_truth_sequence.GetNumMotionShifts();
+  ASSERT_EQ(registered_sequence.GetNumMotionShifts(), num_motion_shifts);
   for (int i = 0; i < num_motion_shifts; ++i) {
     const MotionShift ground_truth_shift = ground_truth_sequence[i];
     const MotionShift estimated_shift = registered_sequence[i];
     EXPECT_NEAR(
         ground_truth_shift.dx,
         estimated_shift.dx,
-        kTranslationEstimateErrorTolerance);
+        tolerance);
     EXPECT_NEAR(
         ground_truth_shift.dy,
         estimated_shift.dy,
-        kTranslationEstimateErrorTolerance);
+        tolerance);
+  }
+}
+
+// Tests that keypoint registration recovers the applied shifts.
+TEST(Registration, TranslationalRegistration) {
+  const MotionShiftSequence ground_truth_sequence(kGroundTruthShifts);
+
+  // Load the original image and apply motion shifts to it.
+  const ImageData original_image =
+      super_resolution::util::LoadImage(kTestImagePath);
+  const std::vector<ImageData> shifted_images =
+      GetShiftedImages(original_image, ground_truth_sequence);
+
+  // Try to register it and test that the registered results are close to the
+  // ground truth.
+  const MotionShiftSequence registered_sequence =
+      super_resolution::registration::TranslationalRegistration(shifted_images);
+  ExpectShiftsNear(ground_truth_sequence, registered_sequence);
+}
+
+// Returns the shift of the given image relative to the reference image as
+// computed by the original sequential per-pair keypoint registration: BRISK
+// keypoints on the first channel, nearest-neighbor matches of every reference
+// descriptor, distance thresholding, RANSAC, and a rigid transform fit. The
+// exact nearest-neighbor search stands in for the approximate Flann search.
+MotionShift RegisterPairSequentially(
+    const ImageData& reference_image, const ImageData& image) {
+
+  cv::Ptr<cv::BRISK> detector = cv::BRISK::create();
+  std::vector<cv::KeyPoint> keypoints[2];
+  cv::Mat descriptors[2];
+  const ImageData* images[2] = {&reference_image, &image};
+  for (int i = 0; i < 2; ++i) {
+    cv::Mat detection_image;
+    images[i]->GetChannelImage(0).convertTo(detection_image, CV_8U, 255);
+    cv::Mat binary_descriptors;
+    detector->detectAndCompute(
+        detection_image, cv::noArray(), keypoints[i], binary_descriptors);
+    binary_descriptors.convertTo(descriptors[i], CV_32F);
+  }
+
+  cv::BFMatcher matcher(cv::NORM_L2);
+  std::vector<cv::DMatch> matches;
+  matcher.match(descriptors[0], descriptors[1], matches);
+  double smallest_distance = matches[0].distance;
+  for (const cv::DMatch& match : matches) {
+    smallest_distance = std::min<double>(smallest_distance, match.distance);
   }
+  const double distance_threshold = std::max(5.0 * smallest_distance, 0.04);
+  std::vector<cv::Point2f> reference_points;
+  std::vector<cv::Point2f> image_points;
+  for (const cv::DMatch& match : matches) {
+    if (match.distance <= distance_threshold) {
+      reference_points.push_back(keypoints[0][match.queryIdx].pt);
+      image_points.push_back(keypoints[1][match.trainIdx].pt);
+    }
+  }
+
+  std::vector<cv::Point2f> inlier_reference_points = reference_points;
+  std::vector<cv::Point2f> inlier_image_points = image_points;
+  if (reference_points.size() >= 3) {
+    std::vector<unsigned char> inliers_mask;
+    cv::findHomography(
+        reference_points, image_points, CV_RANSAC, 0.1, inliers_mask);
+    inlier_reference_points.clear();
+    inlier_image_points.clear();
+    for (int i = 0; i < inliers_mask.size(); ++i) {
+      if (inliers_mask[i] != 0) {
+        inlier_reference_points.push_back(reference_points[i]);
+        inlier_image_points.push_back(image_points[i]);
+      }
+    }
+  }
+  const cv::Mat affine_transform = cv::estimateRigidTransform(
+      inlier_reference_points, inlier_image_points, false);
+  return MotionShift(
+      affine_transform.at<double>(0, 2), affine_transform.at<double>(1, 2));
+}
+
+// Tests that registering a burst in parallel gives exactly the same shifts as
+// the sequential per-pair registration, and the same shifts on every run.
+TEST(Registration, ParallelRegistrationMatchesSequential) {
+  const MotionShiftSequence ground_truth_sequence(kGroundTruthShifts);
+  const ImageData original_image =
+      super_resolution::util::LoadImage(kTestImagePath);
+  const std::vector<ImageData> shifted_images =
+      GetShiftedImages(original_image, ground_truth_sequence);
+
+  const MotionShiftSequence registered_sequence =
+      super_resolution::registration::TranslationalRegistration(shifted_images);
+  const MotionShiftSequence repeated_sequence =
+      super_resolution::registration::TranslationalRegistration(shifted_images);
+  const int num_motion_shifts = ground_truth_sequence.GetNumMotionShifts();
+  ASSERT_EQ(registered_sequence.GetNumMotionShifts(), num_motion_shifts);
+  for (int i = 1; i < num_motion_shifts; ++i) {
+    const MotionShift sequential_shift =
+        RegisterPairSequentially(shifted_images[0], shifted_images[i]);
+    EXPECT_EQ(registered_sequence[i].dx, sequential_shift.dx);
+    EXPECT_EQ(registered_sequence[i].dy, sequential_shift.dy);
+    EXPECT_EQ(repeated_sequence[i].dx, registered_sequence[i].dx);
+    EXPECT_EQ(repeated_sequence[i].dy, registered_sequence[i].dy);
+  }
+}
+
+// Tests that phase correlation recovers the applied shifts, both directly and
+// with a coarse estimate on a downsampled pyramid level.
+TEST(Registration, PhaseCorrelationRegistration) {
+  const MotionShiftSequence ground_truth_sequence(kGroundTruthShifts);
+  const ImageData original_image =
+      super_resolution::util::LoadImage(kTestImagePath);
+  const std::vector<ImageData> shifted_images =
+      GetShiftedImages(original_image, ground_truth_sequence);
+
+  RegistrationOptions options;
+  options.method = REGISTRATION_PHASE_CORRELATION;
+  for (const int num_pyramid_levels : {0, 2}) {
+    options.num_pyramid_levels = num_pyramid_levels;
+    const MotionShiftSequence registered_sequence =
+        super_resolution::registration::TranslationalRegistration(
+            shifted_images, options);
+    ExpectShiftsNear(ground_truth_sequence, registered_sequence);
+  }
+}
+
+// Tests that phase correlation recovers fractional shifts to sub-pixel
+// accuracy, both directly and with a coarse estimate on a downsampled pyramid
+// level.
+TEST(Registration, PhaseCorrelationSubpixelShifts) {
+  const MotionShiftSequence ground_truth_sequence(kGroundTruthSubpixelShifts);
+  const ImageData original_image =
+      super_resolution::util::LoadImage(kTestImagePath);
+  const std::vector<ImageData> shifted_images =
+      GetShiftedImages(original_image, ground_truth_sequence);
+
+  RegistrationOptions options;
+  options.method = REGISTRATION_PHASE_CORRELATION;
+  for (const int num_pyramid_levels : {0, 2}) {
+    options.num_pyramid_levels = num_pyramid_levels;
+    const MotionShiftSequence registered_sequence =
+        super_resolution::registration::TranslationalRegistration(
+            shifted_images, options);
+    ExpectShiftsNear(
+        ground_truth_sequence,
+        registered_sequence,
+        kSubpixelTranslationEstimateErrorTolerance);
+  }
+}
+
+// Tests that phase correlation registers a smooth image without any texture
+// for keypoints to be detected on, for integer and fractional shifts.
+TEST(Registration, PhaseCorrelationOnSmoothImage) {
+  const int image_size = 128;
+  const double sigma = 12.0;
+  cv::Mat blob_image(image_size, image_size, CV_64FC1);
+  for (int row = 0; row < image_size; ++row) {
+    for (int col = 0; col < image_size; ++col) {
+      const double dx = col - 60.0;
+      const double dy = row - 66.0;
+      blob_image.at<double>(row, col) =
+          std::exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+    }
+  }
+  const ImageData original_image(
+      blob_image, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+
+  const MotionShiftSequence ground_truth_sequence({
+    MotionShift(0, 0),
+    MotionShift(3, -2),
+    MotionShift(-7, 4)
+  });
+  const std::vector<ImageData> shifted_images =
+      GetShiftedImages(original_image, ground_truth_sequence);
+
+  RegistrationOptions options;
+  options.method = REGISTRATION_PHASE_CORRELATION;
+  const MotionShiftSequence registered_sequence =
+      super_resolution::registration::TranslationalRegistration(
+          shifted_images, options);
+  ExpectShiftsNear(ground_truth_sequence, registered_sequence);
+
+  const MotionShiftSequence subpixel_ground_truth_sequence({
+    MotionShift(0, 0),
+    MotionShift(0.25, -1.5),
+    MotionShift(-2.5, 0.75)
+  });
+  const std::vector<ImageData> subpixel_shifted_images =
+      GetShiftedImages(original_image, subpixel_ground_truth_sequence);
+  const MotionShiftSequence subpixel_registered_sequence =
+      super_resolution::registration::TranslationalRegistration(
+          subpixel_shifted_images, options);
+  ExpectShiftsNear(
+      subpixel_ground_truth_sequence,
+      subpixel_registered_sequence,
+      kSubpixelTranslationEstimateErrorTolerance);
 }
@@ -0,0 +1,121 @@
+#include <cmath>
+#include <vector>
+
+#include "hyperspectral/spectral_interpolation.h"
+#include "image/image_data.h"
+#include "util/test_util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::ImageData;
+using super_resolution::test::AreImagesEqual;
+using super_resolution::test::AreMatricesEqual;
+
+using testing::ElementsAre;
+
+constexpr double kInterpolationErrorTolerance = 1e-9;
+
+// Returns an image where the value of each pixel in each band is given by the
+// function f(band, row, col).
+template <typename FunctionType>
+ImageData MakeImage(
+    const int num_rows,
+    const int num_cols,
+    const int num_bands,
+    const FunctionType& f) {
+
+  ImageData image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        channel.at<double>(row, col) = f(band, row, col);
+      }
+    }
+    image.AddChannel(channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+  return image;
+}
+
+TEST(SpectralInterpolation, SelectKeyBands) {
+  // A flat spectrum with a sharp peak at band 15.
+  const ImageData image = MakeImage(4, 5, 20,
+      [](const int band, const int row, const int col) {
+        return (band == 15 ? 1.0 : 0.0) + row * 0.01 + col * 0.02;
+      });
+
+  super_resolution::KeyBandOptions options;
+  options.band_step = 6;
+  EXPECT_THAT(
+      super_resolution::SelectKeyBands(image, options),
+      ElementsAre(0, 6, 12, 18, 19));
+  EXPECT_THAT(
+      super_resolution::GetSkippedBands(8, {0, 3, 7}),
+      ElementsAre(1, 2, 4, 5, 6));
+
+  // Placing the key bands by curvature puts the interior ones around the peak.
+  options.select_by_curvature = true;
+  const std::vector<int> key_bands =
+      super_resolution::SelectKeyBands(image, options);
+  ASSERT_GE(key_bands.size(), 3);
+  EXPECT_EQ(key_bands.front(), 0);
+  EXPECT_EQ(key_bands.back(), 19);
+  for (int i = 1; i < key_bands.size() - 1; ++i) {
+    EXPECT_GE(key_bands[i], 14);
+    EXPECT_LE(key_bands[i], 16);
+  }
+
+  // A band step of 1 keeps all bands.
+  options.band_step = 1;
+  EXPECT_EQ(super_resolution::SelectKeyBands(image, options).size(), 20);
+}
+
+// Tests that the skipped bands get the spectrally interpolated detail of the
+// key bands on top of their own upsampled observations.
+TEST(SpectralInterpolation, InterpolateSkippedBands) {
+  const int num_rows = 6;
+  const int num_cols = 7;
+  const int num_bands = 9;
+
+  // The upsampled image is smooth, and the detail changes linearly across the
+  // spectrum.
+  const auto upsampled_value =
+      [](const int band, const int row, const int col) {
+        return 0.5 + 0.05 * band + 0.01 * (row + col);
+      };
+  const auto detail_value =
+      [](const int band, const int row, const int col) {
+        return (1.0 + 0.25 * band) * std::sin(row * 1.7 + col * 0.9);
+      };
+  const ImageData upsampled_image =
+      MakeImage(num_rows, num_cols, num_bands, upsampled_value);
+  const ImageData expected_image = MakeImage(num_rows, num_cols, num_bands,
+      [&](const int band, const int row, const int col) {
+        return upsampled_value(band, row, col) + detail_value(band, row, col);
+      });
+
+  const std::vector<int> key_bands = {0, 3, 8};
+  const ImageData key_band_image =
+      super_resolution::SelectBands(expected_image, key_bands);
+  ASSERT_EQ(key_band_image.GetNumChannels(), 3);
+  const ImageData result = super_resolution::InterpolateSkippedBands(
+      key_band_image, key_bands, upsampled_image);
+  EXPECT_TRUE(AreImagesEqual(
+      result, expected_image, kInterpolationErrorTolerance));
+
+  // Replacing bands writes the given channels into the image.
+  ImageData replaced_image = upsampled_image;
+  super_resolution::ReplaceBands(
+      super_resolution::SelectBands(expected_image, {2, 5}),
+      {2, 5},
+      &replaced_image);
+  EXPECT_TRUE(AreMatricesEqual(
+      replaced_image.GetChannelImage(2), expected_image.GetChannelImage(2)));
+  EXPECT_TRUE(AreMatricesEqual(
+      replaced_image.GetChannelImage(5), expected_image.GetChannelImage(5)));
+  EXPECT_TRUE(AreMatricesEqual(
+      replaced_image.GetChannelImage(4), upsampled_image.GetChannelImage(4)));
+}
@@ -1,9 +1,12 @@
+#include <cmath>
+#include <string>
 #include <vector>
 
 #include "hyperspectral/spectral_pca.h"
 #include "image/image_data.h"
 #include "util/matrix_util.h"
 #include "util/test_util.h"
+#include "util/util.h"
 
 #include "opencv2/core/core.hpp"
 
@@ -13,9 +16,13 @@
 using super_resolution::ImageData;
 using super_resolution::test::AreImagesEqual;
 using super_resolution::test::AreMatricesEqual;
+using super_resolution::util::GetAbsoluteCodePath;
 
 constexpr double kReconstructionErrorTolerance = 0.00001;
 
+static const std::string kTestBasisFilePath =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/spectral_pca_basis");
+
 TEST(SpectralPCA, Decomposition) {
   // Run on a small controlled data test. Example and known truths are from:
   //   https://www.youtube.com/watch?v=VzPpJXISz-E
@@ -124,3 +131,168 @@ TEST(SpectralPCA, Decomposition) {
       hyperspectral_image,
       0.05));
 }
+
+// Tests that training on the covariance of all pixels finds the subspace of
+// the data. The image is large enough to be split into several tiles.
+TEST(SpectralPCA, StreamingCovarianceTraining) {
+  const int num_rows = 70;
+  const int num_cols = 90;
+  const int num_bands = 6;
+
+  // Every spectral vector is a mean spectrum plus a combination of two other
+  // spectra, so the data lies in a 2D subspace.
+  ImageData hyperspectral_image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        const double first_weight = std::sin(row * 0.37 + col * 0.11);
+        const double second_weight = std::cos(row * col * 0.013);
+        channel.at<double>(row, col) =
+            0.5 + 0.1 * band +
+            first_weight * std::sin(band * 0.9) +
+            second_weight * 0.2 * (band % 3);
+      }
+    }
+    hyperspectral_image.AddChannel(
+        channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+
+  super_resolution::SpectralPCAOptions options;
+  options.training_method = super_resolution::PCA_TRAINING_STREAMING_COVARIANCE;
+  options.num_pca_bands = 2;
+  const super_resolution::SpectralPCA spectral_pca(
+      {hyperspectral_image}, options);
+  const ImageData pca_image = spectral_pca.GetPCAImage(hyperspectral_image);
+  EXPECT_EQ(pca_image.GetNumChannels(), 2);
+  EXPECT_TRUE(AreImagesEqual(
+      spectral_pca.ReconstructImage(pca_image),
+      hyperspectral_image,
+      kReconstructionErrorTolerance));
+
+  // Retaining almost all of the variance should also find the 2D subspace.
+  options.num_pca_bands = 0;
+  options.retained_variance = 0.999;
+  const super_resolution::SpectralPCA spectral_pca_variance(
+      {hyperspectral_image}, options);
+  EXPECT_EQ(
+      spectral_pca_variance.GetPCAImage(hyperspectral_image).GetNumChannels(),
+      2);
+
+  // Keeping all bands gives the same reconstruction as subsampled training.
+  options.retained_variance = 0.0;
+  const super_resolution::SpectralPCA spectral_pca_full(
+      {hyperspectral_image}, options);
+  const super_resolution::SpectralPCA spectral_pca_subsampled(
+      {hyperspectral_image}, 0);
+  EXPECT_TRUE(AreImagesEqual(
+      spectral_pca_full.ReconstructImage(
+          spectral_pca_full.GetPCAImage(hyperspectral_image)),
+      spectral_pca_subsampled.ReconstructImage(
+          spectral_pca_subsampled.GetPCAImage(hyperspectral_image)),
+      kReconstructionErrorTolerance));
+}
+
+// Tests that randomized training finds the same top components as the exact
+// covariance training when the data has a few dominant components.
+TEST(SpectralPCA, RandomizedTraining) {
+  const int num_rows = 30;
+  const int num_cols = 40;
+  const int num_bands = 40;
+
+  // The spectral vectors lie in a 3D subspace, with a different amount of
+  // variance along each direction.
+  ImageData hyperspectral_image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        channel.at<double>(row, col) =
+            1.0 +
+            3.0 * std::sin(row * 0.21 + col * 0.05) * std::cos(band * 0.1) +
+            1.0 * std::cos(col * 0.37 - row * 0.02) * std::sin(band * 0.3) +
+            0.2 * std::sin(row * col * 0.017) * ((band % 4) - 1.5);
+      }
+    }
+    hyperspectral_image.AddChannel(
+        channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+
+  super_resolution::SpectralPCAOptions options;
+  options.training_method = super_resolution::PCA_TRAINING_RANDOMIZED;
+  options.num_pca_bands = 3;
+  options.oversampling = 2;
+  const super_resolution::SpectralPCA spectral_pca(
+      {hyperspectral_image}, options);
+  EXPECT_EQ(spectral_pca.GetNumPCABands(), 3);
+  EXPECT_NEAR(spectral_pca.GetExplainedVarianceRatio(), 1.0, 1e-9);
+  EXPECT_TRUE(AreImagesEqual(
+      spectral_pca.ReconstructImage(
+          spectral_pca.GetPCAImage(hyperspectral_image)),
+      hyperspectral_image,
+      kReconstructionErrorTolerance));
+
+  // Keeping fewer components than the rank of the data gives the same
+  // approximation as the exact training.
+  options.num_pca_bands = 2;
+  const super_resolution::SpectralPCA spectral_pca_randomized(
+      {hyperspectral_image}, options);
+  options.training_method = super_resolution::PCA_TRAINING_STREAMING_COVARIANCE;
+  const super_resolution::SpectralPCA spectral_pca_exact(
+      {hyperspectral_image}, options);
+  EXPECT_LT(spectral_pca_randomized.GetExplainedVarianceRatio(), 1.0);
+  EXPECT_NEAR(
+      spectral_pca_randomized.GetExplainedVarianceRatio(),
+      spectral_pca_exact.GetExplainedVarianceRatio(),
+      1e-9);
+  EXPECT_TRUE(AreImagesEqual(
+      spectral_pca_randomized.ReconstructImage(
+          spectral_pca_randomized.GetPCAImage(hyperspectral_image)),
+      spectral_pca_exact.ReconstructImage(
+          spectral_pca_exact.GetPCAImage(hyperspectral_image)),
+      kReconstructionErrorTolerance));
+}
+
+// Tests that a saved basis is loaded with the same projection, explained
+// variance, and source fingerprint.
+TEST(SpectralPCA, SaveAndLoadBasis) {
+  const int num_rows = 8;
+  const int num_cols = 9;
+  const int num_bands = 7;
+  ImageData hyperspectral_image;
+  for (int band = 0; band < num_bands; ++band) {
+    cv::Mat channel(num_rows, num_cols, CV_64FC1);
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        channel.at<double>(row, col) =
+            std::sin(band * 0.8 + row * 0.5) * std::cos(col * 0.3 - band);
+      }
+    }
+    hyperspectral_image.AddChannel(
+        channel, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+
+  const super_resolution::SpectralPCA spectral_pca({hyperspectral_image}, 4);
+  spectral_pca.SaveBasis(kTestBasisFilePath);
+  const super_resolution::SpectralPCA loaded_spectral_pca =
+      super_resolution::SpectralPCA::LoadBasis(kTestBasisFilePath);
+
+  EXPECT_EQ(loaded_spectral_pca.GetNumSpectralBands(), num_bands);
+  EXPECT_EQ(loaded_spectral_pca.GetNumPCABands(), 4);
+  EXPECT_EQ(
+      loaded_spectral_pca.GetExplainedVarianceRatio(),
+      spectral_pca.GetExplainedVarianceRatio());
+  EXPECT_EQ(
+      loaded_spectral_pca.GetSourceFingerprint(),
+      spectral_pca.GetSourceFingerprint());
+  EXPECT_TRUE(AreImagesEqual(
+      loaded_spectral_pca.GetPCAImage(hyperspectral_image),
+      spectral_pca.GetPCAImage(hyperspectral_image)));
+
+  // Training with different options gives a different fingerprint.
+  const super_resolution::SpectralPCA other_spectral_pca(
+      {hyperspectral_image}, 3);
+  EXPECT_NE(
+      other_spectral_pca.GetSourceFingerprint(),
+      spectral_pca.GetSourceFingerprint());
+}
@@ -1,11 +1,18 @@
+#include <sys/stat.h>
+
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "image/image_data.h"
 #include "util/config_reader.h"
+#include "util/data_loader.h"
 #include "util/string_util.h"
 #include "util/util.h"
 
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 
@@ -14,6 +21,10 @@ using testing::ElementsAre;
 using testing::UnorderedElementsAreArray;
 using testing::Pair;
 
+// Directory for the images written by the LoadImages test.
+static const std::string kTestImageDirectory =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/load_images");
+
 // Path to a test config file (to test ReadConfigurationFile).
 static const std::string kTestConfigFilePath =
     GetAbsoluteCodePath("test_data/test_hs_config.txt");
@@ -90,3 +101,40 @@ TEST(Util, GetFileExtension) {
   EXPECT_EQ(super_resolution::util::GetFileExtension("one.two.three"), "three");
   EXPECT_EQ(super_resolution::util::GetFileExtension("........dots"), "dots");
 }
+
+// Tests that images in a directory are loaded in order of their file names,
+// both all at once and with the prefetcher.
+TEST(Util, LoadImages) {
+  mkdir(kTestImageDirectory.c_str(), 0755);
+  // Written out of order. The pixel value identifies each image.
+  const std::vector<std::string> file_names = {"c.png", "a.png", "b.png"};
+  const std::vector<int> pixel_values = {30, 10, 20};
+  for (int i = 0; i < file_names.size(); ++i) {
+    const cv::Mat image(4, 5, CV_8UC1, cv::Scalar(pixel_values[i]));
+    ASSERT_TRUE(cv::imwrite(kTestImageDirectory + "/" + file_names[i], image));
+  }
+
+  EXPECT_THAT(
+      super_resolution::util::ListImageFiles(kTestImageDirectory),
+      ElementsAre(
+          kTestImageDirectory + "/a.png",
+          kTestImageDirectory + "/b.png",
+          kTestImageDirectory + "/c.png"));
+
+  const std::vector<super_resolution::ImageData> images =
+      super_resolution::util::LoadImages(kTestImageDirectory);
+  ASSERT_EQ(images.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_NEAR(images[i].GetPixelValue(0, 0), (i + 1) * 10 / 255.0, 1e-9);
+  }
+
+  const super_resolution::util::ImagePrefetcher prefetcher(
+      kTestImageDirectory, 2);
+  ASSERT_EQ(prefetcher.GetNumImages(), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_NEAR(
+        prefetcher.GetImage(i).GetPixelValue(0, 0), (i + 1) * 10 / 255.0, 1e-9);
+  }
+  EXPECT_EQ(prefetcher.GetImages().size(), 3);
+}
+
@@ -1,4 +1,5 @@
 #include <string>
+#include <vector>
 
 #include "image/image_data.h"
 #include "util/data_loader.h"
@@ -42,3 +43,134 @@ TEST(WaveletTransform, WaveletTransform) {
   //     coefficients.GetCoefficientsImage()
   // });
 }
+
+// Tests that the multi-level lifting transforms reconstruct images with odd
+// sizes exactly, and that the output buffers are reused.
+TEST(WaveletTransform, MultiLevelLiftingTransform) {
+  const int num_rows = 10;
+  const int num_cols = 13;
+  const int num_levels = 3;
+  super_resolution::ImageData image;
+  for (int channel = 0; channel < 3; ++channel) {
+    cv::Mat channel_image(num_rows, num_cols, CV_64FC1);
+    cv::randu(channel_image, 0.0, 1.0);
+    image.AddChannel(channel_image, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+
+  super_resolution::ImageData coefficients;
+  super_resolution::ImageData reconstructed_image;
+  for (const auto wavelet_type : {
+      super_resolution::wavelet::WAVELET_HAAR,
+      super_resolution::wavelet::WAVELET_CDF_5_3,
+      super_resolution::wavelet::WAVELET_CDF_9_7}) {
+    super_resolution::wavelet::MultiLevelWaveletTransform(
+        image, wavelet_type, num_levels, &coefficients);
+    const double* coefficients_data = coefficients.GetChannelData(0);
+    super_resolution::wavelet::InverseMultiLevelWaveletTransform(
+        coefficients, wavelet_type, num_levels, &reconstructed_image);
+    EXPECT_TRUE(super_resolution::test::AreImagesEqual(
+        image, reconstructed_image, 1e-10));
+
+    // Transforming again reuses the buffers of the previous transform.
+    super_resolution::wavelet::MultiLevelWaveletTransform(
+        image, wavelet_type, num_levels, &coefficients);
+    EXPECT_EQ(coefficients.GetChannelData(0), coefficients_data);
+
+    // The in-place transforms give the same result.
+    super_resolution::ImageData in_place_image(image);
+    super_resolution::wavelet::MultiLevelWaveletTransformInPlace(
+        wavelet_type, num_levels, &in_place_image);
+    EXPECT_TRUE(super_resolution::test::AreImagesEqual(
+        in_place_image, coefficients, 1e-10));
+    super_resolution::wavelet::InverseMultiLevelWaveletTransformInPlace(
+        wavelet_type, num_levels, &in_place_image);
+    EXPECT_TRUE(super_resolution::test::AreImagesEqual(
+        in_place_image, image, 1e-10));
+  }
+}
+
+// Tests the sub-band layout, that the detail coefficients of a constant image
+// are zero, and that a single Haar level matches WaveletTransform().
+TEST(WaveletTransform, MultiLevelSubbands) {
+  using super_resolution::wavelet::GetSubbandRegion;
+  using super_resolution::wavelet::SUBBAND_LL;
+  using super_resolution::wavelet::SUBBAND_LH;
+  using super_resolution::wavelet::SUBBAND_HL;
+  using super_resolution::wavelet::SUBBAND_HH;
+
+  const cv::Size image_size(13, 10);
+  EXPECT_EQ(GetSubbandRegion(image_size, 1, SUBBAND_LL), cv::Rect(0, 0, 7, 5));
+  EXPECT_EQ(GetSubbandRegion(image_size, 1, SUBBAND_LH), cv::Rect(7, 0, 6, 5));
+  EXPECT_EQ(GetSubbandRegion(image_size, 1, SUBBAND_HH), cv::Rect(7, 5, 6, 5));
+  EXPECT_EQ(GetSubbandRegion(image_size, 2, SUBBAND_HL), cv::Rect(0, 3, 4, 2));
+
+  super_resolution::ImageData constant_image;
+  constant_image.AddChannel(
+      cv::Mat(image_size, CV_64FC1, cv::Scalar(0.7)),
+      super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  for (const auto wavelet_type : {
+      super_resolution::wavelet::WAVELET_CDF_5_3,
+      super_resolution::wavelet::WAVELET_CDF_9_7}) {
+    super_resolution::ImageData coefficients;
+    super_resolution::wavelet::MultiLevelWaveletTransform(
+        constant_image, wavelet_type, 2, &coefficients);
+    cv::Mat details = coefficients.GetChannelImage(0).clone();
+    details(GetSubbandRegion(image_size, 2, SUBBAND_LL)) = 0.0;
+    EXPECT_NEAR(cv::norm(details, cv::NORM_INF), 0.0, 1e-10);
+  }
+
+  // WaveletTransform() ignores the last row and column of odd-sized images.
+  const super_resolution::ImageData original_image =
+      super_resolution::util::LoadImage(kTestImagePath);
+  const cv::Size even_size(
+      original_image.GetImageSize().width / 2 * 2,
+      original_image.GetImageSize().height / 2 * 2);
+  super_resolution::ImageData even_image;
+  even_image.AddChannel(
+      original_image.GetChannelImage(0)(
+          cv::Rect(0, 0, even_size.width, even_size.height)),
+      super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  const super_resolution::wavelet::WaveletCoefficients coefficients =
+      super_resolution::wavelet::WaveletTransform(even_image);
+  super_resolution::ImageData lifting_coefficients;
+  super_resolution::wavelet::MultiLevelWaveletTransform(
+      even_image,
+      super_resolution::wavelet::WAVELET_HAAR,
+      1,
+      &lifting_coefficients);
+  const cv::Mat lifting_channel = lifting_coefficients.GetChannelImage(0);
+  EXPECT_TRUE(super_resolution::test::AreMatricesEqual(
+      lifting_channel(GetSubbandRegion(even_size, 1, SUBBAND_LL)),
+      coefficients.ll.GetChannelImage(0),
+      1e-10));
+  EXPECT_TRUE(super_resolution::test::AreMatricesEqual(
+      lifting_channel(GetSubbandRegion(even_size, 1, SUBBAND_LH)),
+      coefficients.lh.GetChannelImage(0),
+      1e-10));
+  EXPECT_TRUE(super_resolution::test::AreMatricesEqual(
+      lifting_channel(GetSubbandRegion(even_size, 1, SUBBAND_HL)),
+      coefficients.hl.GetChannelImage(0),
+      1e-10));
+  EXPECT_TRUE(super_resolution::test::AreMatricesEqual(
+      lifting_channel(GetSubbandRegion(even_size, 1, SUBBAND_HH)),
+      coefficients.hh.GetChannelImage(0),
+      1e-10));
+}
+
+TEST(WaveletTransform, GetSubbandEnergyFractions) {
+  // Alternating columns of 0 and 1 split the energy between LL and LH.
+  cv::Mat stripes(6, 8, CV_64FC1);
+  for (int col = 0; col < stripes.cols; ++col) {
+    stripes.col(col) = static_cast<double>(col % 2);
+  }
+  super_resolution::ImageData image;
+  image.AddChannel(stripes, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  const std::vector<double> energy_fractions =
+      super_resolution::wavelet::GetSubbandEnergyFractions(
+          super_resolution::wavelet::WaveletTransform(image));
+  ASSERT_EQ(energy_fractions.size(), 4);
+  EXPECT_NEAR(energy_fractions[0], 0.5, 1e-10);
+  EXPECT_NEAR(energy_fractions[1], 0.5, 1e-10);
+  EXPECT_NEAR(energy_fractions[2], 0.0, 1e-10);
+  EXPECT_NEAR(energy_fractions[3], 0.0, 1e-10);
+}